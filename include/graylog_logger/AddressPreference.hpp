@@ -0,0 +1,22 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief The order in which the addresses of a server are tried.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+namespace Log {
+
+/// \brief Which addresses are tried first if the host name of a server
+/// resolves to both IPv4 and IPv6 addresses.
+enum class AddressPreference {
+  IPv4First,
+  IPv6First,
+  ResolverOrder, ///< The order in which the resolver returns the addresses.
+};
+
+} // namespace Log
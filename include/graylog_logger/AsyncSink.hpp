@@ -0,0 +1,250 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Log handler template that turns a synchronous writer into a
+/// threaded log handler with a bounded message queue.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "graylog_logger/LogUtil.hpp"
+#include "graylog_logger/Metrics.hpp"
+#include "graylog_logger/MinimalSpan.hpp"
+#include "graylog_logger/QueueBudget.hpp"
+#include "graylog_logger/ThreadedExecutor.hpp"
+#include <algorithm>
+#include <atomic>
+#include <ciso646>
+#include <concurrentqueue/concurrentqueue.h>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace Log {
+
+/// \brief What to do with a new log message when the queue of a handler is
+/// full.
+enum class OverflowPolicy {
+  DropNewest,  ///< Discard the new message.
+  DropOldest,  ///< Discard the oldest queued message to make room.
+  CallerWrites ///< Write queued messages in the calling thread until there
+               ///< is room. No messages are lost.
+};
+
+struct AsyncSinkSettings {
+  /// \brief Maximum number of bytes (see LogMessage::approximateSize()) of
+  /// the messages waiting to be written. Zero for no limit.
+  size_t MaxQueueBytes{8 * 1024 * 1024};
+  /// \brief Maximum number of messages waiting to be written. Zero for no
+  /// limit.
+  size_t MaxQueueLength{0};
+  /// \brief Maximum number of messages passed to the writer in one call.
+  size_t MaxBatchSize{64};
+  OverflowPolicy Overflow{OverflowPolicy::CallerWrites};
+  /// \brief The worker pool used for writing. If nullptr, the default pool
+  /// (or a dedicated thread) is used, see WorkerPool::setDefault().
+  std::shared_ptr<WorkerPool> Pool{nullptr};
+};
+
+struct AsyncSinkMetrics {
+  std::uint64_t Enqueued{0};
+  std::uint64_t Written{0};
+  std::uint64_t Dropped{0};
+  std::uint64_t Batches{0};
+};
+
+/// \brief Used by writers to convert log messages to strings.
+using MessageFormatter = std::function<std::string(const LogMessage &)>;
+
+/// \brief A log handler that queues messages and passes them in batches to
+/// a writer in a separate thread.
+///
+/// The writer (SyncWriter) only has to implement the following two member
+/// functions:
+/// \code
+/// size_t write(minimal::span<const LogMessage> Messages,
+///              const MessageFormatter &Formatter); // Returns bytes written
+/// void flush();
+/// \endcode
+/// Calls to the writer are serialised, i.e. the writer does not have to be
+/// thread safe.
+template <class SyncWriter> class AsyncSink : public BaseLogHandler {
+public:
+  template <typename... WriterArgs>
+  explicit AsyncSink(const AsyncSinkSettings &Settings, WriterArgs &&... Args)
+      : Writer(std::forward<WriterArgs>(Args)...), Settings(Settings),
+        Batch(std::max<size_t>(this->Settings.MaxBatchSize, 1)),
+        Budget(Settings.MaxQueueBytes, Settings.MaxQueueLength),
+        Executor(Settings.Pool) {}
+
+  ~AsyncSink() override {
+    Executor.SendWork([this]() { writeAll(); });
+  }
+
+  void addMessage(const LogMessage &Message) override {
+    if (not reserveQueueSlot(Message.approximateSize(),
+                             Message.SeverityLevel)) {
+      return;
+    }
+    Queue.enqueue(Message);
+    Metrics.enqueued();
+    scheduleWrite();
+  }
+
+  void addMessages(minimal::span<const LogMessage *const> Messages) override {
+    size_t NrOfQueued{0};
+    for (auto CMessage : Messages) {
+      if (reserveQueueSlot(CMessage->approximateSize(),
+                           CMessage->SeverityLevel)) {
+        Queue.enqueue(*CMessage);
+        ++NrOfQueued;
+      }
+    }
+    if (NrOfQueued > 0) {
+      Metrics.enqueued(NrOfQueued);
+      scheduleWrite();
+    }
+  }
+
+  /// \brief Waits for all messages created before the call to flush to be
+  /// written and then flushes the writer.
+  /// \param[in] TimeOut Amount of time to wait for messages to be written.
+  /// \return Returns true if queue was emptied and the writer flushed before
+  /// the time out. Returns false otherwise.
+  bool flush(std::chrono::system_clock::duration TimeOut) override {
+    auto WorkDone = std::make_shared<std::promise<void>>();
+    auto WorkDoneFuture = WorkDone->get_future();
+    Executor.SendWork([=, WorkDone{std::move(WorkDone)}]() {
+      writeAll();
+      std::lock_guard<std::mutex> Lock(WriterMutex);
+      Writer.flush();
+      WorkDone->set_value();
+    });
+    return std::future_status::ready == WorkDoneFuture.wait_for(TimeOut);
+  }
+
+  /// \brief Are there any queued messages?
+  /// \note The message queue will show as empty before the last message in
+  /// the queue has been written.
+  /// \return Returns true if message queue is empty.
+  bool emptyQueue() override { return queueSize() == 0; }
+
+  /// \brief Number of queued messages.
+  /// \return The number of messages that have been queued but not yet taken
+  /// from the queue by the writer.
+  size_t queueSize() override { return Budget.messages(); }
+
+  /// \brief Counters of messages passing through the handler.
+  AsyncSinkMetrics getSinkMetrics() const {
+    auto CurrentMetrics = Metrics.snapshot();
+    AsyncSinkMetrics Result;
+    Result.Enqueued = CurrentMetrics.Enqueued;
+    Result.Written = CurrentMetrics.Dequeued;
+    Result.Dropped = CurrentMetrics.Dropped;
+    Result.Batches = Batches.load();
+    return Result;
+  }
+
+  /// \brief Counters of the handler. The latency is measured from the
+  /// creation of a message until it has been written.
+  MetricsSnapshot getMetrics() const override { return Metrics.snapshot(); }
+
+protected:
+  /// \brief Write at most one batch of messages.
+  /// \return The number of messages written.
+  size_t writeBatch() {
+    std::lock_guard<std::mutex> Lock(WriterMutex);
+    Metrics.queueDepth(Budget.messages());
+    auto NrOfMessages = Queue.try_dequeue_bulk(Batch.begin(), Batch.size());
+    if (NrOfMessages == 0) {
+      return 0;
+    }
+    size_t DequeuedBytes{0};
+    for (size_t i = 0; i < NrOfMessages; ++i) {
+      DequeuedBytes += Batch[i].approximateSize();
+    }
+    Budget.release(DequeuedBytes, NrOfMessages);
+    auto BytesWritten = Writer.write(
+        minimal::span<const LogMessage>(Batch.data(), NrOfMessages), Formatter);
+    auto Now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < NrOfMessages; ++i) {
+      Metrics.latencySince(Batch[i].MonotonicTimestamp, Now);
+    }
+    Metrics.dequeued(NrOfMessages);
+    Metrics.bytesWritten(BytesWritten);
+    ++Batches;
+    return NrOfMessages;
+  }
+
+  void writeAll() {
+    while (writeBatch() > 0) {
+    }
+  }
+
+  SyncWriter Writer;
+
+private:
+  bool reserveQueueSlot(size_t Bytes, Severity Level) {
+    while (not Budget.tryAcquire(Bytes, 1, Level)) {
+      if (Budget.hasRoomFor(Bytes)) {
+        // Rejected by the process wide memory budget. Making room in this
+        // queue would not help and might discard messages of higher
+        // severity.
+        Metrics.dropped();
+        return false;
+      }
+      switch (Settings.Overflow) {
+      case OverflowPolicy::DropOldest: {
+        LogMessage OldMessage;
+        if (Queue.try_dequeue(OldMessage)) {
+          Budget.release(OldMessage.approximateSize());
+          Metrics.dropped();
+        }
+        break;
+      }
+      case OverflowPolicy::CallerWrites:
+        writeBatch();
+        break;
+      case OverflowPolicy::DropNewest: // Fallthrough
+      default:
+        Metrics.dropped();
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void scheduleWrite() {
+    if (WriteScheduled.exchange(true)) {
+      return;
+    }
+    Executor.SendWork([this]() {
+      WriteScheduled = false;
+      writeBatch();
+      if (Budget.messages() > 0) {
+        scheduleWrite();
+      }
+    });
+  }
+
+  const AsyncSinkSettings Settings;
+  MessageFormatter Formatter{
+      [this](const LogMessage &Message) { return messageToString(Message); }};
+  std::mutex WriterMutex;
+  std::vector<LogMessage> Batch;
+  moodycamel::ConcurrentQueue<LogMessage> Queue;
+  QueueBudget Budget;
+  std::atomic_bool WriteScheduled{false};
+  MetricsRecorder Metrics;
+  std::atomic<std::uint64_t> Batches{0};
+
+protected:
+  ThreadedExecutor Executor; // Must be last
+};
+
+} // namespace Log
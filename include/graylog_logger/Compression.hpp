@@ -0,0 +1,23 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Compression formats supported by the Graylog transports.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+namespace Log {
+
+/// \brief Compression of GELF payloads.
+/// \note Compression requires the library to be built with zlib (WITH_ZLIB is
+/// defined in LibConfig.hpp). Otherwise messages are sent uncompressed.
+enum class Compression {
+  None,
+  Zlib, ///< zlib (RFC 1950) format.
+  Gzip, ///< gzip (RFC 1952) format.
+};
+
+} // namespace Log
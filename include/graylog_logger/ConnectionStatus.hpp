@@ -8,6 +8,12 @@
 //===----------------------------------------------------------------------===//
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <system_error>
+
 namespace Log {
 enum class Status {
   ADDR_LOOKUP,
@@ -15,4 +21,25 @@ enum class Status {
   CONNECT,
   SEND_LOOP,
 };
+
+/// \brief The number of values of Status.
+constexpr size_t NrOfStatusValues{4};
+
+/// \brief A change of the status of a connection.
+struct StatusChange {
+  Status Previous;
+  Status Current;
+  /// \brief When the status changed.
+  std::chrono::system_clock::time_point Time;
+  /// \brief The error that caused the change, e.g. when the connection was
+  /// lost or could not be established. Empty otherwise.
+  std::error_code Error;
+};
+
+/// \brief Called on every change of the status of a connection.
+using StatusCallback = std::function<void(const StatusChange &)>;
+
+/// \brief The cumulative time that a connection has spent in every status,
+/// indexed by static_cast<size_t>(Status).
+using StatusDurations = std::array<std::chrono::nanoseconds, NrOfStatusValues>;
 } // namespace Log
@@ -9,40 +9,52 @@
 
 #pragma once
 
+#include "graylog_logger/AsyncSink.hpp"
+#include "graylog_logger/IoBackend.hpp"
 #include "graylog_logger/LogUtil.hpp"
-#include "graylog_logger/ThreadedExecutor.hpp"
 #include <fstream>
+#include <memory>
 #include <string>
 
 namespace Log {
 
-class FileInterface : public BaseLogHandler {
+class IoUringFile;
+
+/// \brief Appends batches of log messages to a file.
+class FileWriter {
+public:
+  /// \param[in] Name Name of the log file.
+  /// \param[in] Backend IoBackend::IoUring writes the file through an
+  /// io_uring if available, std::ofstream is used otherwise.
+  explicit FileWriter(std::string const &Name,
+                      IoBackend Backend = IoBackend::Default);
+  ~FileWriter();
+  size_t write(minimal::span<const LogMessage> Messages,
+               const MessageFormatter &Formatter);
+  void flush();
+  bool isOpen() const;
+
+private:
+  std::ofstream FileStream;
+  std::string OutputBuffer;
+  /// \brief Used instead of FileStream with IoBackend::IoUring.
+  std::unique_ptr<IoUringFile> UringFile;
+};
+
+class FileInterface : public AsyncSink<FileWriter> {
 public:
+  /// \param[in] Name Name of the log file. Log messages are appended to the
+  /// file if it already exists.
+  /// \param[in] MaxQueueLength The maximum number of queued messages. When the
+  /// queue is full, the thread adding messages writes them to file instead.
   explicit FileInterface(std::string const &Name,
                          const size_t MaxQueueLength = 100);
-  void addMessage(const LogMessage &Message) override;
-
-  /// \brief Waits for all messages created before the call to flush to be
-  /// printed and then flushes the file stream.
-  /// \param[in] TimeOut Amount of time to wait for messages to be written.
-  /// \return Returns true if queue was emptied and stream flushed before the
-  /// time out. Returns false otherwise.
-  bool flush(std::chrono::system_clock::duration TimeOut) override;
-
-  /// \brief Are there any queued messages?
-  /// \note The message queue will show as empty before the last message in
-  /// the queue has been written.
-  /// \return Returns true if message queue is empty.
-  bool emptyQueue() override;
-
-  /// \brief Number of queued messages.
-  /// \return Due to multiple threads accessing this queue, shows approximate
-  /// number of messages in the queue.
-  size_t queueSize() override;
-
-protected:
-  std::ofstream FileStream;
-  ThreadedExecutor Executor; // Must be last
+  /// \param[in] Name Name of the log file.
+  /// \param[in] Settings Queue and batching settings.
+  /// \param[in] Backend The system interface used for writing, see
+  /// IoBackend.
+  FileInterface(std::string const &Name, const AsyncSinkSettings &Settings,
+                IoBackend Backend = IoBackend::Default);
 };
 
 } // namespace Log
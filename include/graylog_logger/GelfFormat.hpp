@@ -0,0 +1,42 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Options for the contents of the GELF messages sent to Graylog.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+namespace Log {
+
+/// \brief Resolution of the GELF "timestamp" field, which is the number of
+/// seconds since the UNIX epoch with decimals.
+enum class TimestampPrecision {
+  Seconds,
+  Milliseconds,
+  Microseconds,
+};
+
+/// \brief Options for the contents of the GELF messages.
+struct GelfFormat {
+  /// \brief Resolution of the "timestamp" field.
+  /// \note A double has (just) enough precision for microseconds; finer
+  /// resolution is available through MonotonicTime.
+  TimestampPrecision Precision{TimestampPrecision::Microseconds};
+  /// \brief Add the field "_monotonic_ns": the time at which the message was
+  /// created according to std::chrono::steady_clock, in nanoseconds.
+  ///
+  /// Unlike the timestamp, this clock is never adjusted. The values are only
+  /// comparable between messages from the same host since it was booted.
+  bool MonotonicTime{false};
+  /// \brief Add the field "_sequence": a number that is incremented for every
+  /// log message created in the process.
+  /// \note The numbers of messages that are filtered out by the severity
+  /// levels of the log handlers are skipped, a gap does thus not necessarily
+  /// mean that a message was lost.
+  bool SequenceNumber{false};
+};
+
+} // namespace Log
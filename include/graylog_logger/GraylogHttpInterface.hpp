@@ -0,0 +1,155 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Interface for sending messages to a Graylog server using GELF over
+/// HTTP.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "graylog_logger/AddressPreference.hpp"
+#include "graylog_logger/Compression.hpp"
+#include "graylog_logger/ConnectionStatus.hpp"
+#include "graylog_logger/GelfFormat.hpp"
+#include "graylog_logger/LogUtil.hpp"
+#include <string>
+#include <vector>
+
+namespace Log {
+
+struct GraylogHttpSettings {
+  /// \brief The path of the GELF HTTP input.
+  std::string Path{"/gelf"};
+  /// \brief Maximum number of bytes of the (serialised) messages waiting
+  /// to be sent. Zero for no limit.
+  size_t MaxQueueBytes{8 * 1024 * 1024};
+  /// \brief Maximum number of messages waiting to be sent. Zero for no
+  /// limit.
+  size_t MaxQueueLength{0};
+  /// \brief Maximum number of messages in the body of one request.
+  ///
+  /// With more than one message per request, the messages are separated by
+  /// newline characters.
+  /// \note The GELF HTTP input of Graylog only accepts one message per
+  /// request. Only use batching with inputs (or relays) that support it.
+  size_t MaxMessagesPerRequest{1};
+  /// \brief Maximum (uncompressed) size of the body of a request. A message
+  /// that is larger is sent in a request of its own.
+  size_t MaxRequestBytes{1024 * 1024};
+  /// \brief Maximum number of requests sent before waiting for the response
+  /// to the first of them (HTTP/1.1 pipelining). One disables pipelining.
+  size_t MaxPipelinedRequests{8};
+  /// \brief Compression of the request bodies. Compression::Gzip is sent
+  /// with "Content-Encoding: gzip" and Compression::Zlib with
+  /// "Content-Encoding: deflate".
+  Compression BodyCompression{Compression::None};
+  /// \brief zlib compression level, 1 (fastest) to 9 (best) or -1 for the
+  /// zlib default.
+  int CompressionLevel{-1};
+  /// \brief Options for the contents of the GELF messages.
+  GelfFormat Format;
+  /// \brief Delays between connection attempts, see
+  /// GraylogSettings::ReconnectDelayMin.
+  std::chrono::milliseconds ReconnectDelayMin{100};
+  std::chrono::milliseconds ReconnectDelayMax{10000};
+  /// \brief Number of times that a request answered with a server error
+  /// (5xx), 408 or 429 is sent again before its messages are discarded.
+  ///
+  /// The request is re-sent on a new connection after the reconnect delay
+  /// or, if it is longer, the time given in the Retry-After field of the
+  /// response.
+  size_t MaxRetries{10};
+  /// \brief The order in which the addresses of the server are tried if the
+  /// host name resolves to more than one. The address of the last
+  /// successful connection is always tried first.
+  AddressPreference Addresses{AddressPreference::IPv4First};
+  /// \brief Time allowed for looking up the addresses of the server and for
+  /// establishing a TCP connection to each of them. Zero disables the
+  /// timeout.
+  std::chrono::milliseconds ConnectTimeout{5000};
+  /// \brief Time allowed for writing the pending requests and for receiving
+  /// each response. The connection is closed and re-established if it
+  /// expires. Zero disables the timeout.
+  std::chrono::milliseconds RequestTimeout{30000};
+};
+
+/// \brief Sends GELF messages to a Graylog server in HTTP POST requests.
+///
+/// The requests are sent over a persistent (keep-alive) connection from a
+/// separate thread. Requests that have not been answered when the connection
+/// is lost are sent again once it has been re-established, a message can
+/// therefore be received twice. Requests rejected by the server with a
+/// client error status code (4xx, except 408 and 429) are counted as
+/// discarded, other error responses cause the request to be re-sent (see
+/// GraylogHttpSettings::MaxRetries).
+class GraylogHttpConnection {
+public:
+  using Status = Log::Status;
+  GraylogHttpConnection(std::string Host, int Port,
+                        const GraylogHttpSettings &Settings);
+  virtual ~GraylogHttpConnection();
+  virtual void sendMessage(std::string Msg);
+  /// \brief Queue several messages for transmission in one go.
+  virtual void sendMessages(std::vector<std::string> Msgs);
+  virtual Status getConnectionStatus() const;
+  virtual bool messageQueueEmpty();
+  /// \brief The number of messages that are queued or that are waiting for
+  /// the server to accept them.
+  virtual size_t messageQueueSize();
+  /// \brief Wait for all messages queued before the call to flush to be
+  /// accepted (or rejected) by the server.
+  virtual bool flush(std::chrono::system_clock::duration TimeOut);
+  /// \brief Get a copy of the counters of the connection.
+  virtual MetricsSnapshot getMetrics() const;
+  /// \brief Register a function that is called on every change of the
+  /// connection status, e.g. by health checks.
+  /// \note The function is called by the thread of the connection and
+  /// should return quickly.
+  /// \return An id for removeStatusCallback().
+  virtual size_t addStatusCallback(StatusCallback Callback);
+  /// \brief Unregister a function registered with addStatusCallback(). The
+  /// function is not called any more once this returns.
+  virtual void removeStatusCallback(size_t Id);
+  /// \brief The cumulative time spent in every status since the connection
+  /// was created.
+  virtual StatusDurations getTimeInStatus() const;
+
+protected:
+  /// \brief Count messages that were discarded before they were queued.
+  void messagesDropped(size_t NrOfMessages);
+
+private:
+  class Impl;
+  std::unique_ptr<Impl> Pimpl;
+};
+
+class GraylogHttpInterface : public BaseLogHandler,
+                             public GraylogHttpConnection {
+public:
+  GraylogHttpInterface(
+      const std::string &Host, int Port,
+      const GraylogHttpSettings &Settings = GraylogHttpSettings());
+  ~GraylogHttpInterface() override = default;
+  void addMessage(const LogMessage &Message) override;
+  void addMessages(minimal::span<const LogMessage *const> Messages) override;
+  /// \brief Waits for all messages created before the call to flush to be
+  /// accepted by the server.
+  /// \param[in] TimeOut Amount of time to wait for messages to be sent.
+  /// \return Returns true if messages were sent before the time out.
+  /// Returns false otherwise.
+  bool flush(std::chrono::system_clock::duration TimeOut) override;
+  bool emptyQueue() override;
+  size_t queueSize() override;
+  MetricsSnapshot getMetrics() const override;
+
+  /// \brief True if GelfFormat::SequenceNumber is set.
+  bool usesSequenceNumbers() const override { return Format.SequenceNumber; }
+
+private:
+  const GelfFormat Format;
+};
+
+} // namespace Log
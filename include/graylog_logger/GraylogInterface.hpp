@@ -9,31 +9,221 @@
 
 #pragma once
 
+#include "graylog_logger/AddressPreference.hpp"
+#include "graylog_logger/Compression.hpp"
 #include "graylog_logger/ConnectionStatus.hpp"
+#include "graylog_logger/GelfFormat.hpp"
+#include "graylog_logger/IoBackend.hpp"
 #include "graylog_logger/LogUtil.hpp"
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace Log {
+
+class IoContext;
+
+/// \brief How messages are distributed over the connections of a pool, see
+/// GraylogSettings::NrOfConnections.
+enum class PoolBalancing {
+  RoundRobin, ///< Every message (or batch) goes to the next connection.
+  /// Messages go to the connection with the fewest bytes waiting to be
+  /// written.
+  LeastOutstandingBytes,
+};
+
+struct GraylogSettings {
+  /// \brief Maximum number of bytes of the (serialised) messages waiting
+  /// to be sent. Zero for no limit.
+  size_t MaxQueueBytes{8 * 1024 * 1024};
+  /// \brief Maximum number of messages waiting to be sent. Zero for no
+  /// limit.
+  size_t MaxQueueLength{0};
+  /// \brief Maximum number of bytes of messages written to the socket in one
+  /// go. Messages are taken from the queue until this limit is reached.
+  size_t MaxBatchBytes{65536};
+  /// \brief Maximum time that messages are held back in order to write them
+  /// in larger batches. Zero disables the holding back of messages.
+  ///
+  /// Messages are only held back when the connection has recently been
+  /// unable to keep up with the rate of new messages; the targeted batch
+  /// size grows while that is the case and shrinks every time the batch is
+  /// written because this time has passed. At low message rates, messages
+  /// are written immediately.
+  std::chrono::microseconds Linger{1000};
+  /// \brief The system interface used for writing to the socket.
+  ///
+  /// With IoBackend::IoUring, the messages are copied into registered
+  /// buffers of MaxBatchBytes and written by the kernel without blocking the
+  /// io_context. The writes of several buffers are submitted together and
+  /// completed in order. Compressed streams (StreamCompression) are always
+  /// written with ASIO.
+  IoBackend Backend{IoBackend::Default};
+  /// \brief Compress the stream of GELF messages sent over the TCP
+  /// connection.
+  ///
+  /// Every connection is one continuous zlib/gzip stream that is flushed
+  /// (Z_SYNC_FLUSH) every time data is written to the socket.
+  /// \note The GELF TCP input of Graylog does not support compression. Only
+  /// use this option with a dedicated receiver (e.g. a relay) that
+  /// decompresses the stream.
+  Compression StreamCompression{Compression::None};
+  /// \brief zlib compression level, 1 (fastest) to 9 (best) or -1 for the
+  /// zlib default.
+  int CompressionLevel{-1};
+  /// \brief Options for the contents of the GELF messages.
+  GelfFormat Format;
+  /// \brief The character written after every message: '\0' for GELF TCP
+  /// inputs or '\n' for receivers that expect newline delimited JSON.
+  char MessageDelimiter{'\0'};
+  /// \brief Path of a Unix domain stream socket, e.g. of a log agent on the
+  /// same host, to which the messages are sent instead of the host and port
+  /// given to the constructor.
+  ///
+  /// The connection is re-established (see ReconnectDelayMin) if the agent
+  /// closes it, e.g. when it is restarted. AdditionalServers are ignored.
+  /// \note Not available on Windows.
+  std::string UnixSocketPath;
+  /// \brief Number of parallel TCP connections to the server(s).
+  ///
+  /// The connections are spread over the server given to the constructor and
+  /// AdditionalServers, and over the addresses that the host names resolve
+  /// to. Messages are only passed to connections that are connected, if
+  /// there are any. The messages of a connection that fails are moved to the
+  /// other connections. MaxQueueBytes and MaxQueueLength are divided between
+  /// the connections.
+  size_t NrOfConnections{1};
+  PoolBalancing Balancing{PoolBalancing::RoundRobin};
+  /// \brief Further servers (host name and port) that receive the same
+  /// stream of messages. Use at least as many connections as servers.
+  std::vector<std::pair<std::string, int>> AdditionalServers;
+  /// \brief Directory in which messages that do not fit in the queue are
+  /// stored until they can be sent. Empty (the default) disables the spool
+  /// and such messages are dropped.
+  ///
+  /// The messages are appended to memory-mapped segment files and sent in
+  /// order once the queue has been emptied. Messages that have not been sent
+  /// when the connection is destroyed are sent by the next connection that
+  /// uses the same directory. With more than one connection, every
+  /// connection uses a sub-directory of its own.
+  /// \note Not available on Windows.
+  std::string SpoolDirectory;
+  /// \brief Size of a segment file. Larger messages get a segment of their
+  /// own.
+  size_t SpoolSegmentSize{16 * 1024 * 1024};
+  /// \brief Maximum total size of the segment files (of all connections).
+  /// The oldest segment files are deleted (and their messages counted as
+  /// discarded) to make room for new ones.
+  size_t SpoolMaxBytes{1024 * 1024 * 1024};
+  /// \brief Delays between connection attempts.
+  ///
+  /// The first attempt after a connection has been lost (or failed) is made
+  /// immediately, unless the connection was lost within
+  /// StableConnectionTime. After that, the delay is chosen at random (full
+  /// jitter) between zero and an upper limit that starts at
+  /// ReconnectDelayMin and doubles with every failed attempt, up to
+  /// ReconnectDelayMax. The randomisation keeps many clients from
+  /// reconnecting to a restarted server in lockstep.
+  std::chrono::milliseconds ReconnectDelayMin{100};
+  std::chrono::milliseconds ReconnectDelayMax{10000};
+  /// \brief A connection that is lost before it has been up for this long
+  /// counts as a failed attempt, i.e. the reconnect delay keeps growing.
+  ///
+  /// Keeps the connection from reconnecting in a tight loop to a server
+  /// that accepts connections and then closes them at once (e.g. an
+  /// overloaded load balancer or a different service on the port).
+  std::chrono::milliseconds StableConnectionTime{1000};
+  /// \brief The order in which the addresses of the server are tried. The
+  /// address of the last successful connection is always tried first.
+  AddressPreference Addresses{AddressPreference::IPv4First};
+  /// \brief Time after which the addresses of the server are looked up
+  /// again.
+  ///
+  /// The addresses are looked up in the background, re-connecting does not
+  /// wait for the lookup. If a lookup fails, the previous addresses are
+  /// kept. A lookup is also started when none of the addresses can be
+  /// connected to. Zero disables the caching; the addresses are then looked
+  /// up before every connection attempt.
+  std::chrono::milliseconds AddressCacheTtl{60000};
+  /// \brief Time allowed for establishing a TCP connection to one of the
+  /// addresses of the server. Zero disables the timeout.
+  std::chrono::milliseconds ConnectTimeout{5000};
+  /// \brief Time allowed for one write to the socket (of at most
+  /// MaxBatchBytes, or of the writes submitted together with
+  /// IoBackend::IoUring) to complete. If the server stops reading, the
+  /// connection is closed and re-established after this time. Zero disables
+  /// the timeout.
+  std::chrono::milliseconds WriteTimeout{30000};
+  /// \brief The io_context that runs the network I/O of the connection(s).
+  ///
+  /// By default (nullptr), every connection runs in a thread of its own.
+  /// An IoContext can be shared by any number of connections, e.g. in order
+  /// to send messages to several servers with few threads, and can wrap an
+  /// io_context that is run by the application.
+  std::shared_ptr<IoContext> Context;
+};
+
 class GraylogConnection {
 public:
   using Status = Log::Status;
   GraylogConnection(std::string Host, int Port, size_t MaxQueueSize);
+  GraylogConnection(std::string Host, int Port,
+                    const GraylogSettings &Settings);
   virtual ~GraylogConnection();
   virtual void sendMessage(std::string Msg);
+  /// \brief Queue several messages for transmission in one go.
+  virtual void sendMessages(std::vector<std::string> Msgs);
   virtual Status getConnectionStatus() const;
   virtual bool messageQueueEmpty();
   virtual size_t messageQueueSize();
   virtual bool flush(std::chrono::system_clock::duration TimeOut);
+  /// \brief Get a copy of the counters of the connection.
+  ///
+  /// The number of enqueued and dropped messages, messages taken from the
+  /// queue for transmission, bytes sent, the number of (re-)connections and
+  /// a histogram of the time messages spend in the queue.
+  /// With several connections (see GraylogSettings::NrOfConnections), the
+  /// counters are summed. Messages that are moved to another connection
+  /// are only counted once, and the queue high-water mark is that of the
+  /// connection with the largest queue.
+  virtual MetricsSnapshot getMetrics() const;
+  /// \brief Register a function that is called on every change of the
+  /// connection status (of the connections as a whole, see
+  /// GraylogSettings::NrOfConnections), e.g. by health checks.
+  /// \note The function is called by the thread of the connection and
+  /// should return quickly.
+  /// \return An id for removeStatusCallback().
+  virtual size_t addStatusCallback(StatusCallback Callback);
+  /// \brief Unregister a function registered with addStatusCallback(). The
+  /// function is not called any more once this returns.
+  virtual void removeStatusCallback(size_t Id);
+  /// \brief The cumulative time spent in every status since the connection
+  /// was created.
+  virtual StatusDurations getTimeInStatus() const;
+
+protected:
+  /// \brief Count messages that were discarded before they were queued.
+  void messagesDropped(size_t NrOfMessages);
 
 private:
   class Impl;
-  std::unique_ptr<Impl> Pimpl;
+  /// \brief The connection(s) to the server(s), see
+  /// GraylogSettings::NrOfConnections.
+  class Pool;
+  std::unique_ptr<Pool> Pimpl;
 };
 class GraylogInterface : public BaseLogHandler, public GraylogConnection {
 public:
   GraylogInterface(const std::string &Host, int Port,
                    size_t MaxQueueLength = 1000);
+  GraylogInterface(const std::string &Host, int Port,
+                   const GraylogSettings &Settings);
   ~GraylogInterface() override = default;
   void addMessage(const LogMessage &Message) override;
+  /// \brief Serialises all the messages and queues them for transmission in
+  /// one go.
+  void addMessages(minimal::span<const LogMessage *const> Messages) override;
   /// \brief Waits for all messages created before the call to flush to be
   /// transmitted.
   /// \param[in] TimeOut Amount of time to wait for messages to be transmitted.
@@ -54,8 +244,20 @@ public:
   /// number of messages in the queue.
   size_t queueSize() override;
 
+  /// \brief Counters of the connection to the server, see
+  /// GraylogConnection::getMetrics().
+  MetricsSnapshot getMetrics() const override;
+
+  /// \brief True if GelfFormat::SequenceNumber is set.
+  bool usesSequenceNumbers() const override { return Format.SequenceNumber; }
+
 protected:
   static std::string logMsgToJSON(const LogMessage &Message);
+  static std::string logMsgToJSON(const LogMessage &Message,
+                                  const GelfFormat &Format);
+
+private:
+  const GelfFormat Format;
 };
 
 } // namespace Log
@@ -0,0 +1,136 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Interface for sending messages to a Graylog server using GELF over
+/// UDP.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "graylog_logger/AddressPreference.hpp"
+#include "graylog_logger/Compression.hpp"
+#include "graylog_logger/ConnectionStatus.hpp"
+#include "graylog_logger/GelfFormat.hpp"
+#include "graylog_logger/LogUtil.hpp"
+
+namespace Log {
+
+struct GraylogUdpSettings {
+  /// \brief Maximum number of bytes of the (serialised) messages waiting
+  /// to be sent. Zero for no limit.
+  size_t MaxQueueBytes{8 * 1024 * 1024};
+  /// \brief Maximum number of messages waiting to be sent. Zero for no
+  /// limit.
+  size_t MaxQueueLength{0};
+  /// \brief Maximum size of the payload of a UDP datagram. Messages that are
+  /// larger are split into (at most 128) GELF chunks.
+  size_t MaxDatagramSize{1420};
+  /// \brief Maximum number of datagrams passed to the operating system in one
+  /// system call.
+  size_t MaxDatagramsPerSend{64};
+  /// \brief Compression of the GELF messages. Graylog detects and
+  /// decompresses zlib and gzip compressed datagrams automatically.
+  /// Compression is done before a message is split into chunks.
+  Compression PayloadCompression{Compression::None};
+  /// \brief zlib compression level, 1 (fastest) to 9 (best) or -1 for the
+  /// zlib default.
+  int CompressionLevel{-1};
+  /// \brief Options for the contents of the GELF messages.
+  GelfFormat Format;
+  /// \brief Path of a Unix domain datagram socket, e.g. of a log agent on
+  /// the same host, to which the messages are sent instead of the host and
+  /// port given to the constructor. Consider increasing MaxDatagramSize, the
+  /// datagrams of Unix domain sockets are not limited by a network MTU.
+  /// \note Not available on Windows.
+  std::string UnixSocketPath;
+  /// \brief Time before a failed address lookup is retried or, with a Unix
+  /// domain socket, before the socket is re-connected after the receiver
+  /// has gone away (e.g. restarted).
+  ///
+  /// A Unix domain socket is re-connected once immediately when a send
+  /// fails and the datagrams that were not sent are sent again. If that
+  /// fails too, they are counted as discarded, as are the messages until
+  /// the socket has been re-connected.
+  std::chrono::milliseconds RetryDelay{10000};
+  /// \brief Which address of the server is used if the host name resolves
+  /// to more than one.
+  AddressPreference Addresses{AddressPreference::IPv4First};
+};
+
+/// \brief Sends GELF messages to a Graylog server as UDP datagrams (or to a
+/// local agent over a Unix domain datagram socket).
+///
+/// Unlike GraylogConnection, there is no connection to maintain; messages
+/// are sent in a separate thread as soon as possible. Messages are lost if
+/// they are too large, if the host name can not be resolved or if the server
+/// is not receiving datagrams.
+class GraylogUdpConnection {
+public:
+  using Status = Log::Status;
+  GraylogUdpConnection(std::string Host, int Port,
+                       const GraylogUdpSettings &Settings);
+  virtual ~GraylogUdpConnection();
+  virtual void sendMessage(std::string Msg);
+  /// \brief Queue several messages for transmission in one go.
+  virtual void sendMessages(std::vector<std::string> Msgs);
+  /// \brief Status::SEND_LOOP once the host name has been resolved.
+  virtual Status getConnectionStatus() const;
+  virtual bool messageQueueEmpty();
+  virtual size_t messageQueueSize();
+  /// \brief Wait for all messages queued before the call to flush to be
+  /// handed to the operating system (or discarded).
+  virtual bool flush(std::chrono::system_clock::duration TimeOut);
+  /// \brief Get a copy of the counters of the connection.
+  virtual MetricsSnapshot getMetrics() const;
+  /// \brief Register a function that is called on every change of the
+  /// connection status, e.g. by health checks.
+  /// \note The function is called by the thread of the connection and
+  /// should return quickly.
+  /// \return An id for removeStatusCallback().
+  virtual size_t addStatusCallback(StatusCallback Callback);
+  /// \brief Unregister a function registered with addStatusCallback(). The
+  /// function is not called any more once this returns.
+  virtual void removeStatusCallback(size_t Id);
+  /// \brief The cumulative time spent in every status since the connection
+  /// was created.
+  virtual StatusDurations getTimeInStatus() const;
+
+protected:
+  /// \brief Count messages that were discarded before they were queued.
+  void messagesDropped(size_t NrOfMessages);
+
+private:
+  class Impl;
+  std::unique_ptr<Impl> Pimpl;
+};
+
+class GraylogUdpInterface : public BaseLogHandler, public GraylogUdpConnection {
+public:
+  GraylogUdpInterface(
+      const std::string &Host, int Port,
+      const GraylogUdpSettings &Settings = GraylogUdpSettings());
+  ~GraylogUdpInterface() override = default;
+  void addMessage(const LogMessage &Message) override;
+  void addMessages(minimal::span<const LogMessage *const> Messages) override;
+  /// \brief Waits for all messages created before the call to flush to be
+  /// sent.
+  /// \param[in] TimeOut Amount of time to wait for messages to be sent.
+  /// \return Returns true if messages were sent before the time out.
+  /// Returns false otherwise.
+  /// \note A sent UDP message is not guaranteed to be received.
+  bool flush(std::chrono::system_clock::duration TimeOut) override;
+  bool emptyQueue() override;
+  size_t queueSize() override;
+  MetricsSnapshot getMetrics() const override;
+
+  /// \brief True if GelfFormat::SequenceNumber is set.
+  bool usesSequenceNumbers() const override { return Format.SequenceNumber; }
+
+private:
+  const GelfFormat Format;
+};
+
+} // namespace Log
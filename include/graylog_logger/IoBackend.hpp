@@ -0,0 +1,30 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Selection of the system interface used for writing.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+namespace Log {
+
+/// \brief The system interface used by the TCP connections and the file
+/// handler for writing.
+/// \note io_uring requires the library to be built on Linux with
+/// linux/io_uring.h available (WITH_IO_URING is defined in LibConfig.hpp)
+/// and a kernel that allows its use, see IoUringAvailable(). Otherwise the
+/// default backend is used.
+enum class IoBackend {
+  Default, ///< ASIO for sockets and std::ofstream for files.
+  IoUring, ///< Writes from registered buffers submitted to an io_uring.
+};
+
+/// \brief Can IoBackend::IoUring be used?
+/// \return False if the library was built without io_uring support or if
+/// the kernel does not support (or does not allow) io_uring.
+bool IoUringAvailable();
+
+} // namespace Log
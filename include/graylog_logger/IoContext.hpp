@@ -0,0 +1,59 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief An ASIO io_context that can be shared by several connections to
+/// Graylog servers.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <asio.hpp>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace Log {
+
+/// \brief The io_context on which the network I/O of connections is run,
+/// see GraylogSettings::Context.
+///
+/// The io_context is either owned by the library and run by a fixed number
+/// of threads, or owned and run by the application. Any number of
+/// connections can share an instance, the handlers of a single connection
+/// never run concurrently.
+class IoContext {
+public:
+  /// \brief An io_context that is run by threads of the library.
+  /// \param[in] NrOfThreads The number of threads that run the io_context.
+  /// At least one thread is always created.
+  explicit IoContext(size_t NrOfThreads = 1);
+  /// \brief Use an io_context of the application, e.g. in order to run the
+  /// connections in the event loop of the application.
+  /// \param[in] External The io_context. Has to outlive this instance and
+  /// the connections using it.
+  /// \note The connections only send messages while the application runs
+  /// the io_context. A connection must not be destroyed by a handler that
+  /// is run by the io_context.
+  explicit IoContext(asio::io_service &External);
+  ~IoContext();
+  IoContext(const IoContext &) = delete;
+  IoContext &operator=(const IoContext &) = delete;
+
+  asio::io_service &context() { return Context; }
+
+  /// \brief The number of threads of the library that run the io_context.
+  /// \return Zero if the io_context is run by the application.
+  size_t size() const { return Threads.size(); }
+
+private:
+  std::unique_ptr<asio::io_service> OwnedContext;
+  asio::io_service &Context;
+  std::unique_ptr<asio::io_service::work> Work;
+  std::vector<std::thread> Threads;
+};
+
+} // namespace Log
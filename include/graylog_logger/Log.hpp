@@ -163,6 +163,22 @@ void AddField(const std::string &Key, const AdditionalField &Value);
 /// \param[in] Level The maximum severity level.
 void SetMinimumSeverity(const Severity Level);
 
+/// \brief Limit the memory used by messages waiting to be processed by the
+/// logger, see LoggingBase::setQueueLimits(). The log handlers have limits
+/// of their own.
+/// \param[in] MaxBytes Maximum number of bytes, zero for no limit.
+/// \param[in] MaxMessages Maximum number of messages, zero for no limit.
+void SetQueueLimits(size_t MaxBytes, size_t MaxMessages);
+
+/// \brief Limit the memory used by the messages in all the queues of the
+/// library (the logger, the log handlers and their connections) combined.
+///
+/// Messages of low severity are discarded first as the budget runs low, see
+/// MemoryBudget.
+/// \param[in] MaxBytes Maximum number of bytes, zero (the default) for no
+/// limit.
+void SetMemoryBudget(size_t MaxBytes);
+
 /// \brief Add a log handler that will consume log messages.
 ///
 /// It is possible to use one of the log handlers provided with this library
@@ -202,6 +218,18 @@ AddLogHandler(T *ptr) {
 /// de-allocate it yourself.
 void AddLogHandler(const BaseLogHandler *Handler);
 
+/// \brief Run loggers and log handlers on a shared pool of worker threads.
+///
+/// By default, every log handler (and the logger itself) uses a thread of
+/// its own. After calling this function, log handlers created afterwards
+/// share a pool of threads instead, such that the number of threads used by
+/// the library is independent of the number of log handlers. The work of
+/// every single handler is still done in order.
+/// \note Call this function before any other function in the library in
+/// order for the default logger and console handler to use the pool as well.
+/// \param[in] NrOfThreads The number of threads in the shared pool.
+void UseSharedWorkerPool(size_t NrOfThreads = 1);
+
 /// \brief Remove all log message handlers.
 ///
 /// Clears the vector of handlers. If no other shared pointer for a handler
@@ -212,4 +240,11 @@ void RemoveAllHandlers();
 /// \return A std::vector containing shared pointers to handlers known by the
 /// logging system.
 std::vector<LogHandler_P> GetHandlers();
+
+/// \brief Get a copy of the counters of the logging system.
+///
+/// Use BaseLogHandler::getMetrics() on the handlers returned by GetHandlers()
+/// for the counters of the individual log handlers.
+/// \return Message and latency counters of the logger.
+MetricsSnapshot GetMetrics();
 } // namespace Log
@@ -10,7 +10,11 @@
 
 #pragma once
 
+#include "graylog_logger/Metrics.hpp"
+#include "graylog_logger/MinimalSpan.hpp"
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
@@ -77,12 +81,40 @@ struct LogMessage {
   LogMessage() = default;
   std::string MessageString;
   system_time Timestamp;
+  /// \brief The time at which the message was created according to a clock
+  /// that is never adjusted. Used for measuring the time between messages.
+  std::chrono::steady_clock::time_point MonotonicTimestamp;
+  /// \brief Incremented for every message created in the process, see
+  /// createSequenceNumber(). Zero if not set.
+  std::uint64_t SequenceNumber{0};
   int ProcessId{-1};
   std::string ProcessName;
   std::string Host;
   Severity SeverityLevel{Severity::Debug};
   std::string ThreadId;
   std::vector<std::pair<std::string, AdditionalField>> AdditionalFields;
+  /// \brief Identifies the static part of the message.
+  ///
+  /// If non-zero, Host, ProcessId, ProcessName and the first
+  /// NrOfStaticFields additional fields are identical in all messages with
+  /// the same identifier. Log handlers can use this to cache e.g. the
+  /// serialised form of these fields. Set by the logger and reset to zero
+  /// when addField() replaces one of the static fields.
+  /// \note Set it to zero if the static part is changed in some other way.
+  std::uint64_t StaticFieldsId{0};
+  /// \brief The number of additional fields that are part of the static
+  /// part of the message, see StaticFieldsId.
+  size_t NrOfStaticFields{0};
+  /// \brief Get a new (process wide unique) value for StaticFieldsId.
+  static std::uint64_t createStaticFieldsId();
+  /// \brief Get the next (process wide) message sequence number.
+  static std::uint64_t createSequenceNumber();
+  /// \brief An estimate of the memory used by the message, including the
+  /// contents of its strings. Used for the byte limits of queues.
+  size_t approximateSize() const;
+  /// \brief An estimate of the memory used by a list of additional fields.
+  static size_t approximateSize(
+      const std::vector<std::pair<std::string, AdditionalField>> &Fields);
   template <typename valueType>
   void addField(std::string Key, const valueType &Value) {
     int FieldLoc = -1;
@@ -96,6 +128,9 @@ struct LogMessage {
       AdditionalFields.push_back({Key, Value});
     } else {
       AdditionalFields[FieldLoc] = {Key, Value};
+      if (size_t(FieldLoc) < NrOfStaticFields) {
+        StaticFieldsId = 0;
+      }
     }
   }
 };
@@ -116,6 +151,16 @@ public:
   /// \param[in] Message The log message.
   virtual void addMessage(const LogMessage &Message) = 0;
 
+  /// \brief Called by the logging library when several new log messages are
+  /// available at once.
+  ///
+  /// The default implementation calls addMessage() for every message.
+  /// Override it in order to e.g. queue or serialise all the messages in one
+  /// go.
+  /// \param[in] Messages Pointers to the log messages. Only valid for the
+  /// duration of the call.
+  virtual void addMessages(minimal::span<const LogMessage *const> Messages);
+
   /// \brief Empty the queue of messages. Might do nothing. See documentation
   /// of derived classes for details.
   /// \param[in] TimeOut Amount of time to wait queue to empty.
@@ -133,6 +178,19 @@ public:
   /// \return The number of messages in the queue.
   virtual size_t queueSize() = 0;
 
+  /// \brief Get a copy of the counters of the handler.
+  /// \note Handlers that do not keep any counters (e.g. custom handlers that
+  /// do not override this function) return only zeros.
+  /// \return Message, byte and latency counters.
+  virtual MetricsSnapshot getMetrics() const;
+
+  /// \brief Does the handler use LogMessage::SequenceNumber?
+  ///
+  /// Sequence numbers are taken from a process wide counter. The logger only
+  /// does that if one of its handlers uses them, they are zero otherwise.
+  /// \note Must not change once the handler has been added to the logger.
+  virtual bool usesSequenceNumbers() const { return false; }
+
   /// \brief Used to set a custom log message to std::string formatting
   /// function.
   ///
@@ -143,11 +201,61 @@ public:
   void setMessageStringCreatorFunction(
       std::function<std::string(const LogMessage &)> ParserFunction);
 
+  /// \brief Set the minimum severity level of messages passed to this
+  /// handler.
+  ///
+  /// Messages with a level above this threshold are discarded by the logging
+  /// library before they are handed to addMessage(), i.e. before they are
+  /// copied into the queue of the handler. Defaults to Severity::Debug (all
+  /// messages that pass the severity level of the logger).
+  /// \param[in] Level The maximum severity level accepted by the handler.
+  void setMinSeverity(Severity Level);
+
+  /// \brief Get the minimum severity level of messages passed to this
+  /// handler.
+  /// \return The maximum severity level accepted by the handler.
+  Severity getMinSeverity() const;
+
+  /// \brief Used to set a custom filter function which is evaluated (after the
+  /// severity level check) for every message before it is handed to the
+  /// handler.
+  ///
+  /// \note Set the filter before adding the handler to the logging library.
+  /// Changing it while messages are being logged is not thread safe.
+  /// \param[in] Filter Function returning true for messages that should be
+  /// passed to the handler. Pass nullptr to remove the filter.
+  void setMessageFilter(std::function<bool(const LogMessage &)> Filter);
+
+  /// \brief Does the severity level pass the threshold of this handler?
+  /// \param[in] Level The severity level to test.
+  /// \return true if messages of this severity level might be accepted.
+  bool acceptsSeverity(Severity Level) const {
+    return int(Level) <= MinSeverity.load(std::memory_order_relaxed);
+  }
+
+  /// \brief Should the message be passed to this handler?
+  ///
+  /// Checks both the severity level threshold and the message filter.
+  /// \param[in] Message The log message to test.
+  /// \return true if the message should be passed on to addMessage().
+  bool acceptsMessage(const LogMessage &Message) const;
+
+  /// \brief A counter that is incremented every time the severity threshold
+  /// of any handler is changed.
+  ///
+  /// Used by the logging library to detect when its cached (global) severity
+  /// level gate has to be re-calculated.
+  static std::uint64_t severityThresholdVersion();
+
 protected:
   /// \brief Can be used to create strings from messages if set.
   std::function<std::string(const LogMessage &)> MessageParser{nullptr};
   /// \brief The default log message to std::string function.
   std::string messageToString(const LogMessage &Message);
+
+private:
+  std::atomic_int MinSeverity{int(Severity::Debug)};
+  std::function<bool(const LogMessage &)> MessageFilter{nullptr};
 };
 
 using LogHandler_P = std::shared_ptr<BaseLogHandler>;
@@ -22,9 +22,11 @@ public:
   using LoggingBase::addField;
   using LoggingBase::flush;
   using LoggingBase::getHandlers;
+  using LoggingBase::getMetrics;
   using LoggingBase::log;
   using LoggingBase::removeAllHandlers;
   using LoggingBase::setMinSeverity;
+  using LoggingBase::setQueueLimits;
 #ifdef WITH_FMT
   using LoggingBase::fmt_log;
 #endif
@@ -11,6 +11,8 @@
 
 #include "graylog_logger/LibConfig.hpp"
 #include "graylog_logger/LogUtil.hpp"
+#include "graylog_logger/Metrics.hpp"
+#include "graylog_logger/QueueBudget.hpp"
 #include "graylog_logger/ThreadedExecutor.hpp"
 #include <sstream>
 #include <string>
@@ -20,6 +22,7 @@
 #include <tuple>
 #endif
 #include "graylog_logger/MinimalApply.hpp"
+#include <atomic>
 #include <ciso646>
 #include <future>
 #include <thread>
@@ -29,6 +32,10 @@ namespace Log {
 class LoggingBase {
 public:
   LoggingBase();
+  /// \param[in] Pool The worker pool that the logger should use for
+  /// creating and dispatching log messages. If nullptr, the default pool (or
+  /// a dedicated thread) is used, see WorkerPool::setDefault().
+  explicit LoggingBase(std::shared_ptr<WorkerPool> Pool);
   virtual ~LoggingBase();
   virtual void log(const Severity Level, const std::string &Message) {
     log(Level, Message, std::vector<std::pair<std::string, AdditionalField>>());
@@ -36,24 +43,35 @@ public:
   virtual void
   log(const Severity Level, const std::string &Message,
       const std::vector<std::pair<std::string, AdditionalField>> &ExtraFields) {
-    if (int(Level) > int(MinSeverity)) {
+    if (not passesSeverityGate(Level)) {
+      return;
+    }
+    auto Size = sizeof(LogMessage) + Message.size() +
+                LogMessage::approximateSize(ExtraFields);
+    if (not Budget.tryAcquire(Size, 1, Level)) {
+      Metrics.dropped();
       return;
     }
     auto ThreadId = std::this_thread::get_id();
+    auto Created = creationTime();
+    Metrics.enqueued();
     Executor.SendWork([=]() {
+      Budget.release(Size);
+      Metrics.dequeued();
+      if (not handlersAcceptSeverity(Level)) {
+        return;
+      }
       LogMessage cMsg(BaseMsg);
       for (auto &fld : ExtraFields) {
         cMsg.addField(fld.first, fld.second);
       }
-      cMsg.Timestamp = std::chrono::system_clock::now();
+      Created.setOn(cMsg);
       cMsg.MessageString = Message;
       cMsg.SeverityLevel = Level;
       std::ostringstream ss;
       ss << ThreadId;
       cMsg.ThreadId = ss.str();
-      for (auto &ptr : Handlers) {
-        ptr->addMessage(cMsg);
-      }
+      queueForDispatch(std::move(cMsg));
     });
   }
   virtual void log(const Severity Level, const std::string &Message,
@@ -67,15 +85,27 @@ public:
 #ifdef WITH_FMT
   template <typename... Args>
   void fmt_log(const Severity Level, std::string Format, Args... args) {
-    if (int(Level) > int(MinSeverity)) {
+    if (not passesSeverityGate(Level)) {
       return;
     }
-    auto ThreadId = std::this_thread::get_id();
     auto UsedArguments = std::make_tuple(args...);
+    auto Size = sizeof(LogMessage) + Format.size() + sizeof(UsedArguments);
+    if (not Budget.tryAcquire(Size, 1, Level)) {
+      Metrics.dropped();
+      return;
+    }
+    auto ThreadId = std::this_thread::get_id();
+    auto Created = creationTime();
+    Metrics.enqueued();
     Executor.SendWork([=]() {
+      Budget.release(Size);
+      Metrics.dequeued();
+      if (not handlersAcceptSeverity(Level)) {
+        return;
+      }
       LogMessage cMsg(BaseMsg);
       cMsg.SeverityLevel = Level;
-      cMsg.Timestamp = std::chrono::system_clock::now();
+      Created.setOn(cMsg);
       auto format_message = [&Format, &cMsg](const auto &... args) {
         try {
           return fmt::format(Format, args...);
@@ -90,9 +120,7 @@ public:
       std::ostringstream ss;
       ss << ThreadId;
       cMsg.ThreadId = ss.str();
-      for (auto &ptr : Handlers) {
-        ptr->addMessage(cMsg);
-      }
+      queueForDispatch(std::move(cMsg));
     });
   }
 #endif
@@ -101,39 +129,142 @@ public:
 
   template <typename valueType>
   void addField(std::string Key, const valueType &Value) {
-    Executor.SendWork([=]() { BaseMsg.addField(Key, Value); });
+    Executor.SendWork([=]() {
+      BaseMsg.addField(Key, Value);
+      BaseMsg.StaticFieldsId = LogMessage::createStaticFieldsId();
+      BaseMsg.NrOfStaticFields = BaseMsg.AdditionalFields.size();
+    });
   };
   virtual void removeAllHandlers();
   virtual void setMinSeverity(Severity Level);
+  /// \brief Limit the messages waiting to be created and passed to the
+  /// handlers by the logger. Messages beyond the limits are dropped.
+  /// \param[in] MaxBytes Maximum number of bytes (an estimate of the memory
+  /// used by the messages). Zero for no limit. The default is 16 MB.
+  /// \param[in] MaxMessages Maximum number of messages. Zero (the default)
+  /// for no limit.
+  virtual void setQueueLimits(size_t MaxBytes, size_t MaxMessages);
   virtual std::vector<LogHandler_P> getHandlers();
 
+  /// \brief Get a copy of the counters of the logger.
+  ///
+  /// Enqueued and dequeued count the calls to log() (that passed the severity
+  /// level gate) and the corresponding work done in the executor thread.
+  /// Dropped counts the calls to log() rejected because of the queue limits,
+  /// see setQueueLimits().
+  /// The latency histogram measures the time from the creation of a message
+  /// until it is passed to the handlers. Use BaseLogHandler::getMetrics() for
+  /// the counters of the individual handlers.
+  /// \return Message and latency counters.
+  virtual MetricsSnapshot getMetrics() const { return Metrics.snapshot(); }
+
   virtual bool flush(std::chrono::system_clock::duration TimeOut) {
-    auto FlushCompleted = std::make_shared<std::promise<bool>>();
-    auto FlushCompletedValue = FlushCompleted->get_future();
-    Executor.SendWork([=, FlushCompleted{std::move(FlushCompleted)}]() {
-      std::vector<std::future<bool>> FlushResults;
-      for (auto &CHandler : Handlers) {
-        FlushResults.push_back(std::async(
-            std::launch::async, [=]() { return CHandler->flush(TimeOut); }));
-      }
-      bool ReturnValue{true};
-      for (auto &CFlushResult : FlushResults) {
-        CFlushResult.wait();
-        if (not CFlushResult.get()) {
-          ReturnValue = false;
-        }
-      }
-      FlushCompleted->set_value(ReturnValue);
+    auto FlushStart = std::chrono::system_clock::now();
+    // Wait for all messages created before the call to flush to be passed to
+    // the handlers. The handlers are then flushed from this thread as the
+    // executor might share a worker thread with the handlers.
+    auto CurrentHandlers =
+        std::make_shared<std::promise<std::vector<LogHandler_P>>>();
+    auto CurrentHandlersValue = CurrentHandlers->get_future();
+    Executor.SendWork([=, CurrentHandlers{std::move(CurrentHandlers)}]() {
+      dispatchPending();
+      CurrentHandlers->set_value(Handlers);
     });
-    std::vector<std::future<bool>> FlushResult;
-    FlushCompletedValue.wait();
-    return FlushCompletedValue.get();
+    if (std::future_status::ready !=
+        CurrentHandlersValue.wait_for(TimeOut)) {
+      return false;
+    }
+    auto TimeLeft = TimeOut - (std::chrono::system_clock::now() - FlushStart);
+    std::vector<std::future<bool>> FlushResults;
+    for (auto &CHandler : CurrentHandlersValue.get()) {
+      FlushResults.push_back(std::async(
+          std::launch::async, [=]() { return CHandler->flush(TimeLeft); }));
+    }
+    bool ReturnValue{true};
+    for (auto &CFlushResult : FlushResults) {
+      if (not CFlushResult.get()) {
+        ReturnValue = false;
+      }
+    }
+    return ReturnValue;
   }
 
 protected:
+  /// \brief The creation time and sequence number of a message.
+  struct CreationTime {
+    std::chrono::steady_clock::time_point MonotonicTimestamp;
+    std::uint64_t SequenceNumber;
+    void setOn(LogMessage &Message) const {
+      Message.MonotonicTimestamp = MonotonicTimestamp;
+      Message.SequenceNumber = SequenceNumber;
+    }
+  };
+  /// \brief Take the creation time and sequence number of a new message.
+  ///
+  /// Called in the thread calling log() so that the timestamps and sequence
+  /// numbers reflect the order of the calls rather than the order in which
+  /// the messages are processed by the executor. Only the steady clock is
+  /// read here, the system clock timestamp is derived from it when the
+  /// messages are dispatched. The (process wide) sequence number counter is
+  /// only used if a handler needs it.
+  CreationTime creationTime() const {
+    return {std::chrono::steady_clock::now(),
+            CreateSequenceNumbers.load(std::memory_order_relaxed)
+                ? LogMessage::createSequenceNumber()
+                : 0};
+  }
+  /// \brief Check the severity level of a new message against the global
+  /// severity level gate.
+  ///
+  /// The gate is the least restrictive severity threshold of the log handlers,
+  /// limited by the minimum severity level set with setMinSeverity(). It is
+  /// used to discard messages in the calling thread before they are queued.
+  /// \param[in] Level Severity level of the message.
+  /// \return true if the message might be accepted by at least one handler.
+  bool passesSeverityGate(Severity Level) const {
+    if (int(Level) <= SeverityGate.load(std::memory_order_relaxed)) {
+      return true;
+    }
+    // The threshold of a handler has changed since the gate was calculated.
+    // Let the message through and have the gate re-calculated.
+    return SeverityGateVersion.load(std::memory_order_relaxed) !=
+           BaseLogHandler::severityThresholdVersion();
+  }
+  /// \note Must only be called from the executor thread.
+  bool handlersAcceptSeverity(Severity Level);
+  /// \brief Add a message to the messages waiting to be passed to the
+  /// handlers.
+  ///
+  /// Messages created by consecutive calls to log() are collected and passed
+  /// to the handlers in batches (see BaseLogHandler::addMessages()).
+  /// \note Must only be called from the executor thread.
+  void queueForDispatch(LogMessage &&Message);
+  /// \brief Pass all collected messages on to the handlers.
+  ///
+  /// Also sets the (system clock) timestamps of the messages.
+  /// \note Must only be called from the executor thread.
+  void dispatchPending();
+  /// \brief Re-calculate the severity level gate from the handler thresholds.
+  /// \note Must only be called from the executor thread.
+  void updateSeverityGate();
+  /// \brief Make the severity level gate at least as permissive as required
+  /// by a (new) log handler. Can be called from any thread.
+  void relaxSeverityGate(const LogHandler_P &Handler);
+
   Severity MinSeverity{Severity::Notice};
+  std::atomic_int SeverityGate{int(Severity::Notice)};
+  std::atomic<std::uint64_t> SeverityGateVersion{
+      BaseLogHandler::severityThresholdVersion()};
   std::vector<LogHandler_P> Handlers;
+  /// \brief Set if a handler uses sequence numbers.
+  std::atomic_bool CreateSequenceNumbers{false};
+  std::vector<LogMessage> PendingMessages;
+  std::vector<const LogMessage *> HandlerMessages;
+  bool DispatchScheduled{false};
+  const size_t MaxDispatchBatchSize{256};
   LogMessage BaseMsg;
+  MetricsRecorder Metrics;
+  QueueBudget Budget{16 * 1024 * 1024, 0};
   ThreadedExecutor Executor;
 };
 
@@ -0,0 +1,84 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief A limit on the memory used by all the queues of the library.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "graylog_logger/LogUtil.hpp"
+#include <algorithm>
+#include <atomic>
+#include <ciso646>
+#include <cstddef>
+
+namespace Log {
+
+/// \brief Limits the total number of bytes of the messages in the queues of
+/// the logger and the log handlers.
+///
+/// All queues draw from the process wide budget returned by global() (see
+/// QueueBudget). When the budget runs low, messages of low severity are
+/// rejected first: messages of severity level L are only accepted while
+/// the used bytes are below MaxBytes * (16 - L) / 16, i.e. debug messages
+/// are shed when the budget is 9/16 full and emergency messages only when
+/// it is exhausted.
+/// \note Thread safe.
+class MemoryBudget {
+public:
+  /// \brief The budget shared by all queues of the library. Unlimited until
+  /// a limit has been set, see Log::SetMemoryBudget().
+  static MemoryBudget &global();
+
+  /// \param[in] MaxBytes The limit. Zero for no limit.
+  explicit MemoryBudget(size_t MaxBytes = 0) : MaxBytes(MaxBytes) {}
+  MemoryBudget(const MemoryBudget &) = delete;
+  MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+  /// \brief Change the limit. Zero for no limit. Messages already queued
+  /// are not affected.
+  void setLimit(size_t NewMaxBytes) { MaxBytes = NewMaxBytes; }
+  size_t limit() const { return MaxBytes.load(std::memory_order_relaxed); }
+
+  /// \brief Whether messages of a severity level are accepted at the
+  /// moment. Used to discard messages before they are serialised.
+  bool accepts(Severity Level) const {
+    auto Limit = limitFor(Level);
+    return Limit == 0 or bytes() < Limit;
+  }
+  /// \brief Account for a new message if there is room for it.
+  /// \return True if the message can be queued.
+  bool tryAcquire(size_t Bytes, Severity Level) {
+    auto Limit = limitFor(Level);
+    auto Previous = UsedBytes.fetch_add(Bytes, std::memory_order_relaxed);
+    if (Limit > 0 and Previous + Bytes > Limit) {
+      UsedBytes.fetch_sub(Bytes, std::memory_order_relaxed);
+      return false;
+    }
+    return true;
+  }
+  /// \brief Account for bytes regardless of the limit.
+  void acquire(size_t Bytes) {
+    UsedBytes.fetch_add(Bytes, std::memory_order_relaxed);
+  }
+  void release(size_t Bytes) {
+    UsedBytes.fetch_sub(Bytes, std::memory_order_relaxed);
+  }
+  size_t bytes() const { return UsedBytes.load(std::memory_order_relaxed); }
+
+private:
+  /// \brief The limit for messages of a severity level, zero if there is no
+  /// limit.
+  size_t limitFor(Severity Level) const {
+    auto Max = limit();
+    auto LevelValue = std::max(0, std::min(int(Level), 7));
+    return Max - Max / 16 * size_t(LevelValue);
+  }
+  std::atomic<size_t> MaxBytes;
+  std::atomic<size_t> UsedBytes{0};
+};
+
+} // namespace Log
@@ -0,0 +1,145 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Counters used for monitoring the logging pipeline.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace Log {
+
+/// \brief The number of buckets in the latency histogram of MetricsSnapshot.
+constexpr size_t LatencyHistogramBuckets{26};
+
+/// \brief A copy of the counters of a logger or a log handler.
+struct MetricsSnapshot {
+  /// \brief Messages accepted into the queue.
+  std::uint64_t Enqueued{0};
+  /// \brief Messages taken from the queue and passed on (to the handlers in
+  /// the case of the logger and to the sink in the case of a handler).
+  std::uint64_t Dequeued{0};
+  /// \brief Messages discarded because the queue was full.
+  std::uint64_t Dropped{0};
+  /// \brief Messages that were taken from the queue (and counted as
+  /// Dequeued) but then discarded, e.g. because they could not be sent.
+  std::uint64_t Discarded{0};
+  /// \brief The largest number of messages that has been observed waiting in
+  /// the queue.
+  std::uint64_t QueueHighWaterMark{0};
+  /// \brief Bytes written to the sink (file, console, socket etc.).
+  std::uint64_t BytesWritten{0};
+  /// \brief Number of times a (re-)connection to a server has been started.
+  std::uint64_t Reconnects{0};
+  /// \brief Histogram of the time from the creation of a message until it is
+  /// passed on, measured with the steady clock.
+  ///
+  /// Bucket i (for i > 0) counts latencies in the range
+  /// [2^(i-1), 2^i) microseconds, bucket 0 latencies below 1 microsecond. The
+  /// last bucket also counts all latencies above its range.
+  std::array<std::uint64_t, LatencyHistogramBuckets> Latency{};
+
+  /// \brief The (exclusive) upper limit of a latency histogram bucket.
+  static std::chrono::microseconds latencyBucketLimit(size_t Bucket) {
+    return std::chrono::microseconds(std::int64_t(1) << Bucket);
+  }
+};
+
+/// \brief A counter that can be incremented from many threads at the same time
+/// without the threads fighting over the same cache line.
+///
+/// Every thread increments one of several cache line sized slots, the slots
+/// are summed when the value is read.
+class StripedCounter {
+public:
+  void add(std::uint64_t Value) {
+    Stripes[stripeIndex()].Value.fetch_add(Value, std::memory_order_relaxed);
+  }
+  std::uint64_t load() const;
+
+private:
+  static constexpr size_t NrOfStripes{16};
+  static constexpr size_t CacheLineSize{64};
+  static size_t stripeIndex();
+  struct Stripe {
+    std::atomic<std::uint64_t> Value{0};
+    char Padding[CacheLineSize - sizeof(std::atomic<std::uint64_t>)]{};
+  };
+  std::array<Stripe, NrOfStripes> Stripes;
+};
+
+/// \brief Maintains the counters of a logger or a log handler.
+///
+/// The functions are thread safe and do not block. Only the number of added
+/// (Enqueued) and dropped messages use striped counters as these are updated
+/// by the threads creating log messages. The other counters are updated by
+/// the (single) thread consuming messages from the queue.
+class MetricsRecorder {
+public:
+  void enqueued(std::uint64_t NrOfMessages = 1) {
+    EnqueuedCounter.add(NrOfMessages);
+  }
+  void dropped(std::uint64_t NrOfMessages = 1) {
+    DroppedCounter.add(NrOfMessages);
+  }
+  void dequeued(std::uint64_t NrOfMessages = 1) {
+    DequeuedCounter.fetch_add(NrOfMessages, std::memory_order_relaxed);
+  }
+  void discarded(std::uint64_t NrOfMessages = 1) {
+    DiscardedCounter.fetch_add(NrOfMessages, std::memory_order_relaxed);
+  }
+  void bytesWritten(std::uint64_t Bytes) {
+    BytesCounter.fetch_add(Bytes, std::memory_order_relaxed);
+  }
+  void reconnected() {
+    ReconnectCounter.fetch_add(1, std::memory_order_relaxed);
+  }
+  /// \brief Update the queue high-water mark.
+  void queueDepth(std::uint64_t Depth);
+  /// \brief Calculate the queue depth from the enqueued and dequeued counters
+  /// and update the high-water mark with it.
+  /// \note Relatively expensive, call it once per batch of messages.
+  /// \param[in] Held Dequeued messages that are still waiting to be passed
+  /// on. Added to the calculated depth.
+  void updateQueueDepth(std::uint64_t Held = 0);
+  /// \brief Add a measurement to the latency histogram.
+  void latency(std::chrono::nanoseconds Latency);
+  /// \brief Add the time from the creation of a message to now to the
+  /// latency histogram.
+  ///
+  /// Uses the steady clock (LogMessage::MonotonicTimestamp) so that the
+  /// latencies are not affected by adjustments of the system clock.
+  /// \param[in] Created The creation time of the message. Messages without
+  /// one (zero) are not counted.
+  /// \param[in] Now The current time.
+  void latencySince(std::chrono::steady_clock::time_point Created,
+                    std::chrono::steady_clock::time_point Now) {
+    if (Created.time_since_epoch().count() == 0) {
+      return;
+    }
+    latency(std::chrono::duration_cast<std::chrono::nanoseconds>(Now -
+                                                                   Created));
+  }
+  MetricsSnapshot snapshot() const;
+
+private:
+  StripedCounter EnqueuedCounter;
+  StripedCounter DroppedCounter;
+  std::atomic<std::uint64_t> DequeuedCounter{0};
+  std::atomic<std::uint64_t> DiscardedCounter{0};
+  std::atomic<std::uint64_t> BytesCounter{0};
+  std::atomic<std::uint64_t> ReconnectCounter{0};
+  std::atomic<std::uint64_t> HighWaterMark{0};
+  std::array<std::atomic<std::uint64_t>, LatencyHistogramBuckets>
+      LatencyCounters{};
+};
+
+} // namespace Log
@@ -0,0 +1,45 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief A minimal version of std::span from C++20.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace minimal {
+template <class T> class span {
+public:
+  using element_type = T;
+  using iterator = T *;
+
+  constexpr span() = default;
+  constexpr span(T *Data, std::size_t Size) : Data(Data), Size(Size) {}
+  template <class U, class Alloc>
+  span(std::vector<U, Alloc> &Container)
+      : Data(Container.data()), Size(Container.size()) {}
+  template <class U, class Alloc>
+  span(const std::vector<U, Alloc> &Container)
+      : Data(Container.data()), Size(Container.size()) {}
+
+  constexpr T *data() const { return Data; }
+  constexpr std::size_t size() const { return Size; }
+  constexpr bool empty() const { return Size == 0; }
+  constexpr T &operator[](std::size_t Index) const { return Data[Index]; }
+  constexpr iterator begin() const { return Data; }
+  constexpr iterator end() const { return Data + Size; }
+  constexpr span first(std::size_t Count) const { return {Data, Count}; }
+  constexpr span subspan(std::size_t Offset) const {
+    return {Data + Offset, Size - Offset};
+  }
+
+private:
+  T *Data{nullptr};
+  std::size_t Size{0};
+};
+} // namespace minimal
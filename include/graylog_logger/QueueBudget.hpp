@@ -0,0 +1,117 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Byte and message count limits of the queues of the library.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "graylog_logger/MemoryBudget.hpp"
+#include <atomic>
+#include <ciso646>
+#include <cstddef>
+
+namespace Log {
+
+/// \brief Keeps track of the number of messages and bytes in a queue and
+/// enforces limits on them.
+///
+/// Every message is accounted for when it is queued (tryAcquire()) and when
+/// it is taken from the queue (release()). The counters are updated with
+/// atomic operations only, concurrent callers might therefore occasionally
+/// be rejected even though only one of them would have exceeded the limit.
+/// The bytes are also drawn from a MemoryBudget shared with other queues.
+class QueueBudget {
+public:
+  /// \param[in] MaxBytes The maximum number of bytes in the queue. Zero for
+  /// no limit.
+  /// \param[in] MaxMessages The maximum number of messages in the queue. Zero
+  /// for no limit.
+  /// \param[in] Shared The budget shared with other queues.
+  QueueBudget(size_t MaxBytes, size_t MaxMessages,
+              MemoryBudget &Shared = MemoryBudget::global())
+      : MaxBytes(MaxBytes), MaxMessages(MaxMessages), Shared(Shared) {}
+  /// \brief Returns the bytes of the messages that are still queued to the
+  /// shared budget.
+  ~QueueBudget() { Shared.release(QueuedBytes.load()); }
+  QueueBudget(const QueueBudget &) = delete;
+  QueueBudget &operator=(const QueueBudget &) = delete;
+
+  /// \brief Account for new messages if there is room for them, both in
+  /// the queue and in the shared budget.
+  /// \note A message that is larger than the byte limit is accepted if the
+  /// queue is empty, otherwise it could never be queued.
+  /// \param[in] Level The (highest) severity level of the messages, see
+  /// MemoryBudget.
+  /// \return True if the messages can be queued.
+  bool tryAcquire(size_t Bytes, size_t NrOfMessages = 1,
+                  Severity Level = Severity::Emergency) {
+    auto PreviousBytes = QueuedBytes.fetch_add(Bytes);
+    auto PreviousMessages = QueuedMessages.fetch_add(NrOfMessages);
+    auto CMaxBytes = MaxBytes.load(std::memory_order_relaxed);
+    auto CMaxMessages = MaxMessages.load(std::memory_order_relaxed);
+    if ((CMaxBytes > 0 and PreviousBytes > 0 and
+         PreviousBytes + Bytes > CMaxBytes) or
+        (CMaxMessages > 0 and PreviousMessages + NrOfMessages > CMaxMessages)) {
+      releaseLocal(Bytes, NrOfMessages);
+      return false;
+    }
+    if (not Shared.tryAcquire(Bytes, Level)) {
+      releaseLocal(Bytes, NrOfMessages);
+      return false;
+    }
+    return true;
+  }
+  /// \brief Whether the limits of the queue (not considering the shared
+  /// budget) leave room for more messages.
+  bool hasRoomFor(size_t Bytes, size_t NrOfMessages = 1) const {
+    auto CBytes = bytes();
+    auto CMaxBytes = MaxBytes.load(std::memory_order_relaxed);
+    auto CMaxMessages = MaxMessages.load(std::memory_order_relaxed);
+    return (CMaxBytes == 0 or CBytes == 0 or CBytes + Bytes <= CMaxBytes) and
+           (CMaxMessages == 0 or messages() + NrOfMessages <= CMaxMessages);
+  }
+  /// \brief Account for new messages regardless of the limits.
+  void acquire(size_t Bytes, size_t NrOfMessages = 1) {
+    QueuedBytes += Bytes;
+    QueuedMessages += NrOfMessages;
+    Shared.acquire(Bytes);
+  }
+  /// \brief Account for messages that have been taken from the queue.
+  void release(size_t Bytes, size_t NrOfMessages = 1) {
+    releaseLocal(Bytes, NrOfMessages);
+    Shared.release(Bytes);
+  }
+  /// \brief Change the limits. Messages already queued are not affected.
+  void setLimits(size_t NewMaxBytes, size_t NewMaxMessages) {
+    MaxBytes = NewMaxBytes;
+    MaxMessages = NewMaxMessages;
+  }
+  size_t bytes() const { return QueuedBytes.load(); }
+  size_t messages() const { return QueuedMessages.load(); }
+  /// \brief A suitable number of messages to allocate room for up front in
+  /// a queue with this budget.
+  size_t initialCapacity() const {
+    auto CMaxMessages = MaxMessages.load();
+    return CMaxMessages > 0 and CMaxMessages < DefaultCapacity
+               ? CMaxMessages
+               : DefaultCapacity;
+  }
+
+private:
+  void releaseLocal(size_t Bytes, size_t NrOfMessages) {
+    QueuedBytes -= Bytes;
+    QueuedMessages -= NrOfMessages;
+  }
+  static constexpr size_t DefaultCapacity{1024};
+  std::atomic<size_t> MaxBytes;
+  std::atomic<size_t> MaxMessages;
+  MemoryBudget &Shared;
+  std::atomic<size_t> QueuedBytes{0};
+  std::atomic<size_t> QueuedMessages{0};
+};
+
+} // namespace Log
@@ -10,40 +10,38 @@
 
 #pragma once
 
-#include <concurrentqueue/concurrentqueue.h>
+#include "graylog_logger/WorkerPool.hpp"
 #include <functional>
 #include <future>
 #include <memory>
 #include <thread>
 
 namespace Log {
+/// \brief Runs work serially and in order on a worker pool.
+///
+/// Unless a pool is given or a default pool has been set with
+/// WorkerPool::setDefault(), the executor creates a pool with a single
+/// thread for its own use.
 class ThreadedExecutor {
-private:
 public:
   using WorkMessage = std::function<void()>;
-  ThreadedExecutor() : WorkerThread(ThreadFunction) {}
-  ~ThreadedExecutor() {
-    SendWork([=]() { RunThread = false; });
-    WorkerThread.join();
-  }
-  void SendWork(WorkMessage Message) { MessageQueue.enqueue(Message); }
-  size_t size_approx() { return MessageQueue.size_approx(); }
+  ThreadedExecutor();
+  /// \param[in] Pool The pool to run work on. If nullptr, the default pool is
+  /// used, see WorkerPool::setDefault().
+  explicit ThreadedExecutor(std::shared_ptr<WorkerPool> Pool);
+  /// \brief Runs the remaining work (in the calling thread if the work has not
+  /// been started) before returning.
+  ~ThreadedExecutor();
+  ThreadedExecutor(const ThreadedExecutor &) = delete;
+  ThreadedExecutor &operator=(const ThreadedExecutor &) = delete;
+  void SendWork(WorkMessage Message);
+  size_t size_approx();
+
+  class Strand;
 
 private:
-  bool RunThread{true};
-  std::function<void()> ThreadFunction{[=]() {
-    while (RunThread) {
-      WorkMessage CurrentMessage;
-      if (MessageQueue.try_dequeue(CurrentMessage)) {
-        CurrentMessage();
-      } else {
-        using namespace std::chrono_literals;
-        std::this_thread::sleep_for(5ms);
-      }
-    }
-  }};
-  moodycamel::ConcurrentQueue<WorkMessage> MessageQueue;
-  std::thread WorkerThread;
+  std::shared_ptr<WorkerPool> Pool;
+  std::shared_ptr<Strand> WorkQueue;
 };
 
 } // namespace Log
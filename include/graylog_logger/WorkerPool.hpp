@@ -0,0 +1,56 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief A pool of threads that can be shared by the executors of loggers
+/// and log handlers.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+namespace Log {
+
+/// \brief A fixed number of worker threads that run the work of any number
+/// of ThreadedExecutor instances.
+///
+/// The work sent to a single executor is still run serially and in order
+/// (strand semantics), regardless of the number of threads in the pool.
+/// \note Work running on the pool should not block waiting for other work
+/// that is run by the same pool.
+class WorkerPool {
+public:
+  /// \param[in] NrOfThreads The number of worker threads. At least one
+  /// thread is always created.
+  explicit WorkerPool(size_t NrOfThreads = 1);
+  ~WorkerPool();
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  /// \brief The number of worker threads in the pool.
+  size_t size() const;
+
+  /// \brief Set the pool used by executors that are not given a pool
+  /// explicitly.
+  ///
+  /// Only executors created after the call are affected.
+  /// \param[in] Pool The new default pool. Set to nullptr to give every
+  /// executor its own thread (the default).
+  static void setDefault(std::shared_ptr<WorkerPool> Pool);
+
+  /// \brief The pool used by executors that are not given a pool explicitly.
+  /// \return The default pool or nullptr if there is none.
+  static std::shared_ptr<WorkerPool> getDefault();
+
+  class Impl;
+
+private:
+  friend class ThreadedExecutor;
+  std::shared_ptr<Impl> Pimpl;
+};
+
+} // namespace Log
@@ -0,0 +1,104 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Performance tests of the compression of GELF messages.
+///
+/// The bytes_per_second counter gives the CPU cost per MB of uncompressed
+/// GELF data and the Ratio/SavedPercent counters the corresponding savings in
+/// bandwidth.
+///
+//===----------------------------------------------------------------------===//
+
+#include "Compressor.hpp"
+#include "GelfMessage.hpp"
+#include <benchmark/benchmark.h>
+
+#ifdef WITH_ZLIB
+
+namespace {
+std::vector<std::string> createGelfMessages(size_t NrOfMessages) {
+  std::vector<std::string> Result;
+  Log::LogMessage Message;
+  Message.Host = "some-host.example.com";
+  Message.ProcessName = "some_process";
+  Message.ProcessId = 4242;
+  Message.ThreadId = "0x7f3a9c001700";
+  Message.addField("facility", std::string("detector_readout"));
+  for (size_t i = 0; i < NrOfMessages; ++i) {
+    Message.Timestamp = std::chrono::system_clock::now();
+    Message.SeverityLevel = Log::Severity(i % 8);
+    Message.MessageString = "Processed event batch " + std::to_string(i) +
+                            " with " + std::to_string(i * 37 % 1000) +
+                            " events.";
+    Message.addField("batch", std::int64_t(i));
+    Result.push_back(Log::logMessageToGelf(Message));
+  }
+  return Result;
+}
+
+void setCompressionCounters(benchmark::State &state, size_t InputBytes,
+                            size_t OutputBytes) {
+  state.SetBytesProcessed(std::int64_t(InputBytes));
+  state.counters["Ratio"] = double(InputBytes) / double(OutputBytes);
+  state.counters["SavedPercent"] =
+      100.0 * (1.0 - double(OutputBytes) / double(InputBytes));
+}
+} // namespace
+
+/// Every message compressed on its own, as done for UDP datagrams.
+static void BM_CompressMessages(benchmark::State &state) {
+  auto Messages = createGelfMessages(1000);
+  Log::Compressor UsedCompressor(Log::Compression(state.range(0)),
+                                 int(state.range(1)));
+  std::vector<char> Output;
+  size_t InputBytes{0};
+  size_t OutputBytes{0};
+  size_t i{0};
+  for (auto _ : state) {
+    auto &CMessage = Messages[i++ % Messages.size()];
+    UsedCompressor.compress(CMessage.data(), CMessage.size(), Output);
+    InputBytes += CMessage.size();
+    OutputBytes += Output.size();
+  }
+  setCompressionCounters(state, InputBytes, OutputBytes);
+}
+BENCHMARK(BM_CompressMessages)
+    ->Args({int(Log::Compression::Zlib), 1})
+    ->Args({int(Log::Compression::Zlib), 6})
+    ->Args({int(Log::Compression::Gzip), 1})
+    ->Args({int(Log::Compression::Gzip), 6});
+
+/// Batches of messages added to a continuous stream, as done for compressed
+/// TCP connections.
+static void BM_CompressStream(benchmark::State &state) {
+  auto Messages = createGelfMessages(1000);
+  auto BatchSize = size_t(state.range(1));
+  std::vector<char> Batch;
+  Log::Compressor UsedCompressor(Log::Compression::Zlib, int(state.range(0)));
+  std::vector<char> Output;
+  size_t InputBytes{0};
+  size_t OutputBytes{0};
+  size_t i{0};
+  for (auto _ : state) {
+    Batch.clear();
+    for (size_t j = 0; j < BatchSize; ++j) {
+      auto &CMessage = Messages[i++ % Messages.size()];
+      Batch.insert(Batch.end(), CMessage.begin(), CMessage.end());
+      Batch.push_back('\0');
+    }
+    Output.clear();
+    UsedCompressor.compressAndFlush(Batch.data(), Batch.size(), Output);
+    InputBytes += Batch.size();
+    OutputBytes += Output.size();
+  }
+  setCompressionCounters(state, InputBytes, OutputBytes);
+}
+BENCHMARK(BM_CompressStream)
+    ->Args({1, 1})
+    ->Args({1, 32})
+    ->Args({6, 1})
+    ->Args({6, 32});
+
+#endif
@@ -9,17 +9,19 @@
 
 #pragma once
 
+#include <graylog_logger/AsyncSink.hpp>
 #include <graylog_logger/LogUtil.hpp>
-#include <graylog_logger/ThreadedExecutor.hpp>
 
-class DummyLogHandler : public Log::BaseLogHandler {
+class DummyWriter {
 public:
-  DummyLogHandler() = default;
-  void addMessage(const Log::LogMessage &Message) override;
-  bool emptyQueue() override { return true; }
-  size_t queueSize() override { return 0; }
-  bool flush(std::chrono::system_clock::duration) override { return true; }
+  size_t write(minimal::span<const Log::LogMessage> Messages,
+               const Log::MessageFormatter &Formatter);
+  void flush() {}
+};
 
-private:
-  Log::ThreadedExecutor Executor;
-};
\ No newline at end of file
+class DummyLogHandler : public Log::AsyncSink<DummyWriter> {
+public:
+  explicit DummyLogHandler(
+      const Log::AsyncSinkSettings &Settings = Log::AsyncSinkSettings())
+      : AsyncSink(Settings) {}
+};
@@ -0,0 +1,47 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Throughput of the file log handler.
+///
+/// Messages are queued and written to a file. The argument is the IoBackend
+/// (0: std::ofstream, 1: io_uring).
+///
+//===----------------------------------------------------------------------===//
+
+#include "graylog_logger/FileInterface.hpp"
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+static void BM_FileInterfaceThroughput(benchmark::State &state) {
+  const std::string FileName{"file_performance_test.log"};
+  const auto Backend = static_cast<Log::IoBackend>(state.range(0));
+  if (Log::IoBackend::IoUring == Backend and not Log::IoUringAvailable()) {
+    state.SkipWithError("io_uring is not available.");
+    return;
+  }
+  const size_t MessagesPerIteration{10000};
+  Log::LogMessage Message;
+  Message.MessageString = std::string(200, 'x');
+  {
+    Log::AsyncSinkSettings Settings;
+    Settings.MaxQueueLength = MessagesPerIteration;
+    Log::FileInterface Interface(FileName, Settings, Backend);
+    Interface.setMessageStringCreatorFunction(
+        [](const Log::LogMessage &Msg) { return Msg.MessageString; });
+    for (auto _ : state) {
+      for (size_t i = 0; i < MessagesPerIteration; ++i) {
+        Interface.addMessage(Message);
+      }
+      Interface.flush(std::chrono::seconds(10));
+    }
+    state.SetItemsProcessed(state.iterations() * MessagesPerIteration);
+    state.SetBytesProcessed(state.iterations() * MessagesPerIteration *
+                            (Message.MessageString.size() + 1));
+  }
+  std::remove(FileName.c_str());
+}
+BENCHMARK(BM_FileInterfaceThroughput)->Arg(0)->Arg(1)->UseRealTime();
@@ -0,0 +1,205 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Performance tests of the serialisation of log messages to GELF.
+///
+/// The argument is the number of additional fields of the message.
+///
+//===----------------------------------------------------------------------===//
+
+#include "GelfMessage.hpp"
+#include "JsonWriter.hpp"
+#include <benchmark/benchmark.h>
+#include <ciso646>
+#include <nlohmann/json.hpp>
+
+namespace {
+Log::LogMessage createGelfMessage(std::int64_t NrOfFields) {
+  Log::LogMessage Message;
+  Message.Host = "some-host.example.com";
+  Message.ProcessName = "some_process";
+  Message.ProcessId = 4242;
+  Message.ThreadId = "0x7f3a9c001700";
+  Message.SeverityLevel = Log::Severity::Warning;
+  Message.Timestamp = std::chrono::system_clock::now();
+  Message.MessageString =
+      "Processed event batch 1234 with 567 events in \"detector\".";
+  for (std::int64_t i = 0; i < NrOfFields; ++i) {
+    switch (i % 3) {
+    case 0:
+      Message.addField("string_field_" + std::to_string(i),
+                       std::string("some value"));
+      break;
+    case 1:
+      Message.addField("int_field_" + std::to_string(i), i * 1000);
+      break;
+    default:
+      Message.addField("double_field_" + std::to_string(i), i * 0.125);
+    }
+  }
+  return Message;
+}
+
+/// \brief The serialisation used before GelfWriter, through a nlohmann::json
+/// object.
+std::string nlohmannGelf(const Log::LogMessage &Message) {
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
+  nlohmann::json JsonObject;
+  JsonObject["short_message"] = Message.MessageString;
+  JsonObject["version"] = "1.1";
+  JsonObject["level"] = int(Message.SeverityLevel);
+  JsonObject["host"] = Message.Host;
+  JsonObject["timestamp"] =
+      static_cast<double>(
+          duration_cast<milliseconds>(Message.Timestamp.time_since_epoch())
+              .count()) /
+      1000;
+  JsonObject["_process_id"] = Message.ProcessId;
+  JsonObject["_process"] = Message.ProcessName;
+  JsonObject["_thread_id"] = Message.ThreadId;
+  for (auto &field : Message.AdditionalFields) {
+    if (Log::AdditionalField::Type::typeStr == field.second.FieldType) {
+      JsonObject["_" + field.first] = field.second.strVal;
+    } else if (Log::AdditionalField::Type::typeDbl == field.second.FieldType) {
+      JsonObject["_" + field.first] = field.second.dblVal;
+    } else if (Log::AdditionalField::Type::typeInt == field.second.FieldType) {
+      JsonObject["_" + field.first] = field.second.intVal;
+    }
+  }
+  return JsonObject.dump();
+}
+} // namespace
+
+static void BM_GelfNlohmann(benchmark::State &state) {
+  auto Message = createGelfMessage(state.range(0));
+  size_t Bytes{0};
+  for (auto _ : state) {
+    auto Result = nlohmannGelf(Message);
+    Bytes += Result.size();
+    benchmark::DoNotOptimize(Result);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(std::int64_t(Bytes));
+}
+BENCHMARK(BM_GelfNlohmann)->Arg(0)->Arg(4)->Arg(16);
+
+static void BM_GelfWriter(benchmark::State &state) {
+  auto Message = createGelfMessage(state.range(0));
+  size_t Bytes{0};
+  for (auto _ : state) {
+    auto Result = Log::logMessageToGelf(Message);
+    Bytes += Result.size();
+    benchmark::DoNotOptimize(Result);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(std::int64_t(Bytes));
+}
+BENCHMARK(BM_GelfWriter)->Arg(0)->Arg(4)->Arg(16);
+
+/// Serialisation into a re-used buffer, without allocations.
+static void BM_GelfWriterReusedBuffer(benchmark::State &state) {
+  auto Message = createGelfMessage(state.range(0));
+  Log::GelfWriter Writer;
+  std::string Buffer;
+  size_t Bytes{0};
+  for (auto _ : state) {
+    Buffer.clear();
+    Writer.write(Message, Buffer);
+    Bytes += Buffer.size();
+    benchmark::DoNotOptimize(Buffer);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(std::int64_t(Bytes));
+}
+BENCHMARK(BM_GelfWriterReusedBuffer)->Arg(0)->Arg(4)->Arg(16);
+
+/// The additional fields (set with Log::AddField() for example) and the
+/// other static fields of the message are serialised once and re-used.
+static void BM_GelfWriterStaticPart(benchmark::State &state) {
+  auto Message = createGelfMessage(state.range(0));
+  Message.StaticFieldsId = Log::LogMessage::createStaticFieldsId();
+  Message.NrOfStaticFields = Message.AdditionalFields.size();
+  size_t Bytes{0};
+  for (auto _ : state) {
+    auto Result = Log::logMessageToGelf(Message);
+    Bytes += Result.size();
+    benchmark::DoNotOptimize(Result);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(std::int64_t(Bytes));
+}
+BENCHMARK(BM_GelfWriterStaticPart)->Arg(0)->Arg(4)->Arg(16);
+
+namespace {
+/// \brief Message texts of different kinds, the argument of the escaping
+/// benchmarks is the index into this list.
+std::string createEscapeCorpus(std::int64_t Kind) {
+  switch (Kind) {
+  case 0: // A typical short message.
+    return "Processed event batch 1234 with 567 events in 0.25 s.";
+  case 1: { // A long message with a few line breaks, e.g. a stack trace.
+    std::string Result;
+    for (int i = 0; i < 40; ++i) {
+      Result += "  at some::name_space::SomeClass::someFunction(int, "
+                "std::string const&) (some_file.cpp:" +
+                std::to_string(100 + i) + ")\n";
+    }
+    return Result;
+  }
+  case 2: { // A long message with many characters to escape (JSON dump).
+    std::string Result;
+    for (int i = 0; i < 100; ++i) {
+      Result += "{\"key_" + std::to_string(i) +
+                R"(": "C:\\path\\file"},)" + '\t';
+    }
+    return Result;
+  }
+  default: { // Non-ASCII text.
+    std::string Result;
+    for (int i = 0; i < 100; ++i) {
+      Result += "Temperatur \xC3\xB6ver gr\xC3\xA4nsv\xC3\xA4rdet: 25 \xC2\xB0"
+                "C. ";
+    }
+    return Result;
+  }
+  }
+}
+
+void benchmarkEscaping(benchmark::State &state,
+                       Log::JsonScan::Function ScanFunction) {
+  auto Text = createEscapeCorpus(state.range(0));
+  std::string Output;
+  for (auto _ : state) {
+    Output.clear();
+    Log::appendJsonEscaped(Output, Text.data(), Text.size(), ScanFunction);
+    benchmark::DoNotOptimize(Output);
+  }
+  state.SetBytesProcessed(std::int64_t(state.iterations() * Text.size()));
+}
+} // namespace
+
+static void BM_JsonEscapeScalar(benchmark::State &state) {
+  benchmarkEscaping(state, Log::JsonScan::scalar);
+}
+BENCHMARK(BM_JsonEscapeScalar)->DenseRange(0, 3);
+
+#ifdef JSON_SCAN_SSE2
+static void BM_JsonEscapeSse2(benchmark::State &state) {
+  benchmarkEscaping(state, Log::JsonScan::sse2);
+}
+BENCHMARK(BM_JsonEscapeSse2)->DenseRange(0, 3);
+#endif
+
+#ifdef JSON_SCAN_AVX2
+static void BM_JsonEscapeAvx2(benchmark::State &state) {
+  if (not Log::JsonScan::cpuHasAvx2()) {
+    state.SkipWithError("AVX2 is not supported by the CPU.");
+    return;
+  }
+  benchmarkEscaping(state, Log::JsonScan::avx2);
+}
+BENCHMARK(BM_JsonEscapeAvx2)->DenseRange(0, 3);
+#endif
@@ -0,0 +1,139 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Throughput of the TCP connection to a Graylog server.
+///
+/// Batches of messages are queued and sent to a local server that discards
+/// them. The arguments are the maximum batch size in bytes, the linger time
+/// in microseconds and the IoBackend (0: ASIO, 1: io_uring), or the number
+/// of connections of a pool.
+///
+//===----------------------------------------------------------------------===//
+
+#include "graylog_logger/GraylogInterface.hpp"
+#include <array>
+#include <asio.hpp>
+#include <benchmark/benchmark.h>
+#include <thread>
+#include <vector>
+
+namespace {
+/// \brief Accepts connections and reads (and discards) everything sent on
+/// them, using one thread per connection.
+class DiscardServer {
+public:
+  explicit DiscardServer(size_t NrOfConnections = 1)
+      : Acceptor(Service, asio::ip::tcp::endpoint(
+                              asio::ip::address_v4::loopback(), 0)) {
+    Port = Acceptor.local_endpoint().port();
+    for (size_t i = 0; i < NrOfConnections; ++i) {
+      ServerThreads.emplace_back([this]() {
+        asio::ip::tcp::socket Socket(Service);
+        asio::error_code Error;
+        Acceptor.accept(Socket, Error);
+        std::array<char, 65536> Buffer{};
+        while (not Error) {
+          Socket.read_some(asio::buffer(Buffer), Error);
+        }
+      });
+    }
+  }
+  ~DiscardServer() {
+    Service.stop();
+    for (auto &ServerThread : ServerThreads) {
+      ServerThread.join();
+    }
+  }
+  int Port;
+
+private:
+  asio::io_service Service;
+  asio::ip::tcp::acceptor Acceptor;
+  std::vector<std::thread> ServerThreads;
+};
+} // namespace
+
+static void BM_GraylogConnectionThroughput(benchmark::State &state) {
+  DiscardServer Server;
+  const size_t MessagesPerIteration{10000};
+  const std::vector<std::string> Messages(MessagesPerIteration,
+                                          std::string(200, 'x'));
+  {
+    Log::GraylogSettings Settings;
+    Settings.MaxQueueLength = MessagesPerIteration;
+    Settings.MaxBatchBytes = size_t(state.range(0));
+    Settings.Linger = std::chrono::microseconds(state.range(1));
+    Settings.Backend = static_cast<Log::IoBackend>(state.range(2));
+    if (Log::IoBackend::IoUring == Settings.Backend and
+        not Log::IoUringAvailable()) {
+      state.SkipWithError("io_uring is not available.");
+      return;
+    }
+    Log::GraylogConnection Connection("127.0.0.1", Server.Port, Settings);
+    while (Connection.getConnectionStatus() != Log::Status::SEND_LOOP) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::uint64_t ExpectedBytes{0};
+    for (auto _ : state) {
+      Connection.sendMessages(Messages);
+      ExpectedBytes += MessagesPerIteration * (Messages.front().size() + 1);
+      while (Connection.getMetrics().BytesWritten < ExpectedBytes) {
+        std::this_thread::yield();
+      }
+    }
+    state.SetItemsProcessed(state.iterations() * MessagesPerIteration);
+    state.SetBytesProcessed(std::int64_t(ExpectedBytes));
+  }
+  // Close the connection before the server is stopped.
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+}
+BENCHMARK(BM_GraylogConnectionThroughput)
+    ->Args({3000, 0, 0})
+    ->Args({65536, 0, 0})
+    ->Args({65536, 1000, 0})
+    ->Args({3000, 0, 1})
+    ->Args({65536, 0, 1})
+    ->Args({65536, 1000, 1})
+    ->UseRealTime();
+
+static void BM_GraylogConnectionPoolThroughput(benchmark::State &state) {
+  const auto NrOfConnections = size_t(state.range(0));
+  DiscardServer Server(NrOfConnections);
+  const size_t MessagesPerIteration{10000};
+  const size_t MessagesPerBatch{100};
+  const std::vector<std::string> Messages(MessagesPerBatch,
+                                          std::string(200, 'x'));
+  {
+    Log::GraylogSettings Settings;
+    Settings.MaxQueueLength = MessagesPerIteration;
+    Settings.NrOfConnections = NrOfConnections;
+    Settings.Balancing = Log::PoolBalancing::LeastOutstandingBytes;
+    Log::GraylogConnection Connection("127.0.0.1", Server.Port, Settings);
+    while (Connection.getConnectionStatus() != Log::Status::SEND_LOOP) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // Wait for all the connections of the pool.
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::uint64_t ExpectedBytes{0};
+    for (auto _ : state) {
+      // Batches are distributed over the connections.
+      for (size_t i = 0; i < MessagesPerIteration / MessagesPerBatch; ++i) {
+        Connection.sendMessages(Messages);
+      }
+      ExpectedBytes += MessagesPerIteration * (Messages.front().size() + 1);
+      while (Connection.getMetrics().BytesWritten < ExpectedBytes) {
+        std::this_thread::yield();
+      }
+    }
+    state.SetItemsProcessed(state.iterations() * MessagesPerIteration);
+    state.SetBytesProcessed(std::int64_t(ExpectedBytes));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+}
+BENCHMARK(BM_GraylogConnectionPoolThroughput)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->UseRealTime();
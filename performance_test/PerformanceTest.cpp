@@ -11,6 +11,7 @@
 #include <benchmark/benchmark.h>
 #include <fmt/format.h>
 #include <graylog_logger/LoggingBase.hpp>
+#include <graylog_logger/WorkerPool.hpp>
 #include <random>
 
 static void BM_LogMessageGenerationOnly(benchmark::State &state) {
@@ -33,6 +34,22 @@ static void BM_LogMessageGenerationWithDummySink(benchmark::State &state) {
 }
 BENCHMARK(BM_LogMessageGenerationWithDummySink);
 
+static void
+BM_LogMessageGenerationWithSharedWorkerPool(benchmark::State &state) {
+  auto Pool = std::make_shared<Log::WorkerPool>(1);
+  Log::LoggingBase Logger(Pool);
+  Log::AsyncSinkSettings Settings;
+  Settings.Pool = Pool;
+  for (int i = 0; i < 4; ++i) {
+    Logger.addLogHandler(std::make_shared<DummyLogHandler>(Settings));
+  }
+  for (auto _ : state) {
+    Logger.log(Log::Severity::Error, "Some message.");
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogMessageGenerationWithSharedWorkerPool);
+
 static void BM_LogMessageGenerationWithFmtFormatting(benchmark::State &state) {
   Log::LoggingBase Logger;
   auto Handler = std::make_shared<DummyLogHandler>();
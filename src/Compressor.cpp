@@ -0,0 +1,86 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Implementation of the zlib/gzip compressor.
+///
+//===----------------------------------------------------------------------===//
+
+#include "Compressor.hpp"
+
+#ifdef WITH_ZLIB
+#include <stdexcept>
+
+namespace Log {
+
+namespace {
+int windowBits(Compression Format) {
+  const int MaxWindowBits{15};
+  const int GzipHeader{16};
+  if (Compression::Gzip == Format) {
+    return MaxWindowBits + GzipHeader;
+  }
+  return MaxWindowBits;
+}
+} // namespace
+
+Compressor::Compressor(Compression Format, int Level) {
+  const int MemoryLevel{8};
+  if (Z_OK != deflateInit2(&Stream, Level, Z_DEFLATED, windowBits(Format),
+                           MemoryLevel, Z_DEFAULT_STRATEGY)) {
+    throw std::runtime_error("Unable to initialise zlib stream.");
+  }
+}
+
+Compressor::~Compressor() { deflateEnd(&Stream); }
+
+void Compressor::reset() { deflateReset(&Stream); }
+
+void Compressor::compress(const char *Data, size_t Size,
+                          std::vector<char> &Output) {
+  deflateReset(&Stream);
+  Output.resize(deflateBound(&Stream, static_cast<uLong>(Size)));
+  Stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(Data));
+  Stream.avail_in = static_cast<uInt>(Size);
+  Stream.next_out = reinterpret_cast<Bytef *>(Output.data());
+  Stream.avail_out = static_cast<uInt>(Output.size());
+  deflate(&Stream, Z_FINISH);
+  Output.resize(Output.size() - Stream.avail_out);
+}
+
+void Compressor::compressAndFlush(const char *Data, size_t Size,
+                                  std::vector<char> &Output) {
+  deflateToStream(Data, Size, Output, Z_SYNC_FLUSH);
+}
+
+void Compressor::addToStream(const char *Data, size_t Size,
+                             std::vector<char> &Output) {
+  deflateToStream(Data, Size, Output, Z_NO_FLUSH);
+}
+
+void Compressor::deflateToStream(const char *Data, size_t Size,
+                                 std::vector<char> &Output, int FlushMode) {
+  // Room for the compressed data and the sync flush marker.
+  const size_t FlushMargin{16};
+  auto OutputStart = Output.size();
+  Output.resize(OutputStart + deflateBound(&Stream, static_cast<uLong>(Size)) +
+                FlushMargin);
+  Stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(Data));
+  Stream.avail_in = static_cast<uInt>(Size);
+  Stream.next_out = reinterpret_cast<Bytef *>(Output.data() + OutputStart);
+  Stream.avail_out = static_cast<uInt>(Output.size() - OutputStart);
+  deflate(&Stream, FlushMode);
+  while (Stream.avail_out == 0) {
+    // Should not happen, but make sure that all output has been flushed.
+    auto UsedSize = Output.size();
+    Output.resize(UsedSize * 2);
+    Stream.next_out = reinterpret_cast<Bytef *>(Output.data() + UsedSize);
+    Stream.avail_out = static_cast<uInt>(Output.size() - UsedSize);
+    deflate(&Stream, FlushMode);
+  }
+  Output.resize(Output.size() - Stream.avail_out);
+}
+
+} // namespace Log
+#endif
@@ -0,0 +1,66 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief A re-usable zlib/gzip compressor.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "graylog_logger/Compression.hpp"
+#include "graylog_logger/LibConfig.hpp"
+#include <vector>
+
+#ifdef WITH_ZLIB
+#include <zlib.h>
+
+namespace Log {
+
+/// \brief Wraps a zlib deflate stream. The stream (and its buffers) are
+/// re-used for all messages in order to avoid allocations.
+/// \note Not thread safe. Intended to be used by the thread of a connection.
+class Compressor {
+public:
+  /// \param[in] Format Compression::Zlib or Compression::Gzip.
+  /// \param[in] Level The zlib compression level, 0 (none) to 9 (best) or -1
+  /// for the zlib default.
+  /// \throws std::runtime_error If the zlib stream can not be initialised.
+  Compressor(Compression Format, int Level);
+  ~Compressor();
+  Compressor(const Compressor &) = delete;
+  Compressor &operator=(const Compressor &) = delete;
+
+  /// \brief Compress a complete message into a stream of its own.
+  /// \param[in] Data The data to compress.
+  /// \param[in] Size The number of bytes to compress.
+  /// \param[out] Output Replaced by the compressed data.
+  void compress(const char *Data, size_t Size, std::vector<char> &Output);
+
+  /// \brief Add data to a continuous stream and flush it such that all data
+  /// added so far can be decompressed by the receiver.
+  /// \param[in] Data The data to compress.
+  /// \param[in] Size The number of bytes to compress.
+  /// \param[out] Output The compressed data is appended to this vector.
+  void compressAndFlush(const char *Data, size_t Size,
+                        std::vector<char> &Output);
+
+  /// \brief Add data to a continuous stream without flushing it. The output
+  /// of zlib might be held back until the next call to compressAndFlush().
+  /// \param[in] Data The data to compress.
+  /// \param[in] Size The number of bytes to compress.
+  /// \param[out] Output The compressed data is appended to this vector.
+  void addToStream(const char *Data, size_t Size, std::vector<char> &Output);
+
+  /// \brief Start a new stream, e.g. after re-connecting.
+  void reset();
+
+private:
+  void deflateToStream(const char *Data, size_t Size,
+                       std::vector<char> &Output, int FlushMode);
+  z_stream Stream{};
+};
+
+} // namespace Log
+#endif
@@ -22,26 +22,22 @@ std::string ConsoleStringCreator(const LogMessage &Message) {
          Message.MessageString;
 }
 
-ConsoleInterface::ConsoleInterface() {
-  BaseLogHandler::setMessageStringCreatorFunction(ConsoleStringCreator);
-}
-void ConsoleInterface::addMessage(const LogMessage &Message) {
-  Executor.SendWork(
-      [=]() { std::cout << BaseLogHandler::MessageParser(Message) << "\n"; });
-}
-
-bool ConsoleInterface::flush(std::chrono::system_clock::duration TimeOut) {
-  auto WorkDone = std::make_shared<std::promise<void>>();
-  auto WorkDoneFuture = WorkDone->get_future();
-  Executor.SendWork([=, WorkDone{std::move(WorkDone)}]() {
-    std::cout.flush();
-    WorkDone->set_value();
-  });
-  return std::future_status::ready == WorkDoneFuture.wait_for(TimeOut);
+size_t ConsoleWriter::write(minimal::span<const LogMessage> Messages,
+                            const MessageFormatter &Formatter) {
+  OutputBuffer.clear();
+  for (auto &CMessage : Messages) {
+    OutputBuffer += Formatter(CMessage);
+    OutputBuffer += '\n';
+  }
+  std::cout << OutputBuffer;
+  return OutputBuffer.size();
 }
 
-bool ConsoleInterface::emptyQueue() { return Executor.size_approx() == 0; }
+void ConsoleWriter::flush() { std::cout.flush(); }
 
-size_t ConsoleInterface::queueSize() { return Executor.size_approx(); }
+ConsoleInterface::ConsoleInterface(const AsyncSinkSettings &Settings)
+    : AsyncSink(Settings) {
+  BaseLogHandler::setMessageStringCreatorFunction(ConsoleStringCreator);
+}
 
 } // namespace Log
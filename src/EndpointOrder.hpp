@@ -0,0 +1,38 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Orders the addresses of a server by preference.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "graylog_logger/AddressPreference.hpp"
+#include <algorithm>
+#include <ciso646>
+#include <vector>
+
+namespace Log {
+
+/// \brief Sort the (TCP or UDP) endpoints of a server by address family.
+///
+/// The order of the resolver is kept within each address family.
+/// \param[in, out] Endpoints The endpoints in the order of the resolver.
+/// \param[in] Preference The address family to try first.
+template <typename Endpoint>
+void orderEndpoints(std::vector<Endpoint> &Endpoints,
+                    AddressPreference Preference) {
+  if (AddressPreference::ResolverOrder == Preference) {
+    return;
+  }
+  const bool IPv6First{AddressPreference::IPv6First == Preference};
+  std::stable_sort(Endpoints.begin(), Endpoints.end(),
+                   [IPv6First](const Endpoint &A, const Endpoint &B) {
+                     return (A.address().is_v6() == IPv6First) and
+                            (B.address().is_v6() != IPv6First);
+                   });
+}
+
+} // namespace Log
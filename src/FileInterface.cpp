@@ -8,43 +8,88 @@
 //===----------------------------------------------------------------------===//
 
 #include "graylog_logger/FileInterface.hpp"
+#include "IoUringFile.hpp"
 #include "graylog_logger/Log.hpp"
 #include <ciso646>
 #include <fstream>
 
 namespace Log {
 
-FileInterface::FileInterface(std::string const &Name,
-                             const size_t MaxQueueLength)
-    : BaseLogHandler(), FileStream(Name, std::ios::app) {
-  if (FileStream.is_open() and FileStream.good()) {
-    Log::Msg(Severity::Info, "Started logging to log file: \"" + Name + "\"");
-  } else {
-    Log::Msg(Severity::Error,
-             "Unable to open log file for logging: \"" + Name + "\"");
+FileWriter::FileWriter(std::string const &Name, IoBackend Backend) {
+  if (IoBackend::IoUring == Backend and IoUringAvailable()) {
+    UringFile = std::make_unique<IoUringFile>(Name);
+    if (UringFile->isOpen()) {
+      return;
+    }
+    UringFile.reset();
   }
+  FileStream.open(Name, std::ios::app);
 }
 
-void FileInterface::addMessage(const LogMessage &Message) {
-  Executor.SendWork([=]() {
-    if (FileStream.good() and FileStream.is_open()) {
-      FileStream << BaseLogHandler::messageToString(Message) << std::endl;
+FileWriter::~FileWriter() = default;
+
+size_t FileWriter::write(minimal::span<const LogMessage> Messages,
+                         const MessageFormatter &Formatter) {
+  if (not isOpen()) {
+    return 0;
+  }
+  if (UringFile != nullptr) {
+    // The messages are copied into the registered buffers and written in
+    // the background.
+    size_t Size{0};
+    const char Delimiter{'\n'};
+    for (auto &CMessage : Messages) {
+      auto Line = Formatter(CMessage);
+      UringFile->append(Line.data(), Line.size());
+      UringFile->append(&Delimiter, 1);
+      Size += Line.size() + 1;
     }
-  });
+    UringFile->submit();
+    return Size;
+  }
+  OutputBuffer.clear();
+  for (auto &CMessage : Messages) {
+    OutputBuffer += Formatter(CMessage);
+    OutputBuffer += '\n';
+  }
+  FileStream.write(OutputBuffer.data(), OutputBuffer.size());
+  FileStream.flush();
+  return OutputBuffer.size();
+}
+
+void FileWriter::flush() {
+  if (UringFile != nullptr) {
+    UringFile->flush();
+    return;
+  }
+  FileStream.flush();
 }
 
-bool FileInterface::flush(std::chrono::system_clock::duration TimeOut) {
-  auto WorkDone = std::make_shared<std::promise<void>>();
-  auto WorkDoneFuture = WorkDone->get_future();
-  Executor.SendWork([=, WorkDone{std::move(WorkDone)}]() {
-    FileStream.flush();
-    WorkDone->set_value();
-  });
-  return std::future_status::ready == WorkDoneFuture.wait_for(TimeOut);
+bool FileWriter::isOpen() const {
+  if (UringFile != nullptr) {
+    return UringFile->isOpen();
+  }
+  return FileStream.is_open() and FileStream.good();
 }
 
-bool FileInterface::emptyQueue() { return Executor.size_approx() == 0; }
+FileInterface::FileInterface(std::string const &Name,
+                             const size_t MaxQueueLength)
+    : FileInterface(Name, [MaxQueueLength]() {
+        AsyncSinkSettings Settings;
+        Settings.MaxQueueLength = MaxQueueLength;
+        return Settings;
+      }()) {}
 
-size_t FileInterface::queueSize() { return Executor.size_approx(); }
+FileInterface::FileInterface(std::string const &Name,
+                             const AsyncSinkSettings &Settings,
+                             IoBackend Backend)
+    : AsyncSink(Settings, Name, Backend) {
+  if (Writer.isOpen()) {
+    Log::Msg(Severity::Info, "Started logging to log file: \"" + Name + "\"");
+  } else {
+    Log::Msg(Severity::Error,
+             "Unable to open log file for logging: \"" + Name + "\"");
+  }
+}
 
 } // namespace Log
@@ -0,0 +1,249 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Conversion of log messages to GELF.
+///
+//===----------------------------------------------------------------------===//
+
+#include "GelfMessage.hpp"
+#include "JsonWriter.hpp"
+#include <algorithm>
+#include <array>
+#include <ciso646>
+
+namespace Log {
+
+namespace {
+/// \brief The names of the standard fields that are written with an
+/// underscore prefix, in sorted order.
+const std::array<std::string, 5> UnderscoreFields{
+    {"monotonic_ns", "process", "process_id", "sequence", "thread_id"}};
+
+/// \brief Whether an additional field replaces one of the standard fields
+/// that are written as part of the static prefix.
+bool replacesStaticStandardField(const std::string &Name) {
+  return Name == "process" or Name == "process_id";
+}
+
+/// \brief Whether the optional standard fields are enabled in the format.
+bool isEnabled(const std::string &Name, const GelfFormat &Format) {
+  if (Name == "monotonic_ns") {
+    return Format.MonotonicTime;
+  }
+  if (Name == "sequence") {
+    return Format.SequenceNumber;
+  }
+  return true;
+}
+
+void appendStandardField(const std::string &Name, const LogMessage &Message,
+                         std::string &Output) {
+  if (Name == "process") {
+    appendJsonString(Output, Message.ProcessName);
+  } else if (Name == "process_id") {
+    appendJsonInteger(Output, Message.ProcessId);
+  } else if (Name == "thread_id") {
+    appendJsonString(Output, Message.ThreadId);
+  } else if (Name == "monotonic_ns") {
+    appendJsonInteger(
+        Output, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    Message.MonotonicTimestamp.time_since_epoch())
+                    .count());
+  } else {
+    appendJsonInteger(Output, std::int64_t(Message.SequenceNumber));
+  }
+}
+
+double timestampInSeconds(const system_time &Timestamp,
+                          TimestampPrecision Precision) {
+  using std::chrono::duration_cast;
+  auto SinceEpoch = Timestamp.time_since_epoch();
+  if (TimestampPrecision::Seconds == Precision) {
+    return static_cast<double>(
+        duration_cast<std::chrono::seconds>(SinceEpoch).count());
+  }
+  if (TimestampPrecision::Milliseconds == Precision) {
+    return static_cast<double>(
+               duration_cast<std::chrono::milliseconds>(SinceEpoch).count()) /
+           1e3;
+  }
+  return static_cast<double>(
+             duration_cast<std::chrono::microseconds>(SinceEpoch).count()) /
+         1e6;
+}
+} // namespace
+
+const std::array<std::string, GelfWriter::NrOfDynamicFields>
+    GelfWriter::DynamicFields{{"monotonic_ns", "sequence", "thread_id"}};
+
+void GelfWriter::writeKey(const std::string &Name, std::string &Output) {
+  if (not FirstKey) {
+    Output.push_back(',');
+  }
+  FirstKey = false;
+  Output.append("\"_", 2);
+  appendJsonEscaped(Output, Name.data(), Name.size());
+  Output.append("\":", 2);
+}
+
+void GelfWriter::writeField(const FieldPair &Field, std::string &Output) {
+  writeKey(Field.first, Output);
+  if (AdditionalField::Type::typeStr == Field.second.FieldType) {
+    appendJsonString(Output, Field.second.strVal);
+  } else if (AdditionalField::Type::typeDbl == Field.second.FieldType) {
+    appendJsonDouble(Output, Field.second.dblVal);
+  } else if (AdditionalField::Type::typeInt == Field.second.FieldType) {
+    appendJsonInteger(Output, Field.second.intVal);
+  } else {
+    Output.append("null", 4);
+  }
+}
+
+void GelfWriter::writeSorted(const LogMessage &Message,
+                             const GelfFormat &Format, std::string &Output) {
+  // Keys are written in the (byte-wise) sorted order of a JSON object. If
+  // there are several additional fields with the same name, the last one is
+  // used.
+  SortedFields.clear();
+  for (auto &Field : Message.AdditionalFields) {
+    SortedFields.push_back(&Field);
+  }
+  std::stable_sort(
+      SortedFields.begin(), SortedFields.end(),
+      [](auto &LHS, auto &RHS) { return LHS->first < RHS->first; });
+  auto LastOfName = std::unique(
+      SortedFields.rbegin(), SortedFields.rend(),
+      [](auto &LHS, auto &RHS) { return LHS->first == RHS->first; });
+  SortedFields.erase(SortedFields.begin(), LastOfName.base());
+
+  FirstKey = true;
+  Output.push_back('{');
+  // The names of the additional fields are prefixed with an underscore and
+  // are thus sorted before the standard fields without one. An additional
+  // field replaces a standard field with the same name.
+  auto NextField = SortedFields.begin();
+  for (auto &Name : UnderscoreFields) {
+    if (not isEnabled(Name, Format)) {
+      continue;
+    }
+    while (NextField != SortedFields.end() and (*NextField)->first < Name) {
+      writeField(**NextField++, Output);
+    }
+    if (NextField != SortedFields.end() and (*NextField)->first == Name) {
+      writeField(**NextField++, Output);
+      continue;
+    }
+    writeKey(Name, Output);
+    appendStandardField(Name, Message, Output);
+  }
+  while (NextField != SortedFields.end()) {
+    writeField(**NextField++, Output);
+  }
+  Output.append(",\"host\":", 8);
+  appendJsonString(Output, Message.Host);
+  Output.append(",\"level\":", 9);
+  appendJsonInteger(Output, int(Message.SeverityLevel));
+  Output.append(",\"short_message\":", 17);
+  appendJsonString(Output, Message.MessageString);
+  Output.append(",\"timestamp\":", 13);
+  appendJsonDouble(Output,
+                   timestampInSeconds(Message.Timestamp, Format.Precision));
+  Output.append(",\"version\":\"1.1\"}", 17);
+}
+
+void GelfWriter::write(const LogMessage &Message, std::string &Output,
+                       const GelfFormat &Format) {
+  if (Message.StaticFieldsId == 0 or
+      Message.NrOfStaticFields > Message.AdditionalFields.size()) {
+    writeSorted(Message, Format, Output);
+    return;
+  }
+  for (auto i = Message.NrOfStaticFields; i < Message.AdditionalFields.size();
+       ++i) {
+    if (replacesStaticStandardField(Message.AdditionalFields[i].first)) {
+      writeSorted(Message, Format, Output);
+      return;
+    }
+  }
+  writeWithPrefix(Message, Format, Output);
+}
+
+void GelfWriter::updatePrefix(const LogMessage &Message) {
+  Prefix = "{\"version\":\"1.1\",\"host\":";
+  appendJsonString(Prefix, Message.Host);
+  FirstKey = false;
+  auto StaticFieldsBegin = Message.AdditionalFields.begin();
+  auto StaticFieldsEnd = StaticFieldsBegin + Message.NrOfStaticFields;
+  auto isStaticField = [&](const std::string &Name) {
+    return std::any_of(StaticFieldsBegin, StaticFieldsEnd,
+                       [&Name](auto &Field) { return Field.first == Name; });
+  };
+  if (not isStaticField("process")) {
+    writeKey("process", Prefix);
+    appendJsonString(Prefix, Message.ProcessName);
+  }
+  if (not isStaticField("process_id")) {
+    writeKey("process_id", Prefix);
+    appendJsonInteger(Prefix, Message.ProcessId);
+  }
+  for (size_t i = 0; i < DynamicFields.size(); ++i) {
+    PrefixReplaces[i] = isStaticField(DynamicFields[i]);
+  }
+  for (auto Field = StaticFieldsBegin; Field != StaticFieldsEnd; ++Field) {
+    writeField(*Field, Prefix);
+  }
+  PrefixId = Message.StaticFieldsId;
+}
+
+void GelfWriter::writeWithPrefix(const LogMessage &Message,
+                                 const GelfFormat &Format,
+                                 std::string &Output) {
+  if (Message.StaticFieldsId != PrefixId) {
+    updatePrefix(Message);
+  }
+  Output.append(Prefix);
+  Output.append(",\"level\":", 9);
+  appendJsonInteger(Output, int(Message.SeverityLevel));
+  Output.append(",\"short_message\":", 17);
+  appendJsonString(Output, Message.MessageString);
+  Output.append(",\"timestamp\":", 13);
+  appendJsonDouble(Output,
+                   timestampInSeconds(Message.Timestamp, Format.Precision));
+  FirstKey = false;
+  std::array<bool, NrOfDynamicFields> WriteField;
+  for (size_t i = 0; i < DynamicFields.size(); ++i) {
+    WriteField[i] = isEnabled(DynamicFields[i], Format) and
+                    not PrefixReplaces[i];
+  }
+  for (auto i = Message.NrOfStaticFields; i < Message.AdditionalFields.size();
+       ++i) {
+    auto &Field = Message.AdditionalFields[i];
+    for (size_t j = 0; j < DynamicFields.size(); ++j) {
+      WriteField[j] = WriteField[j] and Field.first != DynamicFields[j];
+    }
+    writeField(Field, Output);
+  }
+  for (size_t i = 0; i < DynamicFields.size(); ++i) {
+    if (WriteField[i]) {
+      writeKey(DynamicFields[i], Output);
+      appendStandardField(DynamicFields[i], Message, Output);
+    }
+  }
+  Output.push_back('}');
+}
+
+std::string logMessageToGelf(const LogMessage &Message,
+                             const GelfFormat &Format) {
+  thread_local GelfWriter Writer;
+  std::string Result;
+  // Room for the standard fields and some additional fields without
+  // re-allocating.
+  const size_t ExpectedOverhead{256};
+  Result.reserve(Message.MessageString.size() + ExpectedOverhead);
+  Writer.write(Message, Result, Format);
+  return Result;
+}
+
+} // namespace Log
@@ -0,0 +1,69 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Conversion of log messages to GELF (Graylog Extended Log Format).
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "graylog_logger/GelfFormat.hpp"
+#include "graylog_logger/LogUtil.hpp"
+#include <array>
+#include <string>
+#include <vector>
+
+namespace Log {
+
+/// \brief Serialises log messages to GELF JSON objects.
+///
+/// The JSON is written directly to the output string. For messages with a
+/// static part (see LogMessage::StaticFieldsId), the serialised static
+/// fields are kept and re-used for all messages with the same static part.
+/// Other messages are written with the keys in sorted order, identical to
+/// building a nlohmann::json object of the message and calling dump() on it.
+/// \note Keeps buffers between messages. Not thread safe.
+class GelfWriter {
+public:
+  /// \brief Serialise a log message.
+  /// \param[in] Message The log message to serialise.
+  /// \param[out] Output The GELF message is appended to this string.
+  /// \param[in] Format Options for the contents of the GELF message.
+  void write(const LogMessage &Message, std::string &Output,
+             const GelfFormat &Format = GelfFormat());
+
+private:
+  using FieldPair = std::pair<std::string, AdditionalField>;
+  void writeSorted(const LogMessage &Message, const GelfFormat &Format,
+                   std::string &Output);
+  void writeWithPrefix(const LogMessage &Message, const GelfFormat &Format,
+                       std::string &Output);
+  void updatePrefix(const LogMessage &Message);
+  void writeKey(const std::string &Name, std::string &Output);
+  void writeField(const FieldPair &Field, std::string &Output);
+  std::vector<const FieldPair *> SortedFields;
+  bool FirstKey{true};
+  /// \brief The serialised static part of the messages with the static
+  /// fields identifier PrefixId.
+  std::string Prefix;
+  std::uint64_t PrefixId{0};
+  /// \brief The standard fields that are not part of the static prefix.
+  /// They are written after the dynamic additional fields.
+  static constexpr size_t NrOfDynamicFields{3};
+  static const std::array<std::string, NrOfDynamicFields> DynamicFields;
+  /// \brief Static additional fields replace these standard fields.
+  std::array<bool, NrOfDynamicFields> PrefixReplaces{};
+};
+
+/// \brief Serialise a log message to a GELF JSON object.
+///
+/// Used by all the Graylog transports (TCP, UDP etc.).
+/// \param[in] Message The log message to serialise.
+/// \param[in] Format Options for the contents of the GELF message.
+/// \return The GELF message as a JSON string.
+std::string logMessageToGelf(const LogMessage &Message,
+                             const GelfFormat &Format = GelfFormat());
+
+} // namespace Log
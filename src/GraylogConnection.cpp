@@ -9,26 +9,80 @@
 //===----------------------------------------------------------------------===//
 
 #include "GraylogConnection.hpp"
+#include "EndpointOrder.hpp"
+#include <algorithm>
 #include <chrono>
 #include <ciso646>
 #include <utility>
+#ifdef WITH_IO_URING
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#endif
 
 namespace Log {
 
 using std::chrono_literals::operator""ms;
 using std::chrono_literals::operator""s;
 
+constexpr size_t GraylogConnection::Impl::MessagesPerDequeue;
+constexpr size_t GraylogConnection::Impl::MinBatchTarget;
+constexpr size_t GraylogConnection::Impl::RingBuffers;
+
+std::chrono::milliseconds reconnectDelayLimit(size_t NrOfFailures,
+                                              std::chrono::milliseconds Min,
+                                              std::chrono::milliseconds Max) {
+  if (NrOfFailures == 0) {
+    return 0ms;
+  }
+  auto Limit = std::min(Min, Max);
+  for (size_t i = 1; i < NrOfFailures and Limit < Max; ++i) {
+    Limit = std::min(Limit * 2, Max);
+  }
+  return Limit;
+}
+
+void HandlerGate::close() {
+  std::unique_lock<std::mutex> Lock(Mutex);
+  Closed = true;
+  HandlerLeft.wait(Lock, [this]() { return NrOfRunning == 0; });
+}
+
+bool HandlerGate::enter() {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  if (Closed) {
+    return false;
+  }
+  ++NrOfRunning;
+  return true;
+}
+
+void HandlerGate::leave() {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  if (--NrOfRunning == 0 and Closed) {
+    HandlerLeft.notify_all();
+  }
+}
+
 struct QueryResult {
-  explicit QueryResult(asio::ip::tcp::resolver::iterator &&Endpoints)
-      : EndpointIterator(std::move(Endpoints)) {
-    while (EndpointIterator != asio::ip::tcp::resolver::iterator()) {
-      auto CEndpoint = *EndpointIterator;
-      EndpointList.push_back(CEndpoint);
-      ++EndpointIterator;
+  /// \brief No endpoints, e.g. when connecting to a Unix domain socket.
+  QueryResult() = default;
+  /// \param[in] Endpoints The addresses of the server, in order of
+  /// preference.
+  /// \param[in] FirstEndpoint Index of the endpoint to try first.
+  /// \param[in] LastGood The endpoint of the last successful connection.
+  /// Tried first (instead of FirstEndpoint) if it is one of Endpoints.
+  QueryResult(std::vector<asio::ip::tcp::endpoint> Endpoints,
+              size_t FirstEndpoint, const asio::ip::tcp::endpoint &LastGood)
+      : EndpointList(std::move(Endpoints)) {
+    if (EndpointList.empty()) {
+      return;
+    }
+    auto Good = std::find(EndpointList.begin(), EndpointList.end(), LastGood);
+    if (Good == EndpointList.end()) {
+      Good = EndpointList.begin() + FirstEndpoint % EndpointList.size();
     }
-    std::sort(EndpointList.begin(), EndpointList.end(), [](auto &a, auto &b) {
-      return a.address().is_v6() < b.address().is_v6();
-    });
+    std::rotate(EndpointList.begin(), Good, EndpointList.end());
   }
   asio::ip::tcp::endpoint getNextEndpoint() {
     if (NextEndpoint < EndpointList.size()) {
@@ -36,10 +90,16 @@ struct QueryResult {
     }
     return {};
   }
+  /// \brief The endpoint returned by the last call to getNextEndpoint().
+  asio::ip::tcp::endpoint getCurrentEndpoint() const {
+    if (NextEndpoint > 0 and NextEndpoint <= EndpointList.size()) {
+      return EndpointList[NextEndpoint - 1];
+    }
+    return {};
+  }
   bool isDone() const { return NextEndpoint >= EndpointList.size(); }
-  asio::ip::tcp::resolver::iterator EndpointIterator;
   std::vector<asio::ip::tcp::endpoint> EndpointList;
-  int NextEndpoint{0};
+  size_t NextEndpoint{0};
 };
 
 void GraylogConnection::Impl::tryConnect(QueryResult AllEndpoints) {
@@ -47,168 +107,738 @@ void GraylogConnection::Impl::tryConnect(QueryResult AllEndpoints) {
   auto HandlerGlue = [this, AllEndpoints](auto &Err) {
     this->connectHandler(Err, AllEndpoints);
   };
-  Socket.async_connect(CurrentEndpoint, HandlerGlue);
+  Socket.async_connect(
+      asio::generic::stream_protocol::endpoint(CurrentEndpoint),
+      bind(HandlerGlue));
+  startDeadline(Settings.ConnectTimeout);
   setState(Status::CONNECT);
 }
 
-GraylogConnection::Impl::Impl(std::string Host, int Port, size_t MaxQueueLength)
-    : HostAddress(std::move(Host)), HostPort(std::to_string(Port)), Service(),
-      Work(std::make_unique<asio::io_service::work>(Service)), Socket(Service),
-      Resolver(Service), ReconnectTimeout(Service, 10s),
-      LogMessages(MaxQueueLength) {
-  doAddressQuery();
-  AsioThread = std::thread(&GraylogConnection::Impl::threadFunction, this);
+GraylogConnection::Impl::Impl(std::string Host, int Port,
+                              const GraylogSettings &Settings,
+                              FailoverTarget *Failover, size_t FirstEndpoint)
+    : Settings(Settings), Failover(Failover), FirstEndpoint(FirstEndpoint),
+      HostAddress(std::move(Host)), HostPort(std::to_string(Port)),
+      Budget(Settings.MaxQueueBytes, Settings.MaxQueueLength),
+      LogMessages(Budget.initialCapacity()),
+      DequeuedMessages(MessagesPerDequeue),
+      Context(Settings.Context != nullptr ? Settings.Context
+                                          : std::make_shared<IoContext>()),
+      Service(Context->context()), Strand(Service.get_executor()),
+      Gate(std::make_shared<HandlerGate>()), Socket(Service), Resolver(Service),
+      ReconnectTimeout(Service, 10s), LingerTimer(Service),
+      DeadlineTimer(Service), RefreshTimer(Service),
+      BackoffRandom(std::random_device()()) {
+#ifdef WITH_ZLIB
+  if (Compression::None != Settings.StreamCompression) {
+    StreamCompressor = std::make_unique<Compressor>(Settings.StreamCompression,
+                                                    Settings.CompressionLevel);
+  }
+#endif
+#ifdef WITH_IO_URING
+  // Compressed streams are written with ASIO, as the whole compressed batch
+  // has to be written.
+  if (IoBackend::IoUring == Settings.Backend and IoUringAvailable() and
+      Compression::None == Settings.StreamCompression) {
+    auto Writer = std::make_unique<IoUringWriter>(
+        RingBuffers, std::max<size_t>(Settings.MaxBatchBytes, MinBatchTarget));
+    auto EventFd = Writer->isOpen() ? ::dup(Writer->fd()) : -1;
+    if (EventFd >= 0) {
+      Ring = std::move(Writer);
+      RingEvents =
+          std::make_unique<asio::posix::stream_descriptor>(Service, EventFd);
+    }
+  }
+#endif
+#ifndef _WIN32
+  if (not Settings.SpoolDirectory.empty()) {
+    Spool = std::make_unique<MessageSpool>(Settings.SpoolDirectory,
+                                           Settings.SpoolSegmentSize,
+                                           Settings.SpoolMaxBytes, Metrics);
+  }
+#endif
+  asio::post(Strand, bind([this]() { this->doAddressQuery(); }));
 }
 
 void GraylogConnection::Impl::resolverHandler(
     const asio::error_code &Error,
     asio::ip::tcp::resolver::iterator EndpointIter) {
+  LookupInProgress = false;
+  auto ConnectWhenDone = WaitingForLookup;
+  WaitingForLookup = false;
   if (Error) {
-    setState(Status::ADDR_RETRY_WAIT);
-    reConnect(ReconnectDelay::LONG);
+    if (not ConnectWhenDone) {
+      // Keep using the cached addresses.
+      scheduleAddressRefresh();
+      return;
+    }
+    setState(Status::ADDR_RETRY_WAIT, Error);
+    failOver();
+    reConnect();
     return;
   }
-  QueryResult AllEndpoints(std::move(EndpointIter));
-  tryConnect(AllEndpoints);
+  std::vector<asio::ip::tcp::endpoint> Endpoints;
+  for (; EndpointIter != asio::ip::tcp::resolver::iterator(); ++EndpointIter) {
+    Endpoints.push_back(EndpointIter->endpoint());
+  }
+  orderEndpoints(Endpoints, Settings.Addresses);
+  if (Settings.AddressCacheTtl.count() > 0 and not Endpoints.empty()) {
+    CachedEndpoints = Endpoints;
+    scheduleAddressRefresh();
+  }
+  if (ConnectWhenDone) {
+    tryConnect(
+        QueryResult(std::move(Endpoints), FirstEndpoint, LastGoodEndpoint));
+  }
+}
+
+void GraylogConnection::Impl::startAddressLookup() {
+  if (LookupInProgress) {
+    return;
+  }
+  LookupInProgress = true;
+  asio::ip::tcp::resolver::query Query(HostAddress, HostPort);
+  auto HandlerGlue = [this](auto &Error, auto EndpointIter) {
+    this->resolverHandler(Error, EndpointIter);
+  };
+  Resolver.async_resolve(Query, bind(HandlerGlue));
+}
+
+void GraylogConnection::Impl::scheduleAddressRefresh() {
+  RefreshTimer.expires_after(Settings.AddressCacheTtl);
+  auto HandlerGlue = [this](auto &Error) {
+    if (not Error) {
+      this->startAddressLookup();
+    }
+  };
+  RefreshTimer.async_wait(bind(HandlerGlue));
 }
 
 void GraylogConnection::Impl::connectHandler(const asio::error_code &Error,
                                              const QueryResult &AllEndpoints) {
+  cancelDeadline();
+  auto Reason = closeReason(Error);
   if (!Error) {
+    LastGoodEndpoint = AllEndpoints.getCurrentEndpoint();
+    // The attempt counter is only reset once the connection has proven to
+    // be stable, see reConnect().
+    Connected = true;
+    ConnectedSince = std::chrono::steady_clock::now();
     setState(Status::SEND_LOOP);
+    // The part of a message written on an earlier connection was discarded
+    // by the server. Send the whole message again.
+    PendingBytes += PendingOffset;
+    OutstandingBytes.fetch_add(PendingOffset, std::memory_order_relaxed);
+    PendingOffset = 0;
+#ifdef WITH_ZLIB
+    if (StreamCompressor != nullptr) {
+      // Every connection is a new stream.
+      StreamCompressor->reset();
+    }
+#endif
     auto HandlerGlue = [this](auto &Error, auto Size) {
       this->receiveHandler(Error, Size);
     };
-    Socket.async_receive(asio::buffer(InputBuffer), HandlerGlue);
+    Socket.async_receive(asio::buffer(InputBuffer), bind(HandlerGlue));
     trySendMessage();
+    if (Failover != nullptr) {
+      Failover->connected(this);
+    }
     return;
   }
   Socket.close();
   if (AllEndpoints.isDone()) {
-    reConnect(ReconnectDelay::LONG);
+    if (not CachedEndpoints.empty()) {
+      // The addresses of the server might have changed. The next attempt
+      // uses the new addresses if the lookup has completed by then.
+      startAddressLookup();
+    }
+    failOver();
+    reConnect(Reason);
     return;
   }
   tryConnect(AllEndpoints);
 }
 
-void GraylogConnection::Impl::reConnect(ReconnectDelay Delay) {
-  auto HandlerGlue = [this](auto & /* Err */) { this->doAddressQuery(); };
-  switch (Delay) {
-  case ReconnectDelay::SHORT:
-    ReconnectTimeout.expires_after(100ms);
-    break;
-  case ReconnectDelay::LONG: // Fallthrough
-  default:
-    ReconnectTimeout.expires_after(10s);
-    break;
+asio::error_code
+GraylogConnection::Impl::closeReason(const asio::error_code &Error) {
+  auto Reason = CloseReason ? CloseReason : Error;
+  CloseReason.clear();
+  return Reason;
+}
+
+void GraylogConnection::Impl::reConnect(const asio::error_code &Error) {
+  if (Connected) {
+    Connected = false;
+    if (std::chrono::steady_clock::now() - ConnectedSince >=
+        Settings.StableConnectionTime) {
+      NrOfFailedAttempts = 0;
+    }
   }
-  ReconnectTimeout.async_wait(HandlerGlue);
-  setState(Status::ADDR_RETRY_WAIT);
+  auto HandlerGlue = [this](auto & /* Err */) { this->doAddressQuery(); };
+  // Full jitter: a random delay between zero and the exponentially growing
+  // limit. The first attempt is made immediately.
+  auto Limit = reconnectDelayLimit(NrOfFailedAttempts++,
+                                   Settings.ReconnectDelayMin,
+                                   Settings.ReconnectDelayMax);
+  std::uniform_int_distribution<std::chrono::milliseconds::rep> Delay(
+      0, Limit.count());
+  ReconnectTimeout.expires_after(
+      std::chrono::milliseconds(Delay(BackoffRandom)));
+  ReconnectTimeout.async_wait(bind(HandlerGlue));
+  Metrics.reconnected();
+  setState(Status::ADDR_RETRY_WAIT, Error);
 }
 
 void GraylogConnection::Impl::receiveHandler(const asio::error_code &Error,
                                              std::size_t /* BytesReceived */) {
   if (Error) {
-    Socket.close();
-    reConnect(ReconnectDelay::SHORT);
+    closeSocket();
+    failOver();
+    reConnect(closeReason(Error));
     return;
   }
   auto HandlerGlue = [this](auto &Error, auto Size) {
     this->receiveHandler(Error, Size);
   };
-  Socket.async_receive(asio::buffer(InputBuffer), HandlerGlue);
+  Socket.async_receive(asio::buffer(InputBuffer), bind(HandlerGlue));
+}
+
+void GraylogConnection::Impl::notifySender() {
+  // Only the first producer after the ASIO thread has started dequeueing
+  // messages has to wake it up.
+  if (not SenderNotified.load() and not SenderNotified.exchange(true)) {
+    asio::post(Strand, bind([this]() { this->trySendMessage(); }));
+  }
+}
+
+void GraylogConnection::Impl::retryFailover() {
+  asio::post(Strand, bind([this]() { this->trySendMessage(); }));
 }
 
 void GraylogConnection::Impl::trySendMessage() {
-  if (not Socket.is_open()) {
+  if (WriteInProgress) {
+    // Called again when the write has finished.
     return;
   }
-  auto HandlerGlue = [this](auto &Err, auto Size) {
-    this->sentMessageHandler(Err, Size);
-  };
-  if (MessageBuffer.size() > MessageAdditionLimit) {
-    asio::async_write(Socket, asio::buffer(MessageBuffer), HandlerGlue);
-    return;
-  }
-  std::function<std::string(void)> NewMessageFunc;
-  using namespace std::chrono_literals;
-  if (LogMessages.wait_dequeue_timed(NewMessageFunc, 10ms)) {
-    auto NewMessage = NewMessageFunc();
-    if (NewMessage.empty()) {
-      if (!MessageBuffer.empty()) {
-        asio::async_write(Socket, asio::buffer(MessageBuffer), HandlerGlue);
-      } else {
-        Service.post([this]() { this->trySendMessage(); });
+  if (not Socket.is_open() or Status::SEND_LOOP != State.get()) {
+    // Called again when connected.
+    failOver();
+    return;
+  }
+  SenderNotified = false;
+  dequeueMessages();
+  if (PendingBytes == 0) {
+    return;
+  }
+  if (PendingBytes < BatchTarget and not FlushRequested and
+      Settings.Linger.count() > 0) {
+    // Wait for more messages in order to write a larger batch.
+    if (not Lingering) {
+      Lingering = true;
+      LingerTimer.expires_after(Settings.Linger);
+      auto HandlerGlue = [this](auto &Error) { this->lingerHandler(Error); };
+      LingerTimer.async_wait(bind(HandlerGlue));
+    }
+    return;
+  }
+  writePendingMessages();
+}
+
+void GraylogConnection::Impl::lingerHandler(const asio::error_code &Error) {
+  if (Error or not Lingering) {
+    return;
+  }
+  Lingering = false;
+  // Not enough messages arrived in time, hold back fewer messages.
+  shrinkBatchTarget();
+  if (not Socket.is_open() or Status::SEND_LOOP != State.get() or
+      WriteInProgress) {
+    return;
+  }
+  SenderNotified = false;
+  dequeueMessages();
+  if (PendingBytes > 0) {
+    writePendingMessages();
+  }
+}
+
+void GraylogConnection::Impl::growBatchTarget() {
+  BatchTarget = std::min(std::max(BatchTarget * 2, MinBatchTarget),
+                         Settings.MaxBatchBytes);
+}
+
+void GraylogConnection::Impl::shrinkBatchTarget() {
+  BatchTarget /= 2;
+  if (BatchTarget < MinBatchTarget) {
+    BatchTarget = 0;
+  }
+}
+
+bool GraylogConnection::Impl::spoolActive() const {
+#ifndef _WIN32
+  return Spool != nullptr and Spool->active();
+#else
+  return false;
+#endif
+}
+
+void GraylogConnection::Impl::spoolMessage(const std::string &Msg) {
+#ifndef _WIN32
+  if (Spool != nullptr and Spool->append(Msg)) {
+    OutstandingBytes.fetch_add(Msg.size() + 1, std::memory_order_relaxed);
+    Metrics.enqueued();
+    notifySender();
+    return;
+  }
+#endif
+  Metrics.dropped();
+}
+
+size_t GraylogConnection::Impl::queueSize() {
+#ifndef _WIN32
+  if (Spool != nullptr) {
+    return Budget.messages() + Spool->size();
+  }
+#endif
+  return Budget.messages();
+}
+
+bool GraylogConnection::Impl::readSpool() {
+#ifndef _WIN32
+  if (not spoolActive()) {
+    return false;
+  }
+  // The spooled messages are newer than the queued ones, they are only read
+  // when the queue is empty.
+  auto NrOfMessages =
+      Spool->read(PendingMessages, maxPendingBytes() - PendingBytes);
+  for (auto i = PendingMessages.size() - NrOfMessages;
+       i < PendingMessages.size(); ++i) {
+    PendingBytes += PendingMessages[i].size() + 1;
+  }
+  Metrics.dequeued(NrOfMessages);
+  if (not Spool->active()) {
+    for (auto &Flush : DeferredFlushes) {
+      Flush.Message();
+      FlushRequested = true;
+    }
+    DeferredFlushes.clear();
+  }
+  return NrOfMessages > 0;
+#else
+  return false;
+#endif
+}
+
+size_t GraylogConnection::Impl::maxPendingBytes() const {
+#ifdef WITH_IO_URING
+  if (Ring != nullptr) {
+    return RingBuffers * Ring->bufferSize();
+  }
+#endif
+  return Settings.MaxBatchBytes;
+}
+
+void GraylogConnection::Impl::dequeueMessages() {
+  while (PendingBytes < maxPendingBytes()) {
+    auto NrOfMessages = LogMessages.try_dequeue_bulk(DequeuedMessages.begin(),
+                                                     DequeuedMessages.size());
+    if (NrOfMessages == 0) {
+      if (readSpool()) {
+        continue;
       }
       return;
     }
-    std::copy(NewMessage.begin(), NewMessage.end(),
-              std::back_inserter(MessageBuffer));
-    MessageBuffer.push_back('\0');
-    asio::async_write(Socket, asio::buffer(MessageBuffer), HandlerGlue);
-  } else if (!MessageBuffer.empty()) {
-    asio::async_write(Socket, asio::buffer(MessageBuffer), HandlerGlue);
-  } else {
-    Service.post([this]() { this->trySendMessage(); });
+    Metrics.updateQueueDepth();
+    auto Now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < NrOfMessages; ++i) {
+      if (DequeuedMessages[i].Size == 0 and spoolActive()) {
+        // Completed once the older, spooled, messages have been read.
+        DeferredFlushes.push_back(std::move(DequeuedMessages[i]));
+        DequeuedMessages[i] = QueuedMessage();
+        continue;
+      }
+      Budget.release(DequeuedMessages[i].Size,
+                     DequeuedMessages[i].Size > 0 ? 1 : 0);
+      auto NewMessage = DequeuedMessages[i].Message();
+      auto Queued = DequeuedMessages[i].Queued;
+      DequeuedMessages[i] = QueuedMessage();
+      if (NewMessage.empty()) {
+        FlushRequested = true;
+        continue;
+      }
+      Metrics.dequeued();
+      Metrics.latency(Now - Queued);
+      PendingBytes += NewMessage.size() + 1;
+      PendingMessages.push_back(std::move(NewMessage));
+    }
   }
 }
 
 void GraylogConnection::Impl::sentMessageHandler(const asio::error_code &Error,
                                                  std::size_t BytesSent) {
-  if (BytesSent == MessageBuffer.size()) {
-    MessageBuffer.clear();
-  } else if (BytesSent > 0) {
-    std::vector<char> TempVector;
-    std::copy(MessageBuffer.begin() + BytesSent, MessageBuffer.end(),
-              std::back_inserter(TempVector));
-    MessageBuffer = TempVector;
+  cancelDeadline();
+  WriteInProgress = false;
+  Metrics.bytesWritten(BytesSent);
+#ifdef WITH_ZLIB
+  if (StreamCompressor != nullptr) {
+    // It is not known how much of the uncompressed data a partial write
+    // corresponds to. On failure, all pending messages are sent again in a
+    // new stream on the next connection.
+    if (Error) {
+      if (not CloseReason) {
+        CloseReason = Error;
+      }
+      Socket.close();
+      failOver();
+      return;
+    }
+    consumePendingBytes(PendingBytes);
+    sendNextBatch();
+    return;
   }
+#endif
+  consumePendingBytes(BytesSent);
   if (Error) {
+    if (not CloseReason) {
+      CloseReason = Error;
+    }
     Socket.close();
+    failOver();
     return;
   }
+  sendNextBatch();
+}
+
+void GraylogConnection::Impl::sendNextBatch() {
+  SenderNotified = false;
+  dequeueMessages();
+  // At least as much data was queued during the write as was written, the
+  // connection is not keeping up. Aim for larger writes.
+  if (PendingBytes > 0 and PendingBytes >= WriteSize) {
+    growBatchTarget();
+  }
   trySendMessage();
 }
 
-void GraylogConnection::Impl::doAddressQuery() {
-  setState(Status::ADDR_LOOKUP);
-  asio::ip::tcp::resolver::query Query(HostAddress, HostPort);
-  auto HandlerGlue = [this](auto &Error, auto EndpointIter) {
-    this->resolverHandler(Error, EndpointIter);
+void GraylogConnection::Impl::consumePendingBytes(size_t Bytes) {
+  PendingBytes -= Bytes;
+  OutstandingBytes.fetch_sub(Bytes, std::memory_order_relaxed);
+  while (Bytes > 0) {
+    auto RemainingOfFirst = PendingMessages.front().size() + 1 - PendingOffset;
+    if (Bytes < RemainingOfFirst) {
+      PendingOffset += Bytes;
+      return;
+    }
+    Bytes -= RemainingOfFirst;
+    PendingMessages.pop_front();
+    PendingOffset = 0;
+  }
+}
+
+void GraylogConnection::Impl::failOver() {
+  if (Failover == nullptr or WriteInProgress or
+      not Failover->canTakeOver(this)) {
+    return;
+  }
+  if (Lingering) {
+    Lingering = false;
+    LingerTimer.cancel();
+  }
+  FlushRequested = false;
+  std::vector<QueuedMessage> Messages;
+  auto Now = std::chrono::steady_clock::now();
+  // A partially written message is sent again in full.
+  for (auto &Message : PendingMessages) {
+    auto Size = Message.size() + 1;
+    Messages.push_back({[Message{std::move(Message)}]() mutable {
+                          return std::move(Message);
+                        },
+                        Now, Size});
+  }
+  PendingMessages.clear();
+  OutstandingBytes.fetch_sub(PendingBytes, std::memory_order_relaxed);
+  PendingBytes = 0;
+  PendingOffset = 0;
+  SenderNotified = false;
+  while (true) {
+    auto NrOfMessages = LogMessages.try_dequeue_bulk(DequeuedMessages.begin(),
+                                                     DequeuedMessages.size());
+    if (NrOfMessages == 0) {
+      break;
+    }
+    for (size_t i = 0; i < NrOfMessages; ++i) {
+      auto &CMessage = DequeuedMessages[i];
+      if (CMessage.Size > 0) {
+        Metrics.dequeued();
+        Budget.release(CMessage.Size);
+        OutstandingBytes.fetch_sub(CMessage.Size, std::memory_order_relaxed);
+      }
+      Messages.push_back(std::move(CMessage));
+      CMessage = QueuedMessage();
+    }
+  }
+  if (not Messages.empty()) {
+    Failover->takeOver(this, std::move(Messages));
+  }
+}
+
+void GraylogConnection::Impl::takeOver(std::vector<QueuedMessage> Messages) {
+  size_t NrOfMessages{0};
+  size_t Size{0};
+  for (auto &CMessage : Messages) {
+    NrOfMessages += CMessage.Size > 0 ? 1 : 0;
+    Size += CMessage.Size;
+  }
+  // Not limited by the budget, the messages have already been accepted.
+  Budget.acquire(Size, NrOfMessages);
+  LogMessages.enqueue_bulk(std::make_move_iterator(Messages.begin()),
+                           Messages.size());
+  OutstandingBytes.fetch_add(Size, std::memory_order_relaxed);
+  Metrics.enqueued(NrOfMessages);
+  // After counting them as enqueued, see Pool::getMetrics().
+  TakenOver.fetch_add(NrOfMessages, std::memory_order_relaxed);
+  notifySender();
+}
+
+void GraylogConnection::Impl::writePendingMessages() {
+  if (Lingering) {
+    Lingering = false;
+    LingerTimer.cancel();
+  }
+  FlushRequested = false;
+  WriteSize = PendingBytes;
+  // The messages are written in place, a partially written message is
+  // continued at its offset.
+  WriteBuffers.clear();
+  auto Offset = PendingOffset;
+  for (auto &Message : PendingMessages) {
+    if (Offset < Message.size()) {
+      WriteBuffers.emplace_back(Message.data() + Offset,
+                                Message.size() - Offset);
+    }
+    WriteBuffers.emplace_back(&Settings.MessageDelimiter, 1);
+    Offset = 0;
+  }
+  auto HandlerGlue = [this](auto &Err, auto Size) {
+    this->sentMessageHandler(Err, Size);
   };
-  Resolver.async_resolve(Query, HandlerGlue);
+#ifdef WITH_ZLIB
+  if (StreamCompressor != nullptr) {
+    CompressedBuffer.clear();
+    for (auto &Buffer : WriteBuffers) {
+      StreamCompressor->addToStream(static_cast<const char *>(Buffer.data()),
+                                    Buffer.size(), CompressedBuffer);
+    }
+    StreamCompressor->compressAndFlush(nullptr, 0, CompressedBuffer);
+    asio::async_write(Socket, asio::buffer(CompressedBuffer),
+                      bind(HandlerGlue));
+    startDeadline(Settings.WriteTimeout);
+    WriteInProgress = true;
+    return;
+  }
+#endif
+#ifdef WITH_IO_URING
+  if (Ring != nullptr and submitRingWrite()) {
+    startDeadline(Settings.WriteTimeout);
+    WriteInProgress = true;
+    return;
+  }
+#endif
+  asio::async_write(Socket, WriteBuffers, bind(HandlerGlue));
+  startDeadline(Settings.WriteTimeout);
+  WriteInProgress = true;
 }
 
-GraylogConnection::Impl::~Impl() {
-  Service.stop();
-  AsioThread.join();
-  try {
-    Socket.close();
-  } catch (asio::system_error &) {
-    // Do nothing
+#ifdef WITH_IO_URING
+bool GraylogConnection::Impl::submitRingWrite() {
+  // The writes of the previous call have completed, all buffers are free.
+  auto Buffer = Ring->nextBuffer();
+  size_t Size{0};
+  for (auto &CBuffer : WriteBuffers) {
+    auto Data = static_cast<const char *>(CBuffer.data());
+    auto Remaining = CBuffer.size();
+    while (Remaining > 0 and Buffer != nullptr) {
+      auto Part = std::min(Remaining, Ring->bufferSize() - Size);
+      std::memcpy(Buffer + Size, Data, Part);
+      Size += Part;
+      Data += Part;
+      Remaining -= Part;
+      if (Size == Ring->bufferSize()) {
+        Ring->queueWrite(Socket.native_handle(), Size);
+        Buffer = Ring->nextBuffer();
+        Size = 0;
+      }
+    }
+    if (Buffer == nullptr) {
+      // The rest is written once these writes have completed.
+      break;
+    }
+  }
+  if (Size > 0) {
+    Ring->queueWrite(Socket.native_handle(), Size);
+  }
+  if (Ring->submit() < 0) {
+    // Fall back to ASIO.
+    RingEvents.reset();
+    Ring.reset();
+    return false;
+  }
+  RingBytesWritten = 0;
+  RingError = 0;
+  RingWriteShort = false;
+  waitForRingWrite();
+  return true;
+}
+
+void GraylogConnection::Impl::waitForRingWrite() {
+  if (Ring == nullptr or Ring->inFlight() == 0) {
+    return;
+  }
+  auto TakeCompletions = [this]() {
+    IoUringWriter::Result Done{0, 0};
+    while (Ring->completion(Done)) {
+      if (Done.Written >= 0) {
+        RingBytesWritten += size_t(Done.Written);
+        RingWriteShort |= size_t(Done.Written) < Done.Size;
+      } else if (RingError == 0 and
+                 not(-ECANCELED == Done.Written and RingWriteShort)) {
+        // Writes after a failed or short one are cancelled by the kernel.
+        RingError = -Done.Written;
+      }
+    }
+    return Ring->inFlight() == 0;
+  };
+  if (not TakeCompletions()) {
+    if (not RingWaitPending) {
+      RingWaitPending = true;
+      auto HandlerGlue = [this](auto &Error) {
+        RingWaitPending = false;
+        if (not Error) {
+          this->waitForRingWrite();
+        }
+      };
+      RingEvents->async_wait(asio::posix::stream_descriptor::wait_read,
+                             bind(HandlerGlue));
+    }
+    // A completion that arrived before the wait was started does not end
+    // the wait.
+    if (not TakeCompletions()) {
+      return;
+    }
+  }
+  auto BytesSent = RingBytesWritten;
+  if (EAGAIN == RingError) {
+    // Older kernels do not wait for non-blocking sockets to become
+    // writable. The rest is written once the socket is writable.
+    auto HandlerGlue = [this, BytesSent](auto &Error) {
+      this->sentMessageHandler(Error, BytesSent);
+    };
+    Socket.async_wait(asio::socket_base::wait_write, bind(HandlerGlue));
+    return;
+  }
+  asio::error_code Error;
+  if (RingError != 0) {
+    Error = asio::error_code(RingError, asio::error::get_system_category());
+  }
+  // Posted rather than called in order not to recurse into the next write.
+  asio::post(Strand, bind([this, Error, BytesSent]() {
+               this->sentMessageHandler(Error, BytesSent);
+             }));
+}
+#endif
+
+void GraylogConnection::Impl::startDeadline(std::chrono::milliseconds TimeOut) {
+  ++DeadlineId;
+  if (TimeOut.count() <= 0) {
+    return;
   }
+  DeadlineTimer.expires_after(TimeOut);
+  auto HandlerGlue = [this, Id = DeadlineId](auto &Error) {
+    if (not Error and Id == this->DeadlineId) {
+      this->deadlineHandler();
+    }
+  };
+  DeadlineTimer.async_wait(bind(HandlerGlue));
+}
+
+void GraylogConnection::Impl::cancelDeadline() {
+  ++DeadlineId;
+  DeadlineTimer.cancel();
 }
 
-GraylogConnection::Impl::Status
-GraylogConnection::Impl::getConnectionStatus() const {
-  return ConnectionState;
+void GraylogConnection::Impl::deadlineHandler() {
+  // The pending connect or write operation completes with an error, which
+  // is handled as usual.
+  CloseReason = asio::error::timed_out;
+  closeSocket();
 }
 
-void GraylogConnection::Impl::threadFunction() { Service.run(); }
+void GraylogConnection::Impl::closeSocket() {
+#ifdef WITH_IO_URING
+  if (Ring != nullptr) {
+    // The ring holds a reference to the socket, closing it does not abort
+    // the write.
+    Ring->cancel();
+  }
+#endif
+  asio::error_code Error;
+  Socket.close(Error);
+}
+
+void GraylogConnection::Impl::doAddressQuery() {
+#ifndef _WIN32
+  if (not Settings.UnixSocketPath.empty()) {
+    // There is no address to look up.
+    auto HandlerGlue = [this](auto &Err) {
+      this->connectHandler(Err, QueryResult());
+    };
+    Socket.async_connect(
+        asio::local::stream_protocol::endpoint(Settings.UnixSocketPath),
+        bind(HandlerGlue));
+    startDeadline(Settings.ConnectTimeout);
+    setState(Status::CONNECT);
+    return;
+  }
+#endif
+  if (not CachedEndpoints.empty()) {
+    // Kept up to date in the background, see scheduleAddressRefresh().
+    tryConnect(QueryResult(CachedEndpoints, FirstEndpoint, LastGoodEndpoint));
+    return;
+  }
+  setState(Status::ADDR_LOOKUP);
+  WaitingForLookup = true;
+  startAddressLookup();
+}
+
+void GraylogConnection::Impl::stop() { Gate->close(); }
+
+GraylogConnection::Impl::~Impl() {
+  stop();
+  // Pending operations complete with an error once the socket, the resolver
+  // and the timers have been destroyed. Their handlers do nothing.
+  asio::error_code Error;
+  Socket.close(Error);
+}
 
 void GraylogConnection::Impl::setState(
-    GraylogConnection::Impl::Status NewState) {
-  ConnectionState = NewState;
+    GraylogConnection::Impl::Status NewState, const asio::error_code &Error) {
+  State.set(NewState, Error);
 }
 
 bool GraylogConnection::Impl::flush(
     std::chrono::system_clock::duration TimeOut) {
   auto WorkDone = std::make_shared<std::promise<void>>();
   auto WorkDoneFuture = WorkDone->get_future();
-  LogMessages.try_enqueue([WorkDone = std::move(WorkDone)]() -> std::string {
+  auto FlushFunc = [WorkDone = std::move(WorkDone)]() -> std::string {
     WorkDone->set_value();
     return {};
-  });
+  };
+  // Flush requests are not limited by the maximum queue length, the queue
+  // might be full of messages that are followed by spooled ones.
+  LogMessages.enqueue({std::move(FlushFunc), std::chrono::steady_clock::now()});
+  notifySender();
   return std::future_status::ready == WorkDoneFuture.wait_for(TimeOut);
 }
 
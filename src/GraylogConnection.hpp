@@ -9,58 +9,273 @@
 
 #pragma once
 
+#include "Compressor.hpp"
+#include "IoUring.hpp"
+#include "MessageSpool.hpp"
+#include "StatusTracker.hpp"
 #include "graylog_logger/ConnectionStatus.hpp"
 #include "graylog_logger/GraylogInterface.hpp"
+#include "graylog_logger/IoContext.hpp"
+#include "graylog_logger/Metrics.hpp"
+#include "graylog_logger/QueueBudget.hpp"
 #include <array>
 #include <asio.hpp>
 #include <atomic>
-#include <concurrentqueue/blockingconcurrentqueue.h>
+#include <chrono>
+#include <ciso646>
+#include <concurrentqueue/concurrentqueue.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <functional>
+#include <iterator>
 #include <memory>
+#include <mutex>
+#include <random>
 #include <string>
-#include <thread>
+#include <utility>
+#include <vector>
 
 namespace Log {
 
 struct QueryResult;
 
-/// \todo Implement timeouts in the ASIO code in case we ever have problems with
-/// bad connections.
+/// \brief The upper limit of the random delay before a connection attempt.
+/// \param[in] NrOfFailures The number of failed attempts since the last
+/// successful connection (or since the connection was lost).
+/// \param[in] Min The limit after the first failed attempt, doubled for every
+/// further failure.
+/// \param[in] Max The maximum limit.
+/// \return Zero if NrOfFailures is zero.
+std::chrono::milliseconds reconnectDelayLimit(size_t NrOfFailures,
+                                              std::chrono::milliseconds Min,
+                                              std::chrono::milliseconds Max);
+
+/// \brief Keeps the handlers of a connection from running once the
+/// connection is being destroyed.
+///
+/// Handlers that are still queued in a shared io_context when the
+/// connection is destroyed share the ownership of the gate and do nothing
+/// once it has been closed.
+class HandlerGate {
+public:
+  /// \brief Admits a handler (unless the gate has been closed) for the
+  /// lifetime of the instance.
+  class Entry {
+  public:
+    explicit Entry(HandlerGate &Gate) : Gate(Gate), Admitted(Gate.enter()) {}
+    ~Entry() {
+      if (Admitted) {
+        Gate.leave();
+      }
+    }
+    explicit operator bool() const { return Admitted; }
+
+  private:
+    HandlerGate &Gate;
+    const bool Admitted;
+  };
+  /// \brief Wait for the admitted handlers to finish and admit no further
+  /// handlers.
+  void close();
+
+private:
+  bool enter();
+  void leave();
+  std::mutex Mutex;
+  std::condition_variable HandlerLeft;
+  size_t NrOfRunning{0};
+  bool Closed{false};
+};
 
 class GraylogConnection::Impl {
 public:
   using Status = Log::Status;
-  Impl(std::string Host, int Port, size_t MaxQueueLength);
+  /// \brief A message waiting for transmission, the time at which it was
+  /// queued and its size on the wire (zero for flush requests).
+  struct QueuedMessage {
+    std::function<std::string(void)> Message;
+    std::chrono::steady_clock::time_point Queued;
+    size_t Size{0};
+  };
+  /// \brief Takes over the messages of a connection that is not connected
+  /// to its server, see GraylogConnection::Pool.
+  class FailoverTarget {
+  public:
+    virtual ~FailoverTarget() = default;
+    /// \brief Whether another connection can take over messages from
+    /// Failed.
+    /// \note Called from the thread of the failed connection.
+    virtual bool canTakeOver(const Impl *Failed) const = 0;
+    /// \brief Pass messages of a failed connection to another connection.
+    /// \param[in] Failed The connection that the messages are taken from.
+    /// \param[in] Messages The messages (and flush requests), oldest first.
+    virtual void takeOver(const Impl *Failed,
+                          std::vector<QueuedMessage> Messages) = 0;
+    /// \brief Called when a connection has been established.
+    virtual void connected(const Impl *Connection) = 0;
+  };
+  /// \param[in] Failover Takes over the messages if the connection fails.
+  /// Can be nullptr.
+  /// \param[in] FirstEndpoint Index of the address (of the addresses that
+  /// the host name resolves to) to try first.
+  Impl(std::string Host, int Port, const GraylogSettings &Settings,
+       FailoverTarget *Failover = nullptr, size_t FirstEndpoint = 0);
   virtual ~Impl();
   virtual void sendMessage(std::string Msg) {
-    auto MsgFunc = [=]() { return Msg; };
-    LogMessages.try_enqueue(MsgFunc);
+    auto Size = Msg.size() + 1;
+    if (spoolActive() or not Budget.tryAcquire(Size)) {
+      spoolMessage(Msg);
+      return;
+    }
+    LogMessages.enqueue(
+        {[Msg{std::move(Msg)}]() mutable { return std::move(Msg); },
+         std::chrono::steady_clock::now(), Size});
+    OutstandingBytes.fetch_add(Size, std::memory_order_relaxed);
+    Metrics.enqueued();
+    notifySender();
   };
-  Status getConnectionStatus() const;
+  virtual void sendMessages(std::vector<std::string> Msgs) {
+    size_t NrOfQueued{0};
+    size_t QueuedSize{0};
+    if (not spoolActive()) {
+      for (auto &Msg : Msgs) {
+        QueuedSize += Msg.size() + 1;
+      }
+      NrOfQueued = Msgs.size();
+      if (not Budget.tryAcquire(QueuedSize, NrOfQueued)) {
+        // Not enough room for all of them, queue as many as possible.
+        NrOfQueued = 0;
+        QueuedSize = 0;
+        while (NrOfQueued < Msgs.size() and
+               Budget.tryAcquire(Msgs[NrOfQueued].size() + 1)) {
+          QueuedSize += Msgs[NrOfQueued].size() + 1;
+          ++NrOfQueued;
+        }
+      }
+    }
+    if (NrOfQueued > 0) {
+      std::vector<QueuedMessage> MsgFuncs;
+      MsgFuncs.reserve(NrOfQueued);
+      auto Now = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < NrOfQueued; ++i) {
+        auto Size = Msgs[i].size() + 1;
+        MsgFuncs.push_back({[Msg{std::move(Msgs[i])}]() mutable
+                            -> std::string { return std::move(Msg); },
+                            Now, Size});
+      }
+      LogMessages.enqueue_bulk(std::make_move_iterator(MsgFuncs.begin()),
+                               MsgFuncs.size());
+      OutstandingBytes.fetch_add(QueuedSize, std::memory_order_relaxed);
+      Metrics.enqueued(NrOfQueued);
+      notifySender();
+    }
+    for (size_t i = NrOfQueued; i < Msgs.size(); ++i) {
+      spoolMessage(Msgs[i]);
+    }
+  }
+  Status getConnectionStatus() const { return State.get(); }
+  StatusTracker &statusTracker() { return State; }
   virtual bool flush(std::chrono::system_clock::duration TimeOut);
-  virtual size_t queueSize() { return LogMessages.size_approx(); }
+  /// \brief The number of queued and spooled messages.
+  virtual size_t queueSize();
+  MetricsSnapshot getMetrics() const { return Metrics.snapshot(); }
+  /// \brief Count messages that were discarded before they were queued.
+  void dropped(size_t NrOfMessages) { Metrics.dropped(NrOfMessages); }
+  /// \brief Bytes (including null bytes) of the queued messages and of the
+  /// dequeued messages that have not been written yet.
+  size_t outstandingBytes() const {
+    return OutstandingBytes.load(std::memory_order_relaxed);
+  }
+  /// \brief Queue messages taken over from a failed connection. Not limited
+  /// by the maximum queue length.
+  void takeOver(std::vector<QueuedMessage> Messages);
+  /// \brief The number of messages taken over from other connections.
+  ///
+  /// These are counted as dequeued by the failed connection and as enqueued
+  /// by this one, i.e. twice in the sum of the counters of the pool.
+  std::uint64_t takenOver() const {
+    return TakenOver.load(std::memory_order_relaxed);
+  }
+  /// \brief Move the messages to another connection (if there is one) if
+  /// not connected.
+  void retryFailover();
+  /// \brief Wait for the handler that is running (if any) and keep further
+  /// handlers of the connection from running. Called by the destructor.
+  void stop();
 
 protected:
-  enum class ReconnectDelay { LONG, SHORT };
+  void setState(Status NewState, const asio::error_code &Error = {});
+  void notifySender();
+  /// \brief Whether new messages have to be appended to the spool in order
+  /// to keep them in order.
+  bool spoolActive() const;
+  /// \brief Append a message that does not fit in the queue to the spool.
+  /// Counted as dropped if there is no spool (or the spool rejects it).
+  void spoolMessage(const std::string &Msg);
 
-  void threadFunction();
-  void setState(Status NewState);
+  const GraylogSettings Settings;
+  StatusTracker State;
+  FailoverTarget *const Failover;
+  const size_t FirstEndpoint;
+  std::atomic<size_t> OutstandingBytes{0};
+  std::atomic<std::uint64_t> TakenOver{0};
 
-  Status ConnectionState{Status::ADDR_LOOKUP};
-
-  std::atomic_bool closeThread{false};
-
-  std::vector<char> MessageBuffer;
+  /// \brief Dequeued messages that have not been (completely) written to the
+  /// socket yet. Every message is followed by a null byte on the wire.
+  std::deque<std::string> PendingMessages;
+  /// \brief Bytes of the first pending message that have already been
+  /// written.
+  size_t PendingOffset{0};
+  /// \brief Bytes (including null bytes) of the pending messages that remain
+  /// to be written.
+  size_t PendingBytes{0};
+  /// \brief The buffer sequence of the write in progress. Re-used between
+  /// writes.
+  std::vector<asio::const_buffer> WriteBuffers;
 
   std::string HostAddress;
   std::string HostPort;
 
-  std::thread AsioThread;
-  moodycamel::BlockingConcurrentQueue<std::function<std::string(void)>>
-      LogMessages;
+  /// \brief Limits the number and the size of the queued messages (not
+  /// counting flush requests).
+  QueueBudget Budget;
+  moodycamel::ConcurrentQueue<QueuedMessage> LogMessages;
+  /// \brief Set when the ASIO thread has been asked to look at the queue and
+  /// cleared by the ASIO thread right before it dequeues messages. Ensures
+  /// that producers only post to the ASIO thread when the thread might
+  /// otherwise miss their messages.
+  std::atomic_bool SenderNotified{false};
+  bool WriteInProgress{false};
+  /// \brief Number of bytes of the write in progress (or the last write).
+  size_t WriteSize{0};
+  /// \brief A flush request has been dequeued, write without holding back
+  /// the pending messages.
+  bool FlushRequested{false};
+  /// \brief Pending messages are held back until they add up to this number
+  /// of bytes or until the linger timer expires.
+  size_t BatchTarget{0};
+  bool Lingering{false};
+  /// \brief Messages are dequeued in bulk into this vector.
+  std::vector<QueuedMessage> DequeuedMessages;
+  MetricsRecorder Metrics;
+#ifndef _WIN32
+  /// \brief Stores the messages that do not fit in the queue, see
+  /// GraylogSettings::SpoolDirectory. Can be nullptr.
+  std::unique_ptr<MessageSpool> Spool;
+#endif
+  /// \brief Flush requests dequeued while there were messages in the spool.
+  /// Completed once the spool has been read.
+  std::vector<QueuedMessage> DeferredFlushes;
 
 private:
-  const size_t MessageAdditionLimit{3000};
+  static constexpr size_t MessagesPerDequeue{64};
+  /// \brief The smallest non-zero batch target.
+  static constexpr size_t MinBatchTarget{1024};
+  /// \brief Number of registered buffers (of MaxBatchBytes) with
+  /// IoBackend::IoUring, i.e. the maximum number of writes submitted to the
+  /// ring together.
+  static constexpr size_t RingBuffers{8};
   void resolverHandler(const asio::error_code &Error,
                        asio::ip::tcp::resolver::iterator EndpointIter);
   void connectHandler(const asio::error_code &Error,
@@ -68,19 +283,122 @@ private:
   void sentMessageHandler(const asio::error_code &Error, std::size_t BytesSent);
   void receiveHandler(const asio::error_code &Error, std::size_t BytesReceived);
   void trySendMessage();
+  void sendNextBatch();
+  void dequeueMessages();
+  /// \brief The number of pending bytes up to which messages are dequeued:
+  /// enough for one write, or for all the buffers of the ring.
+  size_t maxPendingBytes() const;
+  bool readSpool();
+  void writePendingMessages();
+  void consumePendingBytes(size_t Bytes);
+  void failOver();
+  void lingerHandler(const asio::error_code &Error);
+  void growBatchTarget();
+  void shrinkBatchTarget();
   void waitForMessage();
+  /// \brief Connect to the cached addresses of the server or look them up
+  /// first if there are none.
   void doAddressQuery();
-  void reConnect(ReconnectDelay Delay);
+  /// \brief Look up the addresses of the server unless a lookup is already
+  /// in progress.
+  void startAddressLookup();
+  /// \brief Refresh the cached addresses once they have expired.
+  void scheduleAddressRefresh();
+  /// \param[in] Error The reason for re-connecting, if any.
+  void reConnect(const asio::error_code &Error = {});
+  /// \brief The reason why the socket was closed by the connection (if it
+  /// was), otherwise Error.
+  asio::error_code closeReason(const asio::error_code &Error);
+  void startDeadline(std::chrono::milliseconds TimeOut);
+  void cancelDeadline();
+  void deadlineHandler();
+  /// \brief Close the socket, aborting the operations in progress.
+  void closeSocket();
   void tryConnect(QueryResult AllEndpoints);
+#ifdef WITH_IO_URING
+  /// \brief Copy (the start of) WriteBuffers into the registered buffers
+  /// and submit the writes to the ring with one system call.
+  /// \return False if the writes could not be submitted. The ring is then
+  /// no longer used.
+  bool submitRingWrite();
+  /// \brief Call sentMessageHandler() once all the writes submitted to the
+  /// ring have completed. Takes every completion that is available.
+  void waitForRingWrite();
+#endif
+  /// \brief Wrap a completion handler so that it runs on the strand of the
+  /// connection and only while the connection has not been stopped.
+  template <typename Handler> auto bind(Handler &&Function) {
+    return asio::bind_executor(
+        Strand, [Gate = Gate, Function = std::forward<Handler>(Function)](
+                    auto &&... Args) mutable {
+          HandlerGate::Entry Entry(*Gate);
+          if (Entry) {
+            Function(std::forward<decltype(Args)>(Args)...);
+          }
+        });
+  }
 
-  typedef std::unique_ptr<asio::io_service::work> WorkPtr;
-
+#ifdef WITH_ZLIB
+  std::unique_ptr<Compressor> StreamCompressor;
+  /// \brief The compressed pending messages while they are being written.
+  std::vector<char> CompressedBuffer;
+#endif
   std::array<std::uint8_t, 64> InputBuffer{};
-  asio::io_service Service;
-  WorkPtr Work;
-  asio::ip::tcp::socket Socket;
+  /// \brief The io_context of the connection, see GraylogSettings::Context.
+  std::shared_ptr<IoContext> Context;
+  asio::io_service &Service;
+  /// \brief Serialises the handlers of the connection if the io_context is
+  /// run by more than one thread.
+  asio::strand<asio::io_service::executor_type> Strand;
+  std::shared_ptr<HandlerGate> Gate;
+  /// \brief A TCP socket or, see GraylogSettings::UnixSocketPath, a Unix
+  /// domain stream socket.
+  asio::generic::stream_protocol::socket Socket;
   asio::ip::tcp::resolver Resolver;
   asio::system_timer ReconnectTimeout;
+  asio::steady_timer LingerTimer;
+  /// \brief Closes the socket if a connection attempt or a write takes too
+  /// long.
+  asio::steady_timer DeadlineTimer;
+  /// \brief Identifies the current deadline. Incremented when a deadline is
+  /// started or cancelled so that a handler of an earlier deadline that has
+  /// already been queued does nothing.
+  std::uint64_t DeadlineId{0};
+  /// \brief Set when the socket is closed because a write failed or did
+  /// not complete in time. Reported as the cause of the status change once
+  /// the pending operations have been aborted.
+  asio::error_code CloseReason;
+  /// \brief The addresses of the server (in order of preference) found by
+  /// the last successful lookup, see GraylogSettings::AddressCacheTtl.
+  std::vector<asio::ip::tcp::endpoint> CachedEndpoints;
+  /// \brief The address of the last successful connection. Tried first.
+  asio::ip::tcp::endpoint LastGoodEndpoint;
+  bool LookupInProgress{false};
+  /// \brief Connect once the lookup in progress has completed.
+  bool WaitingForLookup{false};
+  asio::steady_timer RefreshTimer;
+  /// \brief Failed connection attempts since the last connection that
+  /// stayed up for GraylogSettings::StableConnectionTime.
+  size_t NrOfFailedAttempts{0};
+  /// \brief Set while connected, for measuring how long the connection
+  /// has been up.
+  bool Connected{false};
+  std::chrono::steady_clock::time_point ConnectedSince;
+  std::minstd_rand BackoffRandom;
+#ifdef WITH_IO_URING
+  /// \brief Writes to the socket with IoBackend::IoUring.
+  std::unique_ptr<IoUringWriter> Ring;
+  /// \brief The file descriptor of the ring (a duplicate), for waiting for
+  /// completions in the io_context.
+  std::unique_ptr<asio::posix::stream_descriptor> RingEvents;
+  bool RingWaitPending{false};
+  /// \brief The outcome of the completed writes of those submitted
+  /// together: bytes written, the first error (an errno value) and whether
+  /// a write was short, which cancels the writes after it.
+  size_t RingBytesWritten{0};
+  int RingError{0};
+  bool RingWriteShort{false};
+#endif
 };
 
 } // namespace Log
@@ -0,0 +1,216 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Implements the pool of TCP connections to Graylog servers.
+///
+//===----------------------------------------------------------------------===//
+
+#include "GraylogConnectionPool.hpp"
+#include <algorithm>
+#include <ciso646>
+#include <future>
+#include <utility>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace Log {
+
+namespace {
+void addMetrics(MetricsSnapshot &Sum, const MetricsSnapshot &Other) {
+  Sum.Enqueued += Other.Enqueued;
+  Sum.Dequeued += Other.Dequeued;
+  Sum.Dropped += Other.Dropped;
+  Sum.Discarded += Other.Discarded;
+  // The largest queue of any of the connections.
+  Sum.QueueHighWaterMark =
+      std::max(Sum.QueueHighWaterMark, Other.QueueHighWaterMark);
+  Sum.BytesWritten += Other.BytesWritten;
+  Sum.Reconnects += Other.Reconnects;
+  for (size_t i = 0; i < Sum.Latency.size(); ++i) {
+    Sum.Latency[i] += Other.Latency[i];
+  }
+}
+} // namespace
+
+GraylogConnection::Pool::Pool(std::string Host, int Port,
+                              const GraylogSettings &Settings)
+    : Balancing(Settings.Balancing) {
+  std::vector<std::pair<std::string, int>> Servers{{std::move(Host), Port}};
+  Servers.insert(Servers.end(), Settings.AdditionalServers.begin(),
+                 Settings.AdditionalServers.end());
+  auto NrOfConnections = std::max<size_t>(Settings.NrOfConnections, 1);
+  auto ConnectionSettings = Settings;
+  ConnectionSettings.MaxQueueLength =
+      (Settings.MaxQueueLength + NrOfConnections - 1) / NrOfConnections;
+  ConnectionSettings.MaxQueueBytes =
+      (Settings.MaxQueueBytes + NrOfConnections - 1) / NrOfConnections;
+  ConnectionSettings.SpoolMaxBytes = Settings.SpoolMaxBytes / NrOfConnections;
+  FailoverTarget *Failover = NrOfConnections > 1 ? this : nullptr;
+  for (size_t i = 0; i < NrOfConnections; ++i) {
+    // Connections to the same server start with different addresses of the
+    // server (if there are several).
+    auto &Server = Servers[i % Servers.size()];
+#ifndef _WIN32
+    if (NrOfConnections > 1 and not Settings.SpoolDirectory.empty()) {
+      ::mkdir(Settings.SpoolDirectory.c_str(), 0755);
+      ConnectionSettings.SpoolDirectory =
+          Settings.SpoolDirectory + "/connection-" + std::to_string(i);
+    }
+#endif
+    Connections.push_back(std::make_unique<Impl>(Server.first, Server.second,
+                                                 ConnectionSettings, Failover,
+                                                 i / Servers.size()));
+  }
+  if (NrOfConnections > 1) {
+    for (auto &Connection : Connections) {
+      Connection->statusTracker().addCallback(
+          [this](auto &Change) { this->statusChanged(Change); });
+    }
+    // The connections might have changed their status already.
+    statusChanged({});
+  }
+  Running = true;
+}
+
+GraylogConnection::Pool::~Pool() {
+  Running = false;
+  // Stop all the threads before any connection is destroyed as they might
+  // move messages to each other.
+  for (auto &Connection : Connections) {
+    Connection->stop();
+  }
+}
+
+GraylogConnection::Impl *
+GraylogConnection::Pool::selectConnection(const Impl *Excluded) {
+  if (Connections.size() == 1) {
+    return Connections.front().get();
+  }
+  auto First = NextConnection.fetch_add(1, std::memory_order_relaxed);
+  if (PoolBalancing::LeastOutstandingBytes == Balancing) {
+    Impl *Selected{nullptr};
+    size_t SelectedBytes{0};
+    for (auto &Connection : Connections) {
+      if (Connection.get() == Excluded or not isConnected(*Connection)) {
+        continue;
+      }
+      auto Bytes = Connection->outstandingBytes();
+      if (Selected == nullptr or Bytes < SelectedBytes) {
+        Selected = Connection.get();
+        SelectedBytes = Bytes;
+      }
+    }
+    if (Selected != nullptr) {
+      return Selected;
+    }
+  } else {
+    for (size_t i = 0; i < Connections.size(); ++i) {
+      auto Candidate = Connections[(First + i) % Connections.size()].get();
+      if (Candidate != Excluded and isConnected(*Candidate)) {
+        return Candidate;
+      }
+    }
+  }
+  // None of them is connected, the messages are queued until one of the
+  // connections has been (re-)established.
+  return Connections[First % Connections.size()].get();
+}
+
+bool GraylogConnection::Pool::canTakeOver(const Impl *Failed) const {
+  if (not Running) {
+    return false;
+  }
+  return std::any_of(Connections.begin(), Connections.end(),
+                     [Failed](auto &Connection) {
+                       return Connection.get() != Failed and
+                              isConnected(*Connection);
+                     });
+}
+
+void GraylogConnection::Pool::takeOver(
+    const Impl *Failed, std::vector<Impl::QueuedMessage> Messages) {
+  selectConnection(Failed)->takeOver(std::move(Messages));
+}
+
+void GraylogConnection::Pool::connected(const Impl *Connection) {
+  if (not Running) {
+    return;
+  }
+  for (auto &Other : Connections) {
+    if (Other.get() != Connection and not isConnected(*Other)) {
+      Other->retryFailover();
+    }
+  }
+}
+
+Status GraylogConnection::Pool::getConnectionStatus() const {
+  for (auto &Connection : Connections) {
+    if (isConnected(*Connection)) {
+      return Status::SEND_LOOP;
+    }
+  }
+  return Connections.front()->getConnectionStatus();
+}
+
+StatusTracker &GraylogConnection::Pool::statusTracker() {
+  if (Connections.size() == 1) {
+    return Connections.front()->statusTracker();
+  }
+  return State;
+}
+
+void GraylogConnection::Pool::statusChanged(const StatusChange &Change) {
+  // The status is determined while holding the lock so that the last update
+  // reflects the current status of all connections.
+  std::lock_guard<std::mutex> Lock(StatusMutex);
+  State.set(getConnectionStatus(), Change.Error);
+}
+
+bool GraylogConnection::Pool::flush(
+    std::chrono::system_clock::duration TimeOut) {
+  if (Connections.size() == 1) {
+    return Connections.front()->flush(TimeOut);
+  }
+  std::vector<std::future<bool>> FlushResults;
+  for (auto &Connection : Connections) {
+    auto CConnection = Connection.get();
+    FlushResults.push_back(std::async(std::launch::async, [=]() {
+      return CConnection->flush(TimeOut);
+    }));
+  }
+  bool ReturnValue{true};
+  for (auto &CFlushResult : FlushResults) {
+    if (not CFlushResult.get()) {
+      ReturnValue = false;
+    }
+  }
+  return ReturnValue;
+}
+
+size_t GraylogConnection::Pool::queueSize() {
+  size_t Size{0};
+  for (auto &Connection : Connections) {
+    Size += Connection->queueSize();
+  }
+  return Size;
+}
+
+MetricsSnapshot GraylogConnection::Pool::getMetrics() const {
+  MetricsSnapshot Sum;
+  std::uint64_t TakenOver{0};
+  for (auto &Connection : Connections) {
+    // Read before the counters, which have then been updated for at least
+    // this number of messages.
+    TakenOver += Connection->takenOver();
+    addMetrics(Sum, Connection->getMetrics());
+  }
+  // A message that is moved to another connection is only counted once.
+  Sum.Enqueued -= TakenOver;
+  Sum.Dequeued -= TakenOver;
+  return Sum;
+}
+
+} // namespace Log
@@ -0,0 +1,89 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Header file of the pool of TCP connections to Graylog servers.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "GraylogConnection.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Log {
+
+/// \brief One or more TCP connections to one or more Graylog servers.
+///
+/// Every connection has its own queue, run on the IoContext of the settings (a
+/// thread of its own by default). New messages are passed to a connection that
+/// is connected (see GraylogSettings::Balancing) and the messages of a
+/// connection that fails are moved to the other connections.
+/// With a single connection, all calls are passed directly to it.
+class GraylogConnection::Pool : public Impl::FailoverTarget {
+public:
+  using Status = Log::Status;
+  Pool(std::string Host, int Port, const GraylogSettings &Settings);
+  ~Pool() override;
+  void sendMessage(std::string Msg) {
+    selectConnection(nullptr)->sendMessage(std::move(Msg));
+  }
+  void sendMessages(std::vector<std::string> Msgs) {
+    selectConnection(nullptr)->sendMessages(std::move(Msgs));
+  }
+  /// \brief Count discarded messages (in the metrics of the first
+  /// connection).
+  void dropped(size_t NrOfMessages) {
+    Connections.front()->dropped(NrOfMessages);
+  }
+  /// \brief Status::SEND_LOOP if any of the connections is connected,
+  /// otherwise the status of the first connection.
+  Status getConnectionStatus() const;
+  /// \brief The status changes and the time in every status of the pool as
+  /// a whole, see getConnectionStatus().
+  StatusTracker &statusTracker();
+  /// \brief Flush all the connections.
+  bool flush(std::chrono::system_clock::duration TimeOut);
+  size_t queueSize();
+  /// \brief The counters of all the connections added up.
+  /// \note Messages moved from a failed connection are counted as enqueued
+  /// and dequeued once, see Impl::takenOver(). The queue high-water mark is
+  /// the largest one of the connections.
+  MetricsSnapshot getMetrics() const;
+
+  bool canTakeOver(const Impl *Failed) const override;
+  void takeOver(const Impl *Failed,
+                std::vector<Impl::QueuedMessage> Messages) override;
+  /// \brief Have the connections that are not connected move their
+  /// messages to the new connection.
+  void connected(const Impl *Connection) override;
+
+private:
+  /// \brief Select the connection for new messages.
+  /// \param[in] Excluded Connection that should not be selected if any
+  /// other connection is connected. Can be nullptr.
+  Impl *selectConnection(const Impl *Excluded);
+  static bool isConnected(const Impl &Connection) {
+    return Status::SEND_LOOP == Connection.getConnectionStatus();
+  }
+  /// \brief Update the status of the pool when the status of one of the
+  /// connections has changed.
+  void statusChanged(const StatusChange &Change);
+  const PoolBalancing Balancing;
+  std::vector<std::unique_ptr<Impl>> Connections;
+  std::atomic<size_t> NextConnection{0};
+  /// \brief Set when all the connections have been created. Messages are
+  /// only moved between connections while it is set.
+  std::atomic_bool Running{false};
+  /// \brief Only used with more than one connection.
+  StatusTracker State;
+  std::mutex StatusMutex;
+};
+
+} // namespace Log
@@ -0,0 +1,453 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Implements the networking code for sending GELF messages to a
+/// graylog server over HTTP.
+///
+//===----------------------------------------------------------------------===//
+
+#include "GraylogHttpConnection.hpp"
+#include "EndpointOrder.hpp"
+#include "GraylogConnection.hpp"
+#include <algorithm>
+#include <cctype>
+#include <ciso646>
+#include <cstdlib>
+#include <iterator>
+#include <sstream>
+#include <utility>
+
+namespace Log {
+
+using std::chrono_literals::operator""ms;
+
+namespace {
+std::string toLower(std::string Text) {
+  std::transform(Text.begin(), Text.end(), Text.begin(),
+                 [](unsigned char C) { return std::tolower(C); });
+  return Text;
+}
+} // namespace
+
+HttpResponseHeader parseHttpResponseHeader(const std::string &Header) {
+  HttpResponseHeader Result;
+  std::istringstream Lines(Header);
+  std::string Line;
+  std::getline(Lines, Line);
+  auto Space = Line.find(' ');
+  if (Line.compare(0, 5, "HTTP/") != 0 or Space == std::string::npos) {
+    return Result;
+  }
+  auto StatusCode = std::atoi(Line.c_str() + Space + 1);
+  bool KeepAlive{Line.compare(0, 8, "HTTP/1.0") != 0};
+  bool KnownLength{false};
+  while (std::getline(Lines, Line)) {
+    auto Colon = Line.find(':');
+    if (Colon == std::string::npos) {
+      continue;
+    }
+    auto Name = toLower(Line.substr(0, Colon));
+    auto Value = toLower(Line.substr(Colon + 1));
+    if (Name == "content-length") {
+      Result.ContentLength = std::strtoull(Value.c_str(), nullptr, 10);
+      KnownLength = true;
+    } else if (Name == "connection") {
+      if (Value.find("close") != std::string::npos) {
+        KeepAlive = false;
+      } else if (Value.find("keep-alive") != std::string::npos) {
+        KeepAlive = true;
+      }
+    } else if (Name == "transfer-encoding" and
+               Value.find("identity") == std::string::npos) {
+      // Chunked responses are not decoded, the connection is closed
+      // instead.
+      KeepAlive = false;
+      Result.ContentLength = 0;
+    } else if (Name == "retry-after") {
+      // The alternative form, an HTTP date, is ignored.
+      char *End{nullptr};
+      auto Seconds = std::strtoul(Value.c_str(), &End, 10);
+      if (End != Value.c_str()) {
+        Result.RetryAfter = std::chrono::seconds(Seconds);
+      }
+    }
+  }
+  if (StatusCode < 200 or StatusCode == 204 or StatusCode == 304) {
+    // Responses without a body.
+    Result.ContentLength = 0;
+    KnownLength = true;
+  }
+  Result.Close = not KeepAlive or not KnownLength;
+  Result.StatusCode = StatusCode;
+  return Result;
+}
+
+GraylogHttpConnection::Impl::Impl(std::string Host, int Port,
+                                  const GraylogHttpSettings &Settings)
+    : Settings(Settings), HostAddress(std::move(Host)),
+      HostPort(std::to_string(Port)), BackoffRandom(std::random_device()()),
+      Socket(Service), Resolver(Service),
+      Budget(Settings.MaxQueueBytes, Settings.MaxQueueLength),
+      LogMessages(Budget.initialCapacity()) {
+  HeaderPrefix = "POST " + Settings.Path + " HTTP/1.1\r\nHost: " +
+                 HostAddress + ":" + HostPort +
+                 "\r\nContent-Type: application/json\r\n";
+#ifdef WITH_ZLIB
+  if (Compression::None != Settings.BodyCompression) {
+    BodyCompressor = std::make_unique<Compressor>(Settings.BodyCompression,
+                                                  Settings.CompressionLevel);
+    HeaderPrefix += Compression::Gzip == Settings.BodyCompression
+                        ? "Content-Encoding: gzip\r\n"
+                        : "Content-Encoding: deflate\r\n";
+  }
+#endif
+  SendThread = std::thread(&GraylogHttpConnection::Impl::threadFunction, this);
+}
+
+GraylogHttpConnection::Impl::~Impl() {
+  Stopping = true;
+  // Abort the network operation (or address lookup) in progress, if any.
+  Service.post([this]() {
+    asio::error_code Error;
+    Socket.close(Error);
+    Resolver.cancel();
+  });
+  QueuedMessage StopMessage;
+  StopMessage.Stop = true;
+  LogMessages.enqueue(std::move(StopMessage));
+  SendThread.join();
+}
+
+void GraylogHttpConnection::Impl::sendMessage(std::string Msg) {
+  if (not Budget.tryAcquire(Msg.size())) {
+    Metrics.dropped();
+    return;
+  }
+  LogMessages.enqueue(
+      {std::move(Msg), std::chrono::steady_clock::now(), nullptr});
+  Metrics.enqueued();
+}
+
+void GraylogHttpConnection::Impl::sendMessages(std::vector<std::string> Msgs) {
+  size_t TotalSize{0};
+  for (auto &Msg : Msgs) {
+    TotalSize += Msg.size();
+  }
+  auto NrOfQueued = Msgs.size();
+  if (not Budget.tryAcquire(TotalSize, NrOfQueued)) {
+    // Not enough room for all of them, queue as many as possible.
+    NrOfQueued = 0;
+    while (NrOfQueued < Msgs.size() and
+           Budget.tryAcquire(Msgs[NrOfQueued].size())) {
+      ++NrOfQueued;
+    }
+  }
+  std::vector<QueuedMessage> NewMessages;
+  NewMessages.reserve(NrOfQueued);
+  auto Now = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < NrOfQueued; ++i) {
+    NewMessages.push_back({std::move(Msgs[i]), Now, nullptr});
+  }
+  LogMessages.enqueue_bulk(std::make_move_iterator(NewMessages.begin()),
+                           NewMessages.size());
+  Metrics.enqueued(NrOfQueued);
+  Metrics.dropped(Msgs.size() - NrOfQueued);
+}
+
+bool GraylogHttpConnection::Impl::flush(
+    std::chrono::system_clock::duration TimeOut) {
+  QueuedMessage FlushMessage;
+  FlushMessage.Flushed = std::make_shared<std::promise<void>>();
+  auto FlushedFuture = FlushMessage.Flushed->get_future();
+  // Flush requests are not limited by the maximum queue length.
+  LogMessages.enqueue(std::move(FlushMessage));
+  return std::future_status::ready == FlushedFuture.wait_for(TimeOut);
+}
+
+void GraylogHttpConnection::Impl::threadFunction() {
+  while (not Stopping) {
+    if (not fillPipeline()) {
+      return;
+    }
+    if (Pipeline.empty()) {
+      continue;
+    }
+    if (not Socket.is_open() and not connect()) {
+      waitBeforeReconnect();
+      continue;
+    }
+    if (not writeRequests() or not readResponse()) {
+      closeConnection();
+      waitBeforeReconnect();
+    }
+  }
+}
+
+bool GraylogHttpConnection::Impl::fillPipeline() {
+  auto MaxRequests = std::max<size_t>(Settings.MaxPipelinedRequests, 1);
+  while (Pipeline.size() < MaxRequests) {
+    QueuedMessage Message;
+    if (Pipeline.empty() and Batch.NrOfMessages == 0) {
+      LogMessages.wait_dequeue(Message);
+    } else if (not LogMessages.try_dequeue(Message)) {
+      break;
+    }
+    if (Message.Stop) {
+      return false;
+    }
+    if (Message.Flushed != nullptr) {
+      // Completed together with the last of the messages queued before it.
+      if (Batch.NrOfMessages > 0) {
+        Batch.Flushed.push_back(std::move(Message.Flushed));
+      } else if (not Pipeline.empty()) {
+        Pipeline.back().Flushed.push_back(std::move(Message.Flushed));
+      } else {
+        Message.Flushed->set_value();
+      }
+      continue;
+    }
+    addToBatch(Message);
+  }
+  // Do not hold back messages if there is room for them in the pipeline.
+  if (Batch.NrOfMessages > 0 and Pipeline.size() < MaxRequests) {
+    finishBatch();
+  }
+  return true;
+}
+
+void GraylogHttpConnection::Impl::addToBatch(QueuedMessage &Message) {
+  ++UnansweredMessages;
+  Budget.release(Message.Message.size());
+  Metrics.dequeued();
+  Metrics.latency(std::chrono::steady_clock::now() - Message.Queued);
+  if (Batch.NrOfMessages > 0 and
+      Batch.Body.size() + 1 + Message.Message.size() >
+          Settings.MaxRequestBytes) {
+    finishBatch();
+  }
+  if (Batch.NrOfMessages == 0) {
+    Batch.Body = std::move(Message.Message);
+  } else {
+    Batch.Body.push_back('\n');
+    Batch.Body += Message.Message;
+  }
+  ++Batch.NrOfMessages;
+  if (Batch.NrOfMessages >= Settings.MaxMessagesPerRequest) {
+    finishBatch();
+  }
+}
+
+void GraylogHttpConnection::Impl::finishBatch() {
+#ifdef WITH_ZLIB
+  if (BodyCompressor != nullptr) {
+    BodyCompressor->compress(Batch.Body.data(), Batch.Body.size(),
+                             CompressedBody);
+    Batch.Body.assign(CompressedBody.begin(), CompressedBody.end());
+  }
+#endif
+  Batch.Header = HeaderPrefix +
+                 "Content-Length: " + std::to_string(Batch.Body.size()) +
+                 "\r\n\r\n";
+  Pipeline.push_back(std::move(Batch));
+  Batch = Request();
+}
+
+void GraylogHttpConnection::Impl::completeRequest() {
+  auto &Completed = Pipeline.front();
+  UnansweredMessages -= Completed.NrOfMessages;
+  for (auto &Flushed : Completed.Flushed) {
+    Flushed->set_value();
+  }
+  Pipeline.pop_front();
+}
+
+bool GraylogHttpConnection::Impl::connect() {
+  State.set(Status::ADDR_LOOKUP);
+  asio::error_code Error;
+  std::vector<asio::ip::tcp::endpoint> Endpoints;
+  Resolver.async_resolve(
+      asio::ip::tcp::resolver::query(HostAddress, HostPort),
+      [&](const asio::error_code &ResolveError,
+          asio::ip::tcp::resolver::iterator EndpointIter) {
+        Error = ResolveError;
+        for (; not Error and
+               EndpointIter != asio::ip::tcp::resolver::iterator();
+             ++EndpointIter) {
+          Endpoints.push_back(EndpointIter->endpoint());
+        }
+      });
+  if (not runFor(Settings.ConnectTimeout, Error)) {
+    return false;
+  }
+  orderEndpoints(Endpoints, Settings.Addresses);
+  // The address of the last successful connection is tried first.
+  auto LastGood =
+      std::find(Endpoints.begin(), Endpoints.end(), LastGoodEndpoint);
+  if (LastGood != Endpoints.end()) {
+    std::rotate(Endpoints.begin(), LastGood, LastGood + 1);
+  }
+  if (Endpoints.empty()) {
+    LastError = asio::error::host_not_found;
+    return false;
+  }
+  State.set(Status::CONNECT);
+  for (auto &Endpoint : Endpoints) {
+    if (Stopping) {
+      return false;
+    }
+    Socket.async_connect(Endpoint,
+                         [&Error](const asio::error_code &ConnectError) {
+                           Error = ConnectError;
+                         });
+    if (runFor(Settings.ConnectTimeout, Error)) {
+      LastGoodEndpoint = Endpoint;
+      Socket.set_option(asio::ip::tcp::no_delay(true), Error);
+      State.set(Status::SEND_LOOP);
+      return true;
+    }
+    // Try the next address.
+    closeConnection();
+  }
+  return false;
+}
+
+bool GraylogHttpConnection::Impl::writeRequests() {
+  std::vector<asio::const_buffer> Buffers;
+  for (auto &CRequest : Pipeline) {
+    if (not CRequest.Written) {
+      Buffers.push_back(asio::buffer(CRequest.Header));
+      Buffers.push_back(asio::buffer(CRequest.Body));
+    }
+  }
+  if (Buffers.empty()) {
+    return true;
+  }
+  asio::error_code Error;
+  size_t BytesWritten{0};
+  asio::async_write(Socket, Buffers,
+                    [&](const asio::error_code &WriteError, size_t Size) {
+                      Error = WriteError;
+                      BytesWritten = Size;
+                    });
+  if (not runFor(Settings.RequestTimeout, Error)) {
+    return false;
+  }
+  Metrics.bytesWritten(BytesWritten);
+  for (auto &CRequest : Pipeline) {
+    CRequest.Written = true;
+  }
+  return true;
+}
+
+bool GraylogHttpConnection::Impl::readResponse() {
+  asio::error_code Error;
+  size_t HeaderSize{0};
+  asio::async_read_until(Socket, ResponseBuffer, "\r\n\r\n",
+                         [&](const asio::error_code &ReadError, size_t Size) {
+                           Error = ReadError;
+                           HeaderSize = Size;
+                         });
+  if (not runFor(Settings.RequestTimeout, Error)) {
+    return false;
+  }
+  auto HeaderBegin = asio::buffers_begin(ResponseBuffer.data());
+  auto Response = parseHttpResponseHeader(
+      std::string(HeaderBegin, HeaderBegin + HeaderSize));
+  ResponseBuffer.consume(HeaderSize);
+  if (Response.StatusCode == 0) {
+    LastError = asio::error::invalid_argument;
+    return false;
+  }
+  if (ResponseBuffer.size() < Response.ContentLength) {
+    asio::async_read(
+        Socket, ResponseBuffer,
+        asio::transfer_exactly(Response.ContentLength - ResponseBuffer.size()),
+        [&Error](const asio::error_code &ReadError, size_t /* Size */) {
+          Error = ReadError;
+        });
+    if (not runFor(Settings.RequestTimeout, Error)) {
+      return false;
+    }
+  }
+  ResponseBuffer.consume(Response.ContentLength);
+  if (Response.StatusCode < 200) {
+    // Informational response, the final one follows.
+    return readResponse();
+  }
+  bool ServerFailed{Response.StatusCode >= 500 or
+                    Response.StatusCode == 408 or Response.StatusCode == 429};
+  if (ServerFailed and Pipeline.front().NrOfRetries++ < Settings.MaxRetries) {
+    // Try again later, but not before the server wants us to.
+    RetryAfter = Response.RetryAfter;
+    LastError = asio::error::try_again;
+    return false;
+  }
+  if (Response.StatusCode >= 300) {
+    Metrics.discarded(Pipeline.front().NrOfMessages);
+  }
+  if (not ServerFailed) {
+    // The delay keeps growing while the server fails to accept requests.
+    NrOfFailedAttempts = 0;
+  }
+  completeRequest();
+  if (Response.Close) {
+    closeConnection();
+  }
+  return true;
+}
+
+bool GraylogHttpConnection::Impl::runFor(std::chrono::milliseconds TimeOut,
+                                         const asio::error_code &Error) {
+  Service.restart();
+  if (TimeOut.count() > 0) {
+    Service.run_for(TimeOut);
+  } else {
+    Service.run();
+  }
+  if (Service.stopped()) {
+    LastError = Error;
+    return not Error;
+  }
+  // Timed out. Closing the socket (or cancelling the address lookup)
+  // completes the operation with an error.
+  asio::error_code CloseError;
+  Socket.close(CloseError);
+  Resolver.cancel();
+  Service.run();
+  LastError = asio::error::timed_out;
+  return false;
+}
+
+void GraylogHttpConnection::Impl::closeConnection() {
+  asio::error_code Error;
+  Socket.close(Error);
+  ResponseBuffer.consume(ResponseBuffer.size());
+  // Requests that have not been answered are sent again on the next
+  // connection.
+  for (auto &CRequest : Pipeline) {
+    CRequest.Written = false;
+  }
+}
+
+void GraylogHttpConnection::Impl::waitBeforeReconnect() {
+  State.set(Status::ADDR_RETRY_WAIT, LastError);
+  LastError.clear();
+  Metrics.reconnected();
+  // Full jitter, see GraylogConnection::Impl::reConnect().
+  auto Limit = reconnectDelayLimit(NrOfFailedAttempts++,
+                                   Settings.ReconnectDelayMin,
+                                   Settings.ReconnectDelayMax);
+  std::uniform_int_distribution<std::chrono::milliseconds::rep> Delay(
+      0, Limit.count());
+  auto WaitUntil =
+      std::chrono::steady_clock::now() +
+      std::max(std::chrono::milliseconds(Delay(BackoffRandom)), RetryAfter);
+  RetryAfter = 0ms;
+  while (not Stopping and std::chrono::steady_clock::now() < WaitUntil) {
+    std::this_thread::sleep_for(10ms);
+  }
+}
+
+} // namespace Log
@@ -0,0 +1,155 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Header file of the HTTP networking code.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "Compressor.hpp"
+#include "StatusTracker.hpp"
+#include "graylog_logger/GraylogHttpInterface.hpp"
+#include "graylog_logger/Metrics.hpp"
+#include "graylog_logger/QueueBudget.hpp"
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <concurrentqueue/blockingconcurrentqueue.h>
+#include <deque>
+#include <future>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Log {
+
+/// \brief The parts of the header of an HTTP response used by the
+/// connection.
+struct HttpResponseHeader {
+  int StatusCode{0};
+  size_t ContentLength{0};
+  /// \brief The server closes the connection after the response (or the
+  /// length of the body is unknown).
+  bool Close{false};
+  /// \brief Time that the server asks the client to wait before sending
+  /// the request again (Retry-After given in seconds). Zero if not given.
+  std::chrono::seconds RetryAfter{0};
+};
+
+/// \brief Parse the status line and the header fields of an HTTP response.
+/// \param[in] Header The header, up to and including the empty line.
+/// \return A status code of zero if the status line is invalid.
+HttpResponseHeader parseHttpResponseHeader(const std::string &Header);
+
+class GraylogHttpConnection::Impl {
+public:
+  using Status = Log::Status;
+  Impl(std::string Host, int Port, const GraylogHttpSettings &Settings);
+  virtual ~Impl();
+  void sendMessage(std::string Msg);
+  void sendMessages(std::vector<std::string> Msgs);
+  Status getConnectionStatus() const { return State.get(); }
+  StatusTracker &statusTracker() { return State; }
+  bool flush(std::chrono::system_clock::duration TimeOut);
+  size_t queueSize() { return Budget.messages() + UnansweredMessages.load(); }
+  MetricsSnapshot getMetrics() const { return Metrics.snapshot(); }
+  void dropped(size_t NrOfMessages) { Metrics.dropped(NrOfMessages); }
+
+private:
+  struct QueuedMessage {
+    std::string Message;
+    std::chrono::steady_clock::time_point Queued;
+    /// \brief Set for flush requests instead of a message.
+    std::shared_ptr<std::promise<void>> Flushed;
+    bool Stop{false};
+  };
+
+  /// \brief A POST request and the flush requests that are completed with
+  /// it.
+  struct Request {
+    std::string Header;
+    std::string Body;
+    size_t NrOfMessages{0};
+    bool Written{false};
+    /// \brief The number of times that the server asked for the request to
+    /// be sent again.
+    size_t NrOfRetries{0};
+    std::vector<std::shared_ptr<std::promise<void>>> Flushed;
+  };
+
+  void threadFunction();
+  /// \brief Take messages from the queue and turn them into requests until
+  /// the pipeline is full. Only blocks if there is nothing else to do.
+  /// \return False if the connection is being stopped.
+  bool fillPipeline();
+  void addToBatch(QueuedMessage &Message);
+  /// \brief Move the batch of messages into a new request at the end of the
+  /// pipeline.
+  void finishBatch();
+  /// \brief Remove the first request from the pipeline.
+  void completeRequest();
+  /// \brief Look up the addresses of the server and connect to the first
+  /// one that accepts the connection.
+  bool connect();
+  /// \brief Write the requests that have not been written on the current
+  /// connection.
+  bool writeRequests();
+  /// \brief Receive the response to the first request in the pipeline.
+  /// \return False if the request should be re-sent on a new connection.
+  bool readResponse();
+  /// \brief Run the asynchronous operation that has been started.
+  /// \param[in] TimeOut Time allowed for the operation, zero for no limit.
+  /// \param[in] Error Set by the completion handler of the operation.
+  /// \return False if the operation failed or was aborted because it did
+  /// not complete in time.
+  bool runFor(std::chrono::milliseconds TimeOut,
+              const asio::error_code &Error);
+  void closeConnection();
+  void waitBeforeReconnect();
+
+  const GraylogHttpSettings Settings;
+  std::string HostAddress;
+  std::string HostPort;
+  /// \brief The header fields that are the same for all requests.
+  std::string HeaderPrefix;
+  StatusTracker State;
+  /// \brief The reason why the last connection attempt or request failed,
+  /// if known.
+  asio::error_code LastError;
+  std::atomic_bool Stopping{false};
+  size_t NrOfFailedAttempts{0};
+  /// \brief The shortest time to wait before reconnecting, as requested by
+  /// the server.
+  std::chrono::milliseconds RetryAfter{0};
+  std::minstd_rand BackoffRandom;
+
+  std::deque<Request> Pipeline;
+  Request Batch;
+  /// \brief Messages taken from the queue that have not been accepted (or
+  /// rejected) by the server yet.
+  std::atomic<size_t> UnansweredMessages{0};
+#ifdef WITH_ZLIB
+  std::unique_ptr<Compressor> BodyCompressor;
+  std::vector<char> CompressedBody;
+#endif
+
+  asio::io_service Service;
+  asio::ip::tcp::socket Socket;
+  asio::ip::tcp::resolver Resolver;
+  /// \brief The address of the last successful connection. Tried first.
+  asio::ip::tcp::endpoint LastGoodEndpoint;
+  asio::streambuf ResponseBuffer;
+  MetricsRecorder Metrics;
+  /// \brief Limits the number and the size of the queued messages (not
+  /// counting flush and stop requests).
+  QueueBudget Budget;
+  moodycamel::BlockingConcurrentQueue<QueuedMessage> LogMessages;
+  std::thread SendThread; // Must be last
+};
+
+} // namespace Log
@@ -0,0 +1,108 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief The interface implementation for sending messages to a graylog
+/// server over HTTP.
+///
+//===----------------------------------------------------------------------===//
+
+#include "graylog_logger/GraylogHttpInterface.hpp"
+#include "GelfMessage.hpp"
+#include "GraylogHttpConnection.hpp"
+#include "graylog_logger/MemoryBudget.hpp"
+#include <ciso646>
+
+namespace Log {
+
+GraylogHttpConnection::GraylogHttpConnection(
+    std::string Host, int Port, const GraylogHttpSettings &Settings)
+    : Pimpl(std::make_unique<Impl>(std::move(Host), Port, Settings)) {}
+
+GraylogHttpConnection::~GraylogHttpConnection() = default;
+
+void GraylogHttpConnection::sendMessage(std::string Msg) {
+  Pimpl->sendMessage(std::move(Msg));
+}
+
+void GraylogHttpConnection::sendMessages(std::vector<std::string> Msgs) {
+  Pimpl->sendMessages(std::move(Msgs));
+}
+
+Status GraylogHttpConnection::getConnectionStatus() const {
+  return Pimpl->getConnectionStatus();
+}
+
+bool GraylogHttpConnection::messageQueueEmpty() {
+  return Pimpl->queueSize() == 0;
+}
+
+size_t GraylogHttpConnection::messageQueueSize() { return Pimpl->queueSize(); }
+
+bool GraylogHttpConnection::flush(std::chrono::system_clock::duration TimeOut) {
+  return Pimpl->flush(TimeOut);
+}
+
+MetricsSnapshot GraylogHttpConnection::getMetrics() const {
+  return Pimpl->getMetrics();
+}
+
+size_t GraylogHttpConnection::addStatusCallback(StatusCallback Callback) {
+  return Pimpl->statusTracker().addCallback(std::move(Callback));
+}
+
+void GraylogHttpConnection::removeStatusCallback(size_t Id) {
+  Pimpl->statusTracker().removeCallback(Id);
+}
+
+StatusDurations GraylogHttpConnection::getTimeInStatus() const {
+  return Pimpl->statusTracker().timeInStatus();
+}
+
+void GraylogHttpConnection::messagesDropped(size_t NrOfMessages) {
+  Pimpl->dropped(NrOfMessages);
+}
+
+GraylogHttpInterface::GraylogHttpInterface(const std::string &Host, int Port,
+                                           const GraylogHttpSettings &Settings)
+    : GraylogHttpConnection(Host, Port, Settings), Format(Settings.Format) {}
+
+void GraylogHttpInterface::addMessage(const LogMessage &Message) {
+  if (not MemoryBudget::global().accepts(Message.SeverityLevel)) {
+    messagesDropped(1);
+    return;
+  }
+  sendMessage(logMessageToGelf(Message, Format));
+}
+
+void GraylogHttpInterface::addMessages(
+    minimal::span<const LogMessage *const> Messages) {
+  std::vector<std::string> SerialisedMessages;
+  SerialisedMessages.reserve(Messages.size());
+  auto &Budget = MemoryBudget::global();
+  for (auto CMessage : Messages) {
+    // Shed low severity messages before spending time on serialising them.
+    if (Budget.accepts(CMessage->SeverityLevel)) {
+      SerialisedMessages.emplace_back(logMessageToGelf(*CMessage, Format));
+    }
+  }
+  if (SerialisedMessages.size() < Messages.size()) {
+    messagesDropped(Messages.size() - SerialisedMessages.size());
+  }
+  sendMessages(std::move(SerialisedMessages));
+}
+
+bool GraylogHttpInterface::flush(std::chrono::system_clock::duration TimeOut) {
+  return GraylogHttpConnection::flush(TimeOut);
+}
+
+bool GraylogHttpInterface::emptyQueue() { return messageQueueEmpty(); }
+
+size_t GraylogHttpInterface::queueSize() { return messageQueueSize(); }
+
+MetricsSnapshot GraylogHttpInterface::getMetrics() const {
+  return GraylogHttpConnection::getMetrics();
+}
+
+} // namespace Log
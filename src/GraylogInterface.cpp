@@ -9,22 +9,35 @@
 //===----------------------------------------------------------------------===//
 
 #include "graylog_logger/GraylogInterface.hpp"
-#include "GraylogConnection.hpp"
+#include "GelfMessage.hpp"
+#include "GraylogConnectionPool.hpp"
+#include "graylog_logger/MemoryBudget.hpp"
 #include <ciso646>
 #include <cstring>
-#include <nlohmann/json.hpp>
 
 namespace Log {
 
 GraylogConnection::GraylogConnection(std::string Host, int Port,
                                      size_t MaxQueueSize)
-    : Pimpl(std::make_unique<GraylogConnection::Impl>(std::move(Host), Port,
-                                                      MaxQueueSize)) {}
+    : GraylogConnection(std::move(Host), Port, [MaxQueueSize]() {
+        GraylogSettings Settings;
+        Settings.MaxQueueLength = MaxQueueSize;
+        return Settings;
+      }()) {}
+
+GraylogConnection::GraylogConnection(std::string Host, int Port,
+                                     const GraylogSettings &Settings)
+    : Pimpl(std::make_unique<GraylogConnection::Pool>(std::move(Host), Port,
+                                                      Settings)) {}
 
 void GraylogConnection::sendMessage(std::string Msg) {
   Pimpl->sendMessage(std::move(Msg));
 }
 
+void GraylogConnection::sendMessages(std::vector<std::string> Msgs) {
+  Pimpl->sendMessages(std::move(Msgs));
+}
+
 bool GraylogConnection::flush(std::chrono::system_clock::duration TimeOut) {
   return Pimpl->flush(TimeOut);
 }
@@ -37,43 +50,68 @@ bool GraylogConnection::messageQueueEmpty() { return Pimpl->queueSize() == 0; }
 
 size_t GraylogConnection::messageQueueSize() { return Pimpl->queueSize(); }
 
+MetricsSnapshot GraylogConnection::getMetrics() const {
+  return Pimpl->getMetrics();
+}
+
+size_t GraylogConnection::addStatusCallback(StatusCallback Callback) {
+  return Pimpl->statusTracker().addCallback(std::move(Callback));
+}
+
+void GraylogConnection::removeStatusCallback(size_t Id) {
+  Pimpl->statusTracker().removeCallback(Id);
+}
+
+StatusDurations GraylogConnection::getTimeInStatus() const {
+  return Pimpl->statusTracker().timeInStatus();
+}
+
+void GraylogConnection::messagesDropped(size_t NrOfMessages) {
+  Pimpl->dropped(NrOfMessages);
+}
+
 GraylogConnection::~GraylogConnection() = default;
 
 GraylogInterface::GraylogInterface(const std::string &Host, const int Port,
                                    const size_t MaxQueueLength)
     : GraylogConnection(Host, Port, MaxQueueLength) {}
 
+GraylogInterface::GraylogInterface(const std::string &Host, const int Port,
+                                   const GraylogSettings &Settings)
+    : GraylogConnection(Host, Port, Settings), Format(Settings.Format) {}
+
 void GraylogInterface::addMessage(const LogMessage &Message) {
-  sendMessage(logMsgToJSON(Message));
+  if (not MemoryBudget::global().accepts(Message.SeverityLevel)) {
+    messagesDropped(1);
+    return;
+  }
+  sendMessage(logMsgToJSON(Message, Format));
 }
 
-std::string GraylogInterface::logMsgToJSON(const LogMessage &Message) {
-  using std::chrono::duration_cast;
-  using std::chrono::milliseconds;
-
-  nlohmann::json JsonObject;
-  JsonObject["short_message"] = Message.MessageString;
-  JsonObject["version"] = "1.1";
-  JsonObject["level"] = int(Message.SeverityLevel);
-  JsonObject["host"] = Message.Host;
-  JsonObject["timestamp"] =
-      static_cast<double>(
-          duration_cast<milliseconds>(Message.Timestamp.time_since_epoch())
-              .count()) /
-      1000;
-  JsonObject["_process_id"] = Message.ProcessId;
-  JsonObject["_process"] = Message.ProcessName;
-  JsonObject["_thread_id"] = Message.ThreadId;
-  for (auto &field : Message.AdditionalFields) {
-    if (AdditionalField::Type::typeStr == field.second.FieldType) {
-      JsonObject["_" + field.first] = field.second.strVal;
-    } else if (AdditionalField::Type::typeDbl == field.second.FieldType) {
-      JsonObject["_" + field.first] = field.second.dblVal;
-    } else if (AdditionalField::Type::typeInt == field.second.FieldType) {
-      JsonObject["_" + field.first] = field.second.intVal;
+void GraylogInterface::addMessages(
+    minimal::span<const LogMessage *const> Messages) {
+  std::vector<std::string> SerialisedMessages;
+  SerialisedMessages.reserve(Messages.size());
+  auto &Budget = MemoryBudget::global();
+  for (auto CMessage : Messages) {
+    // Shed low severity messages before spending time on serialising them.
+    if (Budget.accepts(CMessage->SeverityLevel)) {
+      SerialisedMessages.emplace_back(logMsgToJSON(*CMessage, Format));
     }
   }
-  return JsonObject.dump();
+  if (SerialisedMessages.size() < Messages.size()) {
+    messagesDropped(Messages.size() - SerialisedMessages.size());
+  }
+  sendMessages(std::move(SerialisedMessages));
+}
+
+std::string GraylogInterface::logMsgToJSON(const LogMessage &Message) {
+  return logMessageToGelf(Message);
+}
+
+std::string GraylogInterface::logMsgToJSON(const LogMessage &Message,
+                                           const GelfFormat &Format) {
+  return logMessageToGelf(Message, Format);
 }
 
 bool GraylogInterface::flush(std::chrono::system_clock::duration TimeOut) {
@@ -84,4 +122,8 @@ bool GraylogInterface::emptyQueue() { return messageQueueEmpty(); }
 
 size_t GraylogInterface::queueSize() { return messageQueueSize(); }
 
+MetricsSnapshot GraylogInterface::getMetrics() const {
+  return GraylogConnection::getMetrics();
+}
+
 } // namespace Log
@@ -0,0 +1,333 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Implements the networking code for sending GELF messages to a
+/// graylog server over UDP.
+///
+//===----------------------------------------------------------------------===//
+
+#include "GraylogUdpConnection.hpp"
+#include "EndpointOrder.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <ciso646>
+#include <iterator>
+#include <random>
+#include <utility>
+
+namespace Log {
+
+GraylogUdpConnection::Impl::Impl(std::string Host, int Port,
+                                 const GraylogUdpSettings &Settings)
+    : Settings(Settings), HostAddress(std::move(Host)),
+      HostPort(std::to_string(Port)),
+      CurrentBatch(std::max<size_t>(Settings.MaxDatagramsPerSend, 1)),
+      Socket(Service), Budget(Settings.MaxQueueBytes, Settings.MaxQueueLength),
+      LogMessages(Budget.initialCapacity()) {
+  std::random_device RandomDevice;
+  NextMessageId = (std::uint64_t(RandomDevice()) << 32) | RandomDevice();
+#ifdef WITH_ZLIB
+  if (Compression::None != Settings.PayloadCompression) {
+    PayloadCompressor = std::make_unique<Compressor>(
+        Settings.PayloadCompression, Settings.CompressionLevel);
+    CompressedBatch.resize(CurrentBatch.size());
+  }
+#endif
+  SendThread = std::thread(&GraylogUdpConnection::Impl::threadFunction, this);
+}
+
+GraylogUdpConnection::Impl::~Impl() {
+  QueuedMessage StopMessage;
+  StopMessage.Stop = true;
+  LogMessages.enqueue(std::move(StopMessage));
+  SendThread.join();
+  asio::error_code Error;
+  Socket.close(Error);
+}
+
+void GraylogUdpConnection::Impl::sendMessage(std::string Msg) {
+  if (not Budget.tryAcquire(Msg.size())) {
+    Metrics.dropped();
+    return;
+  }
+  LogMessages.enqueue(
+      {std::move(Msg), std::chrono::steady_clock::now(), nullptr});
+  Metrics.enqueued();
+}
+
+void GraylogUdpConnection::Impl::sendMessages(std::vector<std::string> Msgs) {
+  size_t TotalSize{0};
+  for (auto &Msg : Msgs) {
+    TotalSize += Msg.size();
+  }
+  auto NrOfQueued = Msgs.size();
+  if (not Budget.tryAcquire(TotalSize, NrOfQueued)) {
+    // Not enough room for all of them, queue as many as possible.
+    NrOfQueued = 0;
+    while (NrOfQueued < Msgs.size() and
+           Budget.tryAcquire(Msgs[NrOfQueued].size())) {
+      ++NrOfQueued;
+    }
+  }
+  std::vector<QueuedMessage> NewMessages;
+  NewMessages.reserve(NrOfQueued);
+  auto Now = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < NrOfQueued; ++i) {
+    NewMessages.push_back({std::move(Msgs[i]), Now, nullptr});
+  }
+  LogMessages.enqueue_bulk(std::make_move_iterator(NewMessages.begin()),
+                           NewMessages.size());
+  Metrics.enqueued(NrOfQueued);
+  Metrics.dropped(Msgs.size() - NrOfQueued);
+}
+
+bool GraylogUdpConnection::Impl::flush(
+    std::chrono::system_clock::duration TimeOut) {
+  QueuedMessage FlushMessage;
+  FlushMessage.Flushed = std::make_shared<std::promise<void>>();
+  auto FlushedFuture = FlushMessage.Flushed->get_future();
+  // Flush requests are not limited by the maximum queue length.
+  LogMessages.enqueue(std::move(FlushMessage));
+  return std::future_status::ready == FlushedFuture.wait_for(TimeOut);
+}
+
+bool GraylogUdpConnection::Impl::openSocket() {
+  State.set(Status::ADDR_LOOKUP);
+  asio::error_code Error;
+  asio::generic::datagram_protocol::endpoint UsedEndpoint;
+  bool FoundEndpoint{false};
+#ifndef _WIN32
+  if (not Settings.UnixSocketPath.empty()) {
+    UsedEndpoint = asio::generic::datagram_protocol::endpoint(
+        asio::local::datagram_protocol::endpoint(Settings.UnixSocketPath));
+    FoundEndpoint = true;
+  }
+#endif
+  if (not FoundEndpoint) {
+    asio::ip::udp::resolver Resolver(Service);
+    auto EndpointIter = Resolver.resolve(
+        asio::ip::udp::resolver::query(HostAddress, HostPort), Error);
+    std::vector<asio::ip::udp::endpoint> Endpoints;
+    for (; not Error and EndpointIter != asio::ip::udp::resolver::iterator();
+         ++EndpointIter) {
+      Endpoints.push_back(EndpointIter->endpoint());
+    }
+    orderEndpoints(Endpoints, Settings.Addresses);
+    if (not Endpoints.empty()) {
+      UsedEndpoint =
+          asio::generic::datagram_protocol::endpoint(Endpoints.front());
+      FoundEndpoint = true;
+    }
+  }
+  if (FoundEndpoint) {
+    Socket.open(UsedEndpoint.protocol(), Error);
+    if (not Error) {
+      Socket.connect(UsedEndpoint, Error);
+    }
+  }
+  if (not FoundEndpoint or Error) {
+    closeSocket(Error ? Error : asio::error::host_not_found);
+    return false;
+  }
+  State.set(Status::SEND_LOOP);
+  return true;
+}
+
+void GraylogUdpConnection::Impl::closeSocket(const asio::error_code &Error) {
+  asio::error_code CloseError;
+  Socket.close(CloseError);
+  NextAddressLookup = std::chrono::steady_clock::now() + Settings.RetryDelay;
+  State.set(Status::ADDR_RETRY_WAIT, Error);
+}
+
+void GraylogUdpConnection::Impl::threadFunction() {
+  openSocket();
+  while (true) {
+    auto NrOfMessages = LogMessages.wait_dequeue_bulk(CurrentBatch.begin(),
+                                                      CurrentBatch.size());
+    Metrics.updateQueueDepth();
+    bool StopThread{false};
+    for (size_t i = 0; i < NrOfMessages and not StopThread; ++i) {
+      auto &CMessage = CurrentBatch[i];
+      if (CMessage.Stop or CMessage.Flushed != nullptr) {
+        sendDatagrams();
+        StopThread = CMessage.Stop;
+        if (CMessage.Flushed != nullptr) {
+          CMessage.Flushed->set_value();
+        }
+        continue;
+      }
+      Budget.release(CMessage.Message.size());
+      Metrics.dequeued();
+      Metrics.latency(std::chrono::steady_clock::now() - CMessage.Queued);
+      if (not Socket.is_open() and
+          std::chrono::steady_clock::now() >= NextAddressLookup) {
+        Metrics.reconnected();
+        openSocket();
+      }
+      if (not Socket.is_open()) {
+        Metrics.discarded();
+        continue;
+      }
+#ifdef WITH_ZLIB
+      if (PayloadCompressor != nullptr) {
+        auto &Compressed = CompressedBatch[i];
+        PayloadCompressor->compress(CMessage.Message.data(),
+                                    CMessage.Message.size(), Compressed);
+        addDatagrams(Compressed.data(), Compressed.size());
+        continue;
+      }
+#endif
+      addDatagrams(CMessage.Message.data(), CMessage.Message.size());
+    }
+    sendDatagrams();
+    for (size_t i = 0; i < NrOfMessages; ++i) {
+      CurrentBatch[i] = QueuedMessage();
+    }
+    if (StopThread) {
+      return;
+    }
+  }
+}
+
+void GraylogUdpConnection::Impl::addDatagrams(const char *Message,
+                                              size_t Size) {
+  auto MaxDatagramSize =
+      std::max(Settings.MaxDatagramSize, GelfChunkHeaderSize + 1);
+  auto MessageNr = NextMessageNr++;
+  if (Size <= MaxDatagramSize) {
+    Datagram NewDatagram;
+    NewDatagram.MessageNr = MessageNr;
+    NewDatagram.Payload = Message;
+    NewDatagram.PayloadSize = Size;
+    Datagrams.push_back(NewDatagram);
+    return;
+  }
+  auto MaxChunkPayload = MaxDatagramSize - GelfChunkHeaderSize;
+  auto NrOfChunks = (Size + MaxChunkPayload - 1) / MaxChunkPayload;
+  if (NrOfChunks > GelfMaxNrOfChunks) {
+    // Graylog discards messages with more chunks than this.
+    Metrics.discarded();
+    return;
+  }
+  auto MessageId = NextMessageId++;
+  for (size_t i = 0; i < NrOfChunks; ++i) {
+    Datagram NewDatagram;
+    NewDatagram.Header[0] = 0x1e;
+    NewDatagram.Header[1] = 0x0f;
+    for (size_t j = 0; j < 8; ++j) {
+      NewDatagram.Header[2 + j] =
+          static_cast<std::uint8_t>(MessageId >> (8 * (7 - j)));
+    }
+    NewDatagram.Header[10] = static_cast<std::uint8_t>(i);
+    NewDatagram.Header[11] = static_cast<std::uint8_t>(NrOfChunks);
+    NewDatagram.HeaderSize = GelfChunkHeaderSize;
+    NewDatagram.MessageNr = MessageNr;
+    NewDatagram.Payload = Message + i * MaxChunkPayload;
+    NewDatagram.PayloadSize =
+        std::min(MaxChunkPayload, Size - i * MaxChunkPayload);
+    Datagrams.push_back(NewDatagram);
+  }
+}
+
+void GraylogUdpConnection::Impl::sendDatagrams() {
+  auto MaxPerSend = std::max<size_t>(Settings.MaxDatagramsPerSend, 1);
+  size_t NrOfHandled{0};
+  bool Reopened{false};
+  while (NrOfHandled < Datagrams.size()) {
+    if (not Socket.is_open()) {
+      // The socket has been closed after a failed send. The receiver might
+      // already be back (e.g. it has been restarted), try once to send the
+      // rest of the datagrams to it.
+      if (Reopened) {
+        break;
+      }
+      Reopened = true;
+      Metrics.reconnected();
+      if (not openSocket()) {
+        break;
+      }
+    }
+    NrOfHandled += sendDatagrams(
+        NrOfHandled, std::min(Datagrams.size() - NrOfHandled, MaxPerSend));
+  }
+  discardDatagrams(NrOfHandled, Datagrams.size() - NrOfHandled);
+  Datagrams.clear();
+}
+
+void GraylogUdpConnection::Impl::discardDatagrams(size_t First,
+                                                  size_t Count) {
+  for (size_t i = First; i < First + Count; ++i) {
+    // Count a message once, also if several of its chunks are lost.
+    if (Datagrams[i].MessageNr != LastDiscardedMessageNr) {
+      LastDiscardedMessageNr = Datagrams[i].MessageNr;
+      Metrics.discarded();
+    }
+  }
+}
+
+#ifdef __linux__
+size_t GraylogUdpConnection::Impl::sendDatagrams(size_t First, size_t Count) {
+  MessageHeaders.resize(Count);
+  IoVectors.resize(Count * 2);
+  for (size_t i = 0; i < Count; ++i) {
+    auto &CDatagram = Datagrams[First + i];
+    auto CIoVector = &IoVectors[i * 2];
+    size_t NrOfIoVectors{0};
+    if (CDatagram.HeaderSize > 0) {
+      CIoVector[NrOfIoVectors++] = {CDatagram.Header.data(),
+                                    CDatagram.HeaderSize};
+    }
+    CIoVector[NrOfIoVectors++] = {const_cast<char *>(CDatagram.Payload),
+                                  CDatagram.PayloadSize};
+    MessageHeaders[i] = mmsghdr();
+    MessageHeaders[i].msg_hdr.msg_iov = CIoVector;
+    MessageHeaders[i].msg_hdr.msg_iovlen = NrOfIoVectors;
+  }
+  int Result{0};
+  do {
+    Result = sendmmsg(Socket.native_handle(), MessageHeaders.data(),
+                      static_cast<unsigned int>(Count), 0);
+  } while (Result < 0 and errno == EINTR);
+  if (Result < 0 and not Settings.UnixSocketPath.empty()) {
+    // The receiver has gone away (e.g. it is being restarted). The socket
+    // has to be connected again once it is back.
+    closeSocket(asio::error_code(errno, asio::error::get_system_category()));
+    return 0;
+  }
+  if (Result <= 0) {
+    // The first datagram could not be sent, e.g. because an earlier datagram
+    // was rejected by the receiving host. Skip it.
+    discardDatagrams(First, 1);
+    return 1;
+  }
+  for (int i = 0; i < Result; ++i) {
+    Metrics.bytesWritten(MessageHeaders[i].msg_len);
+  }
+  return static_cast<size_t>(Result);
+}
+#else
+size_t GraylogUdpConnection::Impl::sendDatagrams(size_t First,
+                                                 size_t /* Count */) {
+  auto &CDatagram = Datagrams[First];
+  std::array<asio::const_buffer, 2> Buffers{
+      {asio::buffer(CDatagram.Header.data(), CDatagram.HeaderSize),
+       asio::buffer(CDatagram.Payload, CDatagram.PayloadSize)}};
+  asio::error_code Error;
+  auto BytesSent = Socket.send(Buffers, 0, Error);
+  if (not Error) {
+    Metrics.bytesWritten(BytesSent);
+  } else if (not Settings.UnixSocketPath.empty()) {
+    // The receiver has gone away, see the Linux version.
+    closeSocket(Error);
+    return 0;
+  } else {
+    discardDatagrams(First, 1);
+  }
+  return 1;
+}
+#endif
+
+} // namespace Log
@@ -0,0 +1,126 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Header file of the UDP networking code.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "Compressor.hpp"
+#include "StatusTracker.hpp"
+#include "graylog_logger/GraylogUdpInterface.hpp"
+#include "graylog_logger/Metrics.hpp"
+#include "graylog_logger/QueueBudget.hpp"
+#include <array>
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <concurrentqueue/blockingconcurrentqueue.h>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
+namespace Log {
+
+/// \brief Size of the header of a GELF chunk: two magic bytes, an eight byte
+/// message id, the sequence number and the sequence count.
+constexpr size_t GelfChunkHeaderSize{12};
+/// \brief Maximum number of chunks of a message accepted by Graylog.
+constexpr size_t GelfMaxNrOfChunks{128};
+
+class GraylogUdpConnection::Impl {
+public:
+  using Status = Log::Status;
+  Impl(std::string Host, int Port, const GraylogUdpSettings &Settings);
+  virtual ~Impl();
+  void sendMessage(std::string Msg);
+  void sendMessages(std::vector<std::string> Msgs);
+  Status getConnectionStatus() const { return State.get(); }
+  StatusTracker &statusTracker() { return State; }
+  bool flush(std::chrono::system_clock::duration TimeOut);
+  size_t queueSize() { return Budget.messages(); }
+  MetricsSnapshot getMetrics() const { return Metrics.snapshot(); }
+  void dropped(size_t NrOfMessages) { Metrics.dropped(NrOfMessages); }
+
+private:
+  struct QueuedMessage {
+    std::string Message;
+    std::chrono::steady_clock::time_point Queued;
+    /// \brief Set for flush and stop requests instead of a message.
+    std::shared_ptr<std::promise<void>> Flushed;
+    bool Stop{false};
+  };
+
+  /// \brief A UDP datagram ready to be sent. The payload refers to a message
+  /// in CurrentBatch (or CompressedBatch).
+  struct Datagram {
+    std::array<std::uint8_t, GelfChunkHeaderSize> Header;
+    size_t HeaderSize{0};
+    const char *Payload{nullptr};
+    size_t PayloadSize{0};
+    /// \brief Identifies the message, which is split into several datagrams
+    /// if it is chunked.
+    std::uint64_t MessageNr{0};
+  };
+
+  void threadFunction();
+  bool openSocket();
+  /// \brief Close the socket after a failed send and try to open it again
+  /// later.
+  /// \param[in] Error The reason for closing the socket.
+  void closeSocket(const asio::error_code &Error);
+  void addDatagrams(const char *Message, size_t Size);
+  void sendDatagrams();
+  /// \brief Send up to Count datagrams, starting at First, with one system
+  /// call.
+  /// \return The number of datagrams sent or skipped. Zero if the socket has
+  /// been closed.
+  size_t sendDatagrams(size_t First, size_t Count);
+  /// \brief Count the messages of datagrams that could not be sent as
+  /// discarded.
+  void discardDatagrams(size_t First, size_t Count);
+
+  const GraylogUdpSettings Settings;
+  std::string HostAddress;
+  std::string HostPort;
+  StatusTracker State;
+  std::chrono::steady_clock::time_point NextAddressLookup;
+
+  std::uint64_t NextMessageId;
+  std::uint64_t NextMessageNr{1};
+  std::uint64_t LastDiscardedMessageNr{0};
+  std::vector<QueuedMessage> CurrentBatch;
+  std::vector<Datagram> Datagrams;
+#ifdef WITH_ZLIB
+  std::unique_ptr<Compressor> PayloadCompressor;
+  /// \brief The compressed versions of the messages in CurrentBatch. Kept
+  /// between batches in order to re-use the allocated memory.
+  std::vector<std::vector<char>> CompressedBatch;
+#endif
+#ifdef __linux__
+  std::vector<mmsghdr> MessageHeaders;
+  std::vector<iovec> IoVectors;
+#endif
+
+  asio::io_service Service;
+  /// \brief A UDP socket or, see GraylogUdpSettings::UnixSocketPath, a Unix
+  /// domain datagram socket.
+  asio::generic::datagram_protocol::socket Socket;
+  MetricsRecorder Metrics;
+  /// \brief Limits the number and the size of the queued messages (not
+  /// counting flush and stop requests).
+  QueueBudget Budget;
+  moodycamel::BlockingConcurrentQueue<QueuedMessage> LogMessages;
+  std::thread SendThread; // Must be last
+};
+
+} // namespace Log
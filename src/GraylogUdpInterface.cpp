@@ -0,0 +1,108 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief The interface implementation for sending messages to a graylog
+/// server over UDP.
+///
+//===----------------------------------------------------------------------===//
+
+#include "graylog_logger/GraylogUdpInterface.hpp"
+#include "GelfMessage.hpp"
+#include "GraylogUdpConnection.hpp"
+#include "graylog_logger/MemoryBudget.hpp"
+#include <ciso646>
+
+namespace Log {
+
+GraylogUdpConnection::GraylogUdpConnection(std::string Host, int Port,
+                                           const GraylogUdpSettings &Settings)
+    : Pimpl(std::make_unique<Impl>(std::move(Host), Port, Settings)) {}
+
+GraylogUdpConnection::~GraylogUdpConnection() = default;
+
+void GraylogUdpConnection::sendMessage(std::string Msg) {
+  Pimpl->sendMessage(std::move(Msg));
+}
+
+void GraylogUdpConnection::sendMessages(std::vector<std::string> Msgs) {
+  Pimpl->sendMessages(std::move(Msgs));
+}
+
+Status GraylogUdpConnection::getConnectionStatus() const {
+  return Pimpl->getConnectionStatus();
+}
+
+bool GraylogUdpConnection::messageQueueEmpty() {
+  return Pimpl->queueSize() == 0;
+}
+
+size_t GraylogUdpConnection::messageQueueSize() { return Pimpl->queueSize(); }
+
+bool GraylogUdpConnection::flush(std::chrono::system_clock::duration TimeOut) {
+  return Pimpl->flush(TimeOut);
+}
+
+MetricsSnapshot GraylogUdpConnection::getMetrics() const {
+  return Pimpl->getMetrics();
+}
+
+size_t GraylogUdpConnection::addStatusCallback(StatusCallback Callback) {
+  return Pimpl->statusTracker().addCallback(std::move(Callback));
+}
+
+void GraylogUdpConnection::removeStatusCallback(size_t Id) {
+  Pimpl->statusTracker().removeCallback(Id);
+}
+
+StatusDurations GraylogUdpConnection::getTimeInStatus() const {
+  return Pimpl->statusTracker().timeInStatus();
+}
+
+void GraylogUdpConnection::messagesDropped(size_t NrOfMessages) {
+  Pimpl->dropped(NrOfMessages);
+}
+
+GraylogUdpInterface::GraylogUdpInterface(const std::string &Host, int Port,
+                                         const GraylogUdpSettings &Settings)
+    : GraylogUdpConnection(Host, Port, Settings), Format(Settings.Format) {}
+
+void GraylogUdpInterface::addMessage(const LogMessage &Message) {
+  if (not MemoryBudget::global().accepts(Message.SeverityLevel)) {
+    messagesDropped(1);
+    return;
+  }
+  sendMessage(logMessageToGelf(Message, Format));
+}
+
+void GraylogUdpInterface::addMessages(
+    minimal::span<const LogMessage *const> Messages) {
+  std::vector<std::string> SerialisedMessages;
+  SerialisedMessages.reserve(Messages.size());
+  auto &Budget = MemoryBudget::global();
+  for (auto CMessage : Messages) {
+    // Shed low severity messages before spending time on serialising them.
+    if (Budget.accepts(CMessage->SeverityLevel)) {
+      SerialisedMessages.emplace_back(logMessageToGelf(*CMessage, Format));
+    }
+  }
+  if (SerialisedMessages.size() < Messages.size()) {
+    messagesDropped(Messages.size() - SerialisedMessages.size());
+  }
+  sendMessages(std::move(SerialisedMessages));
+}
+
+bool GraylogUdpInterface::flush(std::chrono::system_clock::duration TimeOut) {
+  return GraylogUdpConnection::flush(TimeOut);
+}
+
+bool GraylogUdpInterface::emptyQueue() { return messageQueueEmpty(); }
+
+size_t GraylogUdpInterface::queueSize() { return messageQueueSize(); }
+
+MetricsSnapshot GraylogUdpInterface::getMetrics() const {
+  return GraylogUdpConnection::getMetrics();
+}
+
+} // namespace Log
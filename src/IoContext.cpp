@@ -0,0 +1,37 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Implementation of the io_context shared by connections.
+///
+//===----------------------------------------------------------------------===//
+
+#include "graylog_logger/IoContext.hpp"
+#include <algorithm>
+
+namespace Log {
+
+IoContext::IoContext(size_t NrOfThreads)
+    : OwnedContext(std::make_unique<asio::io_service>()),
+      Context(*OwnedContext),
+      Work(std::make_unique<asio::io_service::work>(Context)) {
+  for (size_t i = 0; i < std::max<size_t>(NrOfThreads, 1); ++i) {
+    Threads.emplace_back([this]() { Context.run(); });
+  }
+}
+
+IoContext::IoContext(asio::io_service &External) : Context(External) {}
+
+IoContext::~IoContext() {
+  if (OwnedContext == nullptr) {
+    return;
+  }
+  Work.reset();
+  Context.stop();
+  for (auto &CThread : Threads) {
+    CThread.join();
+  }
+}
+
+} // namespace Log
@@ -0,0 +1,267 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Implementation of the io_uring based writer.
+///
+//===----------------------------------------------------------------------===//
+
+#include "IoUring.hpp"
+
+#ifdef WITH_IO_URING
+
+#include <algorithm>
+#include <cerrno>
+#include <ciso646>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace Log {
+
+namespace {
+/// \brief user_data of requests whose completions are ignored.
+const std::uint64_t IgnoredCompletion{~std::uint64_t(0)};
+
+void *mapRing(int Fd, size_t Size, off_t Offset) {
+  auto Result = ::mmap(nullptr, Size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, Fd, Offset);
+  return Result == MAP_FAILED ? nullptr : Result;
+}
+
+template <typename T> T *ringField(void *Ring, std::uint32_t Offset) {
+  return reinterpret_cast<T *>(static_cast<char *>(Ring) + Offset);
+}
+} // namespace
+
+IoUring::IoUring(unsigned Entries) {
+  io_uring_params Params;
+  std::memset(&Params, 0, sizeof(Params));
+  auto Fd = static_cast<int>(::syscall(__NR_io_uring_setup, Entries, &Params));
+  if (Fd < 0) {
+    return;
+  }
+  // IORING_OP_WRITE and IORING_OP_ASYNC_CANCEL are available since 5.6.
+  if (not(Params.features & IORING_FEAT_RW_CUR_POS)) {
+    ::close(Fd);
+    return;
+  }
+  SqRingSize = Params.sq_off.array + Params.sq_entries * sizeof(unsigned);
+  CqRingSize = Params.cq_off.cqes + Params.cq_entries * sizeof(io_uring_cqe);
+  const bool SingleMmap = Params.features & IORING_FEAT_SINGLE_MMAP;
+  if (SingleMmap) {
+    SqRingSize = CqRingSize = std::max(SqRingSize, CqRingSize);
+  }
+  SqRing = mapRing(Fd, SqRingSize, IORING_OFF_SQ_RING);
+  CqRing = SingleMmap ? SqRing : mapRing(Fd, CqRingSize, IORING_OFF_CQ_RING);
+  SqesSize = Params.sq_entries * sizeof(io_uring_sqe);
+  Sqes = static_cast<io_uring_sqe *>(mapRing(Fd, SqesSize, IORING_OFF_SQES));
+  if (SqRing == nullptr or CqRing == nullptr or Sqes == nullptr) {
+    unmap();
+    ::close(Fd);
+    return;
+  }
+  SqHead = ringField<unsigned>(SqRing, Params.sq_off.head);
+  SqTail = ringField<unsigned>(SqRing, Params.sq_off.tail);
+  SqArray = ringField<unsigned>(SqRing, Params.sq_off.array);
+  SqMask = *ringField<unsigned>(SqRing, Params.sq_off.ring_mask);
+  SqEntries = Params.sq_entries;
+  LocalSqTail = *SqTail;
+  CqHead = ringField<unsigned>(CqRing, Params.cq_off.head);
+  CqTail = ringField<unsigned>(CqRing, Params.cq_off.tail);
+  CqMask = *ringField<unsigned>(CqRing, Params.cq_off.ring_mask);
+  Cqes = ringField<io_uring_cqe>(CqRing, Params.cq_off.cqes);
+  RingFd = Fd;
+}
+
+IoUring::~IoUring() {
+  if (RingFd < 0) {
+    return;
+  }
+  unmap();
+  // Requests in progress are cancelled by the kernel.
+  ::close(RingFd);
+}
+
+void IoUring::unmap() {
+  if (Sqes != nullptr) {
+    ::munmap(Sqes, SqesSize);
+  }
+  if (CqRing != nullptr and CqRing != SqRing) {
+    ::munmap(CqRing, CqRingSize);
+  }
+  if (SqRing != nullptr) {
+    ::munmap(SqRing, SqRingSize);
+  }
+}
+
+int IoUring::registerBuffers(const std::vector<iovec> &Buffers) {
+  auto Result =
+      ::syscall(__NR_io_uring_register, RingFd, IORING_REGISTER_BUFFERS,
+                Buffers.data(), static_cast<unsigned>(Buffers.size()));
+  return Result < 0 ? -errno : 0;
+}
+
+io_uring_sqe *IoUring::getSqe() {
+  auto Head = __atomic_load_n(SqHead, __ATOMIC_ACQUIRE);
+  if (LocalSqTail - Head >= SqEntries) {
+    return nullptr;
+  }
+  auto Index = LocalSqTail & SqMask;
+  SqArray[Index] = Index;
+  ++LocalSqTail;
+  auto Sqe = &Sqes[Index];
+  std::memset(Sqe, 0, sizeof(*Sqe));
+  return Sqe;
+}
+
+int IoUring::submit(unsigned WaitFor) {
+  __atomic_store_n(SqTail, LocalSqTail, __ATOMIC_RELEASE);
+  auto ToSubmit = LocalSqTail - __atomic_load_n(SqHead, __ATOMIC_ACQUIRE);
+  if (ToSubmit == 0 and WaitFor == 0) {
+    return 0;
+  }
+  unsigned Flags = WaitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+  while (true) {
+    auto Result = ::syscall(__NR_io_uring_enter, RingFd, ToSubmit, WaitFor,
+                            Flags, nullptr, 0);
+    if (Result >= 0) {
+      return static_cast<int>(Result);
+    }
+    if (errno != EINTR) {
+      return -errno;
+    }
+  }
+}
+
+bool IoUring::popCompletion(io_uring_cqe &Completion) {
+  auto Head = *CqHead;
+  if (Head == __atomic_load_n(CqTail, __ATOMIC_ACQUIRE)) {
+    return false;
+  }
+  Completion = Cqes[Head & CqMask];
+  __atomic_store_n(CqHead, Head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+IoUringWriter::IoUringWriter(size_t NrOfBuffers, size_t BufferSize)
+    : NrOfBuffers(NrOfBuffers), BufferSize(BufferSize),
+      Memory(new char[NrOfBuffers * BufferSize]), Sizes(NrOfBuffers),
+      Ring(static_cast<unsigned>(2 * NrOfBuffers)) {
+  if (not Ring.isOpen()) {
+    return;
+  }
+  std::vector<iovec> Buffers;
+  for (size_t i = 0; i < NrOfBuffers; ++i) {
+    Buffers.push_back({Memory.get() + i * BufferSize, BufferSize});
+  }
+  Registered = Ring.registerBuffers(Buffers) == 0;
+}
+
+IoUringWriter::~IoUringWriter() {
+  if (not isOpen() or inFlight() == 0) {
+    return;
+  }
+  cancel();
+  while (inFlight() > 0) {
+    waitCompletion();
+  }
+}
+
+char *IoUringWriter::nextBuffer() {
+  if (inFlight() >= NrOfBuffers) {
+    return nullptr;
+  }
+  return Memory.get() + (Queued % NrOfBuffers) * BufferSize;
+}
+
+void IoUringWriter::queueWrite(int Fd, size_t Size) {
+  auto Slot = Queued % NrOfBuffers;
+  // There is room for one write and one cancellation per buffer.
+  auto Sqe = Ring.getSqe();
+  Sqe->opcode = Registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+  if (LastQueued != nullptr) {
+    LastQueued->flags |= IOSQE_IO_LINK;
+  } else if (inFlight() > 0) {
+    Sqe->flags = IOSQE_IO_DRAIN;
+  }
+  LastQueued = Sqe;
+  Sqe->fd = Fd;
+  Sqe->addr =
+      reinterpret_cast<std::uint64_t>(Memory.get() + Slot * BufferSize);
+  Sqe->len = static_cast<std::uint32_t>(Size);
+  // Ignored for files opened with O_APPEND, must be zero for sockets.
+  Sqe->off = 0;
+  Sqe->buf_index = static_cast<std::uint16_t>(Slot);
+  Sqe->user_data = Queued;
+  Sizes[Slot] = Size;
+  ++Queued;
+}
+
+int IoUringWriter::submit() {
+  LastQueued = nullptr;
+  auto Result = Ring.submit();
+  return Result < 0 ? Result : 0;
+}
+
+bool IoUringWriter::completion(Result &Done) {
+  io_uring_cqe Completion;
+  while (Ring.popCompletion(Completion)) {
+    if (Completion.user_data == IgnoredCompletion) {
+      continue;
+    }
+    // The writes complete in order.
+    Done = {Completion.res, Sizes[Completion.user_data % NrOfBuffers]};
+    ++Completed;
+    return true;
+  }
+  return false;
+}
+
+IoUringWriter::Result IoUringWriter::waitCompletion() {
+  Result Done{0, 0};
+  while (not completion(Done)) {
+    auto Error = Ring.submit(1);
+    if (Error < 0) {
+      // Can only fail if the ring is unusable.
+      Done = {Error, Sizes[Completed % NrOfBuffers]};
+      ++Completed;
+      return Done;
+    }
+  }
+  return Done;
+}
+
+void IoUringWriter::cancel() {
+  for (auto Id = Completed; Id < Queued; ++Id) {
+    auto Sqe = Ring.getSqe();
+    if (Sqe == nullptr) {
+      break;
+    }
+    Sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    Sqe->fd = -1;
+    Sqe->addr = Id;
+    Sqe->user_data = IgnoredCompletion;
+  }
+  LastQueued = nullptr;
+  Ring.submit();
+}
+
+} // namespace Log
+
+#endif
+
+namespace Log {
+
+bool IoUringAvailable() {
+#ifdef WITH_IO_URING
+  static const bool Available = IoUring(1).isOpen();
+  return Available;
+#else
+  return false;
+#endif
+}
+
+} // namespace Log
@@ -0,0 +1,171 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Writing to files and sockets through a Linux io_uring.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "graylog_logger/IoBackend.hpp"
+#include "graylog_logger/LibConfig.hpp"
+
+#ifdef WITH_IO_URING
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <memory>
+#include <sys/uio.h>
+#include <vector>
+
+namespace Log {
+
+/// \brief A minimal io_uring, set up and used with the system calls directly
+/// (i.e. liburing is not required).
+///
+/// Not thread safe.
+class IoUring {
+public:
+  /// \param[in] Entries The (minimum) size of the submission queue.
+  explicit IoUring(unsigned Entries);
+  ~IoUring();
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  /// \brief False if the ring could not be set up, e.g. because the kernel
+  /// is older than 5.6 or io_uring has been disabled.
+  bool isOpen() const { return RingFd >= 0; }
+
+  /// \brief The file descriptor of the ring, which is readable (see poll()
+  /// and epoll) when there are completions.
+  int fd() const { return RingFd; }
+
+  /// \brief Register buffers for IORING_OP_WRITE_FIXED.
+  /// \return Zero on success, a negative errno value otherwise.
+  int registerBuffers(const std::vector<iovec> &Buffers);
+
+  /// \brief A cleared submission queue entry to fill in.
+  /// \return nullptr if the submission queue is full.
+  io_uring_sqe *getSqe();
+
+  /// \brief Pass the entries returned by getSqe() to the kernel.
+  /// \param[in] WaitFor Return once there is at least this number of
+  /// completions.
+  /// \return The number of submitted entries or a negative errno value.
+  /// Does not enter the kernel if there is nothing to submit or wait for.
+  int submit(unsigned WaitFor = 0);
+
+  /// \brief Take the oldest completion (if any) without entering the kernel.
+  bool popCompletion(io_uring_cqe &Completion);
+
+private:
+  void unmap();
+  int RingFd{-1};
+  void *SqRing{nullptr};
+  size_t SqRingSize{0};
+  void *CqRing{nullptr};
+  size_t CqRingSize{0};
+  io_uring_sqe *Sqes{nullptr};
+  size_t SqesSize{0};
+  unsigned *SqHead{nullptr};
+  unsigned *SqTail{nullptr};
+  unsigned *SqArray{nullptr};
+  unsigned SqMask{0};
+  unsigned SqEntries{0};
+  /// \brief The tail including the entries that have not been submitted.
+  unsigned LocalSqTail{0};
+  unsigned *CqHead{nullptr};
+  unsigned *CqTail{nullptr};
+  unsigned CqMask{0};
+  io_uring_cqe *Cqes{nullptr};
+};
+
+/// \brief Writes to a file or a stream socket through an io_uring, from
+/// buffers that are registered with the kernel.
+///
+/// The data is written in order: the writes queued before a call to
+/// submit() are linked (IOSQE_IO_LINK), each starts once the previous one
+/// has completed, and the first of them waits for the writes that are
+/// already in progress (IOSQE_IO_DRAIN). If a linked write fails or is
+/// short, the writes after it complete with -ECANCELED. Writes are submitted
+/// in batches and their completions are taken from the ring without system
+/// calls. Not thread safe.
+class IoUringWriter {
+public:
+  /// \brief The outcome of a write.
+  struct Result {
+    /// \brief The number of bytes written or a negative errno value.
+    int Written;
+    /// \brief The number of bytes that were to be written.
+    size_t Size;
+  };
+
+  /// \param[in] NrOfBuffers The maximum number of writes in progress.
+  /// \param[in] BufferSize The maximum size of one write.
+  IoUringWriter(size_t NrOfBuffers, size_t BufferSize);
+  /// \brief Cancel the writes in progress and wait for them to complete, as
+  /// the kernel may still access their buffers.
+  ~IoUringWriter();
+  IoUringWriter(const IoUringWriter &) = delete;
+  IoUringWriter &operator=(const IoUringWriter &) = delete;
+
+  bool isOpen() const { return Ring.isOpen(); }
+
+  /// \brief See IoUring::fd().
+  int fd() const { return Ring.fd(); }
+
+  size_t bufferSize() const { return BufferSize; }
+
+  /// \brief The buffer to fill for the next write.
+  /// \return nullptr if all buffers are used by writes in progress.
+  char *nextBuffer();
+
+  /// \brief Queue a write of the first Size bytes of nextBuffer(). It is
+  /// started by the next call to submit().
+  /// \param[in] Fd A regular file (opened with O_APPEND) or a stream socket.
+  /// \param[in] Size The number of bytes to write.
+  void queueWrite(int Fd, size_t Size);
+
+  /// \brief Start the queued writes with one system call.
+  /// \return Zero on success, a negative errno value otherwise.
+  int submit();
+
+  /// \brief The number of writes that have not completed.
+  size_t inFlight() const { return Queued - Completed; }
+
+  /// \brief Get the outcome of the oldest write if it has completed. Does
+  /// not enter the kernel.
+  bool completion(Result &Done);
+
+  /// \brief Wait for the oldest write to complete.
+  /// \note Only call with writes in flight.
+  Result waitCompletion();
+
+  /// \brief Ask the kernel to cancel the writes in progress. They complete
+  /// with -ECANCELED, unless they complete before being cancelled.
+  void cancel();
+
+private:
+  size_t NrOfBuffers;
+  size_t BufferSize;
+  std::unique_ptr<char[]> Memory;
+  std::vector<size_t> Sizes;
+  /// \brief Declared after the buffers, so that the ring is closed before
+  /// they are freed.
+  IoUring Ring;
+  /// \brief Use IORING_OP_WRITE_FIXED. Registering can fail because of
+  /// the locked memory limit of older kernels, plain writes are used then.
+  bool Registered{false};
+  /// \brief The last write queued since the last submit(), if any. The next
+  /// write is linked to it.
+  io_uring_sqe *LastQueued{nullptr};
+  std::uint64_t Queued{0};
+  std::uint64_t Completed{0};
+};
+
+} // namespace Log
+
+#endif
@@ -0,0 +1,131 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Implementation of appending to a file through an io_uring.
+///
+//===----------------------------------------------------------------------===//
+
+#include "IoUringFile.hpp"
+
+#ifdef WITH_IO_URING
+
+#include <algorithm>
+#include <ciso646>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace Log {
+
+namespace {
+const size_t NrOfBuffers{4};
+const size_t BufferSize{128 * 1024};
+} // namespace
+
+IoUringFile::IoUringFile(std::string const &Name)
+    : Writer(std::make_unique<IoUringWriter>(NrOfBuffers, BufferSize)) {
+  if (not Writer->isOpen()) {
+    return;
+  }
+  Fd = ::open(Name.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+}
+
+IoUringFile::~IoUringFile() {
+  if (Fd < 0) {
+    return;
+  }
+  flush();
+  ::close(Fd);
+}
+
+bool IoUringFile::isOpen() const { return Fd >= 0 and not Failed; }
+
+void IoUringFile::append(const char *Data, size_t Size) {
+  if (not isOpen()) {
+    return;
+  }
+  while (Size > 0) {
+    while (Buffer == nullptr) {
+      Buffer = Writer->nextBuffer();
+      if (Buffer == nullptr) {
+        // All buffers are being written.
+        Writer->submit();
+        auto Done = Writer->waitCompletion();
+        Failed |= Done.Written < 0 or size_t(Done.Written) != Done.Size;
+      }
+    }
+    auto Part = std::min(Size, Writer->bufferSize() - BufferUsed);
+    std::memcpy(Buffer + BufferUsed, Data, Part);
+    BufferUsed += Part;
+    Data += Part;
+    Size -= Part;
+    if (BufferUsed == Writer->bufferSize()) {
+      queueBuffer();
+    }
+  }
+}
+
+void IoUringFile::submit() {
+  if (not isOpen()) {
+    return;
+  }
+  queueBuffer();
+  Writer->submit();
+  checkCompletions(false);
+}
+
+void IoUringFile::flush() {
+  if (Fd < 0) {
+    return;
+  }
+  queueBuffer();
+  Writer->submit();
+  checkCompletions(true);
+}
+
+void IoUringFile::queueBuffer() {
+  if (BufferUsed == 0) {
+    return;
+  }
+  Writer->queueWrite(Fd, BufferUsed);
+  Buffer = nullptr;
+  BufferUsed = 0;
+}
+
+void IoUringFile::checkCompletions(bool Wait) {
+  IoUringWriter::Result Done{0, 0};
+  while (Writer->inFlight() > 0) {
+    if (Wait) {
+      Done = Writer->waitCompletion();
+    } else if (not Writer->completion(Done)) {
+      return;
+    }
+    // A short write to a regular file means that the disk is full or that
+    // the file size limit has been reached.
+    Failed |= Done.Written < 0 or size_t(Done.Written) != Done.Size;
+  }
+}
+
+} // namespace Log
+
+#else
+
+namespace Log {
+
+IoUringFile::IoUringFile(std::string const & /* Name */) {}
+
+IoUringFile::~IoUringFile() = default;
+
+bool IoUringFile::isOpen() const { return false; }
+
+void IoUringFile::append(const char * /* Data */, size_t /* Size */) {}
+
+void IoUringFile::submit() {}
+
+void IoUringFile::flush() {}
+
+} // namespace Log
+
+#endif
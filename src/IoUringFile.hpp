@@ -0,0 +1,61 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Appending to a file through a Linux io_uring.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "IoUring.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace Log {
+
+/// \brief Appends to a file through an io_uring, see IoUringWriter.
+///
+/// The data is copied into registered buffers. Full buffers are written in
+/// the background while the next ones are filled. Without io_uring support
+/// (WITH_IO_URING), the file is never opened.
+class IoUringFile {
+public:
+  /// \param[in] Name Name of the file. It is created if it does not exist.
+  explicit IoUringFile(std::string const &Name);
+  /// \brief Waits for the data to be written.
+  ~IoUringFile();
+  IoUringFile(const IoUringFile &) = delete;
+  IoUringFile &operator=(const IoUringFile &) = delete;
+
+  /// \brief False if the file or the ring could not be opened or if a write
+  /// has failed.
+  bool isOpen() const;
+
+  /// \brief Copy data into the buffers. Full buffers are written; this only
+  /// waits if all buffers are still being written.
+  void append(const char *Data, size_t Size);
+
+  /// \brief Start writing the data appended so far, without waiting for it
+  /// to be written.
+  void submit();
+
+  /// \brief Wait for the data appended so far to be written.
+  void flush();
+
+#ifdef WITH_IO_URING
+private:
+  void queueBuffer();
+  /// \param[in] Wait Wait for all writes in progress to complete.
+  void checkCompletions(bool Wait);
+  int Fd{-1};
+  std::unique_ptr<IoUringWriter> Writer;
+  char *Buffer{nullptr};
+  size_t BufferUsed{0};
+  bool Failed{false};
+#endif
+};
+
+} // namespace Log
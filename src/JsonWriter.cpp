@@ -0,0 +1,239 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Implementation of the JSON writing functions.
+///
+//===----------------------------------------------------------------------===//
+
+#include "JsonWriter.hpp"
+#include "Grisu2.hpp"
+#include <array>
+#include <ciso646>
+#include <cmath>
+#ifdef JSON_SCAN_SSE2
+#include <immintrin.h>
+#endif
+
+namespace Log {
+
+namespace {
+bool isPlainCharacter(unsigned char Character) {
+  return Character >= 0x20 and Character < 0x80 and Character != '"' and
+         Character != '\\';
+}
+
+bool isContinuationByte(unsigned char Character) {
+  return (Character & 0xC0) == 0x80;
+}
+
+/// \brief The length of the UTF-8 sequence starting at Data or zero if it is
+/// not a valid (shortest form, non-surrogate) sequence.
+size_t utf8SequenceLength(const unsigned char *Data, size_t Size) {
+  auto Lead = Data[0];
+  size_t Length{0};
+  unsigned char SecondMin{0x80};
+  unsigned char SecondMax{0xBF};
+  if (Lead >= 0xC2 and Lead <= 0xDF) {
+    Length = 2;
+  } else if (Lead >= 0xE0 and Lead <= 0xEF) {
+    Length = 3;
+    if (Lead == 0xE0) {
+      SecondMin = 0xA0; // Overlong
+    } else if (Lead == 0xED) {
+      SecondMax = 0x9F; // Surrogates
+    }
+  } else if (Lead >= 0xF0 and Lead <= 0xF4) {
+    Length = 4;
+    if (Lead == 0xF0) {
+      SecondMin = 0x90; // Overlong
+    } else if (Lead == 0xF4) {
+      SecondMax = 0x8F; // Above U+10FFFF
+    }
+  } else {
+    return 0;
+  }
+  if (Size < Length or Data[1] < SecondMin or Data[1] > SecondMax) {
+    return 0;
+  }
+  for (size_t i = 2; i < Length; ++i) {
+    if (not isContinuationByte(Data[i])) {
+      return 0;
+    }
+  }
+  return Length;
+}
+
+void appendEscapedCharacter(std::string &Output, unsigned char Character) {
+  switch (Character) {
+  case '"':
+    Output.append("\\\"", 2);
+    break;
+  case '\\':
+    Output.append("\\\\", 2);
+    break;
+  case '\b':
+    Output.append("\\b", 2);
+    break;
+  case '\f':
+    Output.append("\\f", 2);
+    break;
+  case '\n':
+    Output.append("\\n", 2);
+    break;
+  case '\r':
+    Output.append("\\r", 2);
+    break;
+  case '\t':
+    Output.append("\\t", 2);
+    break;
+  default: {
+    const char *HexDigits = "0123456789abcdef";
+    char Escaped[6] = {'\\', 'u', '0', '0', HexDigits[Character >> 4],
+                       HexDigits[Character & 0x0F]};
+    Output.append(Escaped, sizeof(Escaped));
+  }
+  }
+}
+} // namespace
+
+namespace JsonScan {
+size_t scalar(const char *Data, size_t Size) {
+  auto Bytes = reinterpret_cast<const unsigned char *>(Data);
+  size_t i{0};
+  while (i < Size and isPlainCharacter(Bytes[i])) {
+    ++i;
+  }
+  return i;
+}
+
+#ifdef JSON_SCAN_SSE2
+size_t sse2(const char *Data, size_t Size) {
+  const size_t BlockSize{16};
+  // Bytes >= 0x80 are negative when compared as signed characters and are
+  // thus found together with the control characters.
+  const auto Space = _mm_set1_epi8(' ');
+  const auto Quote = _mm_set1_epi8('"');
+  const auto Backslash = _mm_set1_epi8('\\');
+  size_t i{0};
+  for (; i + BlockSize <= Size; i += BlockSize) {
+    auto Block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(Data + i));
+    auto Special = _mm_or_si128(
+        _mm_cmplt_epi8(Block, Space),
+        _mm_or_si128(_mm_cmpeq_epi8(Block, Quote),
+                     _mm_cmpeq_epi8(Block, Backslash)));
+    auto Mask = static_cast<unsigned int>(_mm_movemask_epi8(Special));
+    if (Mask != 0) {
+      return i + static_cast<size_t>(__builtin_ctz(Mask));
+    }
+  }
+  return i + scalar(Data + i, Size - i);
+}
+#endif
+
+#ifdef JSON_SCAN_AVX2
+__attribute__((target("avx2"))) size_t avx2(const char *Data, size_t Size) {
+  const size_t BlockSize{32};
+  const auto Space = _mm256_set1_epi8(' ');
+  const auto Quote = _mm256_set1_epi8('"');
+  const auto Backslash = _mm256_set1_epi8('\\');
+  size_t i{0};
+  for (; i + BlockSize <= Size; i += BlockSize) {
+    auto Block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Data + i));
+    // As _mm256_cmplt_epi8() does not exist: ' ' > Block.
+    auto Special = _mm256_or_si256(
+        _mm256_cmpgt_epi8(Space, Block),
+        _mm256_or_si256(_mm256_cmpeq_epi8(Block, Quote),
+                        _mm256_cmpeq_epi8(Block, Backslash)));
+    auto Mask = static_cast<unsigned int>(_mm256_movemask_epi8(Special));
+    if (Mask != 0) {
+      return i + static_cast<size_t>(__builtin_ctz(Mask));
+    }
+  }
+  return i + sse2(Data + i, Size - i);
+}
+
+bool cpuHasAvx2() { return __builtin_cpu_supports("avx2"); }
+#endif
+
+Function fastest() {
+#ifdef JSON_SCAN_AVX2
+  if (cpuHasAvx2()) {
+    return avx2;
+  }
+#endif
+#ifdef JSON_SCAN_SSE2
+  return sse2;
+#else
+  return scalar;
+#endif
+}
+} // namespace JsonScan
+
+void appendJsonEscaped(std::string &Output, const char *Data, size_t Size) {
+  static const JsonScan::Function FindSpecialCharacter = JsonScan::fastest();
+  appendJsonEscaped(Output, Data, Size, FindSpecialCharacter);
+}
+
+void appendJsonEscaped(std::string &Output, const char *Data, size_t Size,
+                       JsonScan::Function FindSpecialCharacter) {
+  auto Bytes = reinterpret_cast<const unsigned char *>(Data);
+  size_t Start{0};
+  size_t i{0};
+  while (true) {
+    // Runs of plain characters are copied in one go.
+    i += FindSpecialCharacter(Data + i, Size - i);
+    if (i >= Size) {
+      break;
+    }
+    if (Bytes[i] >= 0x80) {
+      auto Length = utf8SequenceLength(Bytes + i, Size - i);
+      if (Length > 0) {
+        i += Length;
+        continue;
+      }
+    }
+    Output.append(Data + Start, i - Start);
+    if (Bytes[i] >= 0x80) {
+      Output.append("\xEF\xBF\xBD", 3);
+    } else {
+      appendEscapedCharacter(Output, Bytes[i]);
+    }
+    Start = ++i;
+  }
+  Output.append(Data + Start, Size - Start);
+}
+
+void appendJsonInteger(std::string &Output, std::int64_t Value) {
+  std::array<char, 20> Digits;
+  auto End = Digits.end();
+  auto Begin = End;
+  auto Magnitude = Value < 0 ? 0 - static_cast<std::uint64_t>(Value)
+                             : static_cast<std::uint64_t>(Value);
+  do {
+    *--Begin = static_cast<char>('0' + Magnitude % 10);
+    Magnitude /= 10;
+  } while (Magnitude > 0);
+  if (Value < 0) {
+    Output.push_back('-');
+  }
+  Output.append(Begin, End);
+}
+
+void appendJsonDouble(std::string &Output, double Value) {
+  if (not std::isfinite(Value)) {
+    Output.append("null", 4);
+    return;
+  }
+  // The same (Grisu2) formatting as nlohmann::json, in order to produce the
+  // same output as before.
+  std::array<char, 64> Buffer;
+  auto End =
+      grisu2::toChars(Buffer.data(), Buffer.data() + Buffer.size(), Value);
+  Output.append(Buffer.data(), End);
+}
+
+} // namespace Log
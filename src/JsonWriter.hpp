@@ -0,0 +1,75 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Functions for appending JSON values to a string.
+///
+/// The output is identical to that of nlohmann::json::dump() for valid
+/// UTF-8 strings.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Log {
+
+/// \brief Functions that find the first byte of a string that can not be
+/// copied to a JSON string as it is, i.e. a quote, a backslash, a control
+/// character or a non-ASCII byte. They all return the index of that byte or
+/// Size if there is none.
+///
+/// appendJsonEscaped() uses the fastest one supported by the CPU.
+namespace JsonScan {
+using Function = size_t (*)(const char *Data, size_t Size);
+size_t scalar(const char *Data, size_t Size);
+#if defined(__GNUC__) && defined(__SSE2__)
+#define JSON_SCAN_SSE2
+/// \brief Scans 16 bytes at a time. SSE2 is available on all x86-64 CPUs.
+size_t sse2(const char *Data, size_t Size);
+#if defined(__x86_64__)
+#define JSON_SCAN_AVX2
+/// \brief Scans 32 bytes at a time.
+/// \note Only call this function if cpuHasAvx2() returns true.
+size_t avx2(const char *Data, size_t Size);
+bool cpuHasAvx2();
+#endif
+#endif
+/// \brief The fastest function supported by the CPU.
+Function fastest();
+} // namespace JsonScan
+
+/// \brief Append the escaped contents of a JSON string (without the quotes).
+///
+/// Quotes, backslashes and control characters are escaped, other characters
+/// (including non-ASCII UTF-8 sequences) are copied as they are. Bytes that
+/// are not part of a valid UTF-8 sequence are replaced with U+FFFD.
+/// \param[out] Output The escaped string is appended to this string.
+/// \param[in] Data The (UTF-8) string to escape.
+/// \param[in] Size The size of the string in bytes.
+void appendJsonEscaped(std::string &Output, const char *Data, size_t Size);
+
+/// \brief appendJsonEscaped() using a specific scan function.
+void appendJsonEscaped(std::string &Output, const char *Data, size_t Size,
+                       JsonScan::Function FindSpecialCharacter);
+
+/// \brief Append a quoted and escaped JSON string.
+inline void appendJsonString(std::string &Output, const std::string &Value) {
+  Output.push_back('"');
+  appendJsonEscaped(Output, Value.data(), Value.size());
+  Output.push_back('"');
+}
+
+/// \brief Append an integer.
+void appendJsonInteger(std::string &Output, std::int64_t Value);
+
+/// \brief Append a floating point number, using the shortest representation
+/// that is parsed back to the same value. Integral values get a ".0" suffix
+/// and non-finite values are written as null.
+void appendJsonDouble(std::string &Output, double Value);
+
+} // namespace Log
@@ -9,6 +9,8 @@
 
 #include "graylog_logger/Log.hpp"
 #include "graylog_logger/Logger.hpp"
+#include "graylog_logger/MemoryBudget.hpp"
+#include "graylog_logger/WorkerPool.hpp"
 #include <ciso646>
 
 namespace Log {
@@ -54,11 +56,25 @@ void SetMinimumSeverity(const Severity Level) {
   Logger::Inst().setMinSeverity(Level);
 }
 
+void SetQueueLimits(size_t MaxBytes, size_t MaxMessages) {
+  Logger::Inst().setQueueLimits(MaxBytes, MaxMessages);
+}
+
+void SetMemoryBudget(size_t MaxBytes) {
+  MemoryBudget::global().setLimit(MaxBytes);
+}
+
 void AddLogHandler(const LogHandler_P &Handler) {
   Logger::Inst().addLogHandler(Handler);
 }
 
+void UseSharedWorkerPool(size_t NrOfThreads) {
+  WorkerPool::setDefault(std::make_shared<WorkerPool>(NrOfThreads));
+}
+
 void RemoveAllHandlers() { Logger::Inst().removeAllHandlers(); }
 
 std::vector<LogHandler_P> GetHandlers() { return Logger::Inst().getHandlers(); }
+
+MetricsSnapshot GetMetrics() { return Logger::Inst().getMetrics(); }
 } // namespace Log
@@ -15,6 +15,68 @@
 
 namespace Log {
 
+namespace {
+std::atomic<std::uint64_t> SeverityThresholdVersion{0};
+std::atomic<std::uint64_t> LastStaticFieldsId{0};
+std::atomic<std::uint64_t> LastSequenceNumber{0};
+} // namespace
+
+std::uint64_t LogMessage::createStaticFieldsId() {
+  return ++LastStaticFieldsId;
+}
+
+std::uint64_t LogMessage::createSequenceNumber() {
+  return LastSequenceNumber.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+size_t LogMessage::approximateSize() const {
+  return sizeof(LogMessage) + MessageString.size() + ProcessName.size() +
+         Host.size() + ThreadId.size() + approximateSize(AdditionalFields);
+}
+
+size_t LogMessage::approximateSize(
+    const std::vector<std::pair<std::string, AdditionalField>> &Fields) {
+  size_t Size{0};
+  for (auto &Field : Fields) {
+    Size += sizeof(Field) + Field.first.size() + Field.second.strVal.size();
+  }
+  return Size;
+}
+
+MetricsSnapshot BaseLogHandler::getMetrics() const { return {}; }
+
+void BaseLogHandler::addMessages(
+    minimal::span<const LogMessage *const> Messages) {
+  for (auto CMessage : Messages) {
+    addMessage(*CMessage);
+  }
+}
+
+void BaseLogHandler::setMinSeverity(Severity Level) {
+  MinSeverity.store(int(Level));
+  ++SeverityThresholdVersion;
+}
+
+Severity BaseLogHandler::getMinSeverity() const {
+  return Severity(MinSeverity.load());
+}
+
+void BaseLogHandler::setMessageFilter(
+    std::function<bool(const LogMessage &)> Filter) {
+  MessageFilter = std::move(Filter);
+}
+
+bool BaseLogHandler::acceptsMessage(const LogMessage &Message) const {
+  if (not acceptsSeverity(Message.SeverityLevel)) {
+    return false;
+  }
+  return nullptr == MessageFilter or MessageFilter(Message);
+}
+
+std::uint64_t BaseLogHandler::severityThresholdVersion() {
+  return SeverityThresholdVersion.load();
+}
+
 void BaseLogHandler::setMessageStringCreatorFunction(
     std::function<std::string(const LogMessage &)> ParserFunction) {
   BaseLogHandler::MessageParser = std::move(ParserFunction);
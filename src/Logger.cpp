@@ -25,7 +25,9 @@ Logger::Logger() {
 }
 
 void Logger::addLogHandler(const LogHandler_P &Handler) {
+  relaxSeverityGate(Handler);
   Executor.SendWork([=]() {
+    dispatchPending();
     if (dynamic_cast<ConsoleInterface *>(Handler.get()) != nullptr) {
       bool replaced = false;
       for (auto ptr : Handlers) {
@@ -40,6 +42,7 @@ void Logger::addLogHandler(const LogHandler_P &Handler) {
     } else {
       Handlers.push_back(Handler);
     }
+    updateSeverityGate();
   });
 }
 
@@ -8,8 +8,11 @@
 //===----------------------------------------------------------------------===//
 
 #include "graylog_logger/LoggingBase.hpp"
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <ciso646>
+#include <limits>
 #include <sys/types.h>
 #include <thread>
 
@@ -93,7 +96,10 @@ std::string get_process_name() {
 }
 #endif
 
-LoggingBase::LoggingBase() {
+LoggingBase::LoggingBase() : LoggingBase(nullptr) {}
+
+LoggingBase::LoggingBase(std::shared_ptr<WorkerPool> Pool)
+    : Executor(std::move(Pool)) {
   Executor.SendWork([=]() {
     const int StringBufferSize = 100;
     std::array<char, StringBufferSize> StringBuffer{};
@@ -104,17 +110,36 @@ LoggingBase::LoggingBase() {
     }
     BaseMsg.ProcessId = getpid();
     BaseMsg.ProcessName = get_process_name();
+    BaseMsg.StaticFieldsId = LogMessage::createStaticFieldsId();
   });
 }
 
 LoggingBase::~LoggingBase() { LoggingBase::removeAllHandlers(); }
 
 void LoggingBase::addLogHandler(const LogHandler_P &Handler) {
-  Executor.SendWork([=]() { Handlers.push_back(Handler); });
+  relaxSeverityGate(Handler);
+  // Set here so that messages logged from now on get sequence numbers, and
+  // again below in case a pending removeAllHandlers() has reset it.
+  if (Handler->usesSequenceNumbers()) {
+    CreateSequenceNumbers = true;
+  }
+  Executor.SendWork([=]() {
+    dispatchPending();
+    Handlers.push_back(Handler);
+    if (Handler->usesSequenceNumbers()) {
+      CreateSequenceNumbers = true;
+    }
+    updateSeverityGate();
+  });
 }
 
 void LoggingBase::removeAllHandlers() {
-  Executor.SendWork([=]() { Handlers.clear(); });
+  Executor.SendWork([=]() {
+    dispatchPending();
+    Handlers.clear();
+    CreateSequenceNumbers = false;
+    updateSeverityGate();
+  });
 }
 
 std::vector<LogHandler_P> LoggingBase::getHandlers() { return Handlers; }
@@ -122,9 +147,99 @@ std::vector<LogHandler_P> LoggingBase::getHandlers() { return Handlers; }
 void LoggingBase::setMinSeverity(Severity Level) {
   auto WorkDone = std::make_shared<std::promise<void>>();
   auto WorkDoneFuture = WorkDone->get_future();
-  Executor.SendWork(
-      [=, WorkDone{std::move(WorkDone)}]() { MinSeverity = Level; });
+  Executor.SendWork([=, WorkDone{std::move(WorkDone)}]() {
+    MinSeverity = Level;
+    updateSeverityGate();
+  });
   WorkDoneFuture.wait();
 }
 
+void LoggingBase::setQueueLimits(size_t MaxBytes, size_t MaxMessages) {
+  Budget.setLimits(MaxBytes, MaxMessages);
+}
+
+bool LoggingBase::handlersAcceptSeverity(Severity Level) {
+  if (SeverityGateVersion != BaseLogHandler::severityThresholdVersion()) {
+    updateSeverityGate();
+  }
+  if (int(Level) > int(MinSeverity)) {
+    return false;
+  }
+  for (auto &CHandler : Handlers) {
+    if (CHandler->acceptsSeverity(Level)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void LoggingBase::queueForDispatch(LogMessage &&Message) {
+  PendingMessages.emplace_back(std::move(Message));
+  if (PendingMessages.size() >= MaxDispatchBatchSize) {
+    dispatchPending();
+    return;
+  }
+  // Messages created by work queued after this point are collected and
+  // dispatched together with this one.
+  if (not DispatchScheduled) {
+    DispatchScheduled = true;
+    Executor.SendWork([=]() { dispatchPending(); });
+  }
+}
+
+void LoggingBase::dispatchPending() {
+  DispatchScheduled = false;
+  if (PendingMessages.empty()) {
+    return;
+  }
+  Metrics.updateQueueDepth(PendingMessages.size());
+  auto Now = std::chrono::steady_clock::now();
+  auto SystemNow = std::chrono::system_clock::now();
+  for (auto &CMessage : PendingMessages) {
+    auto Age = Now - CMessage.MonotonicTimestamp;
+    CMessage.Timestamp =
+        SystemNow -
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(Age);
+    Metrics.latency(Age);
+  }
+  for (auto &CHandler : Handlers) {
+    HandlerMessages.clear();
+    for (auto &CMessage : PendingMessages) {
+      if (CHandler->acceptsMessage(CMessage)) {
+        HandlerMessages.push_back(&CMessage);
+      }
+    }
+    if (HandlerMessages.size() == 1) {
+      CHandler->addMessage(*HandlerMessages.front());
+    } else if (not HandlerMessages.empty()) {
+      CHandler->addMessages(HandlerMessages);
+    }
+  }
+  PendingMessages.clear();
+}
+
+void LoggingBase::updateSeverityGate() {
+  SeverityGateVersion = BaseLogHandler::severityThresholdVersion();
+  if (Handlers.empty()) {
+    // Do not discard messages that are logged before the first handler has
+    // been added.
+    SeverityGate = int(MinSeverity);
+    return;
+  }
+  int LeastRestrictive{std::numeric_limits<int>::min()};
+  for (auto &CHandler : Handlers) {
+    LeastRestrictive =
+        std::max(LeastRestrictive, int(CHandler->getMinSeverity()));
+  }
+  SeverityGate = std::min(int(MinSeverity), LeastRestrictive);
+}
+
+void LoggingBase::relaxSeverityGate(const LogHandler_P &Handler) {
+  auto NewGate = int(Handler->getMinSeverity());
+  auto CurrentGate = SeverityGate.load();
+  while (CurrentGate < NewGate and
+         not SeverityGate.compare_exchange_weak(CurrentGate, NewGate)) {
+  }
+}
+
 } // namespace Log
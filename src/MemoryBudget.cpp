@@ -0,0 +1,19 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Implements the process wide memory budget.
+///
+//===----------------------------------------------------------------------===//
+
+#include "graylog_logger/MemoryBudget.hpp"
+
+namespace Log {
+
+MemoryBudget &MemoryBudget::global() {
+  static MemoryBudget Budget;
+  return Budget;
+}
+
+} // namespace Log
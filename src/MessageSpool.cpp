@@ -0,0 +1,256 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Implements the disk-backed message store.
+///
+//===----------------------------------------------------------------------===//
+
+#include "MessageSpool.hpp"
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <cerrno>
+#include <ciso646>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace Log {
+
+namespace {
+const std::string SegmentPrefix{"graylog-spool-"};
+const std::string SegmentSuffix{".seg"};
+/// \brief Size of the length field in front of every message.
+const size_t RecordHeaderSize{sizeof(std::uint32_t)};
+/// \brief Set in the length field of messages that have been read.
+const std::uint32_t ReadFlag{0x80000000u};
+
+std::uint32_t loadLength(const char *Data) {
+  std::uint32_t Length;
+  std::memcpy(&Length, Data, sizeof(Length));
+  return Length;
+}
+
+void storeLength(char *Data, std::uint32_t Length) {
+  std::memcpy(Data, &Length, sizeof(Length));
+}
+} // namespace
+
+MessageSpool::MessageSpool(std::string Directory, size_t SegmentSize,
+                           size_t MaxBytes, MetricsRecorder &Metrics)
+    : Directory(std::move(Directory)),
+      SegmentSize(std::max(SegmentSize, RecordHeaderSize + 1)),
+      MaxBytes(MaxBytes), Metrics(Metrics) {
+  ::mkdir(this->Directory.c_str(), 0755);
+  recoverSegments();
+}
+
+MessageSpool::~MessageSpool() {
+  // Unread messages are left on disk and recovered by the next instance.
+  for (auto &CSegment : Segments) {
+    ::munmap(CSegment.Data, CSegment.Size);
+  }
+}
+
+void MessageSpool::recoverSegments() {
+  auto DirectoryHandle = ::opendir(Directory.c_str());
+  if (DirectoryHandle == nullptr) {
+    return;
+  }
+  std::vector<std::uint64_t> SegmentNumbers;
+  while (auto Entry = ::readdir(DirectoryHandle)) {
+    std::string Name(Entry->d_name);
+    if (Name.size() <= SegmentPrefix.size() + SegmentSuffix.size() or
+        Name.compare(0, SegmentPrefix.size(), SegmentPrefix) != 0 or
+        Name.compare(Name.size() - SegmentSuffix.size(), SegmentSuffix.size(),
+                     SegmentSuffix) != 0) {
+      continue;
+    }
+    SegmentNumbers.push_back(std::strtoull(
+        Name.c_str() + SegmentPrefix.size(), nullptr, 10));
+  }
+  ::closedir(DirectoryHandle);
+  std::sort(SegmentNumbers.begin(), SegmentNumbers.end());
+  for (auto Number : SegmentNumbers) {
+    Segment CSegment;
+    CSegment.FileName = Directory + "/" + SegmentPrefix +
+                        std::to_string(Number) + SegmentSuffix;
+    if (not mapSegment(CSegment, false)) {
+      continue;
+    }
+    scanSegment(CSegment);
+    if (CSegment.NrOfMessages == 0) {
+      ::munmap(CSegment.Data, CSegment.Size);
+      ::unlink(CSegment.FileName.c_str());
+      continue;
+    }
+    TotalBytes += CSegment.Size;
+    NrOfMessages += CSegment.NrOfMessages;
+    // Queued by an earlier instance, they will be counted as dequeued.
+    Metrics.enqueued(CSegment.NrOfMessages);
+    Segments.push_back(CSegment);
+    NextSegmentNumber = Number + 1;
+  }
+  updateActive();
+}
+
+void MessageSpool::scanSegment(Segment &CSegment) {
+  auto Offset = size_t(0);
+  bool ReadSoFar{true};
+  while (Offset + RecordHeaderSize <= CSegment.Size) {
+    auto Length = loadLength(CSegment.Data + Offset);
+    auto MessageSize = size_t(Length & ~ReadFlag);
+    if (MessageSize == 0 or
+        Offset + RecordHeaderSize + MessageSize > CSegment.Size) {
+      break;
+    }
+    if ((Length & ReadFlag) == 0) {
+      ++CSegment.NrOfMessages;
+      ReadSoFar = false;
+    } else if (ReadSoFar) {
+      CSegment.ReadOffset = Offset + RecordHeaderSize + MessageSize;
+    }
+    Offset += RecordHeaderSize + MessageSize;
+  }
+  // The segment is full, new messages go to a new one.
+  CSegment.WriteOffset = CSegment.Size;
+}
+
+bool MessageSpool::mapSegment(Segment &CSegment, bool Create) {
+  auto Flags = Create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR;
+  auto FileDescriptor = ::open(CSegment.FileName.c_str(), Flags, 0644);
+  if (FileDescriptor < 0) {
+    return false;
+  }
+  if (Create) {
+    if (::ftruncate(FileDescriptor, off_t(CSegment.Size)) != 0) {
+      ::close(FileDescriptor);
+      ::unlink(CSegment.FileName.c_str());
+      return false;
+    }
+  } else {
+    struct stat FileStatus {};
+    if (::fstat(FileDescriptor, &FileStatus) != 0 or FileStatus.st_size <= 0) {
+      ::close(FileDescriptor);
+      return false;
+    }
+    CSegment.Size = size_t(FileStatus.st_size);
+  }
+  auto Mapping = ::mmap(nullptr, CSegment.Size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, FileDescriptor, 0);
+  // The mapping stays valid after the file has been closed.
+  ::close(FileDescriptor);
+  if (Mapping == MAP_FAILED) {
+    if (Create) {
+      ::unlink(CSegment.FileName.c_str());
+    }
+    return false;
+  }
+  CSegment.Data = static_cast<char *>(Mapping);
+  return true;
+}
+
+bool MessageSpool::createSegment(size_t MinSize) {
+  Segment NewSegment;
+  NewSegment.Size = std::max(SegmentSize, MinSize);
+  if (NewSegment.Size > MaxBytes) {
+    return false;
+  }
+  while (not Segments.empty() and TotalBytes + NewSegment.Size > MaxBytes) {
+    removeOldestSegment();
+  }
+  NewSegment.FileName = Directory + "/" + SegmentPrefix +
+                        std::to_string(NextSegmentNumber++) + SegmentSuffix;
+  if (not mapSegment(NewSegment, true)) {
+    return false;
+  }
+  TotalBytes += NewSegment.Size;
+  Segments.push_back(NewSegment);
+  return true;
+}
+
+void MessageSpool::removeOldestSegment() {
+  auto &Oldest = Segments.front();
+  if (Oldest.NrOfMessages > 0) {
+    // Out of disk budget. The messages leave the spool without being sent.
+    Metrics.dequeued(Oldest.NrOfMessages);
+    Metrics.discarded(Oldest.NrOfMessages);
+    NrOfMessages -= Oldest.NrOfMessages;
+  }
+  ::munmap(Oldest.Data, Oldest.Size);
+  ::unlink(Oldest.FileName.c_str());
+  TotalBytes -= Oldest.Size;
+  Segments.pop_front();
+}
+
+void MessageSpool::updateActive() {
+  Active.store(NrOfMessages.load() > 0, std::memory_order_release);
+}
+
+bool MessageSpool::append(const std::string &Message) {
+  auto RecordSize = RecordHeaderSize + Message.size();
+  if (Message.empty() or Message.size() >= ReadFlag) {
+    return false;
+  }
+  std::lock_guard<std::mutex> Lock(SpoolMutex);
+  if (Segments.empty() or
+      Segments.back().WriteOffset + RecordSize > Segments.back().Size) {
+    if (not createSegment(RecordSize)) {
+      return false;
+    }
+  }
+  auto &Newest = Segments.back();
+  std::memcpy(Newest.Data + Newest.WriteOffset + RecordHeaderSize,
+              Message.data(), Message.size());
+  storeLength(Newest.Data + Newest.WriteOffset,
+              static_cast<std::uint32_t>(Message.size()));
+  Newest.WriteOffset += RecordSize;
+  ++Newest.NrOfMessages;
+  ++NrOfMessages;
+  Active.store(true, std::memory_order_release);
+  return true;
+}
+
+size_t MessageSpool::read(std::deque<std::string> &Output, size_t ByteLimit) {
+  std::lock_guard<std::mutex> Lock(SpoolMutex);
+  size_t NrOfRead{0};
+  size_t BytesRead{0};
+  while (not Segments.empty() and (NrOfRead == 0 or BytesRead < ByteLimit)) {
+    auto &Oldest = Segments.front();
+    if (Oldest.NrOfMessages == 0) {
+      removeOldestSegment();
+      continue;
+    }
+    auto Record = Oldest.Data + Oldest.ReadOffset;
+    auto Length = loadLength(Record);
+    auto MessageSize = size_t(Length & ~ReadFlag);
+    Oldest.ReadOffset += RecordHeaderSize + MessageSize;
+    if ((Length & ReadFlag) != 0) {
+      // Read before a restart.
+      continue;
+    }
+    Output.emplace_back(Record + RecordHeaderSize, MessageSize);
+    storeLength(Record, Length | ReadFlag);
+    --Oldest.NrOfMessages;
+    --NrOfMessages;
+    ++NrOfRead;
+    BytesRead += MessageSize;
+  }
+  if (not Segments.empty() and Segments.front().NrOfMessages == 0) {
+    removeOldestSegment();
+  }
+  updateActive();
+  return NrOfRead;
+}
+
+} // namespace Log
+
+#endif
@@ -0,0 +1,97 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Disk-backed store for messages that do not fit in the queue of a
+/// connection.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "graylog_logger/Metrics.hpp"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+#ifndef _WIN32
+
+namespace Log {
+
+/// \brief Stores messages in memory-mapped segment files on disk.
+///
+/// Messages are appended to the newest segment file and read, oldest first,
+/// from the oldest one. Every message is stored as a 32 bit length followed
+/// by the message. The length of a message that has been read is marked in
+/// the file, so that the remaining messages of the segment files found in
+/// the directory at start-up are read again after a restart. A segment file
+/// is deleted when all its messages have been read. If the disk budget is
+/// exceeded, the oldest segment files are deleted (and their messages
+/// counted as dequeued and discarded).
+/// \note Thread safe.
+class MessageSpool {
+public:
+  /// \param[in] Directory The directory of the segment files. Created if it
+  /// does not exist (its parent must exist).
+  /// \param[in] SegmentSize The size of a segment file.
+  /// \param[in] MaxBytes The maximum total size of the segment files.
+  /// \param[in] Metrics Counts the recovered messages as enqueued and the
+  /// messages of deleted segment files as dequeued and discarded.
+  MessageSpool(std::string Directory, size_t SegmentSize, size_t MaxBytes,
+               MetricsRecorder &Metrics);
+  ~MessageSpool();
+  MessageSpool(const MessageSpool &) = delete;
+  MessageSpool &operator=(const MessageSpool &) = delete;
+
+  /// \brief Whether there are messages in the spool. New messages have to be
+  /// appended to the spool (rather than queued) while that is the case in
+  /// order to keep the order of the messages.
+  bool active() const { return Active.load(std::memory_order_acquire); }
+  /// \brief Append a message to the spool.
+  /// \return False if the message could not be stored, e.g. because it is
+  /// larger than the disk budget or the segment file could not be created.
+  bool append(const std::string &Message);
+  /// \brief Read messages from the spool, oldest first.
+  /// \param[out] Output The messages are appended to this deque.
+  /// \param[in] ByteLimit Stop after this many bytes (at least one message is
+  /// read if the spool is not empty).
+  /// \return The number of messages read.
+  size_t read(std::deque<std::string> &Output, size_t ByteLimit);
+  /// \brief Number of messages in the spool.
+  size_t size() const { return NrOfMessages.load(std::memory_order_relaxed); }
+
+private:
+  struct Segment {
+    std::string FileName;
+    char *Data{nullptr};
+    size_t Size{0};
+    size_t WriteOffset{0};
+    size_t ReadOffset{0};
+    /// \brief Messages that have not been read yet.
+    size_t NrOfMessages{0};
+  };
+  bool createSegment(size_t MinSize);
+  bool mapSegment(Segment &CSegment, bool Create);
+  void scanSegment(Segment &CSegment);
+  void removeOldestSegment();
+  void recoverSegments();
+  void updateActive();
+
+  const std::string Directory;
+  const size_t SegmentSize;
+  const size_t MaxBytes;
+  MetricsRecorder &Metrics;
+  std::mutex SpoolMutex;
+  std::deque<Segment> Segments;
+  size_t TotalBytes{0};
+  std::uint64_t NextSegmentNumber{0};
+  std::atomic_bool Active{false};
+  std::atomic<size_t> NrOfMessages{0};
+};
+
+} // namespace Log
+
+#endif
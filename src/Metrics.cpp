@@ -0,0 +1,69 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Implementation of the logging pipeline counters.
+///
+//===----------------------------------------------------------------------===//
+
+#include "graylog_logger/Metrics.hpp"
+#include <ciso646>
+
+namespace Log {
+
+size_t StripedCounter::stripeIndex() {
+  static std::atomic<size_t> NextIndex{0};
+  static thread_local const size_t Index{NextIndex++ % NrOfStripes};
+  return Index;
+}
+
+std::uint64_t StripedCounter::load() const {
+  std::uint64_t Sum{0};
+  for (auto &CStripe : Stripes) {
+    Sum += CStripe.Value.load(std::memory_order_relaxed);
+  }
+  return Sum;
+}
+
+void MetricsRecorder::queueDepth(std::uint64_t Depth) {
+  auto CurrentMax = HighWaterMark.load(std::memory_order_relaxed);
+  while (CurrentMax < Depth and
+         not HighWaterMark.compare_exchange_weak(CurrentMax, Depth,
+                                                 std::memory_order_relaxed)) {
+  }
+}
+
+void MetricsRecorder::updateQueueDepth(std::uint64_t Held) {
+  auto Added = EnqueuedCounter.load();
+  auto Removed = DequeuedCounter.load(std::memory_order_relaxed);
+  queueDepth((Added > Removed ? Added - Removed : 0) + Held);
+}
+
+void MetricsRecorder::latency(std::chrono::nanoseconds Latency) {
+  auto Microseconds =
+      std::chrono::duration_cast<std::chrono::microseconds>(Latency).count();
+  size_t Bucket{0};
+  while (Microseconds > 0 and Bucket < LatencyHistogramBuckets - 1) {
+    Microseconds >>= 1;
+    ++Bucket;
+  }
+  LatencyCounters[Bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+MetricsSnapshot MetricsRecorder::snapshot() const {
+  MetricsSnapshot Result;
+  Result.Enqueued = EnqueuedCounter.load();
+  Result.Dequeued = DequeuedCounter.load(std::memory_order_relaxed);
+  Result.Dropped = DroppedCounter.load();
+  Result.Discarded = DiscardedCounter.load(std::memory_order_relaxed);
+  Result.QueueHighWaterMark = HighWaterMark.load(std::memory_order_relaxed);
+  Result.BytesWritten = BytesCounter.load(std::memory_order_relaxed);
+  Result.Reconnects = ReconnectCounter.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < LatencyHistogramBuckets; ++i) {
+    Result.Latency[i] = LatencyCounters[i].load(std::memory_order_relaxed);
+  }
+  return Result;
+}
+
+} // namespace Log
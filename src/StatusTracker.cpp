@@ -0,0 +1,79 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Implementation of the connection status tracker.
+///
+//===----------------------------------------------------------------------===//
+
+#include "StatusTracker.hpp"
+#include <algorithm>
+#include <ciso646>
+
+namespace Log {
+
+StatusTracker::StatusTracker(Status Initial)
+    : Current(Initial), Entered(std::chrono::steady_clock::now()) {}
+
+void StatusTracker::set(Status NewStatus, std::error_code Error) {
+  // Changes made by different threads are passed to the callbacks in the
+  // order in which they were made.
+  std::lock_guard<std::recursive_mutex> CallbackLock(CallbackMutex);
+  StatusChange Change{NewStatus, NewStatus, std::chrono::system_clock::now(),
+                      Error};
+  decltype(Callbacks) CurrentCallbacks;
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    Change.Previous = Current.load();
+    if (Change.Previous == NewStatus) {
+      return;
+    }
+    auto Now = std::chrono::steady_clock::now();
+    Durations[static_cast<size_t>(Change.Previous)] += Now - Entered;
+    Entered = Now;
+    Current = NewStatus;
+    CurrentCallbacks = Callbacks;
+  }
+  for (auto &Callback : CurrentCallbacks) {
+    {
+      // Might have been removed by one of the other callbacks.
+      std::lock_guard<std::mutex> Lock(Mutex);
+      if (std::none_of(Callbacks.begin(), Callbacks.end(),
+                       [&Callback](auto &Registered) {
+                         return Registered.first == Callback.first;
+                       })) {
+        continue;
+      }
+    }
+    (*Callback.second)(Change);
+  }
+}
+
+size_t StatusTracker::addCallback(StatusCallback Callback) {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  auto Id = NextId++;
+  Callbacks.emplace_back(Id,
+                         std::make_shared<StatusCallback>(std::move(Callback)));
+  return Id;
+}
+
+void StatusTracker::removeCallback(size_t Id) {
+  std::lock_guard<std::recursive_mutex> CallbackLock(CallbackMutex);
+  std::lock_guard<std::mutex> Lock(Mutex);
+  Callbacks.erase(std::remove_if(Callbacks.begin(), Callbacks.end(),
+                                 [Id](auto &Registered) {
+                                   return Registered.first == Id;
+                                 }),
+                  Callbacks.end());
+}
+
+StatusDurations StatusTracker::timeInStatus() const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  auto Result = Durations;
+  Result[static_cast<size_t>(Current.load())] +=
+      std::chrono::steady_clock::now() - Entered;
+  return Result;
+}
+
+} // namespace Log
@@ -0,0 +1,59 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Keeps track of the status of a connection.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "graylog_logger/ConnectionStatus.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace Log {
+
+/// \brief The status of a connection, the time spent in every status and
+/// the callbacks that are called when the status changes.
+///
+/// The status can be read from any thread without locking. The functions
+/// are thread safe.
+class StatusTracker {
+public:
+  explicit StatusTracker(Status Initial = Status::ADDR_LOOKUP);
+  Status get() const { return Current.load(); }
+  /// \brief Change the status and call the callbacks if it differs from
+  /// the current one.
+  /// \param[in] NewStatus The new status.
+  /// \param[in] Error The cause of the change, if any.
+  void set(Status NewStatus, std::error_code Error = {});
+  /// \brief Register a callback.
+  /// \return An id for removeCallback().
+  size_t addCallback(StatusCallback Callback);
+  /// \brief Unregister a callback. The callback is not running (except in
+  /// the calling thread) and is not called any more once this returns.
+  void removeCallback(size_t Id);
+  /// \brief The time spent in every status, including the time spent in
+  /// the current status up to now.
+  StatusDurations timeInStatus() const;
+
+private:
+  using CallbackPtr = std::shared_ptr<StatusCallback>;
+  std::atomic<Status> Current;
+  mutable std::mutex Mutex;
+  std::chrono::steady_clock::time_point Entered;
+  StatusDurations Durations{};
+  std::vector<std::pair<size_t, CallbackPtr>> Callbacks;
+  size_t NextId{1};
+  /// \brief Held while callbacks are called. Recursive so that a callback
+  /// can remove itself (or others).
+  std::recursive_mutex CallbackMutex;
+};
+
+} // namespace Log
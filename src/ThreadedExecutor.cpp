@@ -0,0 +1,169 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Implementation of the worker pool and the executors running on it.
+///
+//===----------------------------------------------------------------------===//
+
+#include "graylog_logger/ThreadedExecutor.hpp"
+#include <algorithm>
+#include <atomic>
+#include <ciso646>
+#include <concurrentqueue/blockingconcurrentqueue.h>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+namespace Log {
+
+class WorkerPool::Impl {
+public:
+  using StrandPtr = std::shared_ptr<ThreadedExecutor::Strand>;
+  explicit Impl(size_t NrOfThreads) : NrOfThreads(NrOfThreads) {}
+  static void start(const std::shared_ptr<Impl> &Pool);
+  void stop();
+  void schedule(StrandPtr Ready) { ReadyStrands.enqueue(std::move(Ready)); }
+  const size_t NrOfThreads;
+
+private:
+  void threadFunction();
+  moodycamel::BlockingConcurrentQueue<StrandPtr> ReadyStrands;
+  std::vector<std::thread> Threads;
+};
+
+class ThreadedExecutor::Strand
+    : public std::enable_shared_from_this<ThreadedExecutor::Strand> {
+public:
+  explicit Strand(WorkerPool::Impl *Pool) : Pool(Pool) {}
+
+  void enqueue(WorkMessage Message) {
+    Queue.enqueue(std::move(Message));
+    if (Pending.fetch_add(1) == 0) {
+      Pool->schedule(shared_from_this());
+    }
+  }
+
+  /// \brief Called by the worker pool. Runs a limited number of jobs in
+  /// order to not starve other executors sharing the pool.
+  void run() {
+    std::lock_guard<std::mutex> Lock(RunMutex);
+    auto Processed = runJobs(MaxJobsPerRun);
+    if (Pending.fetch_sub(Processed) != Processed) {
+      Pool->schedule(shared_from_this());
+    }
+  }
+
+  /// \brief Run all remaining jobs in the calling thread.
+  void drain() {
+    std::lock_guard<std::mutex> Lock(RunMutex);
+    size_t Processed{0};
+    do {
+      Processed = runJobs(std::numeric_limits<size_t>::max());
+      Pending -= Processed;
+    } while (Processed > 0);
+  }
+
+  size_t size() const { return Queue.size_approx(); }
+
+private:
+  size_t runJobs(size_t MaxJobs) {
+    size_t Processed{0};
+    WorkMessage CurrentMessage;
+    while (Processed < MaxJobs and Queue.try_dequeue(CurrentMessage)) {
+      CurrentMessage();
+      CurrentMessage = nullptr;
+      ++Processed;
+    }
+    return Processed;
+  }
+
+  const size_t MaxJobsPerRun{64};
+  WorkerPool::Impl *Pool;
+  std::mutex RunMutex;
+  std::atomic<size_t> Pending{0};
+  moodycamel::ConcurrentQueue<WorkMessage> Queue;
+};
+
+void WorkerPool::Impl::start(const std::shared_ptr<Impl> &Pool) {
+  for (size_t i = 0; i < Pool->NrOfThreads; ++i) {
+    // The threads share ownership of the pool so that the pool can be
+    // de-allocated from one of its own threads.
+    Pool->Threads.emplace_back([Pool]() { Pool->threadFunction(); });
+  }
+}
+
+void WorkerPool::Impl::stop() {
+  for (size_t i = 0; i < Threads.size(); ++i) {
+    ReadyStrands.enqueue(nullptr);
+  }
+  for (auto &CThread : Threads) {
+    if (CThread.get_id() == std::this_thread::get_id()) {
+      CThread.detach();
+    } else {
+      CThread.join();
+    }
+  }
+}
+
+void WorkerPool::Impl::threadFunction() {
+  while (true) {
+    StrandPtr CurrentStrand;
+    ReadyStrands.wait_dequeue(CurrentStrand);
+    if (CurrentStrand == nullptr) {
+      return;
+    }
+    CurrentStrand->run();
+  }
+}
+
+WorkerPool::WorkerPool(size_t NrOfThreads)
+    : Pimpl(std::make_shared<Impl>(std::max<size_t>(NrOfThreads, 1))) {
+  Impl::start(Pimpl);
+}
+
+WorkerPool::~WorkerPool() { Pimpl->stop(); }
+
+size_t WorkerPool::size() const { return Pimpl->NrOfThreads; }
+
+namespace {
+std::mutex DefaultPoolMutex;
+std::shared_ptr<WorkerPool> &defaultPool() {
+  static std::shared_ptr<WorkerPool> Pool;
+  return Pool;
+}
+} // namespace
+
+void WorkerPool::setDefault(std::shared_ptr<WorkerPool> Pool) {
+  std::lock_guard<std::mutex> Lock(DefaultPoolMutex);
+  defaultPool() = std::move(Pool);
+}
+
+std::shared_ptr<WorkerPool> WorkerPool::getDefault() {
+  std::lock_guard<std::mutex> Lock(DefaultPoolMutex);
+  return defaultPool();
+}
+
+ThreadedExecutor::ThreadedExecutor() : ThreadedExecutor(nullptr) {}
+
+ThreadedExecutor::ThreadedExecutor(std::shared_ptr<WorkerPool> UsedPool)
+    : Pool(std::move(UsedPool)) {
+  if (nullptr == Pool) {
+    Pool = WorkerPool::getDefault();
+  }
+  if (nullptr == Pool) {
+    Pool = std::make_shared<WorkerPool>(1);
+  }
+  WorkQueue = std::make_shared<Strand>(Pool->Pimpl.get());
+}
+
+ThreadedExecutor::~ThreadedExecutor() { WorkQueue->drain(); }
+
+void ThreadedExecutor::SendWork(WorkMessage Message) {
+  WorkQueue->enqueue(std::move(Message));
+}
+
+size_t ThreadedExecutor::size_approx() { return WorkQueue->size(); }
+
+} // namespace Log
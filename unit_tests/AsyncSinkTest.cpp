@@ -0,0 +1,222 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Tests of the asynchronous log handler template.
+///
+//===----------------------------------------------------------------------===//
+
+#include "Semaphore.hpp"
+#include "graylog_logger/AsyncSink.hpp"
+#include <ciso646>
+#include <gtest/gtest.h>
+#include <numeric>
+
+using namespace Log;
+using namespace std::chrono_literals;
+
+struct RecordingWriter {
+  size_t write(minimal::span<const LogMessage> Messages,
+               const MessageFormatter &Formatter) {
+    BatchSizes.push_back(Messages.size());
+    size_t Bytes{0};
+    for (auto &CMessage : Messages) {
+      Lines.push_back(Formatter(CMessage));
+      Bytes += Lines.back().size();
+    }
+    return Bytes;
+  }
+  void flush() { ++Flushes; }
+  std::vector<size_t> BatchSizes;
+  std::vector<std::string> Lines;
+  int Flushes{0};
+};
+
+class AsyncSinkStandIn : public AsyncSink<RecordingWriter> {
+public:
+  explicit AsyncSinkStandIn(const AsyncSinkSettings &Settings)
+      : AsyncSink(Settings) {
+    setMessageStringCreatorFunction(
+        [](const LogMessage &Msg) { return Msg.MessageString; });
+  }
+  using AsyncSink::Executor;
+  using AsyncSink::Writer;
+
+  /// Prevent the writer from being called until the returned semaphore is
+  /// notified.
+  std::shared_ptr<Semaphore> blockWriter() {
+    auto Blocked = std::make_shared<Semaphore>();
+    auto Release = std::make_shared<Semaphore>();
+    Executor.SendWork([=]() {
+      Blocked->notify();
+      Release->wait();
+    });
+    Blocked->wait();
+    return Release;
+  }
+};
+
+LogMessage createMessage(std::string const &Text) {
+  LogMessage Message;
+  Message.MessageString = Text;
+  return Message;
+}
+
+TEST(AsyncSink, MessagesAreWrittenInOrder) {
+  AsyncSinkStandIn Sink{AsyncSinkSettings()};
+  for (int i = 0; i < 10; ++i) {
+    Sink.addMessage(createMessage(std::to_string(i)));
+  }
+  ASSERT_TRUE(Sink.flush(10s));
+  ASSERT_EQ(Sink.Writer.Lines.size(), 10u);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(Sink.Writer.Lines[i], std::to_string(i));
+  }
+  EXPECT_EQ(Sink.Writer.Flushes, 1);
+  EXPECT_TRUE(Sink.emptyQueue());
+}
+
+TEST(AsyncSink, MessagesAreBatched) {
+  AsyncSinkSettings Settings;
+  Settings.MaxBatchSize = 8;
+  AsyncSinkStandIn Sink(Settings);
+  auto Release = Sink.blockWriter();
+  for (int i = 0; i < 20; ++i) {
+    Sink.addMessage(createMessage("msg"));
+  }
+  EXPECT_EQ(Sink.queueSize(), 20u);
+  Release->notify();
+  ASSERT_TRUE(Sink.flush(10s));
+  EXPECT_EQ(Sink.Writer.BatchSizes, (std::vector<size_t>{8, 8, 4}));
+  auto Metrics = Sink.getSinkMetrics();
+  EXPECT_EQ(Metrics.Enqueued, 20u);
+  EXPECT_EQ(Metrics.Written, 20u);
+  EXPECT_EQ(Metrics.Batches, 3u);
+  EXPECT_EQ(Metrics.Dropped, 0u);
+}
+
+TEST(AsyncSink, DropNewestOnOverflow) {
+  AsyncSinkSettings Settings;
+  Settings.MaxQueueLength = 5;
+  Settings.Overflow = OverflowPolicy::DropNewest;
+  AsyncSinkStandIn Sink(Settings);
+  auto Release = Sink.blockWriter();
+  for (int i = 0; i < 8; ++i) {
+    Sink.addMessage(createMessage(std::to_string(i)));
+  }
+  EXPECT_EQ(Sink.queueSize(), 5u);
+  Release->notify();
+  ASSERT_TRUE(Sink.flush(10s));
+  EXPECT_EQ(Sink.Writer.Lines,
+            (std::vector<std::string>{"0", "1", "2", "3", "4"}));
+  EXPECT_EQ(Sink.getSinkMetrics().Dropped, 3u);
+}
+
+TEST(AsyncSink, Metrics) {
+  AsyncSinkSettings Settings;
+  Settings.MaxQueueLength = 5;
+  Settings.Overflow = OverflowPolicy::DropNewest;
+  AsyncSinkStandIn Sink(Settings);
+  auto Release = Sink.blockWriter();
+  for (int i = 0; i < 8; ++i) {
+    auto Message = createMessage("Message " + std::to_string(i));
+    // A system clock that has been set forward does not affect the latency.
+    Message.Timestamp = std::chrono::system_clock::now() + 24h;
+    Message.MonotonicTimestamp = std::chrono::steady_clock::now();
+    Sink.addMessage(Message);
+  }
+  Release->notify();
+  ASSERT_TRUE(Sink.flush(10s));
+  auto Metrics = Sink.getMetrics();
+  EXPECT_EQ(Metrics.Enqueued, 5u);
+  EXPECT_EQ(Metrics.Dequeued, 5u);
+  EXPECT_EQ(Metrics.Dropped, 3u);
+  EXPECT_EQ(Metrics.QueueHighWaterMark, 5u);
+  EXPECT_EQ(Metrics.BytesWritten, 5u * std::string("Message 0").size());
+  EXPECT_EQ(std::accumulate(Metrics.Latency.begin(), Metrics.Latency.end(),
+                            std::uint64_t(0)),
+            5u);
+  EXPECT_EQ(Metrics.Latency.back(), 0u);
+}
+
+TEST(AsyncSink, DropOldestOnOverflow) {
+  AsyncSinkSettings Settings;
+  Settings.MaxQueueLength = 5;
+  Settings.Overflow = OverflowPolicy::DropOldest;
+  AsyncSinkStandIn Sink(Settings);
+  auto Release = Sink.blockWriter();
+  for (int i = 0; i < 8; ++i) {
+    Sink.addMessage(createMessage(std::to_string(i)));
+  }
+  EXPECT_EQ(Sink.queueSize(), 5u);
+  Release->notify();
+  ASSERT_TRUE(Sink.flush(10s));
+  EXPECT_EQ(Sink.Writer.Lines,
+            (std::vector<std::string>{"3", "4", "5", "6", "7"}));
+  EXPECT_EQ(Sink.getSinkMetrics().Dropped, 3u);
+}
+
+TEST(AsyncSink, ByteLimit) {
+  AsyncSinkSettings Settings;
+  Settings.MaxQueueBytes = 3 * createMessage("0").approximateSize();
+  Settings.Overflow = OverflowPolicy::DropNewest;
+  AsyncSinkStandIn Sink(Settings);
+  auto Release = Sink.blockWriter();
+  for (int i = 0; i < 8; ++i) {
+    Sink.addMessage(createMessage(std::to_string(i)));
+  }
+  EXPECT_EQ(Sink.queueSize(), 3u);
+  Release->notify();
+  ASSERT_TRUE(Sink.flush(10s));
+  EXPECT_EQ(Sink.Writer.Lines, (std::vector<std::string>{"0", "1", "2"}));
+  EXPECT_EQ(Sink.getSinkMetrics().Dropped, 5u);
+}
+
+TEST(AsyncSink, LargeMessageIsQueuedIfQueueIsEmpty) {
+  AsyncSinkSettings Settings;
+  Settings.MaxQueueBytes = 100;
+  Settings.Overflow = OverflowPolicy::DropOldest;
+  AsyncSinkStandIn Sink(Settings);
+  auto Release = Sink.blockWriter();
+  Sink.addMessage(createMessage("0"));
+  Sink.addMessage(createMessage(std::string(200, 'a')));
+  EXPECT_EQ(Sink.queueSize(), 1u);
+  Release->notify();
+  ASSERT_TRUE(Sink.flush(10s));
+  EXPECT_EQ(Sink.Writer.Lines,
+            (std::vector<std::string>{std::string(200, 'a')}));
+  EXPECT_EQ(Sink.getSinkMetrics().Dropped, 1u);
+}
+
+TEST(AsyncSink, CallerWritesOnOverflow) {
+  AsyncSinkSettings Settings;
+  Settings.MaxQueueLength = 4;
+  Settings.MaxBatchSize = 2;
+  Settings.Overflow = OverflowPolicy::CallerWrites;
+  AsyncSinkStandIn Sink(Settings);
+  for (int i = 0; i < 50; ++i) {
+    Sink.addMessage(createMessage(std::to_string(i)));
+  }
+  ASSERT_TRUE(Sink.flush(10s));
+  ASSERT_EQ(Sink.Writer.Lines.size(), 50u);
+  for (int i = 0; i < 50; ++i) {
+    EXPECT_EQ(Sink.Writer.Lines[i], std::to_string(i));
+  }
+  EXPECT_EQ(Sink.getSinkMetrics().Dropped, 0u);
+}
+
+TEST(AsyncSink, QueueIsWrittenOnDestruction) {
+  auto Writer = std::make_shared<std::vector<std::string>>();
+  {
+    AsyncSinkStandIn Sink{AsyncSinkSettings()};
+    Sink.setMessageStringCreatorFunction([Writer](const LogMessage &Msg) {
+      Writer->push_back(Msg.MessageString);
+      return Msg.MessageString;
+    });
+    for (int i = 0; i < 100; ++i) {
+      Sink.addMessage(createMessage("msg"));
+    }
+  }
+  EXPECT_EQ(Writer->size(), 100u);
+}
@@ -17,8 +17,17 @@ public:
   BaseLogHandlerStandIn(){};
   void addMessage(const LogMessage &Message) override {
     CurrentMessage = Message;
+    ++NrOfMessages;
   };
+  void addMessages(minimal::span<const LogMessage *const> Messages) override {
+    BatchSizes.push_back(Messages.size());
+    BaseLogHandler::addMessages(Messages);
+  }
+  bool usesSequenceNumbers() const override { return SequenceNumbers; }
   LogMessage CurrentMessage;
+  int NrOfMessages{0};
+  bool SequenceNumbers{false};
+  std::vector<size_t> BatchSizes;
   using BaseLogHandler::MessageParser;
   using BaseLogHandler::messageToString;
   bool flush(std::chrono::system_clock::duration) override { return true; }
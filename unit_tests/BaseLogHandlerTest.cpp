@@ -42,3 +42,53 @@ TEST(BaseLogHandler, NewStringCreatorTest) {
   standIn.setMessageStringCreatorFunction(&MyStringCreator);
   ASSERT_EQ(standIn.messageToString(msg), testString);
 }
+
+TEST(BaseLogHandler, DefaultSeverityThreshold) {
+  BaseLogHandlerStandIn standIn;
+  EXPECT_EQ(standIn.getMinSeverity(), Severity::Debug);
+  EXPECT_TRUE(standIn.acceptsSeverity(Severity::Debug));
+  EXPECT_TRUE(standIn.acceptsSeverity(Severity::Emergency));
+}
+
+TEST(BaseLogHandler, SetSeverityThreshold) {
+  BaseLogHandlerStandIn standIn;
+  auto PreviousVersion = BaseLogHandler::severityThresholdVersion();
+  standIn.setMinSeverity(Severity::Warning);
+  EXPECT_NE(PreviousVersion, BaseLogHandler::severityThresholdVersion());
+  EXPECT_EQ(standIn.getMinSeverity(), Severity::Warning);
+  EXPECT_TRUE(standIn.acceptsSeverity(Severity::Warning));
+  EXPECT_TRUE(standIn.acceptsSeverity(Severity::Error));
+  EXPECT_FALSE(standIn.acceptsSeverity(Severity::Notice));
+  LogMessage msg;
+  msg.SeverityLevel = Severity::Info;
+  EXPECT_FALSE(standIn.acceptsMessage(msg));
+}
+
+TEST(BaseLogHandler, MessageFilter) {
+  BaseLogHandlerStandIn standIn;
+  standIn.setMessageFilter([](const LogMessage &Msg) {
+    return Msg.MessageString.find("keep") != std::string::npos;
+  });
+  LogMessage msg;
+  msg.SeverityLevel = Severity::Error;
+  msg.MessageString = "discard this";
+  EXPECT_FALSE(standIn.acceptsMessage(msg));
+  msg.MessageString = "keep this";
+  EXPECT_TRUE(standIn.acceptsMessage(msg));
+  standIn.setMessageFilter(nullptr);
+  msg.MessageString = "discard this";
+  EXPECT_TRUE(standIn.acceptsMessage(msg));
+}
+
+TEST(BaseLogHandler, AddMessagesForwardsToAddMessage) {
+  BaseLogHandlerStandIn standIn;
+  std::vector<LogMessage> Messages(3);
+  Messages[2].MessageString = "Last message";
+  std::vector<const LogMessage *> MessagePointers;
+  for (auto &CMessage : Messages) {
+    MessagePointers.push_back(&CMessage);
+  }
+  standIn.addMessages(MessagePointers);
+  EXPECT_EQ(standIn.NrOfMessages, 3);
+  EXPECT_EQ(standIn.CurrentMessage.MessageString, "Last message");
+}
@@ -0,0 +1,94 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Tests of the zlib/gzip compressor.
+///
+//===----------------------------------------------------------------------===//
+
+#include "Compressor.hpp"
+#include "Decompress.hpp"
+#include <gtest/gtest.h>
+
+#ifdef WITH_ZLIB
+
+using namespace Log;
+
+std::string createCompressorTestString() {
+  std::string Result;
+  for (int i = 0; i < 100; ++i) {
+    Result += R"({"short_message":"Message number )" + std::to_string(i) +
+              R"(","version":"1.1","level":3,"host":"some_host"})";
+  }
+  return Result;
+}
+
+TEST(Compressor, ZlibRoundTrip) {
+  Compressor UnderTest(Compression::Zlib, -1);
+  auto Original = createCompressorTestString();
+  std::vector<char> Output;
+  UnderTest.compress(Original.data(), Original.size(), Output);
+  ASSERT_GT(Output.size(), 2u);
+  EXPECT_EQ(Output[0], '\x78');
+  EXPECT_LT(Output.size(), Original.size() / 4);
+  EXPECT_EQ(decompress(std::string(Output.begin(), Output.end())), Original);
+}
+
+TEST(Compressor, GzipRoundTrip) {
+  Compressor UnderTest(Compression::Gzip, 1);
+  auto Original = createCompressorTestString();
+  std::vector<char> Output;
+  UnderTest.compress(Original.data(), Original.size(), Output);
+  ASSERT_GT(Output.size(), 2u);
+  EXPECT_EQ(Output[0], '\x1f');
+  EXPECT_EQ(Output[1], '\x8b');
+  EXPECT_EQ(decompress(std::string(Output.begin(), Output.end())), Original);
+}
+
+TEST(Compressor, MessagesAreIndependent) {
+  Compressor UnderTest(Compression::Zlib, -1);
+  auto Original = createCompressorTestString();
+  std::vector<char> FirstOutput;
+  std::vector<char> SecondOutput;
+  UnderTest.compress(Original.data(), Original.size(), FirstOutput);
+  UnderTest.compress(Original.data(), Original.size(), SecondOutput);
+  EXPECT_EQ(FirstOutput, SecondOutput);
+}
+
+TEST(Compressor, StreamIsDecodableAfterEveryFlush) {
+  Compressor UnderTest(Compression::Zlib, -1);
+  std::string FirstPart("First part of the stream.");
+  std::string SecondPart("Second part of the stream.");
+  std::vector<char> Output;
+  UnderTest.compressAndFlush(FirstPart.data(), FirstPart.size(), Output);
+  EXPECT_EQ(decompress(std::string(Output.begin(), Output.end())), FirstPart);
+  UnderTest.compressAndFlush(SecondPart.data(), SecondPart.size(), Output);
+  EXPECT_EQ(decompress(std::string(Output.begin(), Output.end())),
+            FirstPart + SecondPart);
+}
+
+TEST(Compressor, AddedDataIsFlushedWithNextFlush) {
+  Compressor UnderTest(Compression::Zlib, -1);
+  std::string FirstPart("First part of the stream.");
+  std::string SecondPart("Second part of the stream.");
+  std::vector<char> Output;
+  UnderTest.addToStream(FirstPart.data(), FirstPart.size(), Output);
+  UnderTest.compressAndFlush(SecondPart.data(), SecondPart.size(), Output);
+  EXPECT_EQ(decompress(std::string(Output.begin(), Output.end())),
+            FirstPart + SecondPart);
+}
+
+TEST(Compressor, ResetStartsNewStream) {
+  Compressor UnderTest(Compression::Gzip, -1);
+  std::string FirstPart("First part of the stream.");
+  std::string SecondPart("Second stream.");
+  std::vector<char> Output;
+  UnderTest.compressAndFlush(FirstPart.data(), FirstPart.size(), Output);
+  UnderTest.reset();
+  Output.clear();
+  UnderTest.compressAndFlush(SecondPart.data(), SecondPart.size(), Output);
+  EXPECT_EQ(decompress(std::string(Output.begin(), Output.end())), SecondPart);
+}
+
+#endif
@@ -64,7 +64,7 @@ TEST(ConsoleInterface, QueueSizeOneIsNotEmpty) {
     Signal2.wait();
     Signal3.notify();
   });
-  cInter.Executor.SendWork([]() {});
+  cInter.addMessage(LogMessage());
   Signal1.wait();
   EXPECT_EQ(cInter.queueSize(), 1);
   EXPECT_FALSE(cInter.emptyQueue());
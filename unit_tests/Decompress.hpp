@@ -0,0 +1,30 @@
+#pragma once
+
+#include "graylog_logger/LibConfig.hpp"
+#include <string>
+
+#ifdef WITH_ZLIB
+#include <zlib.h>
+
+/// Decompress zlib or gzip data (the format is detected automatically). Data
+/// that ends with a sync flush marker (instead of the end of the stream) is
+/// also accepted.
+inline std::string decompress(const std::string &Compressed) {
+  z_stream Stream{};
+  const int AutomaticHeaderDetection{15 + 32};
+  inflateInit2(&Stream, AutomaticHeaderDetection);
+  Stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(Compressed.data()));
+  Stream.avail_in = static_cast<uInt>(Compressed.size());
+  std::string Result;
+  char Buffer[4096];
+  int ReturnValue{Z_OK};
+  do {
+    Stream.next_out = reinterpret_cast<Bytef *>(Buffer);
+    Stream.avail_out = sizeof(Buffer);
+    ReturnValue = inflate(&Stream, Z_SYNC_FLUSH);
+    Result.append(Buffer, sizeof(Buffer) - Stream.avail_out);
+  } while (ReturnValue == Z_OK and Stream.avail_in > 0);
+  inflateEnd(&Stream);
+  return Result;
+}
+#endif
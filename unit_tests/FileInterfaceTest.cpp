@@ -13,6 +13,7 @@
 #include <cstdio>
 #include <fstream>
 #include <gtest/gtest.h>
+#include <iterator>
 
 using namespace Log;
 
@@ -123,7 +124,7 @@ TEST_F(FileInterfaceTest, QueueSizeOneIsNotEmpty) {
     Signal2.wait();
     Signal3.notify();
   });
-  cInter.Executor.SendWork([]() {});
+  cInter.addMessage(LogMessage());
   Signal1.wait();
   EXPECT_EQ(cInter.queueSize(), 1);
   EXPECT_FALSE(cInter.emptyQueue());
@@ -149,3 +150,45 @@ TEST_F(FileInterfaceTest, FlushFail) {
   Signal1.notify();
   Signal2.wait();
 }
+
+namespace {
+std::string readFile(const std::string &Name) {
+  std::ifstream InStream(Name, std::ios::in | std::ios::binary);
+  return {std::istreambuf_iterator<char>(InStream),
+          std::istreambuf_iterator<char>()};
+}
+
+/// \brief Writes messages of varying length, more than fit in the buffers
+/// of the io_uring backend.
+std::string writeMessages(IoBackend Backend) {
+  std::string Expected;
+  FileInterface Interface(usedFileName, AsyncSinkSettings(), Backend);
+  Interface.setMessageStringCreatorFunction(
+      [](const LogMessage &Message) { return Message.MessageString; });
+  LogMessage Message;
+  for (int i = 0; i < 20000; ++i) {
+    Message.MessageString =
+        "Message number " + std::to_string(i) + std::string(i % 100, 'x');
+    Expected += Message.MessageString + '\n';
+    Interface.addMessage(Message);
+  }
+  EXPECT_TRUE(Interface.flush(10s));
+  return Expected;
+}
+} // namespace
+
+TEST_F(FileInterfaceTest, IoUringBackendWritesAllMessagesInOrder) {
+  auto Expected = writeMessages(IoBackend::IoUring);
+  EXPECT_EQ(readFile(usedFileName), Expected);
+}
+
+TEST_F(FileInterfaceTest, IoUringBackendAppendsToFile) {
+  auto First = writeMessages(IoBackend::Default);
+  auto Second = writeMessages(IoBackend::IoUring);
+  EXPECT_EQ(readFile(usedFileName), First + Second);
+}
+
+TEST_F(FileInterfaceTest, IoUringBackendFailsToOpenFile) {
+  FileWriter Writer("", IoBackend::IoUring);
+  EXPECT_FALSE(Writer.isOpen());
+}
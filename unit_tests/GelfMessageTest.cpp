@@ -0,0 +1,353 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Tests of the GELF serialisation.
+///
+//===----------------------------------------------------------------------===//
+
+#include "GelfMessage.hpp"
+#include "JsonWriter.hpp"
+#include <gtest/gtest.h>
+#include <limits>
+#include <nlohmann/json.hpp>
+
+using namespace Log;
+
+namespace {
+/// \brief The original, nlohmann::json based, serialisation of messages.
+std::string referenceGelf(const LogMessage &Message,
+                          const GelfFormat &Format = GelfFormat()) {
+  using std::chrono::duration_cast;
+  nlohmann::json JsonObject;
+  JsonObject["short_message"] = Message.MessageString;
+  JsonObject["version"] = "1.1";
+  JsonObject["level"] = int(Message.SeverityLevel);
+  JsonObject["host"] = Message.Host;
+  auto SinceEpoch = Message.Timestamp.time_since_epoch();
+  if (TimestampPrecision::Seconds == Format.Precision) {
+    JsonObject["timestamp"] = static_cast<double>(
+        duration_cast<std::chrono::seconds>(SinceEpoch).count());
+  } else if (TimestampPrecision::Milliseconds == Format.Precision) {
+    JsonObject["timestamp"] =
+        static_cast<double>(
+            duration_cast<std::chrono::milliseconds>(SinceEpoch).count()) /
+        1000;
+  } else {
+    JsonObject["timestamp"] =
+        static_cast<double>(
+            duration_cast<std::chrono::microseconds>(SinceEpoch).count()) /
+        1000000;
+  }
+  if (Format.MonotonicTime) {
+    JsonObject["_monotonic_ns"] =
+        duration_cast<std::chrono::nanoseconds>(
+            Message.MonotonicTimestamp.time_since_epoch())
+            .count();
+  }
+  if (Format.SequenceNumber) {
+    JsonObject["_sequence"] = Message.SequenceNumber;
+  }
+  JsonObject["_process_id"] = Message.ProcessId;
+  JsonObject["_process"] = Message.ProcessName;
+  JsonObject["_thread_id"] = Message.ThreadId;
+  for (auto &field : Message.AdditionalFields) {
+    if (AdditionalField::Type::typeStr == field.second.FieldType) {
+      JsonObject["_" + field.first] = field.second.strVal;
+    } else if (AdditionalField::Type::typeDbl == field.second.FieldType) {
+      JsonObject["_" + field.first] = field.second.dblVal;
+    } else if (AdditionalField::Type::typeInt == field.second.FieldType) {
+      JsonObject["_" + field.first] = field.second.intVal;
+    }
+  }
+  return JsonObject.dump();
+}
+
+LogMessage createGelfTestMessage() {
+  LogMessage Message;
+  Message.MessageString = "Some message";
+  Message.Timestamp = std::chrono::system_clock::now();
+  Message.ProcessId = 1234;
+  Message.ProcessName = "some_process";
+  Message.Host = "some_host";
+  Message.SeverityLevel = Severity::Warning;
+  Message.ThreadId = "0x7f00aa";
+  return Message;
+}
+
+std::string escaped(const std::string &Value) {
+  std::string Result;
+  appendJsonEscaped(Result, Value.data(), Value.size());
+  return Result;
+}
+
+std::string doubleToJson(double Value) {
+  std::string Result;
+  appendJsonDouble(Result, Value);
+  return Result;
+}
+} // namespace
+
+TEST(GelfMessage, StandardFields) {
+  auto Message = createGelfTestMessage();
+  EXPECT_EQ(logMessageToGelf(Message), referenceGelf(Message));
+}
+
+TEST(GelfMessage, AdditionalFields) {
+  auto Message = createGelfTestMessage();
+  Message.addField("zebra", std::string("last"));
+  Message.addField("alpha", std::int64_t(-42));
+  Message.addField("ratio", 0.25);
+  Message.addField("Capital", std::numeric_limits<std::int64_t>::min());
+  Message.addField("process_a", 1.0);
+  EXPECT_EQ(logMessageToGelf(Message), referenceGelf(Message));
+}
+
+TEST(GelfMessage, AdditionalFieldsReplaceStandardFields) {
+  auto Message = createGelfTestMessage();
+  Message.addField("process", std::string("other_process"));
+  Message.addField("thread_id", std::int64_t(7));
+  EXPECT_EQ(logMessageToGelf(Message), referenceGelf(Message));
+}
+
+TEST(GelfMessage, LastOfDuplicateFieldsIsUsed) {
+  auto Message = createGelfTestMessage();
+  Message.AdditionalFields.push_back({"field", std::string("first")});
+  Message.AdditionalFields.push_back({"other", 1.5});
+  Message.AdditionalFields.push_back({"field", std::string("second")});
+  EXPECT_EQ(logMessageToGelf(Message), referenceGelf(Message));
+}
+
+TEST(GelfMessage, EscapedStrings) {
+  auto Message = createGelfTestMessage();
+  Message.MessageString = "Multi line\n\"quoted\" \\ \t\r\b\f\x01\x1f\x7f/";
+  Message.Host = "h\xC3\xB6st \xE2\x82\xAC \xF0\x9F\x98\x80";
+  Message.addField("key \"with\" quotes", std::string("\x1b[0m"));
+  EXPECT_EQ(logMessageToGelf(Message), referenceGelf(Message));
+}
+
+TEST(GelfMessage, StaticPartIsReused) {
+  auto Message = createGelfTestMessage();
+  Message.addField("static_1", std::string("static value"));
+  Message.addField("static_2", 2.5);
+  Message.StaticFieldsId = LogMessage::createStaticFieldsId();
+  Message.NrOfStaticFields = 2;
+  Message.addField("dynamic", std::int64_t(1));
+  GelfWriter Writer;
+  std::string Output;
+  Writer.write(Message, Output);
+  EXPECT_EQ(nlohmann::json::parse(Output),
+            nlohmann::json::parse(referenceGelf(Message)));
+  // The static part comes first.
+  EXPECT_EQ(Output.find(R"({"version":"1.1","host":"some_host")"), 0u);
+
+  Message.MessageString = "Another message";
+  Message.addField("dynamic", std::string("another value"));
+  Message.addField("another_dynamic", 0.5);
+  Output.clear();
+  Writer.write(Message, Output);
+  EXPECT_EQ(nlohmann::json::parse(Output),
+            nlohmann::json::parse(referenceGelf(Message)));
+}
+
+TEST(GelfMessage, StaticPartIsUpdatedWithNewId) {
+  auto Message = createGelfTestMessage();
+  Message.StaticFieldsId = LogMessage::createStaticFieldsId();
+  GelfWriter Writer;
+  std::string Output;
+  Writer.write(Message, Output);
+  Message.Host = "other_host";
+  Message.StaticFieldsId = LogMessage::createStaticFieldsId();
+  Output.clear();
+  Writer.write(Message, Output);
+  EXPECT_EQ(nlohmann::json::parse(Output)["host"], "other_host");
+}
+
+TEST(GelfMessage, StaticPartWithReplacedStandardFields) {
+  auto Message = createGelfTestMessage();
+  Message.addField("process_id", std::string("static replacement"));
+  Message.addField("thread_id", std::string("static replacement"));
+  Message.StaticFieldsId = LogMessage::createStaticFieldsId();
+  Message.NrOfStaticFields = 2;
+  GelfWriter Writer;
+  std::string Output;
+  Writer.write(Message, Output);
+  EXPECT_EQ(nlohmann::json::parse(Output),
+            nlohmann::json::parse(referenceGelf(Message)));
+  EXPECT_EQ(Output.find("_thread_id"), Output.rfind("_thread_id"));
+
+  Message.addField("process", std::string("dynamic replacement"));
+  Output.clear();
+  Writer.write(Message, Output);
+  EXPECT_EQ(nlohmann::json::parse(Output),
+            nlohmann::json::parse(referenceGelf(Message)));
+  EXPECT_EQ(Output.find("_process\""), Output.rfind("_process\""));
+}
+
+TEST(GelfMessage, ReplacingStaticFieldResetsId) {
+  auto Message = createGelfTestMessage();
+  Message.addField("static", std::string("static value"));
+  Message.StaticFieldsId = LogMessage::createStaticFieldsId();
+  Message.NrOfStaticFields = 1;
+  Message.addField("dynamic", std::int64_t(1));
+  EXPECT_NE(Message.StaticFieldsId, 0u);
+  Message.addField("static", std::string("new value"));
+  EXPECT_EQ(Message.StaticFieldsId, 0u);
+}
+
+TEST(GelfMessage, Timestamps) {
+  auto Message = createGelfTestMessage();
+  for (auto Microseconds :
+       {0ll, 1ll, 10ll, 1000ll, 1590000000000000ll, 1590000000000001ll,
+        1590000000120000ll, 1590000000999999ll}) {
+    Message.Timestamp =
+        system_time(std::chrono::microseconds(Microseconds));
+    EXPECT_EQ(logMessageToGelf(Message), referenceGelf(Message));
+  }
+}
+
+TEST(GelfMessage, TimestampPrecision) {
+  auto Message = createGelfTestMessage();
+  Message.Timestamp = system_time(std::chrono::microseconds(1590000000123456));
+  GelfFormat Format;
+  EXPECT_EQ(nlohmann::json::parse(logMessageToGelf(Message, Format))
+                ["timestamp"],
+            1590000000.123456);
+  Format.Precision = TimestampPrecision::Milliseconds;
+  EXPECT_EQ(nlohmann::json::parse(logMessageToGelf(Message, Format))
+                ["timestamp"],
+            1590000000.123);
+  Format.Precision = TimestampPrecision::Seconds;
+  EXPECT_EQ(nlohmann::json::parse(logMessageToGelf(Message, Format))
+                ["timestamp"],
+            1590000000.0);
+  for (auto Precision :
+       {TimestampPrecision::Seconds, TimestampPrecision::Milliseconds,
+        TimestampPrecision::Microseconds}) {
+    Format.Precision = Precision;
+    EXPECT_EQ(logMessageToGelf(Message, Format),
+              referenceGelf(Message, Format));
+  }
+}
+
+TEST(GelfMessage, MonotonicTimeAndSequenceNumber) {
+  auto Message = createGelfTestMessage();
+  Message.MonotonicTimestamp = std::chrono::steady_clock::time_point(
+      std::chrono::nanoseconds(123456789012345));
+  Message.SequenceNumber = 42;
+  EXPECT_EQ(logMessageToGelf(Message).find("_monotonic_ns"),
+            std::string::npos);
+  EXPECT_EQ(logMessageToGelf(Message).find("_sequence"), std::string::npos);
+  GelfFormat Format;
+  Format.MonotonicTime = true;
+  Format.SequenceNumber = true;
+  EXPECT_EQ(logMessageToGelf(Message, Format),
+            referenceGelf(Message, Format));
+  auto Json = nlohmann::json::parse(logMessageToGelf(Message, Format));
+  EXPECT_EQ(Json["_monotonic_ns"], 123456789012345);
+  EXPECT_EQ(Json["_sequence"], 42);
+}
+
+TEST(GelfMessage, MonotonicTimeAndSequenceNumberWithStaticPart) {
+  auto Message = createGelfTestMessage();
+  Message.MonotonicTimestamp = std::chrono::steady_clock::time_point(
+      std::chrono::nanoseconds(1000));
+  Message.SequenceNumber = 7;
+  Message.addField("static", std::string("static value"));
+  Message.StaticFieldsId = LogMessage::createStaticFieldsId();
+  Message.NrOfStaticFields = 1;
+  GelfFormat Format;
+  Format.MonotonicTime = true;
+  Format.SequenceNumber = true;
+  GelfWriter Writer;
+  std::string Output;
+  Writer.write(Message, Output, Format);
+  EXPECT_EQ(nlohmann::json::parse(Output),
+            nlohmann::json::parse(referenceGelf(Message, Format)));
+
+  // An additional field replaces the standard field.
+  Message.addField("sequence", std::string("replaced"));
+  Output.clear();
+  Writer.write(Message, Output, Format);
+  EXPECT_EQ(nlohmann::json::parse(Output),
+            nlohmann::json::parse(referenceGelf(Message, Format)));
+  EXPECT_EQ(Output.find("_sequence"), Output.rfind("_sequence"));
+}
+
+TEST(GelfMessage, Doubles) {
+  for (auto Value :
+       {0.0, -0.0, 1.0, -1.0, 0.1, 1.0 / 3, 1e15, 1e16, 1.5e17, 1e-4, 1e-5,
+        123456.789, -2.5e-300, std::numeric_limits<double>::max(),
+        std::numeric_limits<double>::min(),
+        std::numeric_limits<double>::denorm_min()}) {
+    EXPECT_EQ(doubleToJson(Value), nlohmann::json(Value).dump());
+  }
+}
+
+TEST(GelfMessage, NonFiniteDoublesAreNull) {
+  EXPECT_EQ(doubleToJson(std::numeric_limits<double>::infinity()), "null");
+  EXPECT_EQ(doubleToJson(std::numeric_limits<double>::quiet_NaN()), "null");
+}
+
+TEST(GelfMessage, InvalidUtf8IsReplaced) {
+  EXPECT_EQ(escaped("a\xFF"
+                    "b"),
+            "a\xEF\xBF\xBD"
+            "b");
+  // Truncated sequence, overlong encoding and encoded surrogate.
+  EXPECT_EQ(escaped("\xE2\x82"), "\xEF\xBF\xBD\xEF\xBF\xBD");
+  EXPECT_EQ(escaped("\xC0\xAF"), "\xEF\xBF\xBD\xEF\xBF\xBD");
+  EXPECT_EQ(escaped("\xED\xA0\x80"), "\xEF\xBF\xBD\xEF\xBF\xBD\xEF\xBF\xBD");
+}
+
+TEST(GelfMessage, OutputIsAppended) {
+  auto Message = createGelfTestMessage();
+  GelfWriter Writer;
+  std::string Output("prefix");
+  Writer.write(Message, Output);
+  EXPECT_EQ(Output, "prefix" + referenceGelf(Message));
+}
+
+namespace {
+/// \brief Strings with special characters at all positions relative to the
+/// 16 and 32 byte blocks of the vectorised scans.
+std::vector<std::string> createScanTestStrings() {
+  std::vector<std::string> Result{""};
+  const std::string SpecialCharacters("\"\\\n\x01\x1f\x80\xff");
+  for (size_t Size = 1; Size < 70; ++Size) {
+    Result.emplace_back(Size, 'a');
+    for (auto Special : SpecialCharacters) {
+      for (size_t Position = 0; Position < Size; ++Position) {
+        std::string Modified(Size, ' ');
+        Modified[Position] = Special;
+        Result.push_back(Modified);
+      }
+    }
+  }
+  return Result;
+}
+} // namespace
+
+TEST(JsonScan, VectorisedScansMatchScalarScan) {
+  for (auto &TestString : createScanTestStrings()) {
+    auto Expected = JsonScan::scalar(TestString.data(), TestString.size());
+#ifdef JSON_SCAN_SSE2
+    EXPECT_EQ(JsonScan::sse2(TestString.data(), TestString.size()), Expected);
+#endif
+#ifdef JSON_SCAN_AVX2
+    if (JsonScan::cpuHasAvx2()) {
+      EXPECT_EQ(JsonScan::avx2(TestString.data(), TestString.size()),
+                Expected);
+    }
+#endif
+  }
+}
+
+TEST(JsonScan, LongStringsAreEscaped) {
+  std::string Long(5000, 'x');
+  Long[100] = '"';
+  Long[4097] = '\n';
+  Long += "\xC3\xB6";
+  EXPECT_EQ(nlohmann::json(Long).dump(), '"' + escaped(Long) + '"');
+}
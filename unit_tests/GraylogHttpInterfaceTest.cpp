@@ -0,0 +1,308 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Tests of the GELF over HTTP log handler.
+///
+//===----------------------------------------------------------------------===//
+
+#include "GraylogHttpConnection.hpp"
+#include "HttpTestServer.hpp"
+#include "graylog_logger/GraylogHttpInterface.hpp"
+#include <algorithm>
+#include <ciso646>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <nlohmann/json.hpp>
+
+using namespace Log;
+using namespace std::chrono_literals;
+
+const std::uint16_t HttpTestPort{2528};
+
+namespace {
+std::vector<std::string> numberedMessages(size_t NrOfMessages) {
+  std::vector<std::string> Messages;
+  for (size_t i = 0; i < NrOfMessages; ++i) {
+    Messages.push_back("Message " + std::to_string(i));
+  }
+  return Messages;
+}
+} // namespace
+
+TEST(GraylogHttpInterface, MessagesArePostedOverOneConnection) {
+  HttpTestServer Server(HttpTestPort);
+  GraylogHttpConnection Connection("localhost", HttpTestPort,
+                                   GraylogHttpSettings());
+  auto Messages = numberedMessages(10);
+  for (auto &Message : Messages) {
+    Connection.sendMessage(Message);
+  }
+  ASSERT_TRUE(Connection.flush(10s));
+  EXPECT_EQ(Server.getMessages(), Messages);
+  auto Requests = Server.getRequests();
+  ASSERT_EQ(Requests.size(), 10u);
+  EXPECT_EQ(Requests[0].Header.find("POST /gelf HTTP/1.1\r\n"), 0u);
+  EXPECT_NE(Requests[0].Header.find("Content-Type: application/json\r\n"),
+            std::string::npos);
+  EXPECT_EQ(Server.getNrOfConnections(), 1u);
+  EXPECT_EQ(Connection.getConnectionStatus(), Status::SEND_LOOP);
+  EXPECT_EQ(Connection.messageQueueSize(), 0u);
+  EXPECT_EQ(Connection.getMetrics().Dequeued, 10u);
+}
+
+TEST(GraylogHttpInterface, MessagesAreBatched) {
+  HttpTestServer Server(HttpTestPort);
+  Server.setResponseDelay(50ms);
+  GraylogHttpSettings Settings;
+  Settings.MaxMessagesPerRequest = 5;
+  Settings.MaxPipelinedRequests = 1;
+  GraylogHttpConnection Connection("localhost", HttpTestPort, Settings);
+  auto Messages = numberedMessages(10);
+  Connection.sendMessages(Messages);
+  ASSERT_TRUE(Connection.flush(10s));
+  EXPECT_EQ(Server.getMessages(), Messages);
+  auto Requests = Server.getRequests();
+  ASSERT_EQ(Requests.size(), 2u);
+  EXPECT_EQ(Requests[0].Body,
+            "Message 0\nMessage 1\nMessage 2\nMessage 3\nMessage 4");
+}
+
+TEST(GraylogHttpInterface, BatchSizeIsLimited) {
+  HttpTestServer Server(HttpTestPort);
+  Server.setResponseDelay(50ms);
+  GraylogHttpSettings Settings;
+  Settings.MaxMessagesPerRequest = 100;
+  Settings.MaxRequestBytes = 20;
+  Settings.MaxPipelinedRequests = 1;
+  GraylogHttpConnection Connection("localhost", HttpTestPort, Settings);
+  auto Messages = numberedMessages(6);
+  Connection.sendMessages(Messages);
+  ASSERT_TRUE(Connection.flush(10s));
+  EXPECT_EQ(Server.getMessages(), Messages);
+  for (auto &CRequest : Server.getRequests()) {
+    EXPECT_LE(CRequest.Body.size(), 20u);
+  }
+}
+
+TEST(GraylogHttpInterface, RequestsArePipelined) {
+  HttpTestServer Server(HttpTestPort);
+  Server.setResponseDelay(20ms);
+  GraylogHttpSettings Settings;
+  Settings.MaxPipelinedRequests = 4;
+  GraylogHttpConnection Connection("localhost", HttpTestPort, Settings);
+  auto Messages = numberedMessages(20);
+  Connection.sendMessages(Messages);
+  ASSERT_TRUE(Connection.flush(10s));
+  EXPECT_EQ(Server.getMessages(), Messages);
+  EXPECT_GT(Server.getMaxPipelinedRequests(), 1u);
+  EXPECT_LE(Server.getMaxPipelinedRequests(), 4u);
+  EXPECT_EQ(Server.getNrOfConnections(), 1u);
+}
+
+TEST(GraylogHttpInterface, PipeliningCanBeDisabled) {
+  HttpTestServer Server(HttpTestPort);
+  Server.setResponseDelay(20ms);
+  GraylogHttpSettings Settings;
+  Settings.MaxPipelinedRequests = 1;
+  GraylogHttpConnection Connection("localhost", HttpTestPort, Settings);
+  Connection.sendMessages(numberedMessages(5));
+  ASSERT_TRUE(Connection.flush(10s));
+  EXPECT_EQ(Server.getMessages().size(), 5u);
+  EXPECT_EQ(Server.getMaxPipelinedRequests(), 1u);
+}
+
+#ifdef WITH_ZLIB
+TEST(GraylogHttpInterface, GzipCompressedBodies) {
+  HttpTestServer Server(HttpTestPort);
+  GraylogHttpSettings Settings;
+  Settings.BodyCompression = Compression::Gzip;
+  Settings.MaxMessagesPerRequest = 10;
+  GraylogHttpConnection Connection("localhost", HttpTestPort, Settings);
+  auto Messages = numberedMessages(10);
+  Connection.sendMessages(Messages);
+  ASSERT_TRUE(Connection.flush(10s));
+  EXPECT_EQ(Server.getMessages(), Messages);
+  auto Requests = Server.getRequests();
+  ASSERT_FALSE(Requests.empty());
+  EXPECT_NE(Requests[0].Header.find("Content-Encoding: gzip\r\n"),
+            std::string::npos);
+}
+#endif
+
+TEST(GraylogHttpInterface, RejectedMessagesAreDiscarded) {
+  HttpTestServer Server(HttpTestPort);
+  Server.setStatusCode(400);
+  GraylogHttpConnection Connection("localhost", HttpTestPort,
+                                   GraylogHttpSettings());
+  Connection.sendMessages(numberedMessages(3));
+  ASSERT_TRUE(Connection.flush(10s));
+  EXPECT_EQ(Server.getRequests().size(), 3u);
+  EXPECT_EQ(Connection.getMetrics().Discarded, 3u);
+  EXPECT_EQ(Connection.getMetrics().Dropped, 0u);
+  EXPECT_EQ(Connection.messageQueueSize(), 0u);
+}
+
+TEST(GraylogHttpInterface, ServerErrorsAreRetried) {
+  HttpTestServer Server(HttpTestPort);
+  Server.setStatusCode(503);
+  GraylogHttpSettings Settings;
+  Settings.ReconnectDelayMin = 10ms;
+  Settings.ReconnectDelayMax = 20ms;
+  GraylogHttpConnection Connection("localhost", HttpTestPort, Settings);
+  Connection.sendMessage("Retried message");
+  ASSERT_TRUE(Server.waitForMessages(2));
+  EXPECT_EQ(Connection.messageQueueSize(), 1u);
+  Server.setStatusCode(202);
+  ASSERT_TRUE(Connection.flush(10s));
+  EXPECT_EQ(Connection.messageQueueSize(), 0u);
+  EXPECT_EQ(Connection.getMetrics().Dropped, 0u);
+  EXPECT_EQ(Connection.getMetrics().Discarded, 0u);
+  EXPECT_GE(Connection.getMetrics().Reconnects, 1u);
+}
+
+TEST(GraylogHttpInterface, RetriesAreLimited) {
+  HttpTestServer Server(HttpTestPort);
+  Server.setStatusCode(500);
+  GraylogHttpSettings Settings;
+  Settings.ReconnectDelayMin = 10ms;
+  Settings.ReconnectDelayMax = 20ms;
+  Settings.MaxRetries = 3;
+  GraylogHttpConnection Connection("localhost", HttpTestPort, Settings);
+  Connection.sendMessage("Failing message");
+  ASSERT_TRUE(Connection.flush(10s));
+  EXPECT_EQ(Server.getRequests().size(), 4u);
+  EXPECT_EQ(Connection.messageQueueSize(), 0u);
+  EXPECT_EQ(Connection.getMetrics().Discarded, 1u);
+  EXPECT_EQ(Connection.getMetrics().Dropped, 0u);
+}
+
+TEST(GraylogHttpInterface, RetryAfterIsHonoured) {
+  HttpTestServer Server(HttpTestPort);
+  Server.setStatusCode(429);
+  Server.setRetryAfter(1);
+  GraylogHttpSettings Settings;
+  Settings.ReconnectDelayMin = 10ms;
+  Settings.ReconnectDelayMax = 20ms;
+  GraylogHttpConnection Connection("localhost", HttpTestPort, Settings);
+  Connection.sendMessage("Throttled message");
+  ASSERT_TRUE(Server.waitForMessages(1));
+  auto FirstRequest = std::chrono::steady_clock::now();
+  ASSERT_TRUE(Server.waitForMessages(2, 5000ms));
+  EXPECT_GE(std::chrono::steady_clock::now() - FirstRequest, 900ms);
+  Server.setStatusCode(202);
+  ASSERT_TRUE(Connection.flush(10s));
+  EXPECT_EQ(Connection.getMetrics().Discarded, 0u);
+}
+
+TEST(GraylogHttpInterface, ReconnectsWhenServerClosesConnection) {
+  HttpTestServer Server(HttpTestPort);
+  Server.setCloseAfterResponse(true);
+  GraylogHttpConnection Connection("localhost", HttpTestPort,
+                                   GraylogHttpSettings());
+  auto Messages = numberedMessages(5);
+  for (auto &Message : Messages) {
+    Connection.sendMessage(Message);
+    ASSERT_TRUE(Connection.flush(10s));
+  }
+  EXPECT_EQ(Server.getMessages(), Messages);
+  EXPECT_EQ(Server.getNrOfConnections(), 5u);
+}
+
+TEST(GraylogHttpInterface, MessagesAreSentOnceServerIsUp) {
+  GraylogHttpSettings Settings;
+  Settings.ReconnectDelayMin = 10ms;
+  Settings.ReconnectDelayMax = 50ms;
+  GraylogHttpConnection Connection("localhost", HttpTestPort, Settings);
+  Connection.sendMessage("Early message");
+  EXPECT_FALSE(Connection.flush(100ms));
+  HttpTestServer Server(HttpTestPort);
+  ASSERT_TRUE(Connection.flush(10s));
+  EXPECT_EQ(Server.getMessages(), std::vector<std::string>{"Early message"});
+}
+
+TEST(GraylogHttpInterface, StatusChangesAreReported) {
+  GraylogHttpSettings Settings;
+  Settings.ReconnectDelayMin = 10ms;
+  Settings.ReconnectDelayMax = 50ms;
+  GraylogHttpConnection Connection("localhost", HttpTestPort, Settings);
+  std::mutex ChangesMutex;
+  std::vector<StatusChange> Changes;
+  Connection.addStatusCallback([&](const StatusChange &Change) {
+    std::lock_guard<std::mutex> Lock(ChangesMutex);
+    Changes.push_back(Change);
+  });
+  Connection.sendMessage("Message");
+  EXPECT_FALSE(Connection.flush(100ms));
+  {
+    std::lock_guard<std::mutex> Lock(ChangesMutex);
+    auto Failed = std::find_if(Changes.begin(), Changes.end(), [](auto &C) {
+      return C.Current == Status::ADDR_RETRY_WAIT;
+    });
+    ASSERT_NE(Failed, Changes.end());
+    EXPECT_EQ(Failed->Error, std::errc::connection_refused);
+  }
+  HttpTestServer Server(HttpTestPort);
+  ASSERT_TRUE(Connection.flush(10s));
+  EXPECT_EQ(Connection.getConnectionStatus(), Status::SEND_LOOP);
+  std::lock_guard<std::mutex> Lock(ChangesMutex);
+  EXPECT_EQ(Changes.back().Current, Status::SEND_LOOP);
+}
+
+TEST(GraylogHttpInterface, LogMessagesAreSentAsGelf) {
+  HttpTestServer Server(HttpTestPort);
+  GraylogHttpInterface Handler("localhost", HttpTestPort);
+  LogMessage Message;
+  Message.MessageString = "Some log message";
+  Message.SeverityLevel = Severity::Error;
+  Handler.addMessage(Message);
+  ASSERT_TRUE(Handler.flush(10s));
+  auto Messages = Server.getMessages();
+  ASSERT_EQ(Messages.size(), 1u);
+  auto Json = nlohmann::json::parse(Messages[0]);
+  EXPECT_EQ(Json["short_message"], "Some log message");
+  EXPECT_EQ(Json["level"], 3);
+}
+
+TEST(HttpResponseHeader, KeepAliveResponse) {
+  auto Header = parseHttpResponseHeader(
+      "HTTP/1.1 202 Accepted\r\ncontent-length: 12\r\n\r\n");
+  EXPECT_EQ(Header.StatusCode, 202);
+  EXPECT_EQ(Header.ContentLength, 12u);
+  EXPECT_FALSE(Header.Close);
+}
+
+TEST(HttpResponseHeader, ConnectionIsClosed) {
+  EXPECT_TRUE(parseHttpResponseHeader("HTTP/1.1 200 OK\r\nContent-Length: "
+                                      "0\r\nConnection: close\r\n\r\n")
+                  .Close);
+  EXPECT_TRUE(
+      parseHttpResponseHeader("HTTP/1.0 200 OK\r\nContent-Length: 0\r\n\r\n")
+          .Close);
+  // The length of the body is unknown.
+  EXPECT_TRUE(parseHttpResponseHeader("HTTP/1.1 200 OK\r\n\r\n").Close);
+  EXPECT_TRUE(parseHttpResponseHeader(
+                  "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n")
+                  .Close);
+  EXPECT_FALSE(
+      parseHttpResponseHeader("HTTP/1.1 204 No Content\r\n\r\n").Close);
+}
+
+TEST(HttpResponseHeader, RetryAfter) {
+  EXPECT_EQ(parseHttpResponseHeader("HTTP/1.1 429 Too Many Requests\r\n"
+                                    "Retry-After: 120\r\n\r\n")
+                .RetryAfter,
+            120s);
+  EXPECT_EQ(parseHttpResponseHeader(
+                "HTTP/1.1 503 Service Unavailable\r\nRetry-After: Fri, 31 "
+                "Dec 1999 23:59:59 GMT\r\n\r\n")
+                .RetryAfter,
+            0s);
+  EXPECT_EQ(parseHttpResponseHeader("HTTP/1.1 200 OK\r\n\r\n").RetryAfter,
+            0s);
+}
+
+TEST(HttpResponseHeader, InvalidStatusLine) {
+  EXPECT_EQ(parseHttpResponseHeader("Hello\r\n\r\n").StatusCode, 0);
+}
@@ -7,15 +7,26 @@
 //
 
 #include "graylog_logger/GraylogInterface.hpp"
+#include "graylog_logger/IoContext.hpp"
+#include "Decompress.hpp"
+#include "EndpointOrder.hpp"
+#include "GraylogConnection.hpp"
 #include "LogTestServer.hpp"
 #include "Semaphore.hpp"
+#include <algorithm>
 #include <ciso646>
 #include <cmath>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
+#include <numeric>
 #include <thread>
+#ifndef _WIN32
+#include <cstdlib>
+#include <unistd.h>
+#endif
 
 using namespace Log;
 
@@ -32,7 +43,11 @@ class GraylogInterfaceStandIn : public GraylogInterface {
 public:
   GraylogInterfaceStandIn(std::string host, int port, int queueLength)
       : GraylogInterface(host, port, queueLength){};
+  GraylogInterfaceStandIn(std::string host, int port,
+                          const GraylogSettings &Settings)
+      : GraylogInterface(host, port, Settings){};
   MOCK_METHOD1(sendMessage, void(std::string));
+  MOCK_METHOD1(sendMessages, void(std::vector<std::string>));
   using GraylogInterface::logMsgToJSON;
   void sendMessageBase(std::string Msg) { GraylogInterface::sendMessage(Msg); }
 };
@@ -151,6 +166,289 @@ TEST_F(GraylogConnectionCom, CloseConnectionTest) {
   EXPECT_EQ(0, logServer->GetNrOfConnections());
 }
 
+TEST_F(GraylogConnectionCom, ImmediateReconnectTest) {
+  GraylogSettings Settings;
+  // Only the first attempt after the connection was lost is immediate.
+  Settings.ReconnectDelayMin = std::chrono::seconds(10);
+  GraylogConnection con("localhost", testPort, Settings);
+  std::this_thread::sleep_for(sleepTime);
+  ASSERT_EQ(1, logServer->GetNrOfConnections());
+  logServer->CloseAllConnections();
+  std::this_thread::sleep_for(sleepTime);
+  EXPECT_EQ(Status::SEND_LOOP, con.getConnectionStatus());
+  EXPECT_EQ(1, logServer->GetNrOfConnections());
+  EXPECT_EQ(con.getMetrics().Reconnects, 1u);
+}
+
+namespace {
+/// \brief Accepts TCP connections and closes them at once.
+class ClosingServer {
+public:
+  explicit ClosingServer(unsigned short Port)
+      : Acceptor(Service, asio::ip::tcp::endpoint(asio::ip::tcp::v6(), Port)) {
+    accept();
+    ServiceThread = std::thread([this]() { Service.run(); });
+  }
+  ~ClosingServer() {
+    Service.stop();
+    ServiceThread.join();
+  }
+  int nrOfConnections() const { return NrOfConnections; }
+
+private:
+  void accept() {
+    Acceptor.async_accept(Socket, [this](const asio::error_code &Error) {
+      if (Error) {
+        return;
+      }
+      ++NrOfConnections;
+      asio::error_code CloseError;
+      Socket.close(CloseError);
+      accept();
+    });
+  }
+  asio::io_service Service;
+  asio::ip::tcp::acceptor Acceptor;
+  asio::ip::tcp::socket Socket{Service};
+  std::atomic_int NrOfConnections{0};
+  std::thread ServiceThread;
+};
+} // namespace
+
+TEST(GraylogConnectionBackoff, ConnectionsClosedAtOnceAreFailedAttempts) {
+  ClosingServer Server(testPort + 40);
+  GraylogSettings Settings;
+  Settings.ReconnectDelayMin = std::chrono::milliseconds(20);
+  GraylogConnection con("localhost", testPort + 40, Settings);
+  // The limit of the delay doubles with every attempt (20 ms, 40 ms, 80 ms
+  // and so on), i.e. about eight connections are expected within a second.
+  // Without the backoff, there would be thousands.
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  auto NrOfConnections = Server.nrOfConnections();
+  EXPECT_GE(NrOfConnections, 3);
+  EXPECT_LT(NrOfConnections, 20);
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  // The delay keeps growing.
+  EXPECT_LT(Server.nrOfConnections() - NrOfConnections, NrOfConnections);
+}
+
+namespace {
+/// \brief Collects the status changes of a connection.
+class StatusChanges {
+public:
+  StatusCallback callback() {
+    return [this](const StatusChange &Change) {
+      std::lock_guard<std::mutex> Lock(Mutex);
+      Changes.push_back(Change);
+    };
+  }
+  std::vector<StatusChange> get() {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    return Changes;
+  }
+
+private:
+  std::mutex Mutex;
+  std::vector<StatusChange> Changes;
+};
+} // namespace
+
+TEST_F(GraylogConnectionCom, StatusCallbackTest) {
+  GraylogConnection con("localhost", testPort, GraylogSettings());
+  std::this_thread::sleep_for(sleepTime);
+  ASSERT_EQ(Status::SEND_LOOP, con.getConnectionStatus());
+  StatusChanges Changes;
+  auto Id = con.addStatusCallback(Changes.callback());
+  logServer->CloseAllConnections();
+  std::this_thread::sleep_for(sleepTime);
+  ASSERT_EQ(Status::SEND_LOOP, con.getConnectionStatus());
+  auto Received = Changes.get();
+  ASSERT_GE(Received.size(), 2u);
+  EXPECT_EQ(Received.front().Previous, Status::SEND_LOOP);
+  EXPECT_EQ(Received.front().Current, Status::ADDR_RETRY_WAIT);
+  // The server closed the connection.
+  EXPECT_TRUE(Received.front().Error);
+  EXPECT_EQ(Received.back().Current, Status::SEND_LOOP);
+  con.removeStatusCallback(Id);
+  logServer->CloseAllConnections();
+  std::this_thread::sleep_for(sleepTime);
+  EXPECT_EQ(Changes.get().size(), Received.size());
+  auto Durations = con.getTimeInStatus();
+  EXPECT_GE(Durations[static_cast<size_t>(Status::SEND_LOOP)], sleepTime);
+}
+
+TEST_F(GraylogConnectionCom, StatusCallbackWrongPortTest) {
+  GraylogSettings Settings;
+  Settings.ReconnectDelayMin = std::chrono::seconds(10);
+  StatusChanges Changes;
+  GraylogConnection con("localhost", testPort + 1, Settings);
+  con.addStatusCallback(Changes.callback());
+  std::this_thread::sleep_for(sleepTime);
+  ASSERT_EQ(Status::ADDR_RETRY_WAIT, con.getConnectionStatus());
+  auto Received = Changes.get();
+  ASSERT_FALSE(Received.empty());
+  EXPECT_EQ(Received.back().Current, Status::ADDR_RETRY_WAIT);
+  EXPECT_TRUE(Received.back().Error);
+}
+
+TEST_F(GraylogConnectionCom, PoolStatusCallbackTest) {
+  GraylogSettings Settings;
+  Settings.NrOfConnections = 2;
+  Settings.ReconnectDelayMin = std::chrono::seconds(10);
+  Settings.AdditionalServers = {{"localhost", testPort + 10}};
+  GraylogConnection con("localhost", testPort, Settings);
+  std::this_thread::sleep_for(sleepTime);
+  ASSERT_EQ(Status::SEND_LOOP, con.getConnectionStatus());
+  StatusChanges Changes;
+  con.addStatusCallback(Changes.callback());
+  // Only the connection to the other server fails (again).
+  std::this_thread::sleep_for(sleepTime);
+  EXPECT_TRUE(Changes.get().empty());
+  EXPECT_GE(con.getTimeInStatus()[static_cast<size_t>(Status::SEND_LOOP)],
+            sleepTime);
+}
+
+TEST_F(GraylogConnectionCom, WriteTimeoutTest) {
+  // Connections to this port are accepted (by the kernel) but nothing is
+  // ever read from them.
+  asio::io_service Service;
+  asio::ip::tcp::acceptor Acceptor(
+      Service, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(),
+                                       testPort + 30));
+  GraylogSettings Settings;
+  Settings.WriteTimeout = std::chrono::milliseconds(200);
+  GraylogConnection con("localhost", testPort + 30, Settings);
+  std::string LargeMessage(1024 * 1024, 'a');
+  for (int i = 0; i < 64; ++i) {
+    con.sendMessage(LargeMessage);
+  }
+  auto Start = std::chrono::steady_clock::now();
+  while (con.getMetrics().Reconnects == 0 and
+         std::chrono::steady_clock::now() < Start + std::chrono::seconds(5)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_GE(con.getMetrics().Reconnects, 1u);
+}
+
+TEST_F(GraylogConnectionCom, IoUringWriteTimeoutTest) {
+  asio::io_service Service;
+  asio::ip::tcp::acceptor Acceptor(
+      Service, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(),
+                                       testPort + 31));
+  GraylogSettings Settings;
+  Settings.Backend = IoBackend::IoUring;
+  Settings.WriteTimeout = std::chrono::milliseconds(200);
+  GraylogConnection con("localhost", testPort + 31, Settings);
+  std::string LargeMessage(1024 * 1024, 'a');
+  for (int i = 0; i < 64; ++i) {
+    con.sendMessage(LargeMessage);
+  }
+  auto Start = std::chrono::steady_clock::now();
+  while (con.getMetrics().Reconnects == 0 and
+         std::chrono::steady_clock::now() < Start + std::chrono::seconds(5)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_GE(con.getMetrics().Reconnects, 1u);
+}
+
+TEST_F(GraylogConnectionCom, QueueByteLimitTest) {
+  GraylogSettings Settings;
+  Settings.MaxQueueBytes = 100;
+  // Nothing is listening on this port, the messages stay in the queue.
+  GraylogConnection con("localhost", testPort + 1, Settings);
+  std::string Message(29, 'a');
+  for (int i = 0; i < 10; ++i) {
+    con.sendMessage(Message);
+  }
+  // Every message takes 30 bytes, including the terminating null byte.
+  EXPECT_EQ(con.messageQueueSize(), 3u);
+  EXPECT_EQ(con.getMetrics().Dropped, 7u);
+  con.sendMessages(std::vector<std::string>(3, "b"));
+  EXPECT_EQ(con.messageQueueSize(), 6u);
+  EXPECT_EQ(con.getMetrics().Dropped, 7u);
+}
+
+TEST(ReconnectDelay, LimitGrowsExponentially) {
+  using std::chrono::milliseconds;
+  const milliseconds Min{100};
+  const milliseconds Max{10000};
+  EXPECT_EQ(reconnectDelayLimit(0, Min, Max), milliseconds(0));
+  EXPECT_EQ(reconnectDelayLimit(1, Min, Max), milliseconds(100));
+  EXPECT_EQ(reconnectDelayLimit(2, Min, Max), milliseconds(200));
+  EXPECT_EQ(reconnectDelayLimit(5, Min, Max), milliseconds(1600));
+  EXPECT_EQ(reconnectDelayLimit(8, Min, Max), milliseconds(10000));
+  EXPECT_EQ(reconnectDelayLimit(1000, Min, Max), milliseconds(10000));
+  EXPECT_EQ(reconnectDelayLimit(1, Max * 2, Max), Max);
+}
+
+namespace {
+std::vector<asio::ip::tcp::endpoint> testEndpoints() {
+  auto Make = [](const char *Address) {
+    return asio::ip::tcp::endpoint(asio::ip::make_address(Address), 1);
+  };
+  return {Make("::1"), Make("127.0.0.1"), Make("fe80::1"), Make("10.0.0.1")};
+}
+} // namespace
+
+TEST(EndpointOrder, IPv4First) {
+  auto Endpoints = testEndpoints();
+  orderEndpoints(Endpoints, AddressPreference::IPv4First);
+  auto Expected = testEndpoints();
+  EXPECT_EQ(Endpoints, decltype(Endpoints)({Expected[1], Expected[3],
+                                            Expected[0], Expected[2]}));
+}
+
+TEST(EndpointOrder, IPv6First) {
+  auto Endpoints = testEndpoints();
+  std::rotate(Endpoints.begin(), Endpoints.begin() + 1, Endpoints.end());
+  orderEndpoints(Endpoints, AddressPreference::IPv6First);
+  auto Expected = testEndpoints();
+  EXPECT_EQ(Endpoints, decltype(Endpoints)({Expected[2], Expected[0],
+                                            Expected[1], Expected[3]}));
+}
+
+TEST(EndpointOrder, ResolverOrder) {
+  auto Endpoints = testEndpoints();
+  orderEndpoints(Endpoints, AddressPreference::ResolverOrder);
+  EXPECT_EQ(Endpoints, testEndpoints());
+}
+
+namespace {
+bool addressWasLookedUp(const std::vector<StatusChange> &Changes) {
+  return std::any_of(Changes.begin(), Changes.end(), [](auto &Change) {
+    return Status::ADDR_LOOKUP == Change.Current;
+  });
+}
+} // namespace
+
+TEST_F(GraylogConnectionCom, ReconnectUsesCachedAddressesTest) {
+  GraylogConnection con("localhost", testPort, GraylogSettings());
+  std::this_thread::sleep_for(sleepTime);
+  ASSERT_EQ(Status::SEND_LOOP, con.getConnectionStatus());
+  StatusChanges Changes;
+  con.addStatusCallback(Changes.callback());
+  logServer->CloseAllConnections();
+  std::this_thread::sleep_for(sleepTime);
+  ASSERT_EQ(Status::SEND_LOOP, con.getConnectionStatus());
+  auto Received = Changes.get();
+  ASSERT_FALSE(Received.empty());
+  EXPECT_FALSE(addressWasLookedUp(Received));
+}
+
+TEST_F(GraylogConnectionCom, ReconnectWithoutAddressCacheTest) {
+  GraylogSettings Settings;
+  Settings.AddressCacheTtl = std::chrono::milliseconds(0);
+  GraylogConnection con("localhost", testPort, Settings);
+  std::this_thread::sleep_for(sleepTime);
+  ASSERT_EQ(Status::SEND_LOOP, con.getConnectionStatus());
+  StatusChanges Changes;
+  con.addStatusCallback(Changes.callback());
+  logServer->CloseAllConnections();
+  std::this_thread::sleep_for(sleepTime);
+  ASSERT_EQ(Status::SEND_LOOP, con.getConnectionStatus());
+  EXPECT_TRUE(addressWasLookedUp(Changes.get()));
+}
+
 TEST_F(GraylogConnectionCom, MessageTransmissionTest) {
   {
     std::string testString("This is a test string!");
@@ -164,6 +462,357 @@ TEST_F(GraylogConnectionCom, MessageTransmissionTest) {
   }
 }
 
+TEST_F(GraylogConnectionCom, MessagesAfterIdlePeriodsTest) {
+  GraylogConnection con("localhost", testPort, 1000);
+  std::string FirstMessage("Sent to an idle connection.");
+  std::string SecondMessage("Sent after the connection became idle again.");
+  std::this_thread::sleep_for(sleepTime);
+  ASSERT_EQ(con.getConnectionStatus(), Status::SEND_LOOP);
+  con.sendMessage(FirstMessage);
+  std::this_thread::sleep_for(sleepTime);
+  EXPECT_EQ(logServer->GetReceivedData(), FirstMessage + '\0');
+  con.sendMessage(SecondMessage);
+  std::this_thread::sleep_for(sleepTime);
+  EXPECT_EQ(logServer->GetReceivedData(),
+            FirstMessage + '\0' + SecondMessage + '\0');
+}
+
+TEST_F(GraylogConnectionCom, MessageStreamTest) {
+  GraylogConnection con("localhost", testPort, 1000);
+  std::vector<std::string> Messages;
+  std::string ExpectedData;
+  for (int i = 0; i < 500; ++i) {
+    Messages.push_back("Message number " + std::to_string(i) +
+                       std::string(i % 50, 'x'));
+    ExpectedData += Messages.back() + '\0';
+  }
+  con.sendMessages(Messages);
+  ASSERT_TRUE(con.flush(std::chrono::seconds(10)));
+  std::this_thread::sleep_for(sleepTime);
+  EXPECT_EQ(logServer->GetReceivedData(), ExpectedData);
+  EXPECT_EQ(con.getMetrics().BytesWritten, ExpectedData.size());
+}
+
+TEST_F(GraylogConnectionCom, IoUringMessageStreamTest) {
+  GraylogSettings Settings;
+  Settings.Backend = IoBackend::IoUring;
+  // Larger messages than fit in the registered buffer.
+  Settings.MaxBatchBytes = 4096;
+  GraylogConnection con("localhost", testPort, Settings);
+  std::vector<std::string> Messages;
+  std::string ExpectedData;
+  for (int i = 0; i < 500; ++i) {
+    Messages.push_back("Message number " + std::to_string(i) +
+                       std::string((i % 50) * (i % 7 == 0 ? 200 : 1), 'x'));
+    ExpectedData += Messages.back() + '\0';
+  }
+  con.sendMessages(Messages);
+  ASSERT_TRUE(con.flush(std::chrono::seconds(10)));
+  std::this_thread::sleep_for(sleepTime);
+  EXPECT_EQ(logServer->GetReceivedData(), ExpectedData);
+  EXPECT_EQ(con.getMetrics().BytesWritten, ExpectedData.size());
+}
+
+TEST_F(GraylogConnectionCom, IoUringLargeStreamTest) {
+  GraylogSettings Settings;
+  Settings.Backend = IoBackend::IoUring;
+  // Every submission fills several of the registered buffers.
+  Settings.MaxBatchBytes = 16 * 1024;
+  Settings.MaxQueueBytes = 0;
+  GraylogConnection con("localhost", testPort, Settings);
+  std::vector<std::string> Messages;
+  std::string ExpectedData;
+  for (int i = 0; i < 2000; ++i) {
+    Messages.push_back("Message number " + std::to_string(i) +
+                       std::string(1000 + (i % 13) * 100, 'y'));
+    ExpectedData += Messages.back() + '\0';
+  }
+  con.sendMessages(Messages);
+  ASSERT_TRUE(con.flush(std::chrono::seconds(10)));
+  auto Start = std::chrono::steady_clock::now();
+  while (size_t(logServer->GetReceivedBytes()) < ExpectedData.size() and
+         std::chrono::steady_clock::now() < Start + std::chrono::seconds(10)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(logServer->GetReceivedData(), ExpectedData);
+  EXPECT_EQ(con.getMetrics().BytesWritten, ExpectedData.size());
+}
+
+TEST_F(GraylogConnectionCom, LingerDoesNotDelaySingleMessagesTest) {
+  GraylogSettings Settings;
+  Settings.Linger = std::chrono::seconds(10);
+  GraylogConnection con("localhost", testPort, Settings);
+  std::string testString("This is a test string!");
+  std::this_thread::sleep_for(sleepTime);
+  con.sendMessage(testString);
+  std::this_thread::sleep_for(sleepTime);
+  EXPECT_EQ(logServer->GetReceivedData(), testString + '\0');
+}
+
+TEST_F(GraylogConnectionCom, SmallBatchesTest) {
+  GraylogSettings Settings;
+  Settings.MaxBatchBytes = 100;
+  Settings.Linger = std::chrono::seconds(10);
+  GraylogConnection con("localhost", testPort, Settings);
+  std::vector<std::string> Messages;
+  std::string ExpectedData;
+  for (int i = 0; i < 500; ++i) {
+    Messages.push_back("Message number " + std::to_string(i));
+    ExpectedData += Messages.back() + '\0';
+  }
+  con.sendMessages(Messages);
+  // Messages that are held back are written when the flush request is
+  // dequeued.
+  ASSERT_TRUE(con.flush(std::chrono::seconds(10)));
+  std::this_thread::sleep_for(sleepTime);
+  EXPECT_EQ(logServer->GetReceivedData(), ExpectedData);
+}
+
+#ifdef WITH_ZLIB
+TEST_F(GraylogConnectionCom, CompressedStreamTest) {
+  GraylogSettings Settings;
+  Settings.StreamCompression = Compression::Gzip;
+  GraylogConnection con("localhost", testPort, Settings);
+  std::string FirstMessage("This is the first test string!");
+  std::string SecondMessage("This is the second test string!");
+  con.sendMessage(FirstMessage);
+  ASSERT_TRUE(con.flush(std::chrono::seconds(10)));
+  con.sendMessage(SecondMessage);
+  ASSERT_TRUE(con.flush(std::chrono::seconds(10)));
+  std::this_thread::sleep_for(sleepTime);
+  EXPECT_EQ(decompress(logServer->GetReceivedData()),
+            FirstMessage + '\0' + SecondMessage + '\0');
+  EXPECT_EQ(con.getMetrics().BytesWritten,
+            logServer->GetReceivedData().size());
+}
+#endif
+
+TEST_F(GraylogConnectionCom, MetricsTest) {
+  std::string testString("This is a test string!");
+  GraylogConnectionStandIn con("localhost", testPort);
+  con.sendMessage(testString);
+  ASSERT_TRUE(con.flush(std::chrono::seconds(10)));
+  std::this_thread::sleep_for(sleepTime);
+  auto Metrics = con.getMetrics();
+  EXPECT_EQ(Metrics.Enqueued, 1u);
+  EXPECT_EQ(Metrics.Dequeued, 1u);
+  EXPECT_EQ(Metrics.Dropped, 0u);
+  EXPECT_EQ(Metrics.QueueHighWaterMark, 1u);
+  EXPECT_EQ(Metrics.BytesWritten, testString.size() + 1);
+  EXPECT_EQ(Metrics.Reconnects, 0u);
+  EXPECT_EQ(std::accumulate(Metrics.Latency.begin(), Metrics.Latency.end(),
+                            std::uint64_t(0)),
+            1u);
+}
+
+namespace {
+int countMessages(const std::string &ReceivedData) {
+  return int(std::count(ReceivedData.begin(), ReceivedData.end(), '\0'));
+}
+} // namespace
+
+TEST_F(GraylogConnectionCom, PoolRoundRobinTest) {
+  GraylogSettings Settings;
+  Settings.NrOfConnections = 3;
+  GraylogConnection con("localhost", testPort, Settings);
+  std::this_thread::sleep_for(sleepTime);
+  ASSERT_EQ(logServer->GetNrOfConnections(), 3);
+  EXPECT_EQ(con.getConnectionStatus(), Status::SEND_LOOP);
+  for (int i = 0; i < 30; ++i) {
+    con.sendMessage("Message number " + std::to_string(i));
+  }
+  ASSERT_TRUE(con.flush(std::chrono::seconds(10)));
+  std::this_thread::sleep_for(sleepTime);
+  EXPECT_EQ(logServer->GetNrOfMessagesPerConnection(),
+            (std::vector<int>{10, 10, 10}));
+  auto Metrics = con.getMetrics();
+  EXPECT_EQ(Metrics.Enqueued, 30u);
+  EXPECT_EQ(Metrics.BytesWritten, logServer->GetReceivedData().size());
+}
+
+TEST_F(GraylogConnectionCom, PoolLeastOutstandingBytesTest) {
+  GraylogSettings Settings;
+  Settings.NrOfConnections = 2;
+  Settings.Balancing = PoolBalancing::LeastOutstandingBytes;
+  GraylogConnection con("localhost", testPort, Settings);
+  std::this_thread::sleep_for(sleepTime);
+  ASSERT_EQ(logServer->GetNrOfConnections(), 2);
+  for (int i = 0; i < 30; ++i) {
+    con.sendMessage("Message number " + std::to_string(i));
+  }
+  ASSERT_TRUE(con.flush(std::chrono::seconds(10)));
+  std::this_thread::sleep_for(sleepTime);
+  EXPECT_EQ(countMessages(logServer->GetReceivedData()), 30);
+}
+
+TEST_F(GraylogConnectionCom, PoolMovesMessagesOfFailedConnectionTest) {
+  // Nothing is listening on the port of the additional server. Half of the
+  // messages are queued for that connection before any connection has been
+  // established.
+  GraylogSettings Settings;
+  Settings.NrOfConnections = 2;
+  Settings.AdditionalServers = {{"localhost", testPort + 10}};
+  GraylogConnection con("localhost", testPort, Settings);
+  for (int i = 0; i < 20; ++i) {
+    con.sendMessage("Message number " + std::to_string(i));
+  }
+  ASSERT_TRUE(con.flush(std::chrono::seconds(10)));
+  std::this_thread::sleep_for(sleepTime);
+  EXPECT_EQ(countMessages(logServer->GetReceivedData()), 20);
+  EXPECT_EQ(logServer->GetNrOfConnections(), 1);
+  auto Metrics = con.getMetrics();
+  EXPECT_EQ(Metrics.Enqueued, 20u);
+  EXPECT_EQ(Metrics.Dequeued, 20u);
+  EXPECT_LE(Metrics.QueueHighWaterMark, 20u);
+}
+
+TEST_F(GraylogConnectionCom, PoolFailoverTest) {
+  const int OtherPort{testPort + 10};
+  auto OtherServer = std::make_unique<LogTestServer>(OtherPort);
+  GraylogSettings Settings;
+  Settings.NrOfConnections = 2;
+  Settings.AdditionalServers = {{"localhost", OtherPort}};
+  GraylogConnection con("localhost", testPort, Settings);
+  std::this_thread::sleep_for(sleepTime);
+  ASSERT_EQ(logServer->GetNrOfConnections(), 1);
+  ASSERT_EQ(OtherServer->GetNrOfConnections(), 1);
+  OtherServer.reset();
+  std::this_thread::sleep_for(sleepTime);
+  for (int i = 0; i < 20; ++i) {
+    con.sendMessage("Message number " + std::to_string(i));
+  }
+  ASSERT_TRUE(con.flush(std::chrono::seconds(10)));
+  std::this_thread::sleep_for(sleepTime);
+  EXPECT_EQ(countMessages(logServer->GetReceivedData()), 20);
+}
+
+TEST_F(GraylogConnectionCom, SharedIoContextTest) {
+  GraylogSettings Settings;
+  Settings.Context = std::make_shared<IoContext>(2);
+  std::vector<std::unique_ptr<GraylogConnection>> Connections;
+  for (int i = 0; i < 3; ++i) {
+    Connections.push_back(
+        std::make_unique<GraylogConnection>("localhost", testPort, Settings));
+  }
+  for (int i = 0; i < 30; ++i) {
+    Connections[i % 3]->sendMessage("Message number " + std::to_string(i));
+  }
+  for (auto &Connection : Connections) {
+    ASSERT_TRUE(Connection->flush(std::chrono::seconds(10)));
+    EXPECT_EQ(Connection->getConnectionStatus(), Status::SEND_LOOP);
+  }
+  std::this_thread::sleep_for(sleepTime);
+  EXPECT_EQ(logServer->GetNrOfConnections(), 3);
+  EXPECT_EQ(countMessages(logServer->GetReceivedData()), 30);
+  EXPECT_EQ(Settings.Context->size(), 2u);
+}
+
+TEST_F(GraylogConnectionCom, ExternalIoContextTest) {
+  asio::io_service Service;
+  auto Work = std::make_unique<asio::io_service::work>(Service);
+  std::thread ServiceThread([&Service]() { Service.run(); });
+  GraylogSettings Settings;
+  Settings.Context = std::make_shared<IoContext>(Service);
+  EXPECT_EQ(Settings.Context->size(), 0u);
+  {
+    GraylogConnection con("localhost", testPort, Settings);
+    con.sendMessage("A message");
+    ASSERT_TRUE(con.flush(std::chrono::seconds(10)));
+  }
+  Work.reset();
+  ServiceThread.join();
+  EXPECT_EQ(countMessages(logServer->GetReceivedData()), 1);
+}
+
+TEST_F(GraylogConnectionCom, IoContextThatIsNotRunTest) {
+  asio::io_service Service;
+  GraylogSettings Settings;
+  Settings.Context = std::make_shared<IoContext>(Service);
+  {
+    GraylogConnection con("localhost", testPort, Settings);
+    con.sendMessage("A message");
+    EXPECT_FALSE(con.flush(sleepTime));
+    EXPECT_EQ(con.getConnectionStatus(), Status::ADDR_LOOKUP);
+  }
+  // The handlers of the destroyed connection do nothing.
+  Service.run();
+  EXPECT_EQ(logServer->GetNrOfConnections(), 0);
+}
+
+#ifndef _WIN32
+namespace {
+std::vector<std::string> splitMessages(const std::string &ReceivedData) {
+  std::vector<std::string> Messages;
+  size_t Start{0};
+  size_t End;
+  while ((End = ReceivedData.find('\0', Start)) != std::string::npos) {
+    Messages.push_back(ReceivedData.substr(Start, End - Start));
+    Start = End + 1;
+  }
+  return Messages;
+}
+
+std::string createSpoolDirectory() {
+  char Template[] = "/tmp/graylog-spool-test-XXXXXX";
+  if (::mkdtemp(Template) == nullptr) {
+    return {};
+  }
+  return Template;
+}
+} // namespace
+
+TEST_F(GraylogConnectionCom, SpoolKeepsMessagesInOrderTest) {
+  GraylogSettings Settings;
+  Settings.MaxQueueLength = 10;
+  Settings.SpoolDirectory = createSpoolDirectory();
+  ASSERT_FALSE(Settings.SpoolDirectory.empty());
+  {
+    GraylogConnection con("localhost", testPort, Settings);
+    for (int i = 0; i < 500; ++i) {
+      con.sendMessage("Message number " + std::to_string(i));
+    }
+    ASSERT_TRUE(con.flush(std::chrono::seconds(10)));
+    std::this_thread::sleep_for(sleepTime);
+    EXPECT_EQ(con.getMetrics().Dropped, 0u);
+  }
+  auto Messages = splitMessages(logServer->GetReceivedData());
+  ASSERT_EQ(Messages.size(), 500u);
+  for (int i = 0; i < 500; ++i) {
+    EXPECT_EQ(Messages[i], "Message number " + std::to_string(i));
+  }
+  EXPECT_EQ(::rmdir(Settings.SpoolDirectory.c_str()), 0);
+}
+
+TEST_F(GraylogConnectionCom, SpooledMessagesAreSentByNextConnectionTest) {
+  GraylogSettings Settings;
+  Settings.MaxQueueLength = 10;
+  Settings.SpoolDirectory = createSpoolDirectory();
+  ASSERT_FALSE(Settings.SpoolDirectory.empty());
+  {
+    // Nothing is listening on this port, the messages that do not fit in the
+    // queue are left in the spool. The queued ones are lost.
+    GraylogConnection con("localhost", testPort + 20, Settings);
+    for (int i = 0; i < 100; ++i) {
+      con.sendMessage("Message number " + std::to_string(i));
+    }
+    EXPECT_EQ(con.messageQueueSize(), 100u);
+    EXPECT_EQ(con.getMetrics().Dropped, 0u);
+  }
+  GraylogConnection con("localhost", testPort, Settings);
+  ASSERT_TRUE(con.flush(std::chrono::seconds(10)));
+  std::this_thread::sleep_for(sleepTime);
+  auto Messages = splitMessages(logServer->GetReceivedData());
+  ASSERT_GT(Messages.size(), 0u);
+  ASSERT_LT(Messages.size(), 100u);
+  auto FirstSpooled = 100 - int(Messages.size());
+  for (size_t i = 0; i < Messages.size(); ++i) {
+    EXPECT_EQ(Messages[i],
+              "Message number " + std::to_string(FirstSpooled + int(i)));
+  }
+  EXPECT_EQ(::rmdir(Settings.SpoolDirectory.c_str()), 0);
+}
+#endif
+
 TEST_F(GraylogConnectionCom, DISABLED_LargeMessageTransmissionTest) {
   {
     std::string RepeatedString("This is a test string!");
@@ -220,6 +869,31 @@ TEST(GraylogInterfaceCom, AddMessageTest) {
   con.addMessage(msg);
 }
 
+TEST(GraylogInterfaceCom, AddMessagesTest) {
+  GraylogInterfaceStandIn con("localhost", testPort, 100);
+  EXPECT_CALL(con, sendMessage(::testing::_)).Times(0);
+  EXPECT_CALL(con, sendMessages(::testing::ElementsAre(IsJSON(), IsJSON(),
+                                                       IsJSON())))
+      .Times(::testing::Exactly(1));
+  std::vector<LogMessage> Messages(3, GetPopulatedLogMsg());
+  std::vector<const LogMessage *> MessagePointers;
+  for (auto &CMessage : Messages) {
+    MessagePointers.push_back(&CMessage);
+  }
+  con.addMessages(MessagePointers);
+}
+
+TEST(GraylogInterfaceCom, AddMessagesQueueSize) {
+  GraylogInterface con("localhost", testPort, 100);
+  std::vector<LogMessage> Messages(3, GetPopulatedLogMsg());
+  std::vector<const LogMessage *> MessagePointers;
+  for (auto &CMessage : Messages) {
+    MessagePointers.push_back(&CMessage);
+  }
+  con.addMessages(MessagePointers);
+  EXPECT_EQ(con.queueSize(), 3u);
+}
+
 TEST(GraylogInterfaceCom, MessageJSONTest) {
   LogMessage msg = GetPopulatedLogMsg();
   GraylogInterfaceStandIn con("localhost", testPort, 100);
@@ -262,6 +936,20 @@ TEST(GraylogInterfaceCom, MessageJSONContentTest) {
   con.addMessage(msg);
 }
 
+TEST(GraylogInterfaceCom, GelfFormatFromSettings) {
+  LogMessage msg = GetPopulatedLogMsg();
+  msg.SequenceNumber = 1234;
+  GraylogSettings Settings;
+  Settings.Format.SequenceNumber = true;
+  GraylogInterfaceStandIn con("localhost", testPort, Settings);
+  EXPECT_TRUE(con.usesSequenceNumbers());
+  EXPECT_CALL(con, sendMessage(::testing::_))
+      .WillOnce(testing::Invoke([](std::string Message) {
+        EXPECT_EQ(nlohmann::json::parse(Message)["_sequence"], 1234);
+      }));
+  con.addMessage(msg);
+}
+
 TEST(GraylogInterfaceCom, TestAdditionalFieldString) {
   GraylogInterfaceStandIn con("localhost", testPort, 100);
   LogMessage testMsg = GetPopulatedLogMsg();
@@ -316,6 +1004,9 @@ TEST(GraylogInterfaceCom, TestQueueSizeLimit) {
     con.addMessage(testMsg);
   }
   EXPECT_NEAR(con.queueSize(), MaxNrOfMessages, 20);
+  auto Metrics = con.getMetrics();
+  EXPECT_EQ(Metrics.Enqueued + Metrics.Dropped, MaxNrOfMessages * 4u);
+  EXPECT_GT(Metrics.Dropped, 0u);
 }
 using std::chrono_literals::operator""ms;
 
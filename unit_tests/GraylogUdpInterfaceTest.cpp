@@ -0,0 +1,211 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Tests of the GELF over UDP log handler.
+///
+//===----------------------------------------------------------------------===//
+
+#include "Decompress.hpp"
+#include "UdpTestServer.hpp"
+#include "graylog_logger/GraylogUdpInterface.hpp"
+#include <ciso646>
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+#include <set>
+
+using namespace Log;
+using namespace std::chrono_literals;
+
+const std::uint16_t UdpTestPort{2527};
+
+TEST(GraylogUdpInterface, SmallMessageIsSentAsOneDatagram) {
+  UdpTestServer Server(UdpTestPort);
+  GraylogUdpConnection Connection("localhost", UdpTestPort,
+                                  GraylogUdpSettings());
+  Connection.sendMessage("Some message");
+  ASSERT_TRUE(Connection.flush(10s));
+  ASSERT_TRUE(Server.waitForMessages(1));
+  EXPECT_EQ(Server.getDatagrams(), std::vector<std::string>{"Some message"});
+  EXPECT_EQ(Connection.getConnectionStatus(), Status::SEND_LOOP);
+}
+
+TEST(GraylogUdpInterface, LargeMessageIsChunked) {
+  UdpTestServer Server(UdpTestPort);
+  GraylogUdpSettings Settings;
+  Settings.MaxDatagramSize = 100;
+  GraylogUdpConnection Connection("localhost", UdpTestPort, Settings);
+  std::string LargeMessage;
+  for (int i = 0; i < 100; ++i) {
+    LargeMessage += "Part " + std::to_string(i) + ". ";
+  }
+  Connection.sendMessage(LargeMessage);
+  ASSERT_TRUE(Connection.flush(10s));
+  ASSERT_TRUE(Server.waitForMessages(1));
+  EXPECT_EQ(Server.getMessages(), std::vector<std::string>{LargeMessage});
+  auto Datagrams = Server.getDatagrams();
+  auto ExpectedNrOfChunks = (LargeMessage.size() + 87) / 88;
+  ASSERT_EQ(Datagrams.size(), ExpectedNrOfChunks);
+  std::set<int> SequenceNumbers;
+  for (auto &CDatagram : Datagrams) {
+    EXPECT_LE(CDatagram.size(), 100u);
+    EXPECT_EQ(CDatagram[0], '\x1e');
+    EXPECT_EQ(CDatagram[1], '\x0f');
+    EXPECT_EQ(CDatagram.substr(2, 8), Datagrams.front().substr(2, 8));
+    EXPECT_EQ(static_cast<size_t>(CDatagram[11]), ExpectedNrOfChunks);
+    SequenceNumbers.insert(CDatagram[10]);
+  }
+  EXPECT_EQ(SequenceNumbers.size(), ExpectedNrOfChunks);
+}
+
+TEST(GraylogUdpInterface, ChunkedMessagesHaveDifferentIds) {
+  UdpTestServer Server(UdpTestPort);
+  GraylogUdpSettings Settings;
+  Settings.MaxDatagramSize = 100;
+  GraylogUdpConnection Connection("localhost", UdpTestPort, Settings);
+  Connection.sendMessage(std::string(150, 'a'));
+  Connection.sendMessage(std::string(150, 'b'));
+  ASSERT_TRUE(Connection.flush(10s));
+  ASSERT_TRUE(Server.waitForMessages(2));
+  auto Datagrams = Server.getDatagrams();
+  ASSERT_EQ(Datagrams.size(), 4u);
+  EXPECT_NE(Datagrams.front().substr(2, 8), Datagrams.back().substr(2, 8));
+  EXPECT_EQ(Server.getMessages(), (std::vector<std::string>{
+                                      std::string(150, 'a'),
+                                      std::string(150, 'b')}));
+}
+
+TEST(GraylogUdpInterface, TooManyChunksIsDropped) {
+  UdpTestServer Server(UdpTestPort);
+  GraylogUdpSettings Settings;
+  Settings.MaxDatagramSize = 62;
+  GraylogUdpConnection Connection("localhost", UdpTestPort, Settings);
+  Connection.sendMessage(std::string(50 * 128 + 1, 'a'));
+  Connection.sendMessage(std::string(50 * 128, 'b'));
+  ASSERT_TRUE(Connection.flush(10s));
+  ASSERT_TRUE(Server.waitForMessages(1));
+  std::this_thread::sleep_for(50ms);
+  EXPECT_EQ(Server.getMessages(),
+            std::vector<std::string>{std::string(50 * 128, 'b')});
+  auto Metrics = Connection.getMetrics();
+  EXPECT_EQ(Metrics.Dequeued, 2u);
+  EXPECT_EQ(Metrics.Discarded, 1u);
+  EXPECT_EQ(Metrics.Dropped, 0u);
+}
+
+TEST(GraylogUdpInterface, ManyMessagesAreSentInOrder) {
+  UdpTestServer Server(UdpTestPort);
+  GraylogUdpSettings Settings;
+  Settings.MaxDatagramsPerSend = 16;
+  GraylogUdpConnection Connection("localhost", UdpTestPort, Settings);
+  std::vector<std::string> SentMessages;
+  for (int i = 0; i < 500; ++i) {
+    SentMessages.push_back("Message " + std::to_string(i));
+  }
+  Connection.sendMessages(SentMessages);
+  ASSERT_TRUE(Connection.flush(10s));
+  ASSERT_TRUE(Server.waitForMessages(SentMessages.size()));
+  EXPECT_EQ(Server.getMessages(), SentMessages);
+  auto Metrics = Connection.getMetrics();
+  EXPECT_EQ(Metrics.Enqueued, 500u);
+  EXPECT_EQ(Metrics.Dequeued, 500u);
+  size_t TotalSize{0};
+  for (auto &CMessage : SentMessages) {
+    TotalSize += CMessage.size();
+  }
+  EXPECT_EQ(Metrics.BytesWritten, TotalSize);
+}
+
+TEST(GraylogUdpInterface, UnknownHost) {
+  GraylogUdpConnection Connection("no_host", UdpTestPort,
+                                  GraylogUdpSettings());
+  Connection.sendMessage("Some message");
+  ASSERT_TRUE(Connection.flush(10s));
+  EXPECT_EQ(Connection.getConnectionStatus(), Status::ADDR_RETRY_WAIT);
+  auto Metrics = Connection.getMetrics();
+  EXPECT_EQ(Metrics.Enqueued, 1u);
+  EXPECT_EQ(Metrics.Dequeued, 1u);
+  EXPECT_EQ(Metrics.Discarded, 1u);
+  EXPECT_EQ(Metrics.Dropped, 0u);
+}
+
+TEST(GraylogUdpInterface, FailedSendIsDiscarded) {
+  // Nothing is listening on the port. The ICMP port unreachable reply to
+  // the first datagram makes the second send fail.
+  GraylogUdpConnection Connection("localhost", UdpTestPort,
+                                  GraylogUdpSettings());
+  Connection.sendMessage("First message");
+  ASSERT_TRUE(Connection.flush(10s));
+  std::this_thread::sleep_for(50ms);
+  Connection.sendMessage("Second message");
+  ASSERT_TRUE(Connection.flush(10s));
+  Connection.sendMessage("Third message");
+  ASSERT_TRUE(Connection.flush(10s));
+  auto Metrics = Connection.getMetrics();
+  EXPECT_EQ(Metrics.Dequeued, 3u);
+  EXPECT_EQ(Metrics.Discarded, 1u);
+  EXPECT_EQ(Metrics.BytesWritten, std::string("First message").size() +
+                                      std::string("Third message").size());
+}
+
+TEST(GraylogUdpInterface, QueueSizeLimit) {
+  GraylogUdpSettings Settings;
+  Settings.MaxQueueLength = 32;
+  GraylogUdpConnection Connection("no_host", UdpTestPort, Settings);
+  for (int i = 0; i < 1000; ++i) {
+    Connection.sendMessage("Some message");
+  }
+  auto Metrics = Connection.getMetrics();
+  EXPECT_EQ(Metrics.Enqueued + Metrics.Dropped, 1000u);
+}
+
+#ifdef WITH_ZLIB
+TEST(GraylogUdpInterface, CompressedMessage) {
+  UdpTestServer Server(UdpTestPort);
+  GraylogUdpSettings Settings;
+  Settings.PayloadCompression = Compression::Zlib;
+  GraylogUdpConnection Connection("localhost", UdpTestPort, Settings);
+  std::string Message(1000, 'a');
+  Connection.sendMessage(Message);
+  ASSERT_TRUE(Connection.flush(10s));
+  ASSERT_TRUE(Server.waitForMessages(1));
+  auto Received = Server.getMessages().front();
+  EXPECT_LT(Received.size(), Message.size());
+  EXPECT_EQ(decompress(Received), Message);
+}
+
+TEST(GraylogUdpInterface, CompressedMessageIsChunked) {
+  UdpTestServer Server(UdpTestPort);
+  GraylogUdpSettings Settings;
+  Settings.PayloadCompression = Compression::Gzip;
+  Settings.MaxDatagramSize = 100;
+  GraylogUdpConnection Connection("localhost", UdpTestPort, Settings);
+  std::string Message;
+  std::uint32_t Value{12345};
+  for (int i = 0; i < 1000; ++i) {
+    Value = Value * 1103515245u + 12345u;
+    Message += static_cast<char>('a' + (Value >> 16) % 26);
+  }
+  Connection.sendMessage(Message);
+  ASSERT_TRUE(Connection.flush(10s));
+  ASSERT_TRUE(Server.waitForMessages(1));
+  EXPECT_GT(Server.getDatagrams().size(), 1u);
+  EXPECT_EQ(decompress(Server.getMessages().front()), Message);
+}
+#endif
+
+TEST(GraylogUdpInterface, LogMessageIsSentAsGelf) {
+  UdpTestServer Server(UdpTestPort);
+  GraylogUdpInterface Handler("localhost", UdpTestPort);
+  LogMessage Message;
+  Message.MessageString = "Some message";
+  Message.SeverityLevel = Severity::Error;
+  Handler.addMessage(Message);
+  ASSERT_TRUE(Handler.flush(10s));
+  ASSERT_TRUE(Server.waitForMessages(1));
+  auto Json = nlohmann::json::parse(Server.getMessages().front());
+  EXPECT_EQ(Json["short_message"], "Some message");
+  EXPECT_EQ(Json["level"], int(Severity::Error));
+  EXPECT_EQ(Json["version"], "1.1");
+}
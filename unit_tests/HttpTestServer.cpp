@@ -0,0 +1,207 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief A minimal HTTP server that receives GELF messages in POST
+/// requests.
+///
+//===----------------------------------------------------------------------===//
+
+#include "HttpTestServer.hpp"
+#include "Decompress.hpp"
+#include <ciso646>
+#include <cstdlib>
+#include <sstream>
+
+class HttpTestServer::Session
+    : public std::enable_shared_from_this<HttpTestServer::Session> {
+public:
+  Session(HttpTestServer &Server, asio::ip::tcp::socket Socket)
+      : Server(Server), Socket(std::move(Socket)),
+        Timer(this->Socket.get_executor()) {}
+  void start() { readHeader(); }
+  void close() {
+    asio::error_code Error;
+    Socket.close(Error);
+    Timer.cancel(Error);
+  }
+
+private:
+  void readHeader() {
+    auto Self = shared_from_this();
+    asio::async_read_until(
+        Socket, Buffer, "\r\n\r\n",
+        [this, Self](const asio::error_code &Error, size_t Size) {
+          if (Error) {
+            return;
+          }
+          auto Begin = asio::buffers_begin(Buffer.data());
+          CurrentRequest = Request();
+          CurrentRequest.Header.assign(Begin, Begin + Size);
+          Buffer.consume(Size);
+          readBody(contentLength(CurrentRequest.Header));
+        });
+  }
+
+  void readBody(size_t Length) {
+    if (Buffer.size() >= Length) {
+      handleBody(Length);
+      return;
+    }
+    auto Self = shared_from_this();
+    asio::async_read(Socket, Buffer,
+                     asio::transfer_exactly(Length - Buffer.size()),
+                     [this, Self, Length](const asio::error_code &Error,
+                                          size_t /* Size */) {
+                       if (Error) {
+                         return;
+                       }
+                       handleBody(Length);
+                     });
+  }
+
+  void handleBody(size_t Length) {
+    auto Begin = asio::buffers_begin(Buffer.data());
+    CurrentRequest.Body.assign(Begin, Begin + Length);
+    Buffer.consume(Length);
+#ifdef WITH_ZLIB
+    if (CurrentRequest.Header.find("Content-Encoding:") != std::string::npos) {
+      CurrentRequest.Body = decompress(CurrentRequest.Body);
+    }
+#endif
+    Server.addRequest(CurrentRequest);
+    auto Self = shared_from_this();
+    Timer.expires_after(Server.ResponseDelay.load());
+    Timer.async_wait([this, Self](const asio::error_code &Error) {
+      if (not Error) {
+        sendResponse();
+      }
+    });
+  }
+
+  void sendResponse() {
+    // Count the requests that have been received while this one was being
+    // handled.
+    asio::error_code Error;
+    auto Available = Socket.available(Error);
+    if (not Error and Available > 0) {
+      asio::read(Socket, Buffer, asio::transfer_exactly(Available), Error);
+    }
+    auto Begin = asio::buffers_begin(Buffer.data());
+    std::string Received(Begin, Begin + Buffer.size());
+    size_t NrOfRequests{1};
+    for (auto Pos = Received.find("\r\n\r\n"); Pos != std::string::npos;
+         Pos = Received.find("\r\n\r\n", Pos + 1)) {
+      ++NrOfRequests;
+    }
+    if (NrOfRequests > Server.MaxPipelinedRequests) {
+      Server.MaxPipelinedRequests = NrOfRequests;
+    }
+    bool Close = Server.CloseAfterResponse;
+    int RetryAfter = Server.RetryAfter;
+    Response = "HTTP/1.1 " + std::to_string(Server.StatusCode) +
+               " Status\r\nContent-Length: 0\r\n" +
+               (RetryAfter >= 0
+                    ? "Retry-After: " + std::to_string(RetryAfter) + "\r\n"
+                    : "") +
+               (Close ? "Connection: close\r\n" : "") + "\r\n";
+    auto Self = shared_from_this();
+    asio::async_write(Socket, asio::buffer(Response),
+                      [this, Self, Close](const asio::error_code &WriteError,
+                                          size_t /* Size */) {
+                        if (WriteError) {
+                          return;
+                        }
+                        if (Close) {
+                          close();
+                          return;
+                        }
+                        readHeader();
+                      });
+  }
+
+  static size_t contentLength(const std::string &Header) {
+    const std::string Field{"Content-Length:"};
+    auto Pos = Header.find(Field);
+    if (Pos == std::string::npos) {
+      return 0;
+    }
+    return std::strtoull(Header.c_str() + Pos + Field.size(), nullptr, 10);
+  }
+
+  HttpTestServer &Server;
+  asio::ip::tcp::socket Socket;
+  asio::steady_timer Timer;
+  asio::streambuf Buffer;
+  Request CurrentRequest;
+  std::string Response;
+};
+
+HttpTestServer::HttpTestServer(std::uint16_t Port)
+    : Acceptor(Service, asio::ip::tcp::endpoint(
+                            asio::ip::address_v4::loopback(), Port)) {
+  acceptConnection();
+  ServerThread = std::thread([this]() { Service.run(); });
+}
+
+HttpTestServer::~HttpTestServer() {
+  Service.post([this]() {
+    asio::error_code Error;
+    Acceptor.close(Error);
+    for (auto &CSession : Sessions) {
+      if (auto Session = CSession.lock()) {
+        Session->close();
+      }
+    }
+  });
+  ServerThread.join();
+}
+
+void HttpTestServer::acceptConnection() {
+  Acceptor.async_accept([this](const asio::error_code &Error,
+                               asio::ip::tcp::socket Socket) {
+    if (Error) {
+      return;
+    }
+    ++NrOfConnections;
+    auto NewSession = std::make_shared<Session>(*this, std::move(Socket));
+    Sessions.push_back(NewSession);
+    NewSession->start();
+    acceptConnection();
+  });
+}
+
+void HttpTestServer::addRequest(Request NewRequest) {
+  std::lock_guard<std::mutex> Lock(DataMutex);
+  Requests.push_back(std::move(NewRequest));
+}
+
+std::vector<HttpTestServer::Request> HttpTestServer::getRequests() {
+  std::lock_guard<std::mutex> Lock(DataMutex);
+  return Requests;
+}
+
+std::vector<std::string> HttpTestServer::getMessages() {
+  std::vector<std::string> Messages;
+  for (auto &CRequest : getRequests()) {
+    std::istringstream Body(CRequest.Body);
+    std::string Message;
+    while (std::getline(Body, Message)) {
+      Messages.push_back(Message);
+    }
+  }
+  return Messages;
+}
+
+bool HttpTestServer::waitForMessages(size_t NrOfMessages,
+                                     std::chrono::milliseconds TimeOut) {
+  auto End = std::chrono::steady_clock::now() + TimeOut;
+  while (getMessages().size() < NrOfMessages) {
+    if (std::chrono::steady_clock::now() > End) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return true;
+}
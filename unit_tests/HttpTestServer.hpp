@@ -0,0 +1,76 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief A minimal HTTP server that receives GELF messages in POST
+/// requests.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class HttpTestServer {
+public:
+  struct Request {
+    /// \brief The request line and the header fields.
+    std::string Header;
+    /// \brief The (decompressed) body.
+    std::string Body;
+  };
+  explicit HttpTestServer(std::uint16_t Port);
+  ~HttpTestServer();
+  std::vector<Request> getRequests();
+  /// \brief The messages of all requests, batched messages are split at
+  /// newline characters.
+  std::vector<std::string> getMessages();
+  /// \brief Wait until at least the given number of messages have been
+  /// received.
+  /// \return true if the messages were received before the time out.
+  bool waitForMessages(size_t NrOfMessages,
+                       std::chrono::milliseconds TimeOut =
+                           std::chrono::milliseconds(2000));
+  /// \brief The status code of the responses, 202 by default.
+  void setStatusCode(int Code) { StatusCode = Code; }
+  /// \brief Seconds sent in a Retry-After field, none if negative.
+  void setRetryAfter(int Seconds) { RetryAfter = Seconds; }
+  /// \brief Close the connection after every response.
+  void setCloseAfterResponse(bool Close) { CloseAfterResponse = Close; }
+  /// \brief Time waited before a response is sent.
+  void setResponseDelay(std::chrono::milliseconds Delay) {
+    ResponseDelay = Delay;
+  }
+  size_t getNrOfConnections() const { return NrOfConnections; }
+  /// \brief The largest number of requests that had been received on a
+  /// connection (including the one being answered) when a response was
+  /// sent.
+  size_t getMaxPipelinedRequests() const { return MaxPipelinedRequests; }
+
+private:
+  class Session;
+  void acceptConnection();
+  void addRequest(Request NewRequest);
+  asio::io_service Service;
+  asio::ip::tcp::acceptor Acceptor;
+  std::atomic_int StatusCode{202};
+  std::atomic_int RetryAfter{-1};
+  std::atomic_bool CloseAfterResponse{false};
+  std::atomic<std::chrono::milliseconds> ResponseDelay{
+      std::chrono::milliseconds(0)};
+  std::atomic<size_t> NrOfConnections{0};
+  std::atomic<size_t> MaxPipelinedRequests{0};
+  std::mutex DataMutex;
+  std::vector<Request> Requests;
+  std::vector<std::weak_ptr<Session>> Sessions;
+  std::thread ServerThread;
+};
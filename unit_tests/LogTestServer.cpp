@@ -22,27 +22,32 @@ LogTestServer::LogTestServer(short port)
 }
 
 void LogTestServer::WaitForNewConnection() {
-  sock_ptr cSock(std::make_shared<asio::ip::tcp::socket>(service));
-  acceptor.async_accept(*cSock.get(),
+  sock_ptr cSock(std::make_shared<TestServerConnection>(service));
+  acceptor.async_accept(cSock->socket,
                         std::bind(&LogTestServer::OnConnectionAccept, this,
                                   std::placeholders::_1, cSock));
 }
 
 LogTestServer::~LogTestServer() {
-  CloseAllConnections();
-  acceptor.close();
+  // The acceptor is closed in the ASIO thread, a client might otherwise
+  // connect after its sockets have been closed.
+  service.post([this]() {
+    acceptor.close();
+    CloseFunction();
+  });
   asioThread.join();
 }
 
 void LogTestServer::CloseFunction() {
+  std::lock_guard<std::mutex> lock(receivedDataMutex);
   for (auto sock : existingSockets) {
-    if (sock->is_open()) {
+    if (sock->socket.is_open()) {
       try {
-        sock->shutdown(asio::socket_base::shutdown_both);
+        sock->socket.shutdown(asio::socket_base::shutdown_both);
       } catch (std::exception &e) {
       }
     }
-    sock->close();
+    sock->socket.close();
   }
   existingSockets.clear();
 }
@@ -65,48 +70,53 @@ void LogTestServer::OnConnectionAccept(const std::error_code &ec,
   if (asio::error::basic_errors::operation_aborted == ec or
       asio::error::basic_errors::bad_descriptor == ec) {
     return;
-  } else if (ec) {
+  } else if (ec or not acceptor.is_open()) {
     return;
   }
-  existingSockets.push_back(cSock);
+  {
+    std::lock_guard<std::mutex> lock(receivedDataMutex);
+    existingSockets.push_back(cSock);
+  }
   connections++;
-  cSock->async_read_some(asio::buffer(receiveBuffer, bufferSize),
-                         std::bind(&LogTestServer::HandleRead, this,
-                                   std::placeholders::_1, std::placeholders::_2,
-                                   cSock));
+  // Accept several simultaneous connections.
+  WaitForNewConnection();
+  cSock->socket.async_read_some(
+      asio::buffer(cSock->receiveBuffer, TestServerConnection::bufferSize),
+      std::bind(&LogTestServer::HandleRead, this, std::placeholders::_1,
+                std::placeholders::_2, cSock));
 }
 
 void LogTestServer::HandleRead(std::error_code ec, std::size_t bytesReceived,
                                sock_ptr cSock) {
   socketError = ec;
-  if (asio::error::operation_aborted == ec) {
+  if (ec) {
     RemoveSocket(cSock);
     connections--;
-    WaitForNewConnection();
-    return;
-  } else if (ec) {
-    RemoveSocket(cSock);
-    connections--;
-    WaitForNewConnection();
     return;
   }
   receivedBytes += bytesReceived;
-  for (int j = 0; j < bytesReceived; j++) {
-    if ('\0' == receiveBuffer[j]) {
-      previousMessage = currentMessage;
-      currentMessage = "";
-      ++nrOfMessagesReceived;
-    } else {
-      currentMessage += receiveBuffer[j];
+  {
+    std::lock_guard<std::mutex> lock(receivedDataMutex);
+    receivedData.append(cSock->receiveBuffer, bytesReceived);
+    for (int j = 0; j < bytesReceived; j++) {
+      if ('\0' == cSock->receiveBuffer[j]) {
+        previousMessage = cSock->currentMessage;
+        cSock->currentMessage = "";
+        ++cSock->nrOfMessages;
+        ++nrOfMessagesReceived;
+      } else {
+        cSock->currentMessage += cSock->receiveBuffer[j];
+      }
     }
   }
-  cSock->async_read_some(asio::buffer(receiveBuffer, bufferSize),
-                         std::bind(&LogTestServer::HandleRead, this,
-                                   std::placeholders::_1, std::placeholders::_2,
-                                   cSock));
+  cSock->socket.async_read_some(
+      asio::buffer(cSock->receiveBuffer, TestServerConnection::bufferSize),
+      std::bind(&LogTestServer::HandleRead, this, std::placeholders::_1,
+                std::placeholders::_2, cSock));
 }
 
 void LogTestServer::RemoveSocket(sock_ptr cSock) {
+  std::lock_guard<std::mutex> lock(receivedDataMutex);
   for (int i = 0; i < existingSockets.size(); i++) {
     if (existingSockets[i] == cSock) {
       existingSockets.erase(existingSockets.begin() + i);
@@ -125,6 +135,24 @@ int LogTestServer::GetNrOfConnections() { return connections; }
 
 int LogTestServer::GetReceivedBytes() { return receivedBytes; }
 
+std::string LogTestServer::GetReceivedData() {
+  std::lock_guard<std::mutex> lock(receivedDataMutex);
+  return receivedData;
+}
+
 int LogTestServer::GetNrOfMessages() { return nrOfMessagesReceived; }
 
-void LogTestServer::ClearReceivedBytes() { receivedBytes = 0; }
+std::vector<int> LogTestServer::GetNrOfMessagesPerConnection() {
+  std::lock_guard<std::mutex> lock(receivedDataMutex);
+  std::vector<int> result;
+  for (auto &cSock : existingSockets) {
+    result.push_back(cSock->nrOfMessages);
+  }
+  return result;
+}
+
+void LogTestServer::ClearReceivedBytes() {
+  receivedBytes = 0;
+  std::lock_guard<std::mutex> lock(receivedDataMutex);
+  receivedData.clear();
+}
@@ -10,11 +10,22 @@
 
 #include <asio.hpp>
 #include <atomic>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
-typedef std::shared_ptr<asio::ip::tcp::socket> sock_ptr;
+/// \brief A connection accepted by the server and its receive state.
+struct TestServerConnection {
+  explicit TestServerConnection(asio::io_service &service) : socket(service) {}
+  static const int bufferSize = 100;
+  asio::ip::tcp::socket socket;
+  char receiveBuffer[bufferSize];
+  std::string currentMessage;
+  int nrOfMessages{0};
+};
+
+typedef std::shared_ptr<TestServerConnection> sock_ptr;
 
 //------------------------------------------------------------------------------
 //     THIS CLASS IS NOT THREAD SAFE AND MAY CRASH AT ANY MOMENT
@@ -29,7 +40,11 @@ public:
   void CloseAllConnections();
   int GetNrOfConnections();
   int GetReceivedBytes();
+  std::string GetReceivedData();
   int GetNrOfMessages();
+  /// \brief The number of messages received on each of the current
+  /// connections.
+  std::vector<int> GetNrOfMessagesPerConnection();
   void ClearReceivedBytes();
 
 private:
@@ -46,9 +61,7 @@ private:
 
   void RemoveSocket(sock_ptr cSock);
 
-  static const int bufferSize = 100;
-  char receiveBuffer[bufferSize];
-  int nrOfMessagesReceived = 0;
+  std::atomic_int nrOfMessagesReceived{0};
 
   std::error_code socketError;
   std::atomic_int connections;
@@ -56,6 +69,8 @@ private:
 
   std::string currentMessage;
   std::string previousMessage;
+  std::mutex receivedDataMutex;
+  std::string receivedData;
 
   std::vector<sock_ptr> existingSockets;
 
@@ -14,11 +14,15 @@
 #include <chrono>
 #include <ciso646>
 #include <gtest/gtest.h>
+#include <numeric>
 #include <thread>
 
 class LoggingBaseStandIn : public LoggingBase {
 public:
   using LoggingBase::BaseMsg;
+  using LoggingBase::Executor;
+  using LoggingBase::passesSeverityGate;
+  using LoggingBase::SeverityGate;
 };
 
 using namespace std::chrono_literals;
@@ -214,6 +218,31 @@ TEST(LoggingBase, LogMsgWithOverlappingStatDynExtraFields) {
   ASSERT_EQ(standIn->CurrentMessage.AdditionalFields[0].second.intVal, v1);
 }
 
+TEST(LoggingBase, StaticFieldsId) {
+  LoggingBase log;
+  auto standIn = std::make_shared<BaseLogHandlerStandIn>();
+  log.addLogHandler(standIn);
+  log.log(Severity::Alert, "Some message");
+  log.flush(10s);
+  auto FirstId = standIn->CurrentMessage.StaticFieldsId;
+  EXPECT_NE(FirstId, 0u);
+  EXPECT_EQ(standIn->CurrentMessage.NrOfStaticFields, 0u);
+  log.log(Severity::Alert, "Some message", {"dynamic_key", 1.0});
+  log.flush(10s);
+  EXPECT_EQ(standIn->CurrentMessage.StaticFieldsId, FirstId);
+  log.addField("static_key", std::string("value"));
+  log.log(Severity::Alert, "Some message", {"dynamic_key", 1.0});
+  log.flush(10s);
+  auto SecondId = standIn->CurrentMessage.StaticFieldsId;
+  EXPECT_NE(SecondId, 0u);
+  EXPECT_NE(SecondId, FirstId);
+  EXPECT_EQ(standIn->CurrentMessage.NrOfStaticFields, 1u);
+  // Replacing a static field makes the static part of the message unique.
+  log.log(Severity::Alert, "Some message", {"static_key", 1.0});
+  log.flush(10s);
+  EXPECT_EQ(standIn->CurrentMessage.StaticFieldsId, 0u);
+}
+
 TEST(LoggingBase, MachineInfoTest) {
   LoggingBase log;
   auto standIn = std::make_shared<BaseLogHandlerStandIn>();
@@ -240,6 +269,237 @@ TEST(LoggingBase, TimestampTest) {
   ASSERT_NEAR(time_diff.count(), 0.0, 0.1) << "Time stamp is incorrect.";
 }
 
+TEST(LoggingBase, CreationTimeIsTakenWhenLogging) {
+  LoggingBaseStandIn log;
+  auto standIn = std::make_shared<BaseLogHandlerStandIn>();
+  standIn->SequenceNumbers = true;
+  log.addLogHandler(standIn);
+  log.flush(10s);
+  std::promise<void> Release;
+  auto ReleaseFuture = Release.get_future().share();
+  log.Executor.SendWork([ReleaseFuture]() { ReleaseFuture.wait(); });
+  auto BeforeLogging = std::chrono::steady_clock::now();
+  auto SystemBeforeLogging = std::chrono::system_clock::now();
+  log.log(Severity::Error, "Some message");
+  auto AfterLogging = std::chrono::steady_clock::now();
+  auto SystemAfterLogging = std::chrono::system_clock::now();
+  std::this_thread::sleep_for(10ms);
+  Release.set_value();
+  log.flush(10s);
+  auto &Message = standIn->CurrentMessage;
+  EXPECT_GE(Message.MonotonicTimestamp, BeforeLogging);
+  EXPECT_LE(Message.MonotonicTimestamp, AfterLogging);
+  // The system clock timestamp is derived from the steady clock one.
+  EXPECT_GE(Message.Timestamp, SystemBeforeLogging - 1ms);
+  EXPECT_LE(Message.Timestamp, SystemAfterLogging + 1ms);
+  EXPECT_NE(Message.SequenceNumber, 0u);
+}
+
+TEST(LoggingBase, NoSequenceNumbersUnlessUsed) {
+  LoggingBase log;
+  auto standIn = std::make_shared<BaseLogHandlerStandIn>();
+  log.addLogHandler(standIn);
+  log.log(Severity::Error, "Some message");
+  log.flush(10s);
+  EXPECT_EQ(standIn->CurrentMessage.SequenceNumber, 0u);
+  auto otherStandIn = std::make_shared<BaseLogHandlerStandIn>();
+  otherStandIn->SequenceNumbers = true;
+  log.addLogHandler(otherStandIn);
+  log.log(Severity::Error, "Some message");
+  log.flush(10s);
+  EXPECT_NE(standIn->CurrentMessage.SequenceNumber, 0u);
+  log.removeAllHandlers();
+  log.addLogHandler(standIn);
+  log.log(Severity::Error, "Some message");
+  log.flush(10s);
+  EXPECT_EQ(standIn->CurrentMessage.SequenceNumber, 0u);
+}
+
+TEST(LoggingBase, SequenceNumbersIncrease) {
+  LoggingBase log;
+  auto standIn = std::make_shared<BaseLogHandlerStandIn>();
+  standIn->SequenceNumbers = true;
+  log.addLogHandler(standIn);
+  log.log(Severity::Error, "First message");
+  log.flush(10s);
+  auto FirstMessage = standIn->CurrentMessage;
+  log.log(Severity::Error, "Second message");
+  log.flush(10s);
+  auto &SecondMessage = standIn->CurrentMessage;
+  EXPECT_GT(SecondMessage.SequenceNumber, FirstMessage.SequenceNumber);
+  EXPECT_GE(SecondMessage.MonotonicTimestamp,
+            FirstMessage.MonotonicTimestamp);
+}
+
+TEST(LoggingBase, HandlerSeverityThreshold) {
+  LoggingBase log;
+  log.setMinSeverity(Severity::Debug);
+  auto allMessages = std::make_shared<BaseLogHandlerStandIn>();
+  auto errorMessages = std::make_shared<BaseLogHandlerStandIn>();
+  errorMessages->setMinSeverity(Severity::Error);
+  log.addLogHandler(allMessages);
+  log.addLogHandler(errorMessages);
+  log.log(Severity::Debug, "Debug message");
+  log.log(Severity::Critical, "Critical message");
+  log.log(Severity::Warning, "Warning message");
+  log.flush(10s);
+  EXPECT_EQ(allMessages->NrOfMessages, 3);
+  EXPECT_EQ(allMessages->CurrentMessage.MessageString, "Warning message");
+  EXPECT_EQ(errorMessages->NrOfMessages, 1);
+  EXPECT_EQ(errorMessages->CurrentMessage.MessageString, "Critical message");
+}
+
+TEST(LoggingBase, HandlerMessageFilter) {
+  LoggingBase log;
+  auto standIn = std::make_shared<BaseLogHandlerStandIn>();
+  standIn->setMessageFilter([](const LogMessage &Msg) {
+    for (auto &CField : Msg.AdditionalFields) {
+      if (CField.first == "subsystem" and CField.second.strVal == "network") {
+        return true;
+      }
+    }
+    return false;
+  });
+  log.addLogHandler(standIn);
+  log.log(Severity::Error, "Network message",
+          {"subsystem", std::string("network")});
+  log.log(Severity::Error, "Other message", {"subsystem", std::string("io")});
+  log.log(Severity::Error, "No subsystem");
+  log.flush(10s);
+  EXPECT_EQ(standIn->NrOfMessages, 1);
+  EXPECT_EQ(standIn->CurrentMessage.MessageString, "Network message");
+}
+
+TEST(LoggingBase, SeverityGateIsLeastRestrictiveHandler) {
+  LoggingBaseStandIn log;
+  log.setMinSeverity(Severity::Debug);
+  auto warningHandler = std::make_shared<BaseLogHandlerStandIn>();
+  warningHandler->setMinSeverity(Severity::Warning);
+  auto errorHandler = std::make_shared<BaseLogHandlerStandIn>();
+  errorHandler->setMinSeverity(Severity::Error);
+  log.addLogHandler(warningHandler);
+  log.addLogHandler(errorHandler);
+  log.flush(10s);
+  EXPECT_EQ(log.SeverityGate, int(Severity::Warning));
+  EXPECT_TRUE(log.passesSeverityGate(Severity::Warning));
+  EXPECT_FALSE(log.passesSeverityGate(Severity::Notice));
+  log.setMinSeverity(Severity::Critical);
+  EXPECT_EQ(log.SeverityGate, int(Severity::Critical));
+}
+
+TEST(LoggingBase, SeverityGateFollowsHandlerThreshold) {
+  LoggingBaseStandIn log;
+  log.setMinSeverity(Severity::Debug);
+  auto standIn = std::make_shared<BaseLogHandlerStandIn>();
+  standIn->setMinSeverity(Severity::Error);
+  log.addLogHandler(standIn);
+  log.flush(10s);
+  standIn->setMinSeverity(Severity::Info);
+  log.log(Severity::Info, "Info message");
+  log.flush(10s);
+  EXPECT_EQ(standIn->NrOfMessages, 1);
+  EXPECT_EQ(log.SeverityGate, int(Severity::Info));
+}
+
+TEST(LoggingBase, QueuedMessagesAreDispatchedInBatches) {
+  LoggingBaseStandIn log;
+  auto standIn = std::make_shared<BaseLogHandlerStandIn>();
+  auto errorsOnly = std::make_shared<BaseLogHandlerStandIn>();
+  errorsOnly->setMinSeverity(Severity::Error);
+  log.addLogHandler(standIn);
+  log.addLogHandler(errorsOnly);
+  log.flush(10s);
+  std::promise<void> Release;
+  auto ReleaseFuture = Release.get_future().share();
+  log.Executor.SendWork([ReleaseFuture]() { ReleaseFuture.wait(); });
+  for (int i = 0; i < 50; ++i) {
+    log.log(i % 2 == 0 ? Severity::Error : Severity::Warning,
+            "Message " + std::to_string(i));
+  }
+  Release.set_value();
+  log.flush(10s);
+  EXPECT_EQ(standIn->NrOfMessages, 50);
+  EXPECT_EQ(standIn->BatchSizes, std::vector<size_t>{50});
+  EXPECT_EQ(standIn->CurrentMessage.MessageString, "Message 49");
+  EXPECT_EQ(errorsOnly->NrOfMessages, 25);
+  EXPECT_EQ(errorsOnly->BatchSizes, std::vector<size_t>{25});
+  EXPECT_EQ(errorsOnly->CurrentMessage.MessageString, "Message 48");
+}
+
+TEST(LoggingBase, PendingMessagesAreDispatchedBeforeRemovingHandlers) {
+  LoggingBaseStandIn log;
+  auto standIn = std::make_shared<BaseLogHandlerStandIn>();
+  log.addLogHandler(standIn);
+  std::promise<void> Release;
+  auto ReleaseFuture = Release.get_future().share();
+  log.Executor.SendWork([ReleaseFuture]() { ReleaseFuture.wait(); });
+  log.log(Severity::Error, "First message");
+  log.log(Severity::Error, "Second message");
+  log.removeAllHandlers();
+  Release.set_value();
+  log.flush(10s);
+  EXPECT_EQ(standIn->NrOfMessages, 2);
+}
+
+TEST(LoggingBase, Metrics) {
+  LoggingBaseStandIn log;
+  auto standIn = std::make_shared<BaseLogHandlerStandIn>();
+  log.addLogHandler(standIn);
+  log.setMinSeverity(Severity::Error);
+  for (int i = 0; i < 10; ++i) {
+    log.log(Severity::Error, "Some message");
+  }
+  log.log(Severity::Debug, "Discarded by the severity level gate");
+  log.flush(10s);
+  auto Metrics = log.getMetrics();
+  EXPECT_EQ(Metrics.Enqueued, 10u);
+  EXPECT_EQ(Metrics.Dequeued, 10u);
+  EXPECT_EQ(Metrics.Dropped, 0u);
+  EXPECT_GE(Metrics.QueueHighWaterMark, 1u);
+  EXPECT_EQ(std::accumulate(Metrics.Latency.begin(), Metrics.Latency.end(),
+                            std::uint64_t(0)),
+            10u);
+  EXPECT_EQ(standIn->getMetrics().Enqueued, 0u);
+}
+
+TEST(LoggingBase, QueueLimits) {
+  LoggingBaseStandIn log;
+  auto standIn = std::make_shared<BaseLogHandlerStandIn>();
+  log.addLogHandler(standIn);
+  log.flush(10s);
+  log.setQueueLimits(0, 5);
+  std::promise<void> Release;
+  auto ReleaseFuture = Release.get_future().share();
+  log.Executor.SendWork([ReleaseFuture]() { ReleaseFuture.wait(); });
+  for (int i = 0; i < 8; ++i) {
+    log.log(Severity::Error, "Message " + std::to_string(i));
+  }
+  Release.set_value();
+  log.flush(10s);
+  EXPECT_EQ(standIn->NrOfMessages, 5);
+  EXPECT_EQ(standIn->CurrentMessage.MessageString, "Message 4");
+  EXPECT_EQ(log.getMetrics().Dropped, 3u);
+}
+
+TEST(LoggingBase, QueueByteLimit) {
+  LoggingBaseStandIn log;
+  auto standIn = std::make_shared<BaseLogHandlerStandIn>();
+  log.addLogHandler(standIn);
+  log.flush(10s);
+  std::string LargeMessage(1000, 'a');
+  log.setQueueLimits(2 * (sizeof(LogMessage) + LargeMessage.size()), 0);
+  std::promise<void> Release;
+  auto ReleaseFuture = Release.get_future().share();
+  log.Executor.SendWork([ReleaseFuture]() { ReleaseFuture.wait(); });
+  for (int i = 0; i < 4; ++i) {
+    log.log(Severity::Error, LargeMessage);
+  }
+  Release.set_value();
+  log.flush(10s);
+  EXPECT_EQ(standIn->NrOfMessages, 2);
+  EXPECT_EQ(log.getMetrics().Dropped, 2u);
+}
+
 #ifdef WITH_FMT
 
 TEST(LoggingBase, FmtLogMessage) {
@@ -0,0 +1,123 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Tests of the process wide memory budget.
+///
+//===----------------------------------------------------------------------===//
+
+#include "graylog_logger/MemoryBudget.hpp"
+#include "graylog_logger/GraylogInterface.hpp"
+#include "graylog_logger/LoggingBase.hpp"
+#include "graylog_logger/QueueBudget.hpp"
+#include <algorithm>
+#include <asio.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+using namespace Log;
+
+TEST(MemoryBudget, UnlimitedByDefault) {
+  MemoryBudget UnderTest;
+  EXPECT_TRUE(UnderTest.tryAcquire(1000000000, Severity::Debug));
+  EXPECT_TRUE(UnderTest.accepts(Severity::Debug));
+  EXPECT_EQ(UnderTest.bytes(), 1000000000u);
+}
+
+TEST(MemoryBudget, LowSeverityIsShedFirst) {
+  MemoryBudget UnderTest(1600);
+  // Debug messages are accepted up to 9/16 of the limit.
+  EXPECT_TRUE(UnderTest.tryAcquire(900, Severity::Debug));
+  EXPECT_FALSE(UnderTest.accepts(Severity::Debug));
+  EXPECT_FALSE(UnderTest.tryAcquire(1, Severity::Debug));
+  EXPECT_TRUE(UnderTest.accepts(Severity::Info));
+  EXPECT_TRUE(UnderTest.tryAcquire(100, Severity::Info));
+  EXPECT_FALSE(UnderTest.tryAcquire(1, Severity::Info));
+  EXPECT_TRUE(UnderTest.tryAcquire(600, Severity::Emergency));
+  EXPECT_FALSE(UnderTest.tryAcquire(1, Severity::Emergency));
+  EXPECT_EQ(UnderTest.bytes(), 1600u);
+  UnderTest.release(1600);
+  EXPECT_TRUE(UnderTest.accepts(Severity::Debug));
+}
+
+TEST(MemoryBudget, QueuesShareTheBudget) {
+  MemoryBudget Shared(1000);
+  QueueBudget First(0, 0, Shared);
+  {
+    QueueBudget Second(0, 0, Shared);
+    EXPECT_TRUE(First.tryAcquire(600));
+    EXPECT_FALSE(Second.tryAcquire(600));
+    EXPECT_EQ(Second.messages(), 0u);
+    EXPECT_TRUE(Second.tryAcquire(400));
+    EXPECT_EQ(Shared.bytes(), 1000u);
+  }
+  // The bytes still held by a destroyed queue are returned.
+  EXPECT_EQ(Shared.bytes(), 600u);
+  First.release(600);
+  EXPECT_EQ(Shared.bytes(), 0u);
+}
+
+TEST(MemoryBudget, QueueLimitIsCheckedFirst) {
+  MemoryBudget Shared(1000);
+  QueueBudget UnderTest(100, 0, Shared);
+  EXPECT_TRUE(UnderTest.tryAcquire(100));
+  EXPECT_FALSE(UnderTest.tryAcquire(100));
+  EXPECT_FALSE(UnderTest.hasRoomFor(100));
+  EXPECT_EQ(Shared.bytes(), 100u);
+}
+
+#ifdef __linux__
+namespace {
+size_t residentBytes() {
+  std::ifstream StatM("/proc/self/statm");
+  size_t TotalPages{0};
+  size_t ResidentPages{0};
+  StatM >> TotalPages >> ResidentPages;
+  return ResidentPages * size_t(sysconf(_SC_PAGESIZE));
+}
+} // namespace
+
+TEST(MemoryBudget, StalledServerStaysWithinBudget) {
+  const size_t Budget{16 * 1024 * 1024};
+  // Connections to this port are accepted (by the kernel) but nothing is
+  // ever read from them.
+  asio::io_service Service;
+  asio::ip::tcp::acceptor Acceptor(
+      Service,
+      asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 2553));
+  auto StartResident = residentBytes();
+  MemoryBudget::global().setLimit(Budget);
+  {
+    LoggingBase Logger;
+    Logger.setMinSeverity(Severity::Info);
+    Logger.setQueueLimits(0, 0);
+    GraylogSettings Settings;
+    Settings.MaxQueueBytes = 0;
+    Settings.MaxQueueLength = 0;
+    Settings.WriteTimeout = std::chrono::milliseconds(0);
+    auto Handler =
+        std::make_shared<GraylogInterface>("localhost", 2553, Settings);
+    Logger.addLogHandler(Handler);
+    // 100 MB of messages, far more than the budget.
+    std::string Message(1024, 'a');
+    size_t MaxUsed{0};
+    for (int i = 0; i < 100000; ++i) {
+      Logger.log(Severity::Info, Message);
+      MaxUsed = std::max(MaxUsed, MemoryBudget::global().bytes());
+    }
+    Logger.flush(std::chrono::milliseconds(100));
+    MaxUsed = std::max(MaxUsed, MemoryBudget::global().bytes());
+    EXPECT_LE(MaxUsed, Budget);
+    auto Metrics = Handler->getMetrics();
+    EXPECT_GT(Metrics.Dropped + Logger.getMetrics().Dropped, 0u);
+    // Allow for the messages that have been taken from the queues and for
+    // memory that the allocator has not returned to the operating system.
+    EXPECT_LT(residentBytes(), StartResident + Budget + 32 * 1024 * 1024);
+    Logger.removeAllHandlers();
+  }
+  MemoryBudget::global().setLimit(0);
+  EXPECT_EQ(MemoryBudget::global().bytes(), 0u);
+}
+#endif
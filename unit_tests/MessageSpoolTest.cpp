@@ -0,0 +1,154 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Tests of the disk-backed message store.
+///
+//===----------------------------------------------------------------------===//
+
+#include "MessageSpool.hpp"
+#include <gtest/gtest.h>
+
+#ifndef _WIN32
+
+#include <cstdlib>
+#include <deque>
+#include <dirent.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace Log;
+
+class MessageSpoolTest : public ::testing::Test {
+public:
+  void SetUp() override {
+    char Template[] = "/tmp/graylog-spool-test-XXXXXX";
+    ASSERT_NE(::mkdtemp(Template), nullptr);
+    Directory = Template;
+  }
+  void TearDown() override {
+    for (auto &File : segmentFiles()) {
+      ::unlink((Directory + "/" + File).c_str());
+    }
+    ::rmdir(Directory.c_str());
+  }
+  std::vector<std::string> segmentFiles() const {
+    std::vector<std::string> Files;
+    auto DirectoryHandle = ::opendir(Directory.c_str());
+    while (auto Entry = ::readdir(DirectoryHandle)) {
+      std::string Name(Entry->d_name);
+      if (Name != "." and Name != "..") {
+        Files.push_back(Name);
+      }
+    }
+    ::closedir(DirectoryHandle);
+    return Files;
+  }
+  static std::string message(int Number) {
+    return "Message number " + std::to_string(Number);
+  }
+  std::string Directory;
+  MetricsRecorder Metrics;
+};
+
+TEST_F(MessageSpoolTest, EmptySpoolIsNotActive) {
+  MessageSpool UnderTest(Directory, 1024, 4096, Metrics);
+  EXPECT_FALSE(UnderTest.active());
+  EXPECT_EQ(UnderTest.size(), 0u);
+  std::deque<std::string> Output;
+  EXPECT_EQ(UnderTest.read(Output, 1024), 0u);
+  EXPECT_TRUE(Output.empty());
+}
+
+TEST_F(MessageSpoolTest, MessagesAreReadInOrder) {
+  MessageSpool UnderTest(Directory, 1024, 65536, Metrics);
+  for (int i = 0; i < 200; ++i) {
+    ASSERT_TRUE(UnderTest.append(message(i)));
+  }
+  EXPECT_TRUE(UnderTest.active());
+  EXPECT_EQ(UnderTest.size(), 200u);
+  // The messages do not fit in a single segment.
+  EXPECT_GT(segmentFiles().size(), 1u);
+  std::deque<std::string> Output;
+  while (UnderTest.read(Output, 100) > 0) {
+  }
+  ASSERT_EQ(Output.size(), 200u);
+  for (int i = 0; i < 200; ++i) {
+    EXPECT_EQ(Output[i], message(i));
+  }
+  EXPECT_FALSE(UnderTest.active());
+  EXPECT_EQ(UnderTest.size(), 0u);
+  EXPECT_TRUE(segmentFiles().empty());
+}
+
+TEST_F(MessageSpoolTest, LargeMessageGetsSegmentOfItsOwn) {
+  MessageSpool UnderTest(Directory, 64, 4096, Metrics);
+  std::string LargeMessage(1000, 'a');
+  ASSERT_TRUE(UnderTest.append(message(0)));
+  ASSERT_TRUE(UnderTest.append(LargeMessage));
+  ASSERT_TRUE(UnderTest.append(message(1)));
+  std::deque<std::string> Output;
+  EXPECT_EQ(UnderTest.read(Output, 8192), 3u);
+  ASSERT_EQ(Output.size(), 3u);
+  EXPECT_EQ(Output[1], LargeMessage);
+  EXPECT_EQ(Output[2], message(1));
+}
+
+TEST_F(MessageSpoolTest, OldestSegmentIsEvictedWhenOverBudget) {
+  MessageSpool UnderTest(Directory, 256, 1024, Metrics);
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(UnderTest.append(message(i)));
+  }
+  EXPECT_LE(segmentFiles().size(), 4u);
+  auto Snapshot = Metrics.snapshot();
+  auto Evicted = Snapshot.Discarded;
+  EXPECT_GT(Evicted, 0u);
+  EXPECT_EQ(Snapshot.Dequeued, Evicted);
+  EXPECT_EQ(Snapshot.Dropped, 0u);
+  EXPECT_EQ(UnderTest.size() + Evicted, 100u);
+  std::deque<std::string> Output;
+  while (UnderTest.read(Output, 1024) > 0) {
+  }
+  ASSERT_EQ(Output.size(), 100u - Evicted);
+  // The newest messages are kept.
+  EXPECT_EQ(Output.front(), message(int(Evicted)));
+  EXPECT_EQ(Output.back(), message(99));
+}
+
+TEST_F(MessageSpoolTest, MessageLargerThanBudgetIsRejected) {
+  MessageSpool UnderTest(Directory, 64, 1024, Metrics);
+  EXPECT_FALSE(UnderTest.append(std::string(2000, 'a')));
+  EXPECT_FALSE(UnderTest.active());
+}
+
+TEST_F(MessageSpoolTest, UnreadMessagesAreRecovered) {
+  {
+    MessageSpool UnderTest(Directory, 256, 65536, Metrics);
+    for (int i = 0; i < 50; ++i) {
+      ASSERT_TRUE(UnderTest.append(message(i)));
+    }
+    std::deque<std::string> Output;
+    UnderTest.read(Output, 100);
+    ASSERT_GT(Output.size(), 0u);
+    ASSERT_LT(Output.size(), 50u);
+  }
+  MessageSpool UnderTest(Directory, 256, 65536, Metrics);
+  EXPECT_TRUE(UnderTest.active());
+  auto NrOfRemaining = UnderTest.size();
+  ASSERT_GT(NrOfRemaining, 0u);
+  EXPECT_EQ(Metrics.snapshot().Enqueued, NrOfRemaining);
+  ASSERT_TRUE(UnderTest.append(message(50)));
+  std::deque<std::string> Output;
+  while (UnderTest.read(Output, 1024) > 0) {
+  }
+  ASSERT_EQ(Output.size(), NrOfRemaining + 1);
+  auto FirstRemaining = 51 - int(Output.size());
+  for (size_t i = 0; i < Output.size(); ++i) {
+    EXPECT_EQ(Output[i], message(FirstRemaining + int(i)));
+  }
+  EXPECT_TRUE(segmentFiles().empty());
+}
+
+#endif
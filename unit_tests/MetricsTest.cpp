@@ -0,0 +1,109 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Tests of the logging pipeline counters.
+///
+//===----------------------------------------------------------------------===//
+
+#include "graylog_logger/Metrics.hpp"
+#include <gtest/gtest.h>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using namespace Log;
+using namespace std::chrono_literals;
+
+TEST(Metrics, InitialSnapshotIsZero) {
+  MetricsRecorder Recorder;
+  auto Snapshot = Recorder.snapshot();
+  EXPECT_EQ(Snapshot.Enqueued, 0u);
+  EXPECT_EQ(Snapshot.Dequeued, 0u);
+  EXPECT_EQ(Snapshot.Dropped, 0u);
+  EXPECT_EQ(Snapshot.Discarded, 0u);
+  EXPECT_EQ(Snapshot.QueueHighWaterMark, 0u);
+  EXPECT_EQ(Snapshot.BytesWritten, 0u);
+  EXPECT_EQ(Snapshot.Reconnects, 0u);
+  EXPECT_EQ(
+      std::accumulate(Snapshot.Latency.begin(), Snapshot.Latency.end(), 0u),
+      0u);
+}
+
+TEST(Metrics, StripedCounterSumsAllThreads) {
+  StripedCounter Counter;
+  std::vector<std::thread> Threads;
+  const int NrOfThreads{20};
+  const int NrOfAdditions{10000};
+  for (int i = 0; i < NrOfThreads; ++i) {
+    Threads.emplace_back([&Counter]() {
+      for (int j = 0; j < NrOfAdditions; ++j) {
+        Counter.add(1);
+      }
+    });
+  }
+  for (auto &CThread : Threads) {
+    CThread.join();
+  }
+  EXPECT_EQ(Counter.load(), std::uint64_t(NrOfThreads * NrOfAdditions));
+}
+
+TEST(Metrics, Counters) {
+  MetricsRecorder Recorder;
+  Recorder.enqueued(5);
+  Recorder.enqueued();
+  Recorder.dequeued(2);
+  Recorder.dropped(3);
+  Recorder.discarded(1);
+  Recorder.bytesWritten(100);
+  Recorder.bytesWritten(23);
+  Recorder.reconnected();
+  auto Snapshot = Recorder.snapshot();
+  EXPECT_EQ(Snapshot.Enqueued, 6u);
+  EXPECT_EQ(Snapshot.Dequeued, 2u);
+  EXPECT_EQ(Snapshot.Dropped, 3u);
+  EXPECT_EQ(Snapshot.Discarded, 1u);
+  EXPECT_EQ(Snapshot.BytesWritten, 123u);
+  EXPECT_EQ(Snapshot.Reconnects, 1u);
+}
+
+TEST(Metrics, QueueHighWaterMark) {
+  MetricsRecorder Recorder;
+  Recorder.queueDepth(10);
+  Recorder.queueDepth(5);
+  EXPECT_EQ(Recorder.snapshot().QueueHighWaterMark, 10u);
+  Recorder.enqueued(20);
+  Recorder.dequeued(5);
+  Recorder.updateQueueDepth(1);
+  EXPECT_EQ(Recorder.snapshot().QueueHighWaterMark, 16u);
+}
+
+TEST(Metrics, LatencyHistogramBuckets) {
+  MetricsRecorder Recorder;
+  Recorder.latency(500ns);
+  Recorder.latency(-5ms);
+  Recorder.latency(1us);
+  Recorder.latency(3us);
+  Recorder.latency(1000us);
+  Recorder.latency(24h);
+  auto Snapshot = Recorder.snapshot();
+  EXPECT_EQ(Snapshot.Latency[0], 2u);
+  EXPECT_EQ(Snapshot.Latency[1], 1u);
+  EXPECT_EQ(Snapshot.Latency[2], 1u);
+  EXPECT_EQ(Snapshot.Latency[10], 1u);
+  EXPECT_EQ(Snapshot.Latency.back(), 1u);
+  EXPECT_EQ(MetricsSnapshot::latencyBucketLimit(10), 1024us);
+}
+
+TEST(Metrics, LatencySinceCreation) {
+  MetricsRecorder Recorder;
+  auto Now = std::chrono::steady_clock::now();
+  Recorder.latencySince(Now - 3us, Now);
+  Recorder.latencySince(std::chrono::steady_clock::time_point(), Now);
+  auto Snapshot = Recorder.snapshot();
+  EXPECT_EQ(Snapshot.Latency[2], 1u);
+  EXPECT_EQ(
+      std::accumulate(Snapshot.Latency.begin(), Snapshot.Latency.end(), 0u),
+      1u);
+}
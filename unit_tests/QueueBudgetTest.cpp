@@ -0,0 +1,67 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Tests of the queue byte and message count limits.
+///
+//===----------------------------------------------------------------------===//
+
+#include "graylog_logger/QueueBudget.hpp"
+#include <gtest/gtest.h>
+
+using namespace Log;
+
+TEST(QueueBudget, ByteLimit) {
+  QueueBudget UnderTest(100, 0);
+  EXPECT_TRUE(UnderTest.tryAcquire(60));
+  EXPECT_TRUE(UnderTest.tryAcquire(40));
+  EXPECT_FALSE(UnderTest.tryAcquire(1));
+  EXPECT_EQ(UnderTest.bytes(), 100u);
+  EXPECT_EQ(UnderTest.messages(), 2u);
+  UnderTest.release(60);
+  EXPECT_TRUE(UnderTest.tryAcquire(50));
+  EXPECT_EQ(UnderTest.bytes(), 90u);
+}
+
+TEST(QueueBudget, MessageLimit) {
+  QueueBudget UnderTest(0, 2);
+  EXPECT_TRUE(UnderTest.tryAcquire(1000000));
+  EXPECT_TRUE(UnderTest.tryAcquire(1000000));
+  EXPECT_FALSE(UnderTest.tryAcquire(1));
+  EXPECT_FALSE(UnderTest.tryAcquire(0, 1));
+  UnderTest.release(1000000);
+  EXPECT_TRUE(UnderTest.tryAcquire(1));
+  EXPECT_FALSE(UnderTest.tryAcquire(10, 2));
+  EXPECT_EQ(UnderTest.messages(), 2u);
+}
+
+TEST(QueueBudget, LargeMessageFitsInEmptyQueue) {
+  QueueBudget UnderTest(100, 0);
+  EXPECT_TRUE(UnderTest.tryAcquire(1000));
+  EXPECT_FALSE(UnderTest.tryAcquire(1));
+  UnderTest.release(1000);
+  EXPECT_EQ(UnderTest.bytes(), 0u);
+}
+
+TEST(QueueBudget, AcquireIgnoresLimits) {
+  QueueBudget UnderTest(100, 1);
+  UnderTest.acquire(200, 2);
+  EXPECT_EQ(UnderTest.bytes(), 200u);
+  EXPECT_EQ(UnderTest.messages(), 2u);
+  EXPECT_FALSE(UnderTest.tryAcquire(1));
+}
+
+TEST(QueueBudget, SetLimits) {
+  QueueBudget UnderTest(10, 0);
+  EXPECT_TRUE(UnderTest.tryAcquire(10));
+  EXPECT_FALSE(UnderTest.tryAcquire(10));
+  UnderTest.setLimits(0, 0);
+  EXPECT_TRUE(UnderTest.tryAcquire(10));
+}
+
+TEST(QueueBudget, InitialCapacity) {
+  EXPECT_EQ(QueueBudget(0, 10).initialCapacity(), 10u);
+  EXPECT_GT(QueueBudget(0, 0).initialCapacity(), 0u);
+  EXPECT_LT(QueueBudget(0, 1000000).initialCapacity(), 1000000u);
+}
@@ -0,0 +1,78 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Tests of the connection status tracker.
+///
+//===----------------------------------------------------------------------===//
+
+#include "StatusTracker.hpp"
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace Log;
+using namespace std::chrono_literals;
+
+TEST(StatusTracker, InitialStatus) {
+  StatusTracker UnderTest(Status::CONNECT);
+  EXPECT_EQ(UnderTest.get(), Status::CONNECT);
+}
+
+TEST(StatusTracker, CallbacksAreCalledOnChanges) {
+  StatusTracker UnderTest;
+  std::vector<StatusChange> Changes;
+  UnderTest.addCallback(
+      [&Changes](auto &Change) { Changes.push_back(Change); });
+  auto Before = std::chrono::system_clock::now();
+  UnderTest.set(Status::CONNECT);
+  UnderTest.set(Status::CONNECT);
+  UnderTest.set(Status::ADDR_RETRY_WAIT,
+                std::make_error_code(std::errc::connection_refused));
+  ASSERT_EQ(Changes.size(), 2u);
+  EXPECT_EQ(Changes[0].Previous, Status::ADDR_LOOKUP);
+  EXPECT_EQ(Changes[0].Current, Status::CONNECT);
+  EXPECT_GE(Changes[0].Time, Before);
+  EXPECT_FALSE(Changes[0].Error);
+  EXPECT_EQ(Changes[1].Previous, Status::CONNECT);
+  EXPECT_EQ(Changes[1].Current, Status::ADDR_RETRY_WAIT);
+  EXPECT_EQ(Changes[1].Error, std::errc::connection_refused);
+  EXPECT_EQ(UnderTest.get(), Status::ADDR_RETRY_WAIT);
+}
+
+TEST(StatusTracker, RemovedCallbacksAreNotCalled) {
+  StatusTracker UnderTest;
+  int NrOfCalls{0};
+  auto Id = UnderTest.addCallback([&NrOfCalls](auto &) { ++NrOfCalls; });
+  UnderTest.set(Status::CONNECT);
+  UnderTest.removeCallback(Id);
+  UnderTest.set(Status::SEND_LOOP);
+  EXPECT_EQ(NrOfCalls, 1);
+}
+
+TEST(StatusTracker, CallbackCanRemoveOtherCallbacks) {
+  StatusTracker UnderTest;
+  size_t SecondId{0};
+  int NrOfCalls{0};
+  UnderTest.addCallback([&](auto &) {
+    ++NrOfCalls;
+    UnderTest.removeCallback(SecondId);
+  });
+  SecondId = UnderTest.addCallback([&NrOfCalls](auto &) { ++NrOfCalls; });
+  UnderTest.set(Status::CONNECT);
+  UnderTest.set(Status::SEND_LOOP);
+  EXPECT_EQ(NrOfCalls, 2);
+}
+
+TEST(StatusTracker, TimeInStatus) {
+  StatusTracker UnderTest;
+  std::this_thread::sleep_for(20ms);
+  UnderTest.set(Status::SEND_LOOP);
+  auto Durations = UnderTest.timeInStatus();
+  EXPECT_GE(Durations[static_cast<size_t>(Status::ADDR_LOOKUP)], 20ms);
+  EXPECT_EQ(Durations[static_cast<size_t>(Status::CONNECT)].count(), 0);
+  std::this_thread::sleep_for(20ms);
+  // Includes the time spent in the current status so far.
+  EXPECT_GE(UnderTest.timeInStatus()[static_cast<size_t>(Status::SEND_LOOP)],
+            20ms);
+}
@@ -0,0 +1,142 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Tests of the threaded executor and the shared worker pool.
+///
+//===----------------------------------------------------------------------===//
+
+#include "BaseLogHandlerStandIn.hpp"
+#include "Semaphore.hpp"
+#include "graylog_logger/ConsoleInterface.hpp"
+#include "graylog_logger/LoggingBase.hpp"
+#include "graylog_logger/ThreadedExecutor.hpp"
+#include <algorithm>
+#include <ciso646>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <set>
+
+using namespace Log;
+using namespace std::chrono_literals;
+
+TEST(ThreadedExecutor, WorkIsDoneInOrder) {
+  std::vector<int> Results;
+  {
+    ThreadedExecutor Executor;
+    for (int i = 0; i < 1000; ++i) {
+      Executor.SendWork([&Results, i]() { Results.push_back(i); });
+    }
+  }
+  ASSERT_EQ(Results.size(), 1000u);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(Results[i], i);
+  }
+}
+
+TEST(ThreadedExecutor, WorkIsNotDoneInCallingThread) {
+  ThreadedExecutor Executor;
+  std::promise<std::thread::id> WorkerId;
+  Executor.SendWork(
+      [&WorkerId]() { WorkerId.set_value(std::this_thread::get_id()); });
+  EXPECT_NE(WorkerId.get_future().get(), std::this_thread::get_id());
+}
+
+TEST(WorkerPool, AtLeastOneThread) {
+  WorkerPool Pool(0);
+  EXPECT_EQ(Pool.size(), 1u);
+}
+
+TEST(WorkerPool, ExecutorsShareThreads) {
+  auto Pool = std::make_shared<WorkerPool>(2);
+  std::mutex ThreadIdsMutex;
+  std::set<std::thread::id> ThreadIds;
+  {
+    std::vector<std::unique_ptr<ThreadedExecutor>> Executors;
+    for (int i = 0; i < 10; ++i) {
+      Executors.emplace_back(std::make_unique<ThreadedExecutor>(Pool));
+    }
+    Semaphore Done;
+    for (auto &CExecutor : Executors) {
+      for (int i = 0; i < 100; ++i) {
+        CExecutor->SendWork([&]() {
+          std::lock_guard<std::mutex> Lock(ThreadIdsMutex);
+          ThreadIds.insert(std::this_thread::get_id());
+        });
+      }
+      CExecutor->SendWork([&Done]() { Done.notify(); });
+    }
+    for (size_t i = 0; i < Executors.size(); ++i) {
+      Done.wait();
+    }
+  }
+  EXPECT_GE(ThreadIds.size(), 1u);
+  EXPECT_LE(ThreadIds.size(), 2u);
+}
+
+TEST(WorkerPool, WorkOfOneExecutorIsSerial) {
+  auto Pool = std::make_shared<WorkerPool>(4);
+  std::atomic_int Running{0};
+  std::atomic_int MaxRunning{0};
+  std::vector<int> Results;
+  {
+    ThreadedExecutor Executor(Pool);
+    for (int i = 0; i < 500; ++i) {
+      Executor.SendWork([&, i]() {
+        auto Now = ++Running;
+        if (Now > MaxRunning) {
+          MaxRunning = Now;
+        }
+        Results.push_back(i);
+        --Running;
+      });
+    }
+  }
+  EXPECT_EQ(MaxRunning, 1);
+  ASSERT_EQ(Results.size(), 500u);
+  for (int i = 0; i < 500; ++i) {
+    EXPECT_EQ(Results[i], i);
+  }
+}
+
+TEST(WorkerPool, DefaultPool) {
+  auto Pool = std::make_shared<WorkerPool>(1);
+  WorkerPool::setDefault(Pool);
+  EXPECT_EQ(WorkerPool::getDefault(), Pool);
+  {
+    ThreadedExecutor First;
+    ThreadedExecutor Second;
+    std::promise<std::thread::id> FirstId;
+    std::promise<std::thread::id> SecondId;
+    First.SendWork(
+        [&FirstId]() { FirstId.set_value(std::this_thread::get_id()); });
+    Second.SendWork(
+        [&SecondId]() { SecondId.set_value(std::this_thread::get_id()); });
+    EXPECT_EQ(FirstId.get_future().get(), SecondId.get_future().get());
+  }
+  WorkerPool::setDefault(nullptr);
+  EXPECT_EQ(WorkerPool::getDefault(), nullptr);
+}
+
+TEST(WorkerPool, LoggerAndHandlersOnSingleThread) {
+  auto Pool = std::make_shared<WorkerPool>(1);
+  AsyncSinkSettings Settings;
+  Settings.Pool = Pool;
+  auto Console = std::make_shared<ConsoleInterface>(Settings);
+  auto StandIn = std::make_shared<BaseLogHandlerStandIn>();
+  testing::internal::CaptureStdout();
+  {
+    LoggingBase Logger(Pool);
+    Logger.addLogHandler(Console);
+    Logger.addLogHandler(StandIn);
+    for (int i = 0; i < 100; ++i) {
+      Logger.log(Severity::Error, "Some message");
+    }
+    EXPECT_TRUE(Logger.flush(10s));
+    EXPECT_EQ(StandIn->NrOfMessages, 100);
+  }
+  Console.reset();
+  auto Output = testing::internal::GetCapturedStdout();
+  EXPECT_EQ(std::count(Output.begin(), Output.end(), '\n'), 100);
+}
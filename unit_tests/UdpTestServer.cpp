@@ -0,0 +1,86 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief A UDP server that receives (chunked) GELF datagrams.
+///
+//===----------------------------------------------------------------------===//
+
+#include "UdpTestServer.hpp"
+#include <ciso646>
+
+UdpTestServer::UdpTestServer(std::uint16_t Port)
+    : Socket(Service,
+             asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), Port)) {
+  asio::socket_base::receive_buffer_size BufferSize(8 * 1024 * 1024);
+  asio::error_code IgnoredError;
+  Socket.set_option(BufferSize, IgnoredError);
+  receiveDatagram();
+  ServerThread = std::thread([this]() { Service.run(); });
+}
+
+UdpTestServer::~UdpTestServer() {
+  Service.post([this]() { Socket.close(); });
+  ServerThread.join();
+}
+
+void UdpTestServer::receiveDatagram() {
+  Socket.async_receive(asio::buffer(ReceiveBuffer),
+                       [this](auto &Error, auto Size) {
+                         if (Error) {
+                           return;
+                         }
+                         handleDatagram(std::string(ReceiveBuffer.data(), Size));
+                         receiveDatagram();
+                       });
+}
+
+void UdpTestServer::handleDatagram(const std::string &Datagram) {
+  std::lock_guard<std::mutex> Lock(DataMutex);
+  Datagrams.push_back(Datagram);
+  const size_t HeaderSize{12};
+  if (Datagram.size() < HeaderSize or Datagram[0] != '\x1e' or
+      Datagram[1] != '\x0f') {
+    Messages.push_back(Datagram);
+    return;
+  }
+  auto MessageId = Datagram.substr(2, 8);
+  auto SequenceNumber = static_cast<std::uint8_t>(Datagram[10]);
+  auto SequenceCount = static_cast<std::uint8_t>(Datagram[11]);
+  auto &Chunks = PartialMessages[MessageId];
+  Chunks[SequenceNumber] = Datagram.substr(HeaderSize);
+  if (Chunks.size() == SequenceCount) {
+    std::string Message;
+    for (auto &CChunk : Chunks) {
+      Message += CChunk.second;
+    }
+    Messages.push_back(Message);
+    PartialMessages.erase(MessageId);
+  }
+}
+
+std::vector<std::string> UdpTestServer::getDatagrams() {
+  std::lock_guard<std::mutex> Lock(DataMutex);
+  return Datagrams;
+}
+
+std::vector<std::string> UdpTestServer::getMessages() {
+  std::lock_guard<std::mutex> Lock(DataMutex);
+  return Messages;
+}
+
+bool UdpTestServer::waitForMessages(size_t NrOfMessages,
+                                    std::chrono::milliseconds TimeOut) {
+  auto End = std::chrono::steady_clock::now() + TimeOut;
+  while (std::chrono::steady_clock::now() < End) {
+    {
+      std::lock_guard<std::mutex> Lock(DataMutex);
+      if (Messages.size() >= NrOfMessages) {
+        return true;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return false;
+}
@@ -0,0 +1,48 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief A UDP server that receives (chunked) GELF datagrams.
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <array>
+#include <asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class UdpTestServer {
+public:
+  explicit UdpTestServer(std::uint16_t Port);
+  ~UdpTestServer();
+  /// \brief All received datagrams, including GELF chunk headers.
+  std::vector<std::string> getDatagrams();
+  /// \brief Received messages, re-assembled from chunks where required.
+  std::vector<std::string> getMessages();
+  /// \brief Wait until at least the given number of messages have been
+  /// received.
+  /// \return true if the messages were received before the time out.
+  bool waitForMessages(size_t NrOfMessages,
+                       std::chrono::milliseconds TimeOut =
+                           std::chrono::milliseconds(2000));
+
+private:
+  void receiveDatagram();
+  void handleDatagram(const std::string &Datagram);
+  asio::io_service Service;
+  asio::ip::udp::socket Socket;
+  std::array<char, 65536> ReceiveBuffer{};
+  std::mutex DataMutex;
+  std::vector<std::string> Datagrams;
+  std::vector<std::string> Messages;
+  std::map<std::string, std::map<int, std::string>> PartialMessages;
+  std::thread ServerThread;
+};
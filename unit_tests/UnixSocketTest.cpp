@@ -0,0 +1,316 @@
+/* Copyright (C) 2020 European Spallation Source, ERIC. See LICENSE file */
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+/// \brief Tests of sending messages to a local agent over Unix domain
+/// sockets.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef _WIN32
+
+#include "graylog_logger/GraylogInterface.hpp"
+#include "graylog_logger/GraylogUdpInterface.hpp"
+#include <array>
+#include <asio.hpp>
+#include <ciso646>
+#include <functional>
+#include <gtest/gtest.h>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+using namespace Log;
+using namespace std::chrono_literals;
+
+namespace {
+
+bool waitUntil(const std::function<bool()> &Condition,
+               std::chrono::milliseconds TimeOut = 5000ms) {
+  auto End = std::chrono::steady_clock::now() + TimeOut;
+  while (not Condition()) {
+    if (std::chrono::steady_clock::now() > End) {
+      return false;
+    }
+    std::this_thread::sleep_for(10ms);
+  }
+  return true;
+}
+
+/// \brief Accepts connections on a Unix domain stream socket and collects
+/// the received bytes.
+class UnixStreamServer {
+public:
+  explicit UnixStreamServer(const std::string &Path) : Acceptor(Service) {
+    ::unlink(Path.c_str());
+    asio::local::stream_protocol::endpoint Endpoint(Path);
+    Acceptor.open(Endpoint.protocol());
+    Acceptor.bind(Endpoint);
+    Acceptor.listen();
+    acceptConnection();
+    ServerThread = std::thread([this]() { Service.run(); });
+  }
+  ~UnixStreamServer() {
+    Service.post([this]() {
+      asio::error_code Error;
+      Acceptor.close(Error);
+      for (auto &CConnection : Connections) {
+        CConnection->Socket.close(Error);
+      }
+    });
+    ServerThread.join();
+  }
+  std::string getData() {
+    std::lock_guard<std::mutex> Lock(DataMutex);
+    return Data;
+  }
+  size_t getNrOfConnections() const { return NrOfConnections; }
+
+private:
+  struct Connection {
+    explicit Connection(asio::local::stream_protocol::socket &&Socket)
+        : Socket(std::move(Socket)) {}
+    asio::local::stream_protocol::socket Socket;
+    std::array<char, 4096> Buffer{};
+  };
+  void acceptConnection() {
+    Acceptor.async_accept([this](const asio::error_code &Error,
+                                 asio::local::stream_protocol::socket Socket) {
+      if (Error) {
+        return;
+      }
+      ++NrOfConnections;
+      Connections.push_back(std::make_unique<Connection>(std::move(Socket)));
+      receive(*Connections.back());
+      acceptConnection();
+    });
+  }
+  void receive(Connection &CConnection) {
+    CConnection.Socket.async_read_some(
+        asio::buffer(CConnection.Buffer),
+        [this, &CConnection](const asio::error_code &Error, size_t Size) {
+          if (Error) {
+            return;
+          }
+          {
+            std::lock_guard<std::mutex> Lock(DataMutex);
+            Data.append(CConnection.Buffer.data(), Size);
+          }
+          receive(CConnection);
+        });
+  }
+  asio::io_service Service;
+  asio::local::stream_protocol::acceptor Acceptor;
+  std::vector<std::unique_ptr<Connection>> Connections;
+  std::atomic<size_t> NrOfConnections{0};
+  std::mutex DataMutex;
+  std::string Data;
+  std::thread ServerThread;
+};
+
+/// \brief Receives datagrams on a Unix domain datagram socket.
+class UnixDatagramServer {
+public:
+  explicit UnixDatagramServer(const std::string &Path) : Socket(Service) {
+    ::unlink(Path.c_str());
+    asio::local::datagram_protocol::endpoint Endpoint(Path);
+    Socket.open(Endpoint.protocol());
+    Socket.bind(Endpoint);
+    receive();
+    ServerThread = std::thread([this]() { Service.run(); });
+  }
+  ~UnixDatagramServer() {
+    Service.post([this]() {
+      asio::error_code Error;
+      Socket.close(Error);
+    });
+    ServerThread.join();
+  }
+  std::vector<std::string> getDatagrams() {
+    std::lock_guard<std::mutex> Lock(DataMutex);
+    return Datagrams;
+  }
+
+private:
+  void receive() {
+    Socket.async_receive(
+        asio::buffer(Buffer),
+        [this](const asio::error_code &Error, size_t Size) {
+          if (Error) {
+            return;
+          }
+          {
+            std::lock_guard<std::mutex> Lock(DataMutex);
+            Datagrams.emplace_back(Buffer.data(), Size);
+          }
+          receive();
+        });
+  }
+  asio::io_service Service;
+  asio::local::datagram_protocol::socket Socket;
+  std::array<char, 65536> Buffer{};
+  std::mutex DataMutex;
+  std::vector<std::string> Datagrams;
+  std::thread ServerThread;
+};
+
+class UnixSocket : public ::testing::Test {
+public:
+  void SetUp() override {
+    char Template[] = "/tmp/graylog-unix-test-XXXXXX";
+    ASSERT_NE(::mkdtemp(Template), nullptr);
+    Directory = Template;
+    SocketPath = Directory + "/agent.sock";
+  }
+  void TearDown() override {
+    ::unlink(SocketPath.c_str());
+    ::rmdir(Directory.c_str());
+  }
+  std::string Directory;
+  std::string SocketPath;
+};
+
+} // namespace
+
+TEST_F(UnixSocket, StreamMessagesAreNullDelimited) {
+  UnixStreamServer Server(SocketPath);
+  GraylogSettings Settings;
+  Settings.UnixSocketPath = SocketPath;
+  GraylogConnection Connection("", 0, Settings);
+  Connection.sendMessage("first");
+  Connection.sendMessage("second");
+  ASSERT_TRUE(Connection.flush(5s));
+  const std::string Expected("first\0second\0", 13);
+  EXPECT_TRUE(waitUntil([&]() { return Server.getData() == Expected; }));
+  EXPECT_EQ(Connection.getConnectionStatus(), Status::SEND_LOOP);
+}
+
+TEST_F(UnixSocket, StreamMessagesAreNewlineDelimited) {
+  UnixStreamServer Server(SocketPath);
+  GraylogSettings Settings;
+  Settings.UnixSocketPath = SocketPath;
+  Settings.MessageDelimiter = '\n';
+  GraylogConnection Connection("", 0, Settings);
+  Connection.sendMessages({"{\"a\":1}", "{\"b\":2}"});
+  ASSERT_TRUE(Connection.flush(5s));
+  EXPECT_TRUE(waitUntil(
+      [&]() { return Server.getData() == "{\"a\":1}\n{\"b\":2}\n"; }));
+}
+
+TEST_F(UnixSocket, StreamReconnectsWhenAgentIsRestarted) {
+  GraylogSettings Settings;
+  Settings.UnixSocketPath = SocketPath;
+  Settings.ReconnectDelayMin = 10ms;
+  Settings.ReconnectDelayMax = 50ms;
+  auto Server = std::make_unique<UnixStreamServer>(SocketPath);
+  GraylogConnection Connection("", 0, Settings);
+  Connection.sendMessage("before");
+  ASSERT_TRUE(Connection.flush(5s));
+  ASSERT_TRUE(waitUntil(
+      [&]() { return Server->getData() == std::string("before\0", 7); }));
+  Server.reset();
+  Server = std::make_unique<UnixStreamServer>(SocketPath);
+  ASSERT_TRUE(waitUntil([&]() {
+    return Server->getNrOfConnections() == 1 and
+           Connection.getConnectionStatus() == Status::SEND_LOOP;
+  }));
+  Connection.sendMessage("after");
+  ASSERT_TRUE(Connection.flush(5s));
+  EXPECT_TRUE(waitUntil(
+      [&]() { return Server->getData() == std::string("after\0", 6); }));
+  EXPECT_GE(Connection.getMetrics().Reconnects, 1u);
+}
+
+TEST_F(UnixSocket, StreamMessagesAreSentOnceAgentIsUp) {
+  GraylogSettings Settings;
+  Settings.UnixSocketPath = SocketPath;
+  Settings.ReconnectDelayMin = 10ms;
+  Settings.ReconnectDelayMax = 50ms;
+  GraylogConnection Connection("", 0, Settings);
+  Connection.sendMessage("early");
+  EXPECT_FALSE(Connection.flush(100ms));
+  UnixStreamServer Server(SocketPath);
+  EXPECT_TRUE(Connection.flush(5s));
+  EXPECT_TRUE(waitUntil(
+      [&]() { return Server.getData() == std::string("early\0", 6); }));
+}
+
+TEST_F(UnixSocket, DatagramPerMessage) {
+  UnixDatagramServer Server(SocketPath);
+  GraylogUdpSettings Settings;
+  Settings.UnixSocketPath = SocketPath;
+  Settings.MaxDatagramSize = 65000;
+  GraylogUdpConnection Connection("", 0, Settings);
+  std::string LargeMessage(10000, 'a');
+  Connection.sendMessages({"first", LargeMessage});
+  ASSERT_TRUE(Connection.flush(5s));
+  EXPECT_TRUE(waitUntil([&]() { return Server.getDatagrams().size() == 2; }));
+  EXPECT_EQ(Server.getDatagrams(),
+            (std::vector<std::string>{"first", LargeMessage}));
+  EXPECT_EQ(Connection.getConnectionStatus(), Status::SEND_LOOP);
+}
+
+TEST_F(UnixSocket, DatagramReconnectsWhenAgentIsRestarted) {
+  GraylogUdpSettings Settings;
+  Settings.UnixSocketPath = SocketPath;
+  Settings.RetryDelay = 10ms;
+  auto Server = std::make_unique<UnixDatagramServer>(SocketPath);
+  GraylogUdpConnection Connection("", 0, Settings);
+  Connection.sendMessage("before");
+  ASSERT_TRUE(Connection.flush(5s));
+  ASSERT_TRUE(waitUntil([&]() { return Server->getDatagrams().size() == 1; }));
+  Server.reset();
+  Server = std::make_unique<UnixDatagramServer>(SocketPath);
+  // Messages sent before the socket has been re-connected are lost.
+  EXPECT_TRUE(waitUntil([&]() {
+    Connection.sendMessage("after");
+    Connection.flush(5s);
+    return not Server->getDatagrams().empty();
+  }));
+  EXPECT_EQ(Server->getDatagrams().front(), "after");
+}
+
+TEST_F(UnixSocket, DatagramsAreResentWhenAgentIsRestarted) {
+  GraylogUdpSettings Settings;
+  Settings.UnixSocketPath = SocketPath;
+  Settings.RetryDelay = 10s;
+  auto Server = std::make_unique<UnixDatagramServer>(SocketPath);
+  GraylogUdpConnection Connection("", 0, Settings);
+  Connection.sendMessage("before");
+  ASSERT_TRUE(Connection.flush(5s));
+  ASSERT_TRUE(waitUntil([&]() { return Server->getDatagrams().size() == 1; }));
+  Server.reset();
+  Server = std::make_unique<UnixDatagramServer>(SocketPath);
+  // The send to the old socket fails, the batch is sent again on a new one.
+  Connection.sendMessages({"first", "second", "third"});
+  ASSERT_TRUE(Connection.flush(5s));
+  EXPECT_TRUE(waitUntil([&]() { return Server->getDatagrams().size() == 3; }));
+  EXPECT_EQ(Server->getDatagrams(),
+            (std::vector<std::string>{"first", "second", "third"}));
+  auto Metrics = Connection.getMetrics();
+  EXPECT_EQ(Metrics.Discarded, 0u);
+  EXPECT_EQ(Metrics.Reconnects, 1u);
+  EXPECT_EQ(Connection.getConnectionStatus(), Status::SEND_LOOP);
+}
+
+TEST_F(UnixSocket, DatagramsAreDiscardedWhileAgentIsDown) {
+  GraylogUdpSettings Settings;
+  Settings.UnixSocketPath = SocketPath;
+  Settings.RetryDelay = 10s;
+  auto Server = std::make_unique<UnixDatagramServer>(SocketPath);
+  GraylogUdpConnection Connection("", 0, Settings);
+  Connection.sendMessage("before");
+  ASSERT_TRUE(Connection.flush(5s));
+  ASSERT_TRUE(waitUntil([&]() { return Server->getDatagrams().size() == 1; }));
+  Server.reset();
+  Connection.sendMessages({"first", "second"});
+  ASSERT_TRUE(Connection.flush(5s));
+  auto Metrics = Connection.getMetrics();
+  EXPECT_EQ(Metrics.Dequeued, 3u);
+  EXPECT_EQ(Metrics.Discarded, 2u);
+  EXPECT_EQ(Connection.getConnectionStatus(), Status::ADDR_RETRY_WAIT);
+}
+
+#endif